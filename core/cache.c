@@ -3,6 +3,117 @@
 extern struct uwsgi_server uwsgi;
 #define cache_item(x) (struct uwsgi_cache_item *) (((char *)uc->items) + ((sizeof(struct uwsgi_cache_item)+uc->keysize) * x))
 
+/*
+	lock striping
+
+	a cache can be split in multiple stripes (stripes=N in --cache2), each one with its own lock.
+
+	The stripe of a key is choosen by its hashtable slot, so every collision chain lives in a single stripe.
+	Each stripe manages its own range of items (and of blocks in bitmap mode) so allocations
+	do not need to touch shared state.
+
+	A non-striped cache is a cache with a single stripe, mapped to uc->lock
+*/
+#define cache_stripe_by_hash(hash) (&uc->stripe[(hash % uc->hashsize) % uc->stripes])
+
+/*
+	item 0 is never used (index 0 means "no item"): it records the stripes layout of the items
+	(valsize -> stripes, first_block -> hashsize, as the stripe of a key depends on its hashtable slot).
+	Stores created with a different layout are refused. Stores created before striping
+	have zeroes there (a single stripe).
+*/
+static void cache_layout_save(struct uwsgi_cache *uc) {
+	struct uwsgi_cache_item *layout = cache_item(0);
+	layout->valsize = uc->stripes;
+	layout->first_block = uc->hashsize;
+}
+
+static int cache_layout_check(struct uwsgi_cache *uc, uint64_t stripes, uint64_t hashsize) {
+	if (!stripes) stripes = 1;
+	if (stripes != uc->stripes) return -1;
+	// the hashsize does not matter for a single stripe
+	if (stripes > 1 && hashsize != uc->hashsize) return -1;
+	return 0;
+}
+
+static struct uwsgi_cache_stripe *cache_stripe_by_index(struct uwsgi_cache *uc, uint64_t index) {
+	uint64_t s = index / uc->stripe_items;
+	if (s >= uc->stripes) s = uc->stripes - 1;
+	return &uc->stripe[s];
+}
+
+// the sequence counter is odd while a writer is working on the stripe (used by optimistic readers)
+#define cache_stripe_write_begin(st) if (uc->stripes > 1) { st->seq++; __sync_synchronize(); }
+#define cache_stripe_write_end(st) if (uc->stripes > 1) { __sync_synchronize(); st->seq++; }
+
+/*
+	record an access for the eviction policy (lfu only needs the hits counter)
+
+	lru stamps are taken from a per-stripe clock (eviction only compares items of the same stripe),
+	so accesses to different stripes do not touch the same memory.
+	The stores are atomic as readers could be concurrent (approximate access data are fine).
+*/
+static inline void cache_item_touch(struct uwsgi_cache *uc, uint64_t index) {
+	struct uwsgi_cache_item *uci = cache_item(index);
+	if (uc->evict == UWSGI_CACHE_EVICT_LRU) {
+		struct uwsgi_cache_stripe *st = cache_stripe_by_index(uc, index);
+		__atomic_store_n(&uci->access, __sync_add_and_fetch(&st->access_clock, 1), __ATOMIC_RELAXED);
+	}
+	else if (uc->evict == UWSGI_CACHE_EVICT_CLOCK) {
+		if (!uci->access) {
+			__atomic_store_n(&uci->access, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/*
+	expiration wheel
+
+	items with an expiration are linked (in the shared expire_links array, indexed like the items)
+	in the slot expires % UWSGI_CACHE_EXPIRE_SLOTS of the wheel of their stripe.
+
+	The sweeper only walks the slots of the seconds elapsed since its last run, so immortal
+	and not-yet-expired items are never touched (items expiring after more than a whole
+	round of the wheel are simply skipped when their slot is checked).
+
+	Items already expired (or expiring in the current second) are linked in the slot of the next second
+	to check, so they cannot be lost in an already checked slot.
+*/
+
+static void cache_expire_link(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t index) {
+	if (!uc->expire_links) return;
+	struct uwsgi_cache_item *uci = cache_item(index);
+	if (!uci->expires) return;
+	struct uwsgi_cache_expire_link *link = &uc->expire_links[index];
+	uint64_t when = uci->expires > st->expire_next ? uci->expires : st->expire_next;
+	link->slot = when % UWSGI_CACHE_EXPIRE_SLOTS;
+	link->prev = 0;
+	link->next = st->expire_wheel[link->slot];
+	if (link->next) {
+		uc->expire_links[link->next].prev = index;
+	}
+	st->expire_wheel[link->slot] = index;
+}
+
+// must be called before changing the expiration of a linked item
+static void cache_expire_unlink(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t index) {
+	if (!uc->expire_links) return;
+	struct uwsgi_cache_item *uci = cache_item(index);
+	if (!uci->expires) return;
+	struct uwsgi_cache_expire_link *link = &uc->expire_links[index];
+	if (link->prev) {
+		uc->expire_links[link->prev].next = link->next;
+	}
+	else {
+		st->expire_wheel[link->slot] = link->next;
+	}
+	if (link->next) {
+		uc->expire_links[link->next].prev = link->prev;
+	}
+	link->prev = 0;
+	link->next = 0;
+}
+
 // block bitmap manager
 
 /* how the cache bitmap works:
@@ -14,6 +125,14 @@ extern struct uwsgi_server uwsgi;
 
 	Object can be placed only on consecutive blocks, fragmentation is not allowed.
 
+	The bitmap is managed as an array of 64bit words (block N is bit N%64 of word N/64),
+	so the scanner can skip a whole word of used or free blocks with a single
+	ctz (count trailing zeros) instead of testing every bit. Long free areas are
+	consumed 4 words (256 blocks) at a time: the OR of the 4 words is zero only
+	if all of them are free (compilers translate it to vector instructions where available).
+
+	The padding bits of the last word (blocks not existing in the cache) are always marked as used.
+
 	To increase the scan performance, a 64bit pointer to the last used bit + 1 is hold
 
 	To search for free blocks you run
@@ -24,137 +143,161 @@ extern struct uwsgi_server uwsgi;
 
 */
 
-static uint64_t uwsgi_cache_find_free_blocks(struct uwsgi_cache *uc, uint64_t need) {
-	// how many blocks we need ?
-	uint64_t needed_blocks = need/uc->blocksize;
-	if (need % uc->blocksize > 0) needed_blocks++;
+#define cache_blocks_needed(len) ((len)/uc->blocksize + (((len) % uc->blocksize) ? 1 : 0))
 
-	// which is the first free bit?
-	uint64_t bitmap_byte = 0;
-	uint8_t bitmap_bit = 0;
-
-	if (uc->blocks_bitmap_pos > 0) {
-		bitmap_byte = uc->blocks_bitmap_pos/8;
-		bitmap_bit = uc->blocks_bitmap_pos % 8;
-	}
-
-	// ok we now have the start position, let's search for contiguous blocks
-	uint8_t *bitmap = uc->blocks_bitmap;
-	uint64_t base = 0xffffffffffffffffLLU;
-	uint8_t base_bit = 0;
-	uint64_t j;
+// search a run of "needed_blocks" free blocks (lower than "end") starting at a position between "start" and "max_base"
+static uint64_t cache_find_free_run(struct uwsgi_cache *uc, uint64_t start, uint64_t end, uint64_t max_base, uint64_t needed_blocks) {
+	uint64_t *bitmap = uc->blocks_bitmap;
+	// stripes are word-aligned, and the padding of the last word is always used
+	uint64_t words = end/64;
+	if (end % 64 > 0) words++;
+	uint64_t base = start;
 	uint64_t found = 0;
-	uint64_t need_to_scan = uc->blocks_bitmap_size;
-	j = bitmap_byte;
-	//uwsgi_log("start scanning %llu bytes starting from %llu need: %llu\n", (unsigned long long) need_to_scan, (unsigned long long) bitmap_byte, (unsigned long long) needed_blocks);
-	while(need_to_scan) {
-		uint8_t num = bitmap[j];
-		uint8_t i;
-		uint8_t bit_pos = 0;
-		if (j == bitmap_byte) {
-			i = 1 << (7-bitmap_bit);
-			bit_pos = bitmap_bit;
-		}
-		else {
-			i = 1 <<7;
-		}	
-		while(i > 0) {
-			// used block
-                	if (num & i) {
-                                found = 0;
-                                base = 0xffffffffffffffffLLU;
-                                base_bit = 0;
-                        }
-			// free block
-                        else {
-                                if (base == 0xffffffffffffffffLLU ) {
-                                        base = j;
-					base_bit = bit_pos;
-                                }
-                                found++;
-                                if (found == needed_blocks) {
-                                        //printf("found %llu consecutive bit starting from byte %llu\n", found, base);
-					return ((base*8) + base_bit);
-                                }
-                        }
-                        i >>= 1;
-			bit_pos++;
-                }
-		j++;
-		need_to_scan--;
-		// check for overlap
-		if (j >= need_to_scan) {
-			j = 0;
-			found = 0;
-			base = 0xffffffffffffffffLLU;
-			base_bit = 0;
+	uint64_t pos = start;
+
+	while(pos/64 < words) {
+		uint64_t w = pos/64;
+		uint8_t off = pos % 64;
+		// fast path for long free runs
+		if (off == 0 && needed_blocks - found > 256) {
+			while(w + 4 <= words && !(bitmap[w] | bitmap[w+1] | bitmap[w+2] | bitmap[w+3])) {
+				found += 256;
+				w += 4;
+				if (found >= needed_blocks) return base;
+			}
+			pos = w * 64;
+			if (w >= words) break;
+		}
+		uint64_t num = bitmap[w] >> off;
+		uint8_t avail = 64 - off;
+		// all of the remaining blocks of this word are free
+		if (num == 0) {
+			found += avail;
+			if (found >= needed_blocks) return base;
+			pos += avail;
+			continue;
 		}
+		// free blocks before the next used one
+		uint8_t free_bits = __builtin_ctzll(num);
+		found += free_bits;
+		if (found >= needed_blocks) return base;
+		// skip the used blocks (the upper bits of ~num are always set after the shift, unless the whole word is used)
+		num >>= free_bits;
+		uint8_t used_bits = ~num ? __builtin_ctzll(~num) : 64;
+		pos += free_bits + used_bits;
+		found = 0;
+		base = pos;
+		if (base > max_base) break;
 	}
 
-	
 	// no more free blocks
 	return 0xffffffffffffffffLLU;
 }
 
-static uint64_t cache_mark_blocks(struct uwsgi_cache *uc, uint64_t index, uint64_t len) {
-	uint64_t needed_blocks = len/uc->blocksize;
-	if (len % uc->blocksize > 0) needed_blocks++;
-
-	uint64_t first_byte = index/8;
-	uint8_t first_byte_bit = index % 8;
-	uint64_t last_byte = (index+needed_blocks)/8;
-	uint8_t last_byte_bit = (index+needed_blocks) % 8;
-
-	//uwsgi_log("%llu %u %llu %u\n", first_byte, first_byte_bit, last_byte, last_byte_bit);
-
-	uint8_t mask = 0xff >> first_byte_bit;
-	uc->blocks_bitmap[first_byte] |= mask;
-
-	uint64_t needed_bytes = (last_byte - first_byte)+1;
+static uint64_t uwsgi_cache_find_free_blocks(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t need) {
+	// how many blocks we need ?
+	uint64_t needed_blocks = cache_blocks_needed(need);
+	if (needed_blocks > st->last_block - st->first_block) return 0xffffffffffffffffLLU;
+
+	// first scan from the last used position to the end of the stripe
+	uint64_t start = st->blocks_bitmap_pos;
+	if (start < st->first_block || start >= st->last_block) start = st->first_block;
+	uint64_t index = cache_find_free_run(uc, start, st->last_block, st->last_block, needed_blocks);
+	if (index != 0xffffffffffffffffLLU || start == st->first_block) return index;
+	// then restart from the beginning (objects cannot wrap, so runs crossing "start" are valid too)
+	return cache_find_free_run(uc, st->first_block, st->last_block, start, needed_blocks);
+}
 
-	if (needed_bytes > 1) {
-		mask = 0xff << (8 - last_byte_bit);
-		uc->blocks_bitmap[last_byte-1] |= mask;
+static void cache_set_blocks(struct uwsgi_cache *uc, uint64_t index, uint64_t needed_blocks, int mark) {
+	uint64_t *bitmap = uc->blocks_bitmap;
+	while(needed_blocks > 0) {
+		uint64_t w = index/64;
+		uint8_t off = index % 64;
+		uint64_t n = 64 - off;
+		if (n > needed_blocks) n = needed_blocks;
+		uint64_t mask = (n == 64) ? 0xffffffffffffffffLLU : (((1LLU << n) - 1) << off);
+		if (mark) {
+			bitmap[w] |= mask;
+		}
+		else {
+			bitmap[w] &= ~mask;
+		}
+		index += n;
+		needed_blocks -= n;
 	}
+}
 
-	if (needed_bytes > 2) {
-		uint8_t *ptr = &uc->blocks_bitmap[first_byte+1];
-		memset(ptr, 0xff, needed_bytes-2);
+static uint64_t cache_mark_blocks(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t index, uint64_t len) {
+	uint64_t needed_blocks = cache_blocks_needed(len);
+	cache_set_blocks(uc, index, needed_blocks, 1);
+	// optimize the scan
+	if (index + needed_blocks >= st->last_block) {
+		st->blocks_bitmap_pos = st->first_block;
+	}
+	else {
+		st->blocks_bitmap_pos = index + needed_blocks;
 	}
 	return needed_blocks;
 }
 
 static void cache_unmark_blocks(struct uwsgi_cache *uc, uint64_t index, uint64_t len) {
-	uint64_t needed_blocks = len/uc->blocksize;
-        if (len % uc->blocksize > 0) needed_blocks++;
-
-        uint64_t first_byte = index/8;
-        uint8_t first_byte_bit = index % 8;
-        uint64_t last_byte = (index+needed_blocks)/8;
-        uint8_t last_byte_bit = (index+needed_blocks) % 8;
-
-	// here we use XOR (0+0 = 0 | 1+0 = 1 | 0+1 = 1| 1+1 = 0|
-
-        uint8_t mask = 0xff >> first_byte_bit;
-        uc->blocks_bitmap[first_byte] ^= mask;
+	cache_set_blocks(uc, index, cache_blocks_needed(len), 0);
+}
 
-        uint64_t needed_bytes = (last_byte - first_byte)+1;
+/*
+	compute the number of free blocks and the distribution of the free runs
+	(histogram[n] counts the runs of 2^n to 2^(n+1)-1 blocks, the last bucket includes all of the bigger ones)
 
-        if (needed_bytes > 1) {
-                mask = 0xff << (8 - last_byte_bit);
-                uc->blocks_bitmap[last_byte-1] ^= mask;
-        }
+	This is called by the stats subsystem without locking, so the results are an approximation
+*/
+uint64_t uwsgi_cache_free_runs(struct uwsgi_cache *uc, uint64_t *histogram, uint64_t *largest) {
+	uint64_t i;
+	uint64_t free_blocks = 0;
+	uint64_t run = 0;
+	uint64_t words = uc->blocks_bitmap_size/8;
+
+	memset(histogram, 0, sizeof(uint64_t) * UWSGI_CACHE_FREE_RUNS_BUCKETS);
+	*largest = 0;
+
+	for(i=0;i<=words;i++) {
+		// the last iteration flushes the current run
+		uint64_t num = i < words ? uc->blocks_bitmap[i] : 0xffffffffffffffffLLU;
+		free_blocks += 64 - __builtin_popcountll(num);
+		uint8_t pos = 0;
+		while(pos < 64) {
+			uint64_t shifted = num >> pos;
+			if (shifted == 0) {
+				run += 64 - pos;
+				break;
+			}
+			uint8_t free_bits = __builtin_ctzll(shifted);
+			run += free_bits;
+			if (run > 0) {
+				uint8_t bucket = 63 - __builtin_clzll(run);
+				if (bucket >= UWSGI_CACHE_FREE_RUNS_BUCKETS) bucket = UWSGI_CACHE_FREE_RUNS_BUCKETS-1;
+				histogram[bucket]++;
+				if (run > *largest) *largest = run;
+				run = 0;
+			}
+			shifted >>= free_bits;
+			pos += free_bits + (~shifted ? __builtin_ctzll(~shifted) : 64);
+		}
+	}
 
-        if (needed_bytes > 2) {
-                uint8_t *ptr = &uc->blocks_bitmap[first_byte+1];
-                memset(ptr, 0, needed_bytes-2);
-        }
+	return free_blocks;
 }
 
 static void cache_send_udp_command(struct uwsgi_cache *, char *, uint16_t, char *, uint16_t, uint64_t, uint8_t);
 
+struct cache_sync_layout {
+	struct uwsgi_cache *uc;
+	uint64_t stripes;
+	uint64_t hashsize;
+};
+
 static void cache_sync_hook(char *k, uint16_t kl, char *v, uint16_t vl, void *data) {
-	struct uwsgi_cache *uc = (struct uwsgi_cache *) data;
+	struct cache_sync_layout *csl = (struct cache_sync_layout *) data;
+	struct uwsgi_cache *uc = csl->uc;
 	if (!uwsgi_strncmp(k, kl, "items", 5)) {
 		size_t num = uwsgi_str_num(v, vl);
 		if (num != uc->max_items) {
@@ -169,6 +312,13 @@ static void cache_sync_hook(char *k, uint16_t kl, char *v, uint16_t vl, void *da
 			exit(1);
 		}
 	}
+	// nodes without striping do not send them
+	if (!uwsgi_strncmp(k, kl, "stripes", 7)) {
+		csl->stripes = uwsgi_str_num(v, vl);
+	}
+	if (!uwsgi_strncmp(k, kl, "hashsize", 8)) {
+		csl->hashsize = uwsgi_str_num(v, vl);
+	}
 }
 
 static void uwsgi_cache_add_items(struct uwsgi_cache *uc) {
@@ -193,14 +343,14 @@ static void uwsgi_cache_add_items(struct uwsgi_cache *uc) {
 		key_len = value - key;
 		value++;
 		uint64_t len = (usl->value + usl->len) - value;
-                uwsgi_wlock(uc->lock);
+                uwsgi_cache_wlock(uc, key, key_len);
                 if (!uwsgi_cache_set2(uc, key, key_len, value, len, 0, 0)) {
                 	uwsgi_log("[cache] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                 }
                 else {
                 	uwsgi_log("[cache-error] unable to store \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                 }
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc, key, key_len);
 next:
                 usl = usl->next;
         }
@@ -225,14 +375,14 @@ static void uwsgi_cache_load_files(struct uwsgi_cache *uc) {
 		}
 		value = uwsgi_open_and_read(key, &len, 0, NULL);
 		if (value) {
-			uwsgi_wlock(uc->lock);
+			uwsgi_cache_wlock(uc, key, key_len);
 			if (!uwsgi_cache_set2(uc, key, key_len, value, len, 0, 0)) {
 				uwsgi_log("[cache] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
 			}		
 			else {
 				uwsgi_log("[cache-error] unable to store \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
 			}
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_cache_rwunlock(uc, key, key_len);
 			free(value);
 		}
 		else {
@@ -262,11 +412,11 @@ next:
                 if (value) {
 			struct uwsgi_buffer *gzipped = uwsgi_gzip(value, len);
 			if (gzipped) {
-                        	uwsgi_wlock(uc->lock);
+                        	uwsgi_cache_wlock(uc, key, key_len);
                         	if (!uwsgi_cache_set2(uc, key, key_len, gzipped->buf, gzipped->len, 0, 0)) {
                                 	uwsgi_log("[cache-gzip] stored \"%.*s\" in \"%s\"\n", key_len, key, uc->name);
                         	}
-                        	uwsgi_rwunlock(uc->lock);
+                        	uwsgi_cache_rwunlock(uc, key, key_len);
 				uwsgi_buffer_destroy(gzipped);
 			}
                         free(value);
@@ -279,28 +429,88 @@ next2:
 
 
 
+// reset the allocation status of the stripes (and of the bitmap)
+static void cache_reset_stripes(struct uwsgi_cache *uc) {
+	uint64_t i;
+	for(i=0;i<uc->stripes;i++) {
+		struct uwsgi_cache_stripe *st = &uc->stripe[i];
+		// the first cache item is always zero
+		st->first_available_item = st->first_item ? st->first_item : 1;
+		st->unused_items_stack_ptr = 0;
+		st->n_items = 0;
+		st->blocks_bitmap_pos = st->first_block;
+		st->expire_next = 0;
+	}
+
+	if (uc->expire_links) {
+		memset(uc->expire_links, 0, sizeof(struct uwsgi_cache_expire_link) * uc->max_items);
+		memset(uc->expire_wheel, 0, sizeof(uint64_t) * UWSGI_CACHE_EXPIRE_SLOTS * uc->stripes);
+	}
+
+	if (uc->blocks_bitmap) {
+		uint64_t words = uc->blocks_bitmap_size/8;
+		memset(uc->blocks_bitmap, 0, uc->blocks_bitmap_size);
+		// mark the padding blocks as used
+		if (uc->blocks % 64 > 0) {
+			uc->blocks_bitmap[words-1] = 0xffffffffffffffffLLU << (uc->blocks % 64);
+		}
+	}
+}
+
+static void cache_setup_stripes(struct uwsgi_cache *uc) {
+	uint64_t i;
+	uc->stripe = uwsgi_calloc_shared(sizeof(struct uwsgi_cache_stripe) * uc->stripes);
+	uc->stripe_items = uc->max_items / uc->stripes;
+	// in bitmap mode each stripe gets a word-aligned range of blocks
+	uint64_t stripe_blocks = ((uc->blocks_bitmap_size/8) / uc->stripes) * 64;
+	for(i=0;i<uc->stripes;i++) {
+		struct uwsgi_cache_stripe *st = &uc->stripe[i];
+		st->first_item = i * uc->stripe_items;
+		st->last_item = (i == uc->stripes-1) ? uc->max_items : st->first_item + uc->stripe_items;
+		if (uc->expire_links) {
+			st->expire_wheel = uc->expire_wheel + (i * UWSGI_CACHE_EXPIRE_SLOTS);
+		}
+		if (uc->blocks_bitmap) {
+			st->first_block = i * stripe_blocks;
+			st->last_block = (i == uc->stripes-1) ? uc->blocks : st->first_block + stripe_blocks;
+		}
+	}
+	cache_reset_stripes(uc);
+}
+
 void uwsgi_cache_init(struct uwsgi_cache *uc) {
 
 	uc->hashtable = uwsgi_calloc_shared(sizeof(uint64_t) * uc->hashsize);
-	uc->unused_blocks_stack = uwsgi_calloc_shared(sizeof(uint64_t) * uc->blocks);
-	// the first cache item is always zero
-	uc->first_available_block = 1;
-	uc->unused_blocks_stack_ptr = 0;
+	uc->unused_blocks_stack = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
 	uc->filesize = ( (sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items) + (uc->blocksize * uc->blocks);
 
 	if (uc->use_blocks_bitmap) {
-		uc->blocks_bitmap_size = uc->blocks/8;
-		if (uc->blocks % 8 > 0) uc->blocks_bitmap_size++;
+		// the bitmap is managed as 64bit words
+		uint64_t words = uc->blocks/64;
+		if (uc->blocks % 64 > 0) words++;
+		uc->blocks_bitmap_size = words * 8;
 		uc->blocks_bitmap = uwsgi_calloc_shared(uc->blocks_bitmap_size);
 	}
 
+	if (!uc->stripes) uc->stripes = 1;
+
+	// no need to index expirations if the sweeper will not run
+	if (!uwsgi.cache_no_expire && !uc->no_expire) {
+		uc->expire_links = uwsgi_calloc_shared(sizeof(struct uwsgi_cache_expire_link) * uc->max_items);
+		uc->expire_wheel = uwsgi_calloc_shared(sizeof(uint64_t) * UWSGI_CACHE_EXPIRE_SLOTS * uc->stripes);
+	}
+
+	cache_setup_stripes(uc);
+
 	//uwsgi.cache_items = (struct uwsgi_cache_item *) mmap(NULL, sizeof(struct uwsgi_cache_item) * uwsgi.cache_max_items, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 	if (uc->store) {
 		int cache_fd;
 		struct stat cst;
+		int new_store = 0;
 
 		if (stat(uc->store, &cst)) {
 			uwsgi_log("creating a new cache store file: %s\n", uc->store);
+			new_store = 1;
 			cache_fd = open(uc->store, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
 			if (cache_fd >= 0) {
 				// fill the caching store
@@ -329,6 +539,16 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 			exit(1);
 		}
 
+		if (!new_store) {
+			struct uwsgi_cache_item *layout = cache_item(0);
+			if (cache_layout_check(uc, layout->valsize, layout->first_block)) {
+				uwsgi_log("invalid cache store file. It has been created with stripes=%llu (hashsize %llu), please remove it or fix the cache stripes/hashsize\n",
+					(unsigned long long) (layout->valsize ? layout->valsize : 1), (unsigned long long) layout->first_block);
+				exit(1);
+			}
+		}
+		cache_layout_save(uc);
+
 		uwsgi_cache_fix(uc);
 		close(cache_fd);
 	}
@@ -343,6 +563,7 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 			// here we only need to clear the item header
 			memset(cache_item(i), 0, sizeof(struct uwsgi_cache_item));
 		}
+		cache_layout_save(uc);
 	}
 
 	uc->data = ((char *)uc->items) + ((sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items);
@@ -356,12 +577,23 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 		uc->lock = uwsgi_rwlock_init("cache");
 	}
 
-	uwsgi_log("*** Cache \"%s\" initialized: %lluMB (key: %llu bytes, keys: %llu bytes, data: %llu bytes, bitmap: %llu bytes) preallocated ***\n",
+	// the first stripe always uses the cache lock
+	uc->stripe[0].lock = uc->lock;
+	uint64_t i;
+	for(i=1;i<uc->stripes;i++) {
+		char *num = uwsgi_num2str(i);
+		// can't free that until shutdown
+		char *lock_name = uwsgi_concat4("cache_", uc->name ? uc->name : "default", "_", num);
+		free(num);
+		uc->stripe[i].lock = uwsgi_rwlock_init(lock_name);
+	}
+
+	uwsgi_log("*** Cache \"%s\" initialized: %lluMB (key: %llu bytes, keys: %llu bytes, data: %llu bytes, bitmap: %llu bytes, stripes: %llu) preallocated ***\n",
 			uc->name,
 			(unsigned long long) uc->filesize / (1024 * 1024),
 			(unsigned long long) sizeof(struct uwsgi_cache_item)+uc->keysize,
 			(unsigned long long) ((sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items), (unsigned long long) (uc->blocksize * uc->max_items),
-			(unsigned long long) uc->blocks_bitmap_size);
+			(unsigned long long) uc->blocks_bitmap_size, (unsigned long long) uc->stripes);
 
 	uwsgi_cache_setup_nodes(uc);
 
@@ -435,6 +667,212 @@ cycle:
 	return 0;
 }
 
+/*
+	locking api
+
+	users of the cache functions must lock the stripe of the key they are working on
+	(on non-striped caches this is the same as locking uc->lock).
+
+	Operations on the whole cache (like clear or dump) must use the _all variants.
+
+	In striped mode the contended acquisitions (and the time spent waiting for them) are accounted
+	in the stripe stats: every stripe counts its lock users (holders and waiters) and writers,
+	a reader contends with writers, a writer with everybody.
+*/
+
+static void cache_stripe_lock(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, int write) {
+	if (uc->stripes == 1) {
+		if (write) {
+			uwsgi_wlock(st->lock);
+		}
+		else {
+			uwsgi_rlock(st->lock);
+		}
+		return;
+	}
+	uint64_t writers = write ? __sync_fetch_and_add(&st->lock_writers, 1) : __atomic_load_n(&st->lock_writers, __ATOMIC_RELAXED);
+	uint64_t users = __sync_fetch_and_add(&st->lock_users, 1);
+	int contended = write ? users > 0 : writers > 0;
+	uint64_t start = contended ? uwsgi_micros() : 0;
+	if (write) {
+		uwsgi_wlock(st->lock);
+		st->lock_writer = 1;
+	}
+	else {
+		uwsgi_rlock(st->lock);
+	}
+	if (contended) {
+		__sync_fetch_and_add(&st->lock_waits, 1);
+		__sync_fetch_and_add(&st->lock_wait_time, uwsgi_micros() - start);
+	}
+}
+
+static void cache_stripe_unlock(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st) {
+	if (uc->stripes > 1) {
+		// while a writer holds the lock nobody else does
+		if (st->lock_writer) {
+			st->lock_writer = 0;
+			__sync_fetch_and_sub(&st->lock_writers, 1);
+		}
+		__sync_fetch_and_sub(&st->lock_users, 1);
+	}
+	uwsgi_rwunlock(st->lock);
+}
+
+static struct uwsgi_cache_stripe *cache_stripe_by_key(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	if (uc->stripes == 1) return uc->stripe;
+	uint32_t hash = uc->hash->func(key, keylen);
+	return cache_stripe_by_hash(hash);
+}
+
+void uwsgi_cache_rlock(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	cache_stripe_lock(uc, cache_stripe_by_key(uc, key, keylen), 0);
+}
+
+void uwsgi_cache_wlock(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	cache_stripe_lock(uc, cache_stripe_by_key(uc, key, keylen), 1);
+}
+
+void uwsgi_cache_rwunlock(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
+	cache_stripe_unlock(uc, cache_stripe_by_key(uc, key, keylen));
+}
+
+// lock the stripe managing the specified item
+void uwsgi_cache_wlock_item(struct uwsgi_cache *uc, uint64_t index) {
+	cache_stripe_lock(uc, cache_stripe_by_index(uc, index), 1);
+}
+
+void uwsgi_cache_rwunlock_item(struct uwsgi_cache *uc, uint64_t index) {
+	cache_stripe_unlock(uc, cache_stripe_by_index(uc, index));
+}
+
+// stripes are always locked in the same order
+void uwsgi_cache_rlock_all(struct uwsgi_cache *uc) {
+	uint64_t i;
+	for(i=0;i<uc->stripes;i++) {
+		cache_stripe_lock(uc, &uc->stripe[i], 0);
+	}
+}
+
+void uwsgi_cache_wlock_all(struct uwsgi_cache *uc) {
+	uint64_t i;
+	for(i=0;i<uc->stripes;i++) {
+		cache_stripe_lock(uc, &uc->stripe[i], 1);
+	}
+}
+
+void uwsgi_cache_rwunlock_all(struct uwsgi_cache *uc) {
+	uint64_t i;
+	for(i=uc->stripes;i>0;i--) {
+		cache_stripe_unlock(uc, &uc->stripe[i-1]);
+	}
+}
+
+// hits and misses (optimistic readers account them in their stripe)
+uint64_t uwsgi_cache_hits(struct uwsgi_cache *uc) {
+	uint64_t i;
+	uint64_t hits = uc->hits;
+	for(i=0;i<uc->stripes;i++) {
+		hits += uc->stripe[i].hits;
+	}
+	return hits;
+}
+
+uint64_t uwsgi_cache_miss(struct uwsgi_cache *uc) {
+	uint64_t i;
+	uint64_t miss = uc->miss;
+	for(i=0;i<uc->stripes;i++) {
+		miss += uc->stripe[i].miss;
+	}
+	return miss;
+}
+
+uint64_t uwsgi_cache_n_items(struct uwsgi_cache *uc) {
+	uint64_t i;
+	uint64_t n_items = 0;
+	for(i=0;i<uc->stripes;i++) {
+		n_items += uc->stripe[i].n_items;
+	}
+	return n_items;
+}
+
+/*
+	optimistic (lockless) get for striped caches
+
+	the stripe sequence counter is read before and after copying the value,
+	if it changed (or a writer is running) the read is retried.
+	As a writer could be relinking items while we read, every index is validated
+	and the number of visited items is limited.
+
+	Readers never write to the items (they could be reused by a writer in the meantime),
+	the only exception is the access data of lru and clock (see cache_item_touch()), atomically
+	stored. lfu needs a per-item update for each hit, so it always uses the locked path.
+	Counters are per-stripe and atomically updated.
+
+	returns -1 if a consistent copy could not be made (the caller should fallback to the locked path)
+*/
+static int cache_get_optimistic(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t *vallen, uint64_t *expires, char **value) {
+	uint32_t hash = uc->hash->func(key, keylen);
+	struct uwsgi_cache_stripe *st = cache_stripe_by_hash(hash);
+	char *buf = NULL;
+	size_t buf_len = 0;
+	int retries;
+
+	for(retries=0;retries<UWSGI_CACHE_OPTIMISTIC_RETRIES;retries++) {
+		uint64_t seq = st->seq;
+		__sync_synchronize();
+		if (seq & 1) goto retry;
+
+		uint64_t found = 0;
+		uint64_t rounds = 0;
+		uint64_t slot = uc->hashtable[hash % uc->hashsize];
+		while(slot > 0 && slot < uc->max_items && rounds < uc->max_items) {
+			struct uwsgi_cache_item *uci = cache_item(slot);
+			if (uci->hash == hash && uci->keysize == keylen && !memcmp(uci->key, key, keylen)) {
+				if (uci->flags & UWSGI_CACHE_FLAG_UNGETTABLE) break;
+				uint64_t first_block = uci->first_block;
+				uint64_t size = uci->valsize;
+				uint64_t item_expires = uci->expires;
+				// the item is being changed
+				if (!size || first_block >= uc->blocks || size > uc->max_item_size || (first_block * uc->blocksize) + size > uc->blocks * uc->blocksize) goto retry;
+				if (size > buf_len) {
+					char *tmp_buf = realloc(buf, size);
+					if (!tmp_buf) goto retry;
+					buf = tmp_buf;
+					buf_len = size;
+				}
+				memcpy(buf, uc->data + (first_block * uc->blocksize), size);
+				*vallen = size;
+				if (expires) *expires = item_expires;
+				found = slot;
+				break;
+			}
+			slot = uci->next;
+			rounds++;
+		}
+
+		__sync_synchronize();
+		if (st->seq != seq) goto retry;
+
+		__sync_fetch_and_add(&st->optimistic_reads, 1);
+		if (!found) {
+			free(buf);
+			__sync_fetch_and_add(&st->miss, 1);
+			*value = NULL;
+			return 0;
+		}
+		cache_item_touch(uc, found);
+		__sync_fetch_and_add(&st->hits, 1);
+		*value = buf;
+		return 0;
+retry:
+		__sync_fetch_and_add(&st->optimistic_retries, 1);
+	}
+
+	free(buf);
+	return -1;
+}
+
 uint32_t uwsgi_cache_exists2(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 
 	return uwsgi_cache_get_index(uc, key, keylen);
@@ -450,6 +888,7 @@ char *uwsgi_cache_get2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 			return NULL;
 		*valsize = uci->valsize;
 		uci->hits++;
+		cache_item_touch(uc, index);
 		uc->hits++;
 		return uc->data + (uci->first_block * uc->blocksize);
 	}
@@ -468,6 +907,7 @@ int64_t uwsgi_cache_num2(struct uwsgi_cache *uc, char *key, uint16_t keylen) {
 		if (uci->flags & UWSGI_CACHE_FLAG_UNGETTABLE)
                         return 0;
                 uci->hits++;
+                cache_item_touch(uc, index);
                 uc->hits++;
 		int64_t *num = (int64_t *) (uc->data + (uci->first_block * uc->blocksize));
 		return *num;
@@ -489,6 +929,7 @@ char *uwsgi_cache_get3(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 		if (expires)
 			*expires = uci->expires;
                 uci->hits++;
+                cache_item_touch(uc, index);
                 uc->hits++;
                 return uc->data + (uci->first_block * uc->blocksize);
         }
@@ -510,6 +951,7 @@ char *uwsgi_cache_get4(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
                 if (hits)
                         *hits = uci->hits;
                 uci->hits++;
+                cache_item_touch(uc, index);
                 uc->hits++;
                 return uc->data + (uci->first_block * uc->blocksize);
         }
@@ -520,6 +962,52 @@ char *uwsgi_cache_get4(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 }
 
 
+// remove an item from the cache (the stripe must be locked and marked as being written)
+static void cache_del_item(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t index) {
+	struct uwsgi_cache_item *uci = cache_item(index);
+
+	cache_expire_unlink(uc, st, index);
+	// unmark blocks (before resetting the value size)
+	if (uc->blocks_bitmap) {
+		cache_unmark_blocks(uc, uci->first_block, uci->valsize);
+	}
+	uci->keysize = 0;
+	uci->valsize = 0;
+	uc->unused_blocks_stack[st->first_item + st->unused_items_stack_ptr] = index;
+	st->unused_items_stack_ptr++;
+	// relink collisioned entry
+	if (uci->prev) {
+		struct uwsgi_cache_item *ucii = cache_item(uci->prev);
+		ucii->next = uci->next;
+	}
+	else {
+		// set next as the new entry point (could be 0)
+		uc->hashtable[uci->hash % uc->hashsize] = uci->next;
+	}
+
+	if (uci->next) {
+		struct uwsgi_cache_item *ucii = cache_item(uci->next);
+		ucii->prev = uci->prev;
+	}
+
+	if (!uci->prev && !uci->next) {
+		// reset hashtable entry
+		//uwsgi_log("!!! resetted hashtable entry !!!\n");
+		uc->hashtable[uci->hash % uc->hashsize] = 0;
+	}
+	uci->hash = 0;
+	uci->prev = 0;
+	uci->next = 0;
+	uci->expires = 0;
+	uci->access = 0;
+
+	st->n_items--;
+
+	if (uc->use_last_modified) {
+		uc->last_modified_at = uwsgi_now();
+	}
+}
+
 int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t index, uint16_t flags) {
 
 	struct uwsgi_cache_item *uci;
@@ -530,52 +1018,90 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
 
 	if (index) {
 		uci = cache_item(index);
-		uci->keysize = 0;
-		uci->valsize = 0;
-		uc->unused_blocks_stack_ptr++;
-		uc->unused_blocks_stack[uc->unused_blocks_stack_ptr] = index;
-		// unmark blocks
-		if (uc->blocks_bitmap) {
-			cache_unmark_blocks(uc, uci->first_block, uci->valsize);
-		}
+		// already free slot
+		if (!uci->keysize) return -1;
+		struct uwsgi_cache_stripe *st = cache_stripe_by_index(uc, index);
+		cache_stripe_write_begin(st);
+		cache_del_item(uc, st, index);
 		ret = 0;
-		// relink collisioned entry
-		if (uci->prev) {
-			struct uwsgi_cache_item *ucii = cache_item(uci->prev);
-			ucii->next = uci->next;
-		}
-		else {
-			// set next as the new entry point (could be 0)
-			uc->hashtable[uci->hash % uc->hashsize] = uci->next;
-		}
+		cache_stripe_write_end(st);
+	}
 
-		if (uci->next) {
-			struct uwsgi_cache_item *ucii = cache_item(uci->next);
-			ucii->prev = uci->prev;
-		}
+	if (uc->nodes && ret == 0 && !(flags & UWSGI_CACHE_FLAG_LOCAL)) {
+                cache_send_udp_command(uc, key, keylen, NULL, 0, 0, 11);
+        }
 
-		if (!uci->prev && !uci->next) {
-			// reset hashtable entry
-			//uwsgi_log("!!! resetted hashtable entry !!!\n");
-			uc->hashtable[uci->hash % uc->hashsize] = 0;
-		}
-		uci->hash = 0;
-		uci->prev = 0;
-		uci->next = 0;
-		uci->expires = 0;
+	return ret;
+}
 
-		uc->n_items--;
+/*
+	eviction
 
-		if (uc->use_last_modified) {
-			uc->last_modified_at = uwsgi_now();
+	when a stripe has no more free items (or blocks) and an eviction policy is configured (evict=lru|clock|lfu)
+	the set operations remove items of the same stripe instead of failing:
+
+	lru -> the least recently accessed item between UWSGI_CACHE_EVICT_SAMPLES candidates
+	lfu -> the less hit item between UWSGI_CACHE_EVICT_SAMPLES candidates
+	clock -> the first item without the reference bit (set by accesses, new items start without it,
+		 the bit is cleared while the hand moves)
+
+	candidates are taken moving the hand of the stripe. Readers only store a number in the item
+	(they cannot update shared lists with the read lock), this is why lru is sampled.
+*/
+
+static uint64_t cache_evict_next(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st) {
+	uint64_t first = st->first_item ? st->first_item : 1;
+	// only items lower than first_available_item could be in use
+	if (st->evict_hand < first || st->evict_hand >= st->first_available_item) {
+		st->evict_hand = first;
+	}
+	return st->evict_hand++;
+}
+
+// evict an item (different from "skip") from a stripe, returns 0 on success
+static int cache_evict(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t skip) {
+	uint64_t first = st->first_item ? st->first_item : 1;
+	if (st->first_available_item <= first) return -1;
+	uint64_t range = st->first_available_item - first;
+	uint64_t victim = 0;
+	uint64_t i;
+
+	if (uc->evict == UWSGI_CACHE_EVICT_CLOCK) {
+		// at most two rounds (the first one could only clear reference bits)
+		for (i = 0; i < range * 2; i++) {
+			uint64_t index = cache_evict_next(uc, st);
+			struct uwsgi_cache_item *uci = cache_item(index);
+			if (!uci->keysize || index == skip) continue;
+			if (uci->access) {
+				uci->access = 0;
+				continue;
+			}
+			victim = index;
+			break;
+		}
+	}
+	else {
+		uint64_t samples = 0;
+		struct uwsgi_cache_item *vci = NULL;
+		for (i = 0; i < range && samples < UWSGI_CACHE_EVICT_SAMPLES; i++) {
+			uint64_t index = cache_evict_next(uc, st);
+			struct uwsgi_cache_item *uci = cache_item(index);
+			if (!uci->keysize || index == skip) continue;
+			samples++;
+			if (!vci
+				|| (uc->evict == UWSGI_CACHE_EVICT_LFU && uci->hits < vci->hits)
+				|| (uc->evict == UWSGI_CACHE_EVICT_LRU && uci->access < vci->access)) {
+				victim = index;
+				vci = uci;
+			}
 		}
 	}
 
-	if (uc->nodes && ret == 0 && !(flags & UWSGI_CACHE_FLAG_LOCAL)) {
-                cache_send_udp_command(uc, key, keylen, NULL, 0, 0, 11);
-        }
+	if (!victim) return -1;
 
-	return ret;
+	cache_del_item(uc, st, victim);
+	uc->evictions++;
+	return 0;
 }
 
 void uwsgi_cache_fix(struct uwsgi_cache *uc) {
@@ -583,26 +1109,54 @@ void uwsgi_cache_fix(struct uwsgi_cache *uc) {
 	uint64_t i;
 	unsigned long long restored = 0;
 
-	for (i = 0; i < uc->max_items; i++) {
+	cache_reset_stripes(uc);
+
+	// the first cache item is always zero
+	for (i = 1; i < uc->max_items; i++) {
 		// valid record ?
 		struct uwsgi_cache_item *uci = cache_item(i);
+		struct uwsgi_cache_stripe *st = cache_stripe_by_index(uc, i);
 		if (uci->keysize) {
 			if (!uci->prev) {
 				// put value in hash_table
 				uc->hashtable[uci->hash % uc->hashsize] = i;
 				restored++;
 			}
+			st->n_items++;
+			// restored lru stamps must not be in the future of the stripe clock
+			if (uc->evict == UWSGI_CACHE_EVICT_LRU && uci->access > st->access_clock) {
+				st->access_clock = uci->access;
+			}
+			cache_expire_link(uc, st, i);
+			// the bitmap is not part of the store, rebuild it
+			if (uc->blocks_bitmap) {
+				cache_mark_blocks(uc, st, uci->first_block, uci->valsize);
+			}
 		}
 		else {
 			// put this record in unused stack
-			uc->first_available_block = i;
-			uc->unused_blocks_stack_ptr++;
-			uc->unused_blocks_stack[uc->unused_blocks_stack_ptr] = i;
+			uc->unused_blocks_stack[st->first_item + st->unused_items_stack_ptr] = i;
+			st->unused_items_stack_ptr++;
 		}
 	}
 
-	uc->n_items = restored;
-	uwsgi_log("[uwsgi-cache] restored %llu items\n", uc->n_items);
+	// all of the free items are in the unused stack
+	for(i=0;i<uc->stripes;i++) {
+		uc->stripe[i].first_available_item = uc->stripe[i].last_item;
+	}
+
+	uwsgi_log("[uwsgi-cache] restored %llu items\n", restored);
+}
+
+// evict items until a run of free blocks for "len" bytes is available
+static uint64_t cache_evict_blocks(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t skip, uint64_t len) {
+	uint64_t evicted = 0;
+	while (evicted < UWSGI_CACHE_EVICT_MAX && !cache_evict(uc, st, skip)) {
+		evicted++;
+		uint64_t first_block = uwsgi_cache_find_free_blocks(uc, st, len);
+		if (first_block != 0xffffffffffffffffLLU) return first_block;
+	}
+	return 0xffffffffffffffffLLU;
 }
 
 int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *val, uint64_t vallen, uint64_t expires, uint64_t flags) {
@@ -627,25 +1181,32 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 
 	if ((flags & UWSGI_CACHE_FLAG_MATH) && vallen != 8) return -1;
 
+	uint32_t hash = uc->hash->func(key, keylen);
+	struct uwsgi_cache_stripe *st = cache_stripe_by_hash(hash);
+	cache_stripe_write_begin(st);
+
 	//uwsgi_log("putting cache data in key %.*s %d\n", keylen, key, vallen);
 	index = uwsgi_cache_get_index(uc, key, keylen);
 	if (!index) {
-		if (uc->first_available_block >= uc->max_items && !uc->unused_blocks_stack_ptr) {
-			uwsgi_log("*** DANGER cache \"%s\" is FULL !!! ***\n", uc->name);
-			uc->full++;
-			goto end;
+		if (st->first_available_item >= st->last_item && !st->unused_items_stack_ptr) {
+			// make room for the new item
+			if (!uc->evict || cache_evict(uc, st, 0)) {
+				uwsgi_log("*** DANGER cache \"%s\" is FULL !!! ***\n", uc->name);
+				uc->full++;
+				goto end;
+			}
 		}
-		if (uc->unused_blocks_stack_ptr) {
+		if (st->unused_items_stack_ptr) {
 			//uwsgi_log("!!! REUSING CACHE SLOT !!! (faci: %llu)\n", (unsigned long long) uwsgi.shared->cache_first_available_block);
-			index = uc->unused_blocks_stack[uc->unused_blocks_stack_ptr];
-			uc->unused_blocks_stack_ptr--;
+			st->unused_items_stack_ptr--;
+			index = uc->unused_blocks_stack[st->first_item + st->unused_items_stack_ptr];
 		}
 		else {
 			rollback_mode = 1;
-			index = uc->first_available_block;
-			if (uc->first_available_block < uc->max_items) {
+			index = st->first_available_item;
+			if (st->first_available_item < st->last_item) {
 				rollback_mode = 2;
-				uc->first_available_block++;
+				st->first_available_item++;
 			}
 		}
 
@@ -654,38 +1215,42 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 			uci->first_block = index;
 		}
 		else {
-			uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+			uci->first_block = uwsgi_cache_find_free_blocks(uc, st, vallen);
 			//uwsgi_log("first block = %llu\n", uci->first_block);
+			if (uci->first_block == 0xffffffffffffffffLLU && uc->evict) {
+				uci->first_block = cache_evict_blocks(uc, st, index, vallen);
+			}
 			if (uci->first_block == 0xffffffffffffffffLLU) {
 				uwsgi_log("*** DANGER cache \"%s\" is FULL !!! ***\n", uc->name);
                                 uc->full++;
 				if (rollback_mode == 0) {
-					uc->unused_blocks_stack_ptr++;
+					// evictions could have changed the stack
+					uc->unused_blocks_stack[st->first_item + st->unused_items_stack_ptr] = index;
+					st->unused_items_stack_ptr++;
 				}
 				else if (rollback_mode == 2) {
-					uc->first_available_block--;
+					st->first_available_item--;
 				}
                                 goto end;
 			}
 			// mark used blocks;
-			uint64_t needed_blocks = cache_mark_blocks(uc, uci->first_block, vallen);
-			// optimize the scan
-			if (uc->blocks_bitmap_pos + (needed_blocks+1) > uc->blocks) {
-                        	uc->blocks_bitmap_pos = 0;
-                        }
-                        else {
-                        	uc->blocks_bitmap_pos = uci->first_block + needed_blocks + 1;
-                        }
+			cache_mark_blocks(uc, st, uci->first_block, vallen);
 		}
 		if (expires && !(flags & UWSGI_CACHE_FLAG_ABSEXPIRE)) {
 			now = uwsgi_now();
 			expires += now;
 		}
 		uci->expires = expires;
-		uci->hash = uc->hash->func(key, keylen);
+		uci->hash = hash;
 		uci->hits = 0;
 		uci->flags = flags;
 		memcpy(uci->key, key, keylen);
+		cache_expire_link(uc, st, index);
+		uci->access = 0;
+		// new items start without the clock reference bit (a flood of new keys cannot push out the referenced ones)
+		if (uc->evict != UWSGI_CACHE_EVICT_CLOCK) {
+			cache_item_touch(uc, index);
+		}
 
 		if ( !(flags & UWSGI_CACHE_FLAG_MATH)) {
 			memcpy(((char *) uc->data) + (uci->first_block * uc->blocksize), val, vallen);
@@ -740,36 +1305,36 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 			uci->prev = last_index;
 		}
 
-		uc->n_items++ ;
+		st->n_items++ ;
 	}
 	else if (flags & UWSGI_CACHE_FLAG_UPDATE) {
 		uci = cache_item(index);
 		if (expires && !(flags & UWSGI_CACHE_FLAG_ABSEXPIRE) && !(flags & UWSGI_CACHE_FLAG_FIXEXPIRE)) {
 			now = uwsgi_now();
 			expires += now;
+			cache_expire_unlink(uc, st, index);
 			uci->expires = expires;
+			cache_expire_link(uc, st, index);
 		}
-		if (uc->blocks_bitmap) {
+		// if the number of blocks does not change, the value can be overwritten in place
+		if (uc->blocks_bitmap && cache_blocks_needed(vallen) != cache_blocks_needed(uci->valsize)) {
 			// we have a special case here, as we need to find a new series of free blocks
 			uint64_t old_first_block = uci->first_block;
-			uci->first_block = uwsgi_cache_find_free_blocks(uc, vallen);
+			// release the old blocks first, so the new value can reuse them
+			cache_unmark_blocks(uc, old_first_block, uci->valsize);
+			uci->first_block = uwsgi_cache_find_free_blocks(uc, st, vallen);
+			if (uci->first_block == 0xffffffffffffffffLLU && uc->evict) {
+				uci->first_block = cache_evict_blocks(uc, st, index, vallen);
+			}
                         if (uci->first_block == 0xffffffffffffffffLLU) {
                                 uwsgi_log("*** DANGER cache \"%s\" is FULL !!! ***\n", uc->name);
                                 uc->full++;
 				uci->first_block = old_first_block;
+				cache_set_blocks(uc, old_first_block, cache_blocks_needed(uci->valsize), 1);
                                 goto end;
                         }
                         // mark used blocks;
-                        uint64_t needed_blocks = cache_mark_blocks(uc, uci->first_block, vallen);
-                        // optimize teh scan
-                        if (uc->blocks_bitmap_pos + (needed_blocks+1) > uc->blocks) {
-                                uc->blocks_bitmap_pos = 0;
-                        }
-                        else {
-                                uc->blocks_bitmap_pos = uci->first_block + needed_blocks + 1;
-                        }
-			// unmark the old blocks
-			cache_unmark_blocks(uc, uci->first_block, uci->valsize);
+                        cache_mark_blocks(uc, st, uci->first_block, vallen);
 		}
 		if ( !(flags & UWSGI_CACHE_FLAG_MATH)) {
 			memcpy(uc->data + (uci->first_block * uc->blocksize), val, vallen);
@@ -796,6 +1361,7 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
                         }
 		}
 		uci->valsize = vallen;
+		cache_item_touch(uc, index);
 		ret = 0;
 	}
 
@@ -809,6 +1375,7 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 
 
 end:
+	cache_stripe_write_end(st);
 	return ret;
 
 }
@@ -945,25 +1512,66 @@ void *cache_udp_server_loop(void *ucache) {
                                 if (6+keylen+vallen+ss > pktsize) continue;
                                 expires = uwsgi_str_num(buf + 10 + keylen+vallen, ss);
                         }
-                        uwsgi_wlock(uc->lock);
+                        uwsgi_cache_wlock(uc, key, keylen);
                         if (uwsgi_cache_set2(uc, key, keylen, val, vallen, expires, UWSGI_CACHE_FLAG_UPDATE|UWSGI_CACHE_FLAG_LOCAL|UWSGI_CACHE_FLAG_ABSEXPIRE)) {
                                 uwsgi_log("[cache-udp-server] unable to update cache\n");
                         }
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, key, keylen);
                 }
                 // cache del
                 else if (buf[3] == 11) {
-                        uwsgi_wlock(uc->lock);
+                        uwsgi_cache_wlock(uc, key, keylen);
                         if (uwsgi_cache_del2(uc, key, keylen, 0, UWSGI_CACHE_FLAG_LOCAL)) {
                                 uwsgi_log("[cache-udp-server] unable to update cache\n");
                         }
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, key, keylen);
                 }
         }
 
         return NULL;
 }
 
+// delete the items of a stripe expired before "now", releasing the lock every UWSGI_CACHE_SWEEP_BATCH items
+static uint64_t cache_sweep_stripe(struct uwsgi_cache *uc, struct uwsgi_cache_stripe *st, uint64_t now) {
+	uint64_t freed_items = 0;
+	uint64_t batch = 0;
+	uint64_t t;
+
+	cache_stripe_lock(uc, st, 1);
+	uint64_t from = st->expire_next;
+	// first run (or clock skew): check the whole wheel
+	if (!from || from > now || now - from >= UWSGI_CACHE_EXPIRE_SLOTS) {
+		from = now - UWSGI_CACHE_EXPIRE_SLOTS;
+	}
+	// items expiring from now on will be linked in a slot not checked yet
+	st->expire_next = now;
+
+	for (t = from; t < now; t++) {
+		uint64_t slot = t % UWSGI_CACHE_EXPIRE_SLOTS;
+		uint64_t index = st->expire_wheel[slot];
+		while (index) {
+			uint64_t next = uc->expire_links[index].next;
+			struct uwsgi_cache_item *uci = cache_item(index);
+			if (uci->expires && uci->expires < now) {
+				uwsgi_cache_del2(uc, NULL, 0, index, UWSGI_CACHE_FLAG_LOCAL);
+				freed_items++;
+				batch++;
+				// give the other lock users a chance, then restart from the head of the slot
+				if (batch >= UWSGI_CACHE_SWEEP_BATCH) {
+					cache_stripe_unlock(uc, st);
+					batch = 0;
+					cache_stripe_lock(uc, st, 1);
+					next = st->expire_wheel[slot];
+				}
+			}
+			index = next;
+		}
+	}
+	cache_stripe_unlock(uc, st);
+
+	return freed_items;
+}
+
 static void *cache_sweeper_loop(void *ucache) {
 
         uint64_t i;
@@ -977,22 +1585,14 @@ static void *cache_sweeper_loop(void *ucache) {
         if (!uwsgi.cache_expire_freq)
                 uwsgi.cache_expire_freq = 3;
 
-        // remove expired cache items TODO use rb_tree timeouts
+        // remove expired cache items (only the slots of the wheel elapsed since the last run are checked)
         for (;;) {
 		sleep(uwsgi.cache_expire_freq);
                 uint64_t freed_items = 0;
-                // skip the first slot
-                for (i = 1; i < uc->max_items; i++) {
-                        uwsgi_wlock(uc->lock);
-			struct uwsgi_cache_item *uci = cache_item(i);
-                        if (uci->expires) {
-                                if (uci->expires < (uint64_t) uwsgi.current_time) {
-                                        uwsgi_cache_del2(uc, NULL, 0, i, UWSGI_CACHE_FLAG_LOCAL);
-                                        freed_items++;
-                                }
-                        }
-                        uwsgi_rwunlock(uc->lock);
-                }
+		uint64_t now = (uint64_t) uwsgi.current_time;
+		for (i = 0; i < uc->stripes; i++) {
+			freed_items += cache_sweep_stripe(uc, &uc->stripe[i], now);
+		}
                 if (uwsgi.cache_report_freed_items && freed_items > 0) {
                         uwsgi_log("freed %llu items for cache \"%s\"\n", (unsigned long long) freed_items, uc->name);
                 }
@@ -1102,6 +1702,8 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 		char *c_bitmap = NULL;
 		char *c_use_last_modified = NULL;
 		char *c_math_initial = NULL;
+		char *c_stripes = NULL;
+		char *c_evict = NULL;
 
 		if (uwsgi_kvlist_parse(arg, strlen(arg), ',', '=',
                         "name", &c_name,
@@ -1129,6 +1731,8 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
                         "bitmap", &c_bitmap,
                         "lastmod", &c_use_last_modified,
                         "math_initial", &c_math_initial,
+                        "stripes", &c_stripes,
+                        "evict", &c_evict,
                 	NULL)) {
 			uwsgi_log("unable to parse cache definition\n");
 			exit(1);
@@ -1179,6 +1783,41 @@ struct uwsgi_cache *uwsgi_cache_create(char *arg) {
 
 		if (c_math_initial) uc->math_initial = strtol(c_math_initial, NULL, 10);
 
+		uc->stripes = 1;
+		if (c_stripes) uc->stripes = uwsgi_n64(c_stripes);
+		if (!uc->stripes || uc->stripes > uc->max_items/2 || uc->stripes > uc->hashsize) {
+			uwsgi_log("invalid number of cache stripes for \"%s\"\n", uc->name);
+			exit(1);
+		}
+		if (uc->use_blocks_bitmap && uc->stripes > 1) {
+			// each stripe gets a word-aligned range of blocks, the last one could be smaller
+			uint64_t words = uc->blocks/64;
+			if (uc->blocks % 64 > 0) words++;
+			if (words < uc->stripes) {
+				uwsgi_log("invalid number of cache stripes for \"%s\", you need at least 64 blocks per stripe\n", uc->name);
+				exit(1);
+			}
+			uint64_t stripe_blocks = (words / uc->stripes) * 64;
+			uint64_t last_stripe_blocks = uc->blocks - (stripe_blocks * (uc->stripes-1));
+			uc->max_item_size = uc->blocksize * (last_stripe_blocks < stripe_blocks ? last_stripe_blocks : stripe_blocks);
+		}
+
+		if (c_evict) {
+			if (!strcmp(c_evict, "lru")) {
+				uc->evict = UWSGI_CACHE_EVICT_LRU;
+			}
+			else if (!strcmp(c_evict, "clock")) {
+				uc->evict = UWSGI_CACHE_EVICT_CLOCK;
+			}
+			else if (!strcmp(c_evict, "lfu")) {
+				uc->evict = UWSGI_CACHE_EVICT_LFU;
+			}
+			else {
+				uwsgi_log("invalid cache eviction policy for \"%s\", supported: lru, clock, lfu\n", uc->name);
+				exit(1);
+			}
+		}
+
 		uc->store_sync = uwsgi.cache_store_sync;
 		if (c_store_sync) { uc->store_sync = uwsgi_n64(c_store_sync); }
 
@@ -1468,15 +2107,22 @@ char *uwsgi_cache_magic_get(char *key, uint16_t keylen, uint64_t *vallen, uint64
 
 	// we have a local cache !!!
 	if (uc) {
-		uwsgi_rlock(uc->lock);
+		// striped caches try the lockless path first
+		if (uc->stripes > 1 && uc->evict != UWSGI_CACHE_EVICT_LFU) {
+			char *buf = NULL;
+			if (!cache_get_optimistic(uc, key, keylen, vallen, expires, &buf)) {
+				return buf;
+			}
+		}
+		uwsgi_cache_rlock(uc, key, keylen);
 		char *value = uwsgi_cache_get3(uc, key, keylen, vallen, expires);
 		if (!value) {
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_cache_rwunlock(uc, key, keylen);
 			return NULL;
 		}
 		char *buf = uwsgi_malloc(*vallen);
 		memcpy(buf, value, *vallen);
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_cache_rwunlock(uc, key, keylen);
 		return buf;
 	}
 
@@ -1573,12 +2219,12 @@ int uwsgi_cache_magic_exists(char *key, uint16_t keylen, char *cache) {
 
         // we have a local cache !!!
         if (uc) {
-                uwsgi_rlock(uc->lock);
+                uwsgi_cache_rlock(uc, key, keylen);
                 if (!uwsgi_cache_exists2(uc, key, keylen)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, key, keylen);
                         return 0;
                 }
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_cache_rwunlock(uc, key, keylen);
 		return 1;
         }
 
@@ -1643,9 +2289,9 @@ int uwsgi_cache_magic_set(char *key, uint16_t keylen, char *value, uint64_t vall
 
 	// we have a local cache !!!
 	if (uc) {
-                uwsgi_wlock(uc->lock);
+                uwsgi_cache_wlock(uc, key, keylen);
                 int ret = uwsgi_cache_set2(uc, key, keylen, value, vallen, expires, flags);
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc, key, keylen);
 		return ret;
         }
 
@@ -1718,12 +2364,12 @@ int uwsgi_cache_magic_del(char *key, uint16_t keylen, char *cache) {
 
         // we have a local cache !!!
         if (uc) {
-                uwsgi_wlock(uc->lock);
+                uwsgi_cache_wlock(uc, key, keylen);
                 if (uwsgi_cache_del2(uc, key, keylen, 0, 0)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, key, keylen);
                         return -1;
                 }
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc, key, keylen);
                 return 0;
         }
 
@@ -1789,14 +2435,12 @@ int uwsgi_cache_magic_clear(char *cache) {
         // we have a local cache !!!
         if (uc) {
 		uint64_t i;
-                uwsgi_wlock(uc->lock);
-		for (i = 1; i < uwsgi.caches->max_items; i++) {
-                	if (uwsgi_cache_del2(uc, NULL, 0, i, 0)) {
-                        	uwsgi_rwunlock(uc->lock);
-                        	return -1;
-                	}
+                uwsgi_cache_wlock_all(uc);
+		// free slots are simply skipped by uwsgi_cache_del2()
+		for (i = 1; i < uc->max_items; i++) {
+                	uwsgi_cache_del2(uc, NULL, 0, i, 0);
 		}
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock_all(uc);
                 return 0;
         }
 
@@ -1876,7 +2520,17 @@ void uwsgi_cache_sync_from_nodes(struct uwsgi_cache *uc) {
 			goto next;
 		}
 
-		uwsgi_hooked_parse(ub->buf, rlen, cache_sync_hook, uc);
+		struct cache_sync_layout csl;
+		memset(&csl, 0, sizeof(struct cache_sync_layout));
+		csl.uc = uc;
+		uwsgi_hooked_parse(ub->buf, rlen, cache_sync_hook, &csl);
+		// items would end in the wrong stripes
+		if (cache_layout_check(uc, csl.stripes, csl.hashsize)) {
+			uwsgi_log("[cache-sync] invalid cache stripes layout, expected stripes=%llu (hashsize %llu) received stripes=%llu (hashsize %llu)\n",
+				(unsigned long long) uc->stripes, (unsigned long long) uc->hashsize,
+				(unsigned long long) (csl.stripes ? csl.stripes : 1), (unsigned long long) csl.hashsize);
+			exit(1);
+		}
 
 		if (uwsgi_read_nb(fd, (char *) uc->items, uc->filesize, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) {
 			uwsgi_buffer_destroy(ub);
@@ -1885,8 +2539,9 @@ void uwsgi_cache_sync_from_nodes(struct uwsgi_cache *uc) {
 			goto next;
                 }
 
+		cache_layout_save(uc);
 		// reset the hashtable
-		memset(uc->hashtable, 0, sizeof(uint64_t) * UMAX16);
+		memset(uc->hashtable, 0, sizeof(uint64_t) * uc->hashsize);
 		// re-fill the hashtable
                 uwsgi_cache_fix(uc);
 
@@ -145,6 +145,11 @@ int event_queue_add_fd_read(int eq, int fd) {
 	pthread_mutex_unlock(&upe->lock);
 	return ret;
 }
+
+// no exclusive wakeups on this engine: losers get EAGAIN on accept()
+int event_queue_add_fd_read_exclusive(int eq, int fd) {
+	return event_queue_add_fd_read(eq, fd);
+}
 int event_queue_add_fd_write(int eq, int fd) {
         struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
@@ -359,6 +364,11 @@ int event_queue_add_fd_read(int eq, int fd) {
 	return 0;
 }
 
+// no exclusive wakeups on this engine: losers get EAGAIN on accept()
+int event_queue_add_fd_read_exclusive(int eq, int fd) {
+	return event_queue_add_fd_read(eq, fd);
+}
+
 int event_queue_add_fd_write(int eq, int fd) {
 
 	if (port_associate(eq, PORT_SOURCE_FD, fd, POLLOUT, (void *)((long) eq))) {
@@ -524,6 +534,26 @@ int event_queue_add_fd_read(int eq, int fd) {
 	return 0;
 }
 
+// when the same fd is monitored by multiple queues, wake up only one of them
+int event_queue_add_fd_read_exclusive(int eq, int fd) {
+#ifdef EPOLLEXCLUSIVE
+	struct epoll_event ee;
+
+	memset(&ee, 0, sizeof(struct epoll_event));
+	ee.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ee.data.fd = fd;
+
+	if (epoll_ctl(eq, EPOLL_CTL_ADD, fd, &ee)) {
+		uwsgi_error("epoll_ctl()");
+		return -1;
+	}
+
+	return 0;
+#else
+	return event_queue_add_fd_read(eq, fd);
+#endif
+}
+
 int event_queue_fd_write_to_read(int eq, int fd) {
 
 	struct epoll_event ee;
@@ -867,6 +897,11 @@ int event_queue_add_fd_read(int eq, int fd) {
 	return 0;
 }
 
+// no exclusive wakeups on this engine: losers get EAGAIN on accept()
+int event_queue_add_fd_read_exclusive(int eq, int fd) {
+	return event_queue_add_fd_read(eq, fd);
+}
+
 int event_queue_add_fd_write(int eq, int fd) {
 
 	struct kevent kev;
@@ -108,6 +108,7 @@ void uwsgi_init_default() {
 	uwsgi.cheaper_overload = 3;
 
 	uwsgi.log_master_bufsize = 8192;
+	uwsgi.req_log_ring_drain = 10;
 
 	uwsgi.worker_reload_mercy = 60;
 
@@ -302,6 +303,10 @@ void uwsgi_commandline_config() {
 
 void uwsgi_setup_workers() {
 	int i, j;
+	// the vars index is at least twice the number of vars (keeping the load factor <= 0.5)
+	uwsgi.var_index_size = 1;
+	while(uwsgi.var_index_size < (uint32_t) uwsgi.vec_size) uwsgi.var_index_size <<= 1;
+
 	// allocate shared memory for workers + master
 	uwsgi.workers = (struct uwsgi_worker *) uwsgi_calloc_shared(sizeof(struct uwsgi_worker) * (uwsgi.numproc + 1));
 
@@ -317,9 +322,18 @@ void uwsgi_setup_workers() {
 		// add 4 bytes for uwsgi header
 		void *buffers = uwsgi_malloc_shared((uwsgi.buffer_size+4) * uwsgi.cores);
 		void *hvec = uwsgi_malloc_shared(sizeof(struct iovec) * uwsgi.vec_size * uwsgi.cores);
+		// the vars index is private to each process
+		uint16_t *var_index = uwsgi_malloc(sizeof(uint16_t) * uwsgi.var_index_size * uwsgi.cores);
 		void *post_buf = NULL;
 		if (uwsgi.post_buffering > 0)
 			post_buf = uwsgi_malloc_shared(uwsgi.post_buffering_bufsize * uwsgi.cores);
+		struct uwsgi_histogram *histograms = NULL;
+		if (uwsgi.stats_histograms)
+			histograms = uwsgi_calloc_shared(sizeof(struct uwsgi_histogram) * UWSGI_HISTOGRAMS * uwsgi.cores);
+		// request log records are produced only by workers
+		char *req_log_rings = NULL;
+		if (uwsgi.req_log_ring_size > 0 && i > 0)
+			req_log_rings = uwsgi_calloc_shared((sizeof(struct uwsgi_log_ring) + uwsgi.req_log_ring_size) * uwsgi.cores);
 
 
 		for (j = 0; j < uwsgi.cores; j++) {
@@ -329,8 +343,13 @@ void uwsgi_setup_workers() {
 			uwsgi.workers[i].cores[j].buffer = buffers + ((uwsgi.buffer_size+4) * j);
 			// iovec for uwsgi vars
 			uwsgi.workers[i].cores[j].hvec = hvec + ((sizeof(struct iovec) * uwsgi.vec_size) * j);
+			uwsgi.workers[i].cores[j].var_index = var_index + (uwsgi.var_index_size * j);
 			if (post_buf)
 				uwsgi.workers[i].cores[j].post_buf = post_buf + (uwsgi.post_buffering_bufsize * j);
+			if (histograms)
+				uwsgi.workers[i].cores[j].histograms = histograms + (UWSGI_HISTOGRAMS * j);
+			if (req_log_rings)
+				uwsgi.workers[i].cores[j].req_log_ring = (struct uwsgi_log_ring *) (req_log_rings + ((sizeof(struct uwsgi_log_ring) + uwsgi.req_log_ring_size) * j));
 		}
 
 		// master does not need to following steps...
@@ -346,6 +365,9 @@ void uwsgi_setup_workers() {
 	if (uwsgi.post_buffering > 0) {
 		total_memory += (uwsgi.post_buffering_bufsize * uwsgi.cores);
 	}
+	if (uwsgi.req_log_ring_size > 0) {
+		total_memory += ((sizeof(struct uwsgi_log_ring) + uwsgi.req_log_ring_size) * uwsgi.cores);
+	}
 
 	total_memory *= (uwsgi.numproc + uwsgi.master_process);
 	if (uwsgi.numproc > 0)
@@ -449,6 +471,18 @@ void sanitize_args() {
 		exit(1);
 	}
 
+	if (uwsgi.req_log_ring_size > 0) {
+		// rings are indexed with a mask
+		uint64_t ring_size = 4096;
+		while(ring_size < uwsgi.req_log_ring_size) ring_size <<= 1;
+		uwsgi.req_log_ring_size = ring_size;
+		if (uwsgi.req_log_ring_drain <= 0) {
+			uwsgi.req_log_ring_drain = 10;
+		}
+		// rings are drained by a thread, so all of the log dispatching must be serialized
+		uwsgi.threaded_logger = 1;
+	}
+
 	/* here we try to choose if thunder lock is a good thing */
 #ifdef UNBIT
 	if (uwsgi.numproc > 1 && !uwsgi.map_socket) {
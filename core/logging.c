@@ -568,6 +568,70 @@ logit:
 	uwsgi.logit(wsgi_req);
 }
 
+static void uwsgi_log_ring_copy_in(struct uwsgi_log_ring *ring, uint64_t pos, char *buf, size_t len) {
+	uint64_t mask = uwsgi.req_log_ring_size - 1;
+	size_t offset = pos & mask;
+	size_t chunk = uwsgi.req_log_ring_size - offset;
+	if (chunk > len) chunk = len;
+	memcpy(ring->data + offset, buf, chunk);
+	if (chunk < len) {
+		memcpy(ring->data, buf + chunk, len - chunk);
+	}
+}
+
+static void uwsgi_log_ring_copy_out(struct uwsgi_log_ring *ring, uint64_t pos, char *buf, size_t len) {
+	uint64_t mask = uwsgi.req_log_ring_size - 1;
+	size_t offset = pos & mask;
+	size_t chunk = uwsgi.req_log_ring_size - offset;
+	if (chunk > len) chunk = len;
+	memcpy(buf, ring->data + offset, chunk);
+	if (chunk < len) {
+		memcpy(buf + chunk, ring->data, len - chunk);
+	}
+}
+
+/*
+	request log records are written in the core ring (if available), the worker never blocks:
+	when the ring is full the record is dropped and accounted in the overflow counter
+*/
+static ssize_t uwsgi_req_log_writev(struct wsgi_request *wsgi_req, struct iovec *iov, int iovcnt) {
+	struct uwsgi_log_ring *ring = NULL;
+	if (uwsgi.req_log_ring_size > 0 && uwsgi.mywid > 0) {
+		ring = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].req_log_ring;
+	}
+	if (!ring) {
+		return writev(uwsgi.req_log_fd, iov, iovcnt);
+	}
+
+	int i;
+	size_t len = 0;
+	for(i=0;i<iovcnt;i++) {
+		len += iov[i].iov_len;
+	}
+
+	uint64_t head = ring->head;
+	__sync_synchronize();
+	uint64_t used = head - ring->tail;
+	if (len > UINT32_MAX || used + 4 + len > uwsgi.req_log_ring_size) {
+		ring->overflows++;
+		return -1;
+	}
+
+	uint32_t record_len = len;
+	uwsgi_log_ring_copy_in(ring, head, (char *) &record_len, 4);
+	uint64_t pos = head + 4;
+	for(i=0;i<iovcnt;i++) {
+		if (iov[i].iov_len == 0) continue;
+		uwsgi_log_ring_copy_in(ring, pos, iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
+	}
+	ring->records++;
+	// the record must be completely written before publishing it
+	__sync_synchronize();
+	ring->head = pos;
+	return len;
+}
+
 void uwsgi_logit_simple(struct wsgi_request *wsgi_req) {
 
 	// optimize this (please)
@@ -667,7 +731,7 @@ void uwsgi_logit_simple(struct wsgi_request *wsgi_req) {
 	logvec[logvecpos].iov_len = rlen;
 
 	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, logvec, logvecpos + 1);
+	rlen = uwsgi_req_log_writev(wsgi_req, logvec, logvecpos + 1);
 }
 
 void get_memusage(uint64_t * rss, uint64_t * vsz) {
@@ -808,6 +872,7 @@ void uwsgi_register_logger(char *name, ssize_t(*func) (struct uwsgi_logger *, ch
 
 	ul->name = name;
 	ul->func = func;
+	ul->func_batch = NULL;
 	ul->next = NULL;
 	ul->configured = 0;
 	ul->fd = -1;
@@ -820,6 +885,16 @@ void uwsgi_register_logger(char *name, ssize_t(*func) (struct uwsgi_logger *, ch
 #endif
 }
 
+// attach a batch function to an already registered logger
+void uwsgi_register_logger_batch(char *name, ssize_t(*func) (struct uwsgi_logger *, struct iovec *, size_t)) {
+	struct uwsgi_logger *ul = uwsgi_get_logger(name);
+	if (!ul) {
+		uwsgi_log("unable to find logger %s\n", name);
+		exit(1);
+	}
+	ul->func_batch = func;
+}
+
 void uwsgi_append_logger(struct uwsgi_logger *ul) {
 
 	if (!uwsgi.choosen_logger) {
@@ -931,7 +1006,7 @@ void uwsgi_logit_lf(struct wsgi_request *wsgi_req) {
 	}
 
 	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, uwsgi.logvectors[wsgi_req->async_id], uwsgi.logformat_vectors);
+	rlen = uwsgi_req_log_writev(wsgi_req, uwsgi.logvectors[wsgi_req->async_id], uwsgi.logformat_vectors);
 
 	// free allocated memory
 	logchunk = uwsgi.logchunks;
@@ -1328,66 +1403,107 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 	}
 }
 
-int uwsgi_master_log(void) {
-
-        ssize_t rlen = read(uwsgi.shared->worker_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
-        if (rlen > 0) {
+static void uwsgi_master_log_dispatch(char *buf, ssize_t rlen) {
 #ifdef UWSGI_PCRE
-                uwsgi_alarm_log_check(uwsgi.log_master_buf, rlen);
-                struct uwsgi_regexp_list *url = uwsgi.log_drain_rules;
+        uwsgi_alarm_log_check(buf, rlen);
+        struct uwsgi_regexp_list *url = uwsgi.log_drain_rules;
+        while (url) {
+                if (uwsgi_regexp_match(url->pattern, url->pattern_extra, buf, rlen) >= 0) {
+                        return;
+                }
+                url = url->next;
+        }
+        if (uwsgi.log_filter_rules) {
+                int show = 0;
+                url = uwsgi.log_filter_rules;
                 while (url) {
-                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                return 0;
+                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, buf, rlen) >= 0) {
+                                show = 1;
+                                break;
                         }
                         url = url->next;
                 }
-                if (uwsgi.log_filter_rules) {
-                        int show = 0;
-                        url = uwsgi.log_filter_rules;
-                        while (url) {
-                                if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                        show = 1;
-                                        break;
-                                }
-                                url = url->next;
-                        }
-                        if (!show)
-                                return 0;
-                }
+                if (!show)
+                        return;
+        }
 
-                url = uwsgi.log_route;
-                int finish = 0;
-                while (url) {
-                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
-                                if (ul_route) {
-                                        ul_route->func(ul_route, uwsgi.log_master_buf, rlen);
-                                        finish = 1;
-                                }
+        url = uwsgi.log_route;
+        int finish = 0;
+        while (url) {
+                if (uwsgi_regexp_match(url->pattern, url->pattern_extra, buf, rlen) >= 0) {
+                        struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
+                        if (ul_route) {
+                                ul_route->func(ul_route, buf, rlen);
+                                finish = 1;
                         }
-                        url = url->next;
                 }
-                if (finish)
-                        return 0;
+                url = url->next;
+        }
+        if (finish)
+                return;
 #endif
 
-                int raw_log = 1;
+        int raw_log = 1;
 
-                struct uwsgi_logger *ul = uwsgi.choosen_logger;
-                while (ul) {
-                        // check for named logger
-                        if (ul->id) {
-                                goto next;
-                        }
-                        ul->func(ul, uwsgi.log_master_buf, rlen);
-                        raw_log = 0;
+        struct uwsgi_logger *ul = uwsgi.choosen_logger;
+        while (ul) {
+                // check for named logger
+                if (ul->id) {
+                        goto next;
+                }
+                ul->func(ul, buf, rlen);
+                raw_log = 0;
 next:
-                        ul = ul->next;
+                ul = ul->next;
+        }
+
+        if (raw_log) {
+                rlen = write(uwsgi.original_log_fd, buf, rlen);
+        }
+}
+
+static void uwsgi_master_req_log_dispatch(char *buf, ssize_t rlen) {
+#ifdef UWSGI_PCRE
+        struct uwsgi_regexp_list *url = uwsgi.log_req_route;
+        int finish = 0;
+        while (url) {
+                if (uwsgi_regexp_match(url->pattern, url->pattern_extra, buf, rlen) >= 0) {
+                        struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
+                        if (ul_route) {
+                                ul_route->func(ul_route, buf, rlen);
+                                finish = 1;
+                        }
                 }
+                url = url->next;
+        }
+        if (finish)
+                return;
+#endif
+
+        int raw_log = 1;
 
-                if (raw_log) {
-                        rlen = write(uwsgi.original_log_fd, uwsgi.log_master_buf, rlen);
+        struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
+        while (ul) {
+                // check for named logger
+                if (ul->id) {
+                        goto next;
                 }
+                ul->func(ul, buf, rlen);
+                raw_log = 0;
+next:
+                ul = ul->next;
+        }
+
+        if (raw_log) {
+                rlen = write(uwsgi.original_log_fd, buf, rlen);
+        }
+}
+
+int uwsgi_master_log(void) {
+
+        ssize_t rlen = read(uwsgi.shared->worker_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
+        if (rlen > 0) {
+                uwsgi_master_log_dispatch(uwsgi.log_master_buf, rlen);
                 return 0;
         }
 
@@ -1398,44 +1514,131 @@ int uwsgi_master_req_log(void) {
 
         ssize_t rlen = read(uwsgi.shared->worker_req_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
         if (rlen > 0) {
+                uwsgi_master_req_log_dispatch(uwsgi.log_master_buf, rlen);
+                return 0;
+        }
+
+        return -1;
+}
+
+/*
+	deliver a batch of request log records drained from a ring
+
+	without request log routes (that need to check every single record) the whole batch
+	is passed to the loggers in one shot (func_batch) or written with a single writev()
+*/
+static void uwsgi_master_req_log_batch(struct iovec *iov, size_t cnt) {
+        size_t i;
+        // request logs without a request logger go to the main one
+        if (!uwsgi.req_log_master) {
+                for(i=0;i<cnt;i++) {
+                        uwsgi_master_log_dispatch(iov[i].iov_base, iov[i].iov_len);
+                }
+                return;
+        }
+
 #ifdef UWSGI_PCRE
-                struct uwsgi_regexp_list *url = uwsgi.log_req_route;
-                int finish = 0;
-                while (url) {
-                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
-                                if (ul_route) {
-                                        ul_route->func(ul_route, uwsgi.log_master_buf, rlen);
-                                        finish = 1;
-                                }
-                        }
-                        url = url->next;
+        if (uwsgi.log_req_route) {
+                for(i=0;i<cnt;i++) {
+                        uwsgi_master_req_log_dispatch(iov[i].iov_base, iov[i].iov_len);
                 }
-                if (finish)
-                        return 0;
+                return;
+        }
 #endif
 
-                int raw_log = 1;
-
-                struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
-                while (ul) {
-                        // check for named logger
-                        if (ul->id) {
-                                goto next;
+        int raw_log = 1;
+        struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
+        while (ul) {
+                // check for named logger
+                if (ul->id) {
+                        goto next;
+                }
+                if (ul->func_batch) {
+                        ul->func_batch(ul, iov, cnt);
+                }
+                else {
+                        for(i=0;i<cnt;i++) {
+                                ul->func(ul, iov[i].iov_base, iov[i].iov_len);
                         }
-                        ul->func(ul, uwsgi.log_master_buf, rlen);
-                        raw_log = 0;
-next:
-                        ul = ul->next;
                 }
+                raw_log = 0;
+next:
+                ul = ul->next;
+        }
+
+        if (raw_log) {
+                ssize_t rlen = writev(uwsgi.original_log_fd, iov, cnt);
+                (void) rlen;
+        }
+}
+
+#define UWSGI_LOG_RING_BATCH 256
+
+// move up to UWSGI_LOG_RING_BATCH records from the ring to buf
+static size_t uwsgi_log_ring_drain(struct uwsgi_log_ring *ring, char *buf, struct iovec *iov) {
+        uint64_t head = ring->head;
+        __sync_synchronize();
+        uint64_t tail = ring->tail;
+        size_t cnt = 0;
+        size_t pos = 0;
+        while (tail < head && cnt < UWSGI_LOG_RING_BATCH) {
+                uint32_t record_len = 0;
+                uwsgi_log_ring_copy_out(ring, tail, (char *) &record_len, 4);
+                uwsgi_log_ring_copy_out(ring, tail + 4, buf + pos, record_len);
+                iov[cnt].iov_base = buf + pos;
+                iov[cnt].iov_len = record_len;
+                pos += record_len;
+                tail += 4 + record_len;
+                cnt++;
+        }
+        if (cnt > 0) {
+                // release the space before dispatching the batch
+                __sync_synchronize();
+                ring->tail = tail;
+        }
+        return cnt;
+}
+
+static void *req_log_rings_loop(void *noarg) {
+        // block all signals
+        sigset_t smask;
+        sigfillset(&smask);
+        pthread_sigmask(SIG_BLOCK, &smask, NULL);
 
-                if (raw_log) {
-                        rlen = write(uwsgi.original_log_fd, uwsgi.log_master_buf, rlen);
+        // a batch can never be bigger than a whole ring
+        char *buf = uwsgi_malloc(uwsgi.req_log_ring_size);
+        struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * UWSGI_LOG_RING_BATCH);
+        // last reported value of the overflow counters
+        uint64_t *overflows = uwsgi_calloc(sizeof(uint64_t) * uwsgi.numproc * uwsgi.cores);
+
+        for (;;) {
+                int i, j;
+                size_t drained = 0;
+                for (i = 1; i <= uwsgi.numproc; i++) {
+                        for (j = 0; j < uwsgi.cores; j++) {
+                                struct uwsgi_log_ring *ring = uwsgi.workers[i].cores[j].req_log_ring;
+                                if (!ring) continue;
+                                size_t cnt = uwsgi_log_ring_drain(ring, buf, iov);
+                                if (cnt > 0) {
+                                        pthread_mutex_lock(&uwsgi.threaded_logger_lock);
+                                        uwsgi_master_req_log_batch(iov, cnt);
+                                        pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
+                                        drained += cnt;
+                                }
+                                uint64_t *last_overflows = &overflows[((i - 1) * uwsgi.cores) + j];
+                                if (ring->overflows != *last_overflows) {
+                                        uwsgi_log("[uwsgi-logger] request log ring of worker %d core %d is full: %llu records dropped\n", i, j, (unsigned long long) (ring->overflows - *last_overflows));
+                                        *last_overflows = ring->overflows;
+                                }
+                        }
+                }
+                // nothing to do, wait for new records
+                if (!drained) {
+                        usleep(uwsgi.req_log_ring_drain * 1000);
                 }
-                return 0;
         }
 
-        return -1;
+        return NULL;
 }
 
 static void *logger_thread_loop(void *noarg) {
@@ -1484,12 +1687,27 @@ void uwsgi_threaded_logger_spawn() {
 
 	if (pthread_create(&logger_thread, NULL, logger_thread_loop, NULL)) {
         	uwsgi_error("pthread_create()");
+		// the rings drain thread shares the loggers with the logger thread (under its lock)
+		if (uwsgi.req_log_ring_size > 0) {
+			uwsgi_log("unable to spawn the threaded logger required by the request log rings\n");
+			exit(1);
+		}
                 uwsgi_log("falling back to non-threaded logger...\n");
                 event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_log_pipe[0]);
                 if (uwsgi.req_log_master) {
                 	event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_req_log_pipe[0]);
                 }
                 uwsgi.threaded_logger = 0;
+		return;
+	}
+
+	// spawned only when the logger thread is running
+	if (uwsgi.req_log_ring_size > 0) {
+		pthread_t req_log_rings_thread;
+		if (pthread_create(&req_log_rings_thread, NULL, req_log_rings_loop, NULL)) {
+			uwsgi_error("pthread_create()");
+			exit(1);
+		}
 	}
 }
 
@@ -125,6 +125,8 @@ void *simple_loop_run(void *arg1) {
 	int main_queue = event_queue_init();
 
 	uwsgi_add_sockets_to_queue(main_queue, core_id);
+	// persistent (puwsgi) connections are monitored here too
+	uwsgi.workers[uwsgi.mywid].cores[core_id].queue = main_queue;
 
 	if (uwsgi.signal_socket > -1) {
 		event_queue_add_fd_read(main_queue, uwsgi.signal_socket);
@@ -405,7 +405,11 @@ int master_loop(char **argv, char **environ) {
 			uwsgi.stats_fd = bind_to_unix(uwsgi.stats, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
 		}
 
-		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.stats_fd);
+		// the stats server runs in its own thread
+		if (!uwsgi_thread_new(uwsgi_stats_server_loop)) {
+			uwsgi_log("!!! unable to spawn the stats server thread !!!\n");
+			exit(1);
+		}
 		uwsgi_log("*** Stats server enabled on %s fd: %d ***\n", uwsgi.stats, uwsgi.stats_fd);
 	}
 
@@ -430,6 +434,8 @@ int master_loop(char **argv, char **environ) {
 
 	uwsgi.snmp_fd = uwsgi_setup_snmp();
 
+	uwsgi_metrics_start_collector();
+
 	if (uwsgi.status.is_cheap) {
 		uwsgi_add_sockets_to_queue(uwsgi.master_queue, -1);
 		for (i = 1; i <= uwsgi.numproc; i++) {
@@ -18,14 +18,6 @@ int uwsgi_master_manage_events(int interesting_fd) {
 		}
 	}
 
-	// stats server ?
-	if (uwsgi.stats && uwsgi.stats_fd > -1) {
-		if (interesting_fd == uwsgi.stats_fd) {
-			uwsgi_send_stats(uwsgi.stats_fd, uwsgi_master_generate_stats);
-			return 0;
-		}
-	}
-
 	// a zerg connection ?
 	if (uwsgi.zerg_server) {
 		if (interesting_fd == uwsgi.zerg_server_fd) {
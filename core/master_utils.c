@@ -646,11 +646,33 @@ int uwsgi_respawn_worker(int wid) {
 	return 0;
 }
 
+static int uwsgi_stats_histograms(struct uwsgi_stats *us, struct uwsgi_histogram *histograms) {
+	if (uwsgi_stats_key(us, "histograms"))
+		return -1;
+	if (uwsgi_stats_object_open(us))
+		return -1;
+	if (uwsgi_stats_histogram(us, "rt", &histograms[UWSGI_HISTOGRAM_RT]))
+		return -1;
+	if (uwsgi_stats_comma(us))
+		return -1;
+	if (uwsgi_stats_histogram(us, "response_size", &histograms[UWSGI_HISTOGRAM_SIZE]))
+		return -1;
+	return uwsgi_stats_object_close(us);
+}
+
 struct uwsgi_stats *uwsgi_master_generate_stats() {
+	return uwsgi_master_fill_stats(uwsgi_stats_new(8192));
+}
+
+// fill the stats document (frees it on error)
+struct uwsgi_stats *uwsgi_master_fill_stats(struct uwsgi_stats *us) {
 
 	int i;
 
-	struct uwsgi_stats *us = uwsgi_stats_new(8192);
+	// histograms are merged by the master (per-worker and instance-wide)
+	struct uwsgi_histogram total_histograms[UWSGI_HISTOGRAMS];
+	struct uwsgi_histogram worker_histograms[UWSGI_HISTOGRAMS];
+	memset(total_histograms, 0, sizeof(total_histograms));
 
 	if (uwsgi_stats_keyval_comma(us, "version", UWSGI_VERSION))
 		goto end;
@@ -784,18 +806,87 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			if (uwsgi_stats_keylong_comma(us, "blocksize", (unsigned long long) uc->blocksize))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "items", (unsigned long long) uc->n_items))
+			if (uwsgi_stats_keylong_comma(us, "items", (unsigned long long) uwsgi_cache_n_items(uc)))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) uc->hits))
+			if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) uwsgi_cache_hits(uc)))
 				goto end;
 
-			if (uwsgi_stats_keylong_comma(us, "miss", (unsigned long long) uc->miss))
+			if (uwsgi_stats_keylong_comma(us, "miss", (unsigned long long) uwsgi_cache_miss(uc)))
 				goto end;
 
 			if (uwsgi_stats_keylong_comma(us, "full", (unsigned long long) uc->full))
 				goto end;
 
+			if (uwsgi_stats_keylong_comma(us, "evictions", (unsigned long long) uc->evictions))
+				goto end;
+
+			if (uc->blocks_bitmap) {
+				uint64_t histogram[UWSGI_CACHE_FREE_RUNS_BUCKETS];
+				uint64_t largest_free_run = 0;
+				uint64_t free_blocks = uwsgi_cache_free_runs(uc, histogram, &largest_free_run);
+
+				if (uwsgi_stats_keylong_comma(us, "free_blocks", (unsigned long long) free_blocks))
+					goto end;
+
+				if (uwsgi_stats_keylong_comma(us, "largest_free_run", (unsigned long long) largest_free_run))
+					goto end;
+
+				// the key of each bucket is the minimum run length it counts
+				if (uwsgi_stats_key(us, "free_runs"))
+					goto end;
+				if (uwsgi_stats_object_open(us))
+					goto end;
+				int j;
+				for(j=0;j<UWSGI_CACHE_FREE_RUNS_BUCKETS;j++) {
+					char bucket[sizeof(UMAX64_STR)+1];
+					snprintf(bucket, sizeof(UMAX64_STR)+1, "%llu", 1LLU << j);
+					if (uwsgi_stats_keylong(us, bucket, (unsigned long long) histogram[j]))
+						goto end;
+					if (j < UWSGI_CACHE_FREE_RUNS_BUCKETS-1) {
+						if (uwsgi_stats_comma(us))
+							goto end;
+					}
+				}
+				if (uwsgi_stats_object_close(us))
+					goto end;
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+
+			if (uc->stripes > 1) {
+				if (uwsgi_stats_key(us, "stripes"))
+					goto end;
+				if (uwsgi_stats_list_open(us))
+					goto end;
+				uint64_t j;
+				for(j=0;j<uc->stripes;j++) {
+					struct uwsgi_cache_stripe *st = &uc->stripe[j];
+					if (uwsgi_stats_object_open(us))
+						goto end;
+					if (uwsgi_stats_keylong_comma(us, "items", (unsigned long long) st->n_items))
+						goto end;
+					if (uwsgi_stats_keylong_comma(us, "lock_waits", (unsigned long long) st->lock_waits))
+						goto end;
+					if (uwsgi_stats_keylong_comma(us, "lock_wait_time", (unsigned long long) st->lock_wait_time))
+						goto end;
+					if (uwsgi_stats_keylong_comma(us, "optimistic_reads", (unsigned long long) st->optimistic_reads))
+						goto end;
+					if (uwsgi_stats_keylong(us, "optimistic_retries", (unsigned long long) st->optimistic_retries))
+						goto end;
+					if (uwsgi_stats_object_close(us))
+						goto end;
+					if (j < uc->stripes-1) {
+						if (uwsgi_stats_comma(us))
+							goto end;
+					}
+				}
+				if (uwsgi_stats_list_close(us))
+					goto end;
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+
 			if (uwsgi_stats_keylong(us, "last_modified_at", (unsigned long long) uc->last_modified_at))
 				goto end;
 
@@ -816,6 +907,116 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		goto end;
 	}
 
+	if (uwsgi.metrics) {
+		if (uwsgi_stats_key(us, "metrics"))
+			goto end;
+
+		if (uwsgi_stats_list_open(us))
+			goto end;
+
+		struct uwsgi_metric *um = uwsgi.metrics;
+		while(um) {
+			if (uwsgi_stats_object_open(us))
+				goto end;
+
+			if (uwsgi_stats_keyval_comma(us, "name", um->name))
+				goto end;
+
+			if (um->oid) {
+				if (uwsgi_stats_keyval_comma(us, "oid", um->oid))
+					goto end;
+			}
+
+			char *type = "counter";
+			if (um->type == UWSGI_METRIC_GAUGE) type = "gauge";
+			else if (um->type == UWSGI_METRIC_ABSOLUTE) type = "absolute";
+			if (uwsgi_stats_keyval_comma(us, "type", type))
+				goto end;
+
+			if (uwsgi_stats_keyslong(us, "value", (long long) uwsgi_metric_value(um)))
+				goto end;
+
+			if (uwsgi_stats_object_close(us))
+				goto end;
+
+			um = um->next;
+			if (um) {
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+		}
+
+		if (uwsgi_stats_list_close(us))
+			goto end;
+
+		if (uwsgi_stats_comma(us))
+			goto end;
+	}
+
+#ifdef UWSGI_ROUTING
+	if (uwsgi.routes || uwsgi.error_routes || uwsgi.final_routes) {
+		if (uwsgi_stats_key(us, "routes"))
+			goto end;
+
+		if (uwsgi_stats_list_open(us))
+			goto end;
+
+		struct uwsgi_route *tables[] = { uwsgi.routes, uwsgi.error_routes, uwsgi.final_routes };
+		char *tables_names[] = { "request", "error", "final" };
+		int first = 1;
+		for(i=0;i<3;i++) {
+			struct uwsgi_route *ur = tables[i];
+			while(ur) {
+				if (ur->label) goto nextroute;
+				if (!first) {
+					if (uwsgi_stats_comma(us))
+						goto end;
+				}
+				first = 0;
+
+				if (uwsgi_stats_object_open(us))
+					goto end;
+
+				if (uwsgi_stats_keyval_comma(us, "table", tables_names[i]))
+					goto end;
+
+				if (uwsgi_stats_keylong_comma(us, "rule", (unsigned long long) ur->pos))
+					goto end;
+
+				if (ur->subject_str) {
+					if (uwsgi_stats_keyval_comma(us, "subject", ur->subject_str))
+						goto end;
+				}
+
+				if (ur->regexp) {
+					if (uwsgi_stats_keyval_comma(us, "regexp", ur->regexp))
+						goto end;
+				}
+
+				if (uwsgi_stats_keyval_comma(us, "action", ur->action))
+					goto end;
+
+				if (uwsgi_stats_keylong_comma(us, "indexed", (unsigned long long) (ur->table ? 1 : 0)))
+					goto end;
+
+				if (uwsgi_stats_keylong(us, "hits", (unsigned long long) uwsgi_route_hits(ur)))
+					goto end;
+
+				if (uwsgi_stats_object_close(us))
+					goto end;
+nextroute:
+				ur = ur->next;
+			}
+		}
+
+		if (uwsgi_stats_list_close(us))
+			goto end;
+
+		if (uwsgi_stats_comma(us))
+			goto end;
+	}
+#endif
+
 	if (uwsgi_stats_key(us, "sockets"))
 		goto end;
 
@@ -929,14 +1130,31 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		if (uwsgi_stats_keylong_comma(us, "avg_rt", (unsigned long long) uwsgi.workers[i + 1].avg_response_time))
 			goto end;
 
+		int j;
+
+		if (uwsgi.stats_histograms) {
+			memset(worker_histograms, 0, sizeof(worker_histograms));
+			for (j = 0; j < uwsgi.cores; j++) {
+				int k;
+				for (k = 0; k < UWSGI_HISTOGRAMS; k++) {
+					uwsgi_histogram_merge(&worker_histograms[k], &uwsgi.workers[i + 1].cores[j].histograms[k]);
+				}
+			}
+			for (j = 0; j < UWSGI_HISTOGRAMS; j++) {
+				uwsgi_histogram_merge(&total_histograms[j], &worker_histograms[j]);
+			}
+			if (uwsgi_stats_histograms(us, worker_histograms))
+				goto end;
+			if (uwsgi_stats_comma(us))
+				goto end;
+		}
+
 		// applications list
 		if (uwsgi_stats_key(us, "apps"))
 			goto end;
 		if (uwsgi_stats_list_open(us))
 			goto end;
 
-		int j;
-
 		for (j = 0; j < uwsgi.workers[i + 1].apps_cnt; j++) {
 			struct uwsgi_app *ua = &uwsgi.workers[i + 1].apps[j];
 
@@ -1007,12 +1225,29 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			if (uwsgi_stats_keylong_comma(us, "offloaded_requests", (unsigned long long) uc->offloaded_requests))
 				goto end;
 
+			if (uwsgi_stats_keylong_comma(us, "single_syscall_responses", (unsigned long long) uc->single_syscall_responses))
+				goto end;
+
 			if (uwsgi_stats_keylong_comma(us, "write_errors", (unsigned long long) uc->write_errors))
 				goto end;
 
+			if (uc->req_log_ring) {
+				if (uwsgi_stats_keylong_comma(us, "req_log_records", (unsigned long long) uc->req_log_ring->records))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "req_log_overflows", (unsigned long long) uc->req_log_ring->overflows))
+					goto end;
+			}
+
 			if (uwsgi_stats_keylong_comma(us, "in_request", (unsigned long long) uc->in_request))
 				goto end;
 
+			if (uc->histograms) {
+				if (uwsgi_stats_histograms(us, uc->histograms))
+					goto end;
+				if (uwsgi_stats_comma(us))
+					goto end;
+			}
+
 			if (uwsgi_stats_key(us, "vars"))
 				goto end;
 
@@ -1049,6 +1284,13 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 	if (uwsgi_stats_list_close(us))
 		goto end;
 
+	if (uwsgi.stats_histograms) {
+		if (uwsgi_stats_comma(us))
+			goto end;
+		if (uwsgi_stats_histograms(us, total_histograms))
+			goto end;
+	}
+
 	struct uwsgi_spooler *uspool = uwsgi.spoolers;
 	if (uspool) {
 		if (uwsgi_stats_comma(us))
@@ -1,3 +1,7 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
 /*
 
 	uWSGI metrics subsystem
@@ -25,10 +29,10 @@
 
 	both 32 and 64bit, both signed and unsigned
 
-	metrics are managed by a dedicated thread (in the master) holding a linked list of all the items. For few metrics it is a good (read: simple) approach,
-	but you can cache lookups in a uWSGI cache for really big list.
+	metrics are managed by a dedicated thread (in the master) holding a linked list of all the items. Lookups by name use a little hashtable,
+	as they can happen for every request (see the routing actions below).
 
-	struct uwsgi_metric *um = uwsgi_register_metric("worker.1.requests", "3.1.1", UWSGI_METRIC_COUNTER, UWSGI_METRIC_PTR, &uwsgi.workers[1].requests, 0, NULL);
+	struct uwsgi_metric *um = uwsgi_register_metric("worker.1.requests", "3.1.1", UWSGI_METRIC_COUNTER, UWSGI_METRIC_PTR, &uwsgi.workers[1].requests, 1, NULL);
 	prototype: struct uwsgi_metric *uwsgi_register_metric(char *name, char *oid, uint8_t value_type, uint8_t collect_way, void *ptr, uint32_t freq, void *custom);
 
 	value_type = UWSGI_METRIC_COUNTER/UWSGI_METRIC_GAUGE/UWSGI_METRIC_ABSOLUTE
@@ -36,6 +40,8 @@
 
 	when freq is zero the value is recomputed whenever requested, otherwise the metrics thread compute it every time the frequency is elapsed and caches it
 
+	metrics must be registered before forking workers (their values are allocated in shared memory)
+
 	For some metric (or all ?) you may want to hold a value even after a server reload. For such a reason you can specify a directory on wich the server (on startup/restart) will look for
 	a file named like the metric and will read the initial value from it. It may look an old-fashioned and quite inefficient way, but it is the most versatile for a sysadmin (allowing him/her
 	to even modify the values manually)
@@ -52,10 +58,12 @@
 
 	and obviously they can get values:
 
-	uwsgi.metric_get("worker.1.requests", no_cache|force=False)
-	if the second parameter is True, the value is recomputed (but if it is a metric with a cache, the cache value will not be updated accordingly, this is the job of the metric thread)
+	uwsgi.metric_get("worker.1.requests")
 
-	Updating metrics from your app MUST BE ATOMIC, for such a reason a uWSGI rwlock is initialized on startup and used for each operation (simple reading from a metric does not require locking)
+	Only MANUAL metrics can be updated (the others would be overwritten by the collector).
+
+	Updating metrics from your app MUST BE ATOMIC: values live in a shared memory area and are updated with atomic operations
+	(gcc builtins) so no lock is needed, and simple reading from a metric does not require locking.
 
 	Metrics can be updated from the internal routing subsystem too:
 
@@ -67,72 +75,469 @@
 
 */
 
-struct uwsgi_metric {
-	char *name;
-	char *oid;
+// metrics values are allocated in shared memory pages, so they can be updated by every process
+static int64_t *uwsgi_metric_slot() {
+	if (!uwsgi.metrics_slots_free) {
+		uwsgi.metrics_slots = uwsgi_calloc_shared(uwsgi.page_size);
+		uwsgi.metrics_slots_free = uwsgi.page_size / sizeof(int64_t);
+	}
+	uwsgi.metrics_slots_free--;
+	return uwsgi.metrics_slots++;
+}
+
+// build the snmp representation of the oid (each part is encoded in base 128)
+static int uwsgi_metric_build_asn(struct uwsgi_metric *um) {
+	char *ptr = um->oid;
+	// a 64bit part needs at most 10 bytes
+	um->asn = uwsgi_malloc(strlen(um->oid) * 10);
+	um->asn_len = 0;
+	while(*ptr) {
+		char *end = NULL;
+		unsigned long long part = strtoull(ptr, &end, 10);
+		if (end == ptr) return -1;
+		uint8_t tmp[10];
+		int i = 0;
+		do {
+			tmp[i++] = part & 0x7f;
+			part >>= 7;
+		} while(part);
+		while(i > 0) {
+			i--;
+			um->asn[um->asn_len++] = tmp[i] | (i ? 0x80 : 0);
+		}
+		if (*end == '.') {
+			end++;
+			if (!*end) return -1;
+		}
+		else if (*end) {
+			return -1;
+		}
+		ptr = end;
+	}
+	return 0;
+}
 
-	// pre-computed snmp representation
-	char *asn;
-	size_t asn_size;
+static int64_t uwsgi_metric_read_file(char *filename) {
+	char buf[64];
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return 0;
+	ssize_t rlen = read(fd, buf, 63);
+	close(fd);
+	if (rlen <= 0) return 0;
+	buf[rlen] = 0;
+	return strtoll(buf, NULL, 10);
+}
 
-	// ABSOLUTE/COUNTER/GAUGE
-	uint8_t type;
+static void uwsgi_metric_store(struct uwsgi_metric *um, int64_t value) {
+	char *filename = uwsgi_concat3(uwsgi.metrics_dir, "/", um->name);
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (fd < 0) {
+		uwsgi_error_open(filename);
+		free(filename);
+		return;
+	}
+	free(filename);
+	char *num = uwsgi_64bit2str(value);
+	if (write(fd, num, strlen(num)) < 0) {
+		uwsgi_error("uwsgi_metric_store()/write()");
+	}
+	else {
+		um->stored_value = value;
+		um->stored = 1;
+	}
+	free(num);
+	close(fd);
+}
 
-	// MANUAL/PTR/FUNC/FILE
-	uint8_t collect_way
+static int64_t uwsgi_metric_collect(struct uwsgi_metric *um) {
+	switch(um->collect_way) {
+		case UWSGI_METRIC_PTR:
+			return um->initial_value + *um->ptr;
+		case UWSGI_METRIC_FUNC:
+			return um->initial_value + um->collector(um);
+		case UWSGI_METRIC_FILE:
+			return um->initial_value + uwsgi_metric_read_file(um->filename);
+		default:
+			break;
+	}
+	return *um->value;
+}
 
-	// this could be taken from a file storage and must laways be added to value when reporting (default 0)
-	int64_t initial_value;
-	// the value of the metric (point to a shared memory area)
-	*int64_t value;
+struct uwsgi_metric *uwsgi_register_metric(char *name, char *oid, uint8_t value_type, uint8_t collect_way, void *ptr, uint32_t freq, void *custom) {
+	struct uwsgi_metric *um = uwsgi_metric_find_by_name(name);
+
+	// a new metric
+	if (!um) {
+		um = uwsgi_calloc(sizeof(struct uwsgi_metric));
+		um->name = name;
+		um->name_len = strlen(name);
+		um->value = uwsgi_metric_slot();
+
+		if (!uwsgi.metrics_hashtable) {
+			uwsgi.metrics_hashtable = uwsgi_calloc(sizeof(struct uwsgi_metric *) * UWSGI_METRICS_HASHSIZE);
+		}
+		uint32_t slot = djb33x_hash(name, um->name_len) % UWSGI_METRICS_HASHSIZE;
+		um->hash_next = uwsgi.metrics_hashtable[slot];
+		uwsgi.metrics_hashtable[slot] = um;
+
+		struct uwsgi_metric *old_metric = uwsgi.metrics;
+		if (!old_metric) {
+			uwsgi.metrics = um;
+		}
+		else {
+			while(old_metric->next) {
+				old_metric = old_metric->next;
+			}
+			old_metric->next = um;
+		}
+		uwsgi.metrics_cnt++;
+	}
+	// overwrite the old one
+	else {
+		if (um->asn) free(um->asn);
+		um->asn = NULL;
+		um->asn_len = 0;
+		um->collector = NULL;
+		um->ptr = NULL;
+		um->filename = NULL;
+	}
 
-	// a custom blob you can attach to a metric
-	void *custom;
+	um->oid = oid;
+	um->type = value_type;
+	um->collect_way = collect_way;
+	um->freq = freq;
+	um->custom = custom;
+	um->last_update = 0;
 
-	// the collection frequency
-	uint32_t freq;
-	time_t last_update;
+	switch(collect_way) {
+		case UWSGI_METRIC_PTR:
+			um->ptr = (int64_t *) ptr;
+			break;
+		case UWSGI_METRIC_FUNC:
+			um->collector = (int64_t (*)(struct uwsgi_metric *)) ptr;
+			break;
+		case UWSGI_METRIC_FILE:
+			um->filename = (char *) ptr;
+			break;
+		default:
+			break;
+	}
 
-	// run this function to collect the value
-	int64_t (*collector)(struct uwsgi_metric *);
-	// take the value from this pointer to a 64bit value
-	int64_t *ptr;
-	// get the initial value from this file, and store each update in it
-	char *filename;
+	if (um->oid && uwsgi_metric_build_asn(um)) {
+		uwsgi_log("invalid oid \"%s\" for metric \"%s\"\n", um->oid, um->name);
+		exit(1);
+	}
 
-	struct uwsgi_metric *next;
-};
+	um->initial_value = 0;
+	if (uwsgi.metrics_dir && uwsgi.metrics_dir_restore) {
+		char *filename = uwsgi_concat3(uwsgi.metrics_dir, "/", um->name);
+		um->initial_value = uwsgi_metric_read_file(filename);
+		free(filename);
+	}
+	*um->value = um->collect_way == UWSGI_METRIC_MANUAL ? um->initial_value : uwsgi_metric_collect(um);
 
-struct uwsgi_metric *uwsgi_register_metric(char *name, char *oid, uint8_t value_type, uint8_t collect_way, void *ptr, uint32_t freq, void *custom) {
-	struct uwsgi_metric *old_metric=NULL,*metric=uwsgi.metric;
+	return um;
+}
 
-	while(metric) {
-		metric = metric->next;
+struct uwsgi_metric *uwsgi_metric_find_by_namen(char *name, size_t len) {
+	if (!uwsgi.metrics_hashtable) return NULL;
+	struct uwsgi_metric *um = uwsgi.metrics_hashtable[djb33x_hash(name, len) % UWSGI_METRICS_HASHSIZE];
+	while(um) {
+		if (!uwsgi_strncmp(um->name, um->name_len, name, len)) {
+			return um;
+		}
+		um = um->hash_next;
 	}
+	return NULL;
 }
 
-void uwsgi_metric_loop() {
-	// every second scan the whole metrics tree
-	time_t now = uwsgi_now();
+struct uwsgi_metric *uwsgi_metric_find_by_name(char *name) {
+	return uwsgi_metric_find_by_namen(name, strlen(name));
 }
 
-int64_t uwsgi_metric_get(char *name, char *oid) {
-	struct uwsgi_metric *um = NULL;
-	if (name) {
-		um = uwsgi_metric_find_by_name(name);
+struct uwsgi_metric *uwsgi_metric_find_by_oid(char *oid) {
+	struct uwsgi_metric *um = uwsgi.metrics;
+	while(um) {
+		if (um->oid && !strcmp(um->oid, oid)) {
+			return um;
+		}
+		um = um->next;
+	}
+	return NULL;
+}
+
+struct uwsgi_metric *uwsgi_metric_find_by_asn(char *asn, size_t len) {
+	struct uwsgi_metric *um = uwsgi.metrics;
+	while(um) {
+		if (um->asn && um->asn_len == len && !memcmp(um->asn, asn, len)) {
+			return um;
+		}
+		um = um->next;
 	}
-	else if (oid) {
-		um = uwsgi_metric_find_by_oid(oid);
+	return NULL;
+}
+
+static struct uwsgi_metric *uwsgi_metric_find(char *name, char *oid) {
+	if (name) return uwsgi_metric_find_by_name(name);
+	if (oid) return uwsgi_metric_find_by_oid(oid);
+	return NULL;
+}
+
+int64_t uwsgi_metric_value(struct uwsgi_metric *um) {
+	// no frequency, recompute it
+	if (um->collect_way != UWSGI_METRIC_MANUAL && !um->freq) {
+		return uwsgi_metric_collect(um);
 	}
+	return *um->value;
+}
+
+int64_t uwsgi_metric_get(char *name, char *oid) {
+	struct uwsgi_metric *um = uwsgi_metric_find(name, oid);
 	if (!um) return 0;
+	return uwsgi_metric_value(um);
+}
 
-	//
-	switch(um->collect_way) {
-		case UWSGI_METRIC_MANUAL:
-			return um->initial_value+*um->value;
-		case UWSGI_METRIC_PTR:
-			return um->initial_value+*um->ptr;
-		case UWSGI_METRIC_FUNC:
-		case UWSGI_METRIC_FILE:
+int64_t uwsgi_metric_getn(char *name, size_t len) {
+	struct uwsgi_metric *um = uwsgi_metric_find_by_namen(name, len);
+	if (!um) return 0;
+	return uwsgi_metric_value(um);
+}
+
+/*
+	update api
+
+	values are changed with atomic operations, mul and div use a compare-and-swap loop
+*/
+
+#define UWSGI_METRIC_OP_SET	0
+#define UWSGI_METRIC_OP_INC	1
+#define UWSGI_METRIC_OP_DEC	2
+#define UWSGI_METRIC_OP_MUL	3
+#define UWSGI_METRIC_OP_DIV	4
+
+static int uwsgi_metric_update(struct uwsgi_metric *um, int op, int64_t value) {
+	if (!um || um->collect_way != UWSGI_METRIC_MANUAL) return -1;
+	int64_t old_value, new_value;
+	switch(op) {
+		case UWSGI_METRIC_OP_SET:
+			__sync_lock_test_and_set(um->value, value);
+			return 0;
+		case UWSGI_METRIC_OP_INC:
+			__sync_add_and_fetch(um->value, value);
+			return 0;
+		case UWSGI_METRIC_OP_DEC:
+			__sync_sub_and_fetch(um->value, value);
+			return 0;
+		case UWSGI_METRIC_OP_MUL:
+			do {
+				old_value = *um->value;
+				new_value = old_value * value;
+			} while(!__sync_bool_compare_and_swap(um->value, old_value, new_value));
+			return 0;
+		case UWSGI_METRIC_OP_DIV:
+			if (value == 0) return -1;
+			do {
+				old_value = *um->value;
+				new_value = old_value / value;
+			} while(!__sync_bool_compare_and_swap(um->value, old_value, new_value));
+			return 0;
+		default:
+			break;
+	}
+	return -1;
+}
+
+int uwsgi_metric_set(char *name, char *oid, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find(name, oid), UWSGI_METRIC_OP_SET, value); }
+int uwsgi_metric_inc(char *name, char *oid, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find(name, oid), UWSGI_METRIC_OP_INC, value); }
+int uwsgi_metric_dec(char *name, char *oid, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find(name, oid), UWSGI_METRIC_OP_DEC, value); }
+int uwsgi_metric_mul(char *name, char *oid, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find(name, oid), UWSGI_METRIC_OP_MUL, value); }
+int uwsgi_metric_div(char *name, char *oid, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find(name, oid), UWSGI_METRIC_OP_DIV, value); }
+
+int uwsgi_metric_setn(char *name, size_t len, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find_by_namen(name, len), UWSGI_METRIC_OP_SET, value); }
+int uwsgi_metric_incn(char *name, size_t len, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find_by_namen(name, len), UWSGI_METRIC_OP_INC, value); }
+int uwsgi_metric_decn(char *name, size_t len, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find_by_namen(name, len), UWSGI_METRIC_OP_DEC, value); }
+int uwsgi_metric_muln(char *name, size_t len, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find_by_namen(name, len), UWSGI_METRIC_OP_MUL, value); }
+int uwsgi_metric_divn(char *name, size_t len, int64_t value) { return uwsgi_metric_update(uwsgi_metric_find_by_namen(name, len), UWSGI_METRIC_OP_DIV, value); }
+
+// the collector thread (running in the master)
+static void *uwsgi_metrics_loop(void *arg) {
+	// block all signals
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+
+	// every second scan the whole metrics list
+	for(;;) {
+		time_t now = uwsgi_now();
+		struct uwsgi_metric *um = uwsgi.metrics;
+		while(um) {
+			if (um->collect_way != UWSGI_METRIC_MANUAL && um->freq > 0 && now - um->last_update >= um->freq) {
+				// aligned 64bit stores are atomic
+				*um->value = uwsgi_metric_collect(um);
+				um->last_update = now;
+			}
+			if (uwsgi.metrics_dir) {
+				int64_t value = uwsgi_metric_value(um);
+				if (!um->stored || um->stored_value != value) {
+					uwsgi_metric_store(um, value);
+				}
+			}
+			um = um->next;
+		}
+		sleep(1);
+	}
+
+	return NULL;
+}
+
+void uwsgi_metrics_start_collector() {
+	if (!uwsgi.has_metrics) return;
+	pthread_t t;
+	if (pthread_create(&t, NULL, uwsgi_metrics_loop, NULL)) {
+		uwsgi_error("pthread_create()");
+		uwsgi_log("unable to run the metrics collector !!!\n");
+		return;
+	}
+	uwsgi_log("metrics collector thread started\n");
+}
+
+static int64_t uwsgi_metric_collector_worker_exceptions(struct uwsgi_metric *um) {
+	return (int64_t) uwsgi_worker_exceptions((int) (long) um->custom);
+}
+
+static void uwsgi_metric_register_ptr(uint8_t type, void *ptr, char *fmt_name, char *fmt_oid, int wid, int cid) {
+	char name[128];
+	char oid[128];
+	if (cid < 0) {
+		snprintf(name, 128, fmt_name, wid);
+		snprintf(oid, 128, fmt_oid, wid);
+	}
+	else {
+		snprintf(name, 128, fmt_name, wid, cid);
+		snprintf(oid, 128, fmt_oid, wid, cid);
+	}
+	uwsgi_register_metric(uwsgi_str(name), uwsgi_str(oid), type, UWSGI_METRIC_PTR, ptr, 1, NULL);
+}
+
+static void uwsgi_metrics_add_custom() {
+	struct uwsgi_string_list *usl = uwsgi.additional_metrics;
+	for(;usl;usl = usl->next) {
+		char *m_name = NULL;
+		char *m_oid = NULL;
+		char *m_type = NULL;
+		char *m_collector = NULL;
+		char *m_freq = NULL;
+		char *m_arg1 = NULL;
+
+		// --metric foobar is a simple manual counter
+		if (!strchr(usl->value, '=')) {
+			uwsgi_register_metric(usl->value, NULL, UWSGI_METRIC_COUNTER, UWSGI_METRIC_MANUAL, NULL, 0, NULL);
+			continue;
+		}
+
+		if (uwsgi_kvlist_parse(usl->value, usl->len, ',', '=',
+			"name", &m_name,
+			"oid", &m_oid,
+			"type", &m_type,
+			"collector", &m_collector,
+			"freq", &m_freq,
+			"arg1", &m_arg1,
+			NULL)) {
+			uwsgi_log("invalid metric syntax: %s\n", usl->value);
+			exit(1);
+		}
+
+		if (!m_name) {
+			uwsgi_log("you need to specify a metric name: %s\n", usl->value);
+			exit(1);
+		}
+
+		uint8_t type = UWSGI_METRIC_COUNTER;
+		if (m_type) {
+			if (!strcmp(m_type, "gauge")) {
+				type = UWSGI_METRIC_GAUGE;
+			}
+			else if (!strcmp(m_type, "absolute")) {
+				type = UWSGI_METRIC_ABSOLUTE;
+			}
+			else if (strcmp(m_type, "counter")) {
+				uwsgi_log("invalid metric type: %s\n", m_type);
+				exit(1);
+			}
+		}
+
+		uint8_t collect_way = UWSGI_METRIC_MANUAL;
+		uint32_t freq = 0;
+		if (m_collector) {
+			if (!strcmp(m_collector, "file")) {
+				collect_way = UWSGI_METRIC_FILE;
+				if (!m_arg1) {
+					uwsgi_log("the \"file\" metric collector requires the filename in arg1: %s\n", usl->value);
+					exit(1);
+				}
+				freq = 1;
+			}
+			else if (strcmp(m_collector, "manual")) {
+				uwsgi_log("invalid metric collector: %s\n", m_collector);
+				exit(1);
+			}
+		}
+		if (m_freq) freq = atoi(m_freq);
+
+		uwsgi_register_metric(m_name, m_oid, type, collect_way, m_arg1, freq, NULL);
+	}
+}
+
+void uwsgi_setup_metrics() {
+	int i, j;
+
+	// custom metrics and the metrics directory implicitly enable the subsystem
+	if (uwsgi.additional_metrics || uwsgi.metrics_dir) uwsgi.has_metrics = 1;
+	if (!uwsgi.has_metrics) return;
+
+	if (uwsgi.metrics_dir && !uwsgi_is_dir(uwsgi.metrics_dir)) {
+		uwsgi_log("invalid metrics directory: %s\n", uwsgi.metrics_dir);
+		exit(1);
+	}
+
+	for(i=1;i<=uwsgi.numproc;i++) {
+		struct uwsgi_worker *w = &uwsgi.workers[i];
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->requests, "worker.%d.requests", "3.%d.1", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_GAUGE, &w->delta_requests, "worker.%d.delta_requests", "3.%d.3", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->failed_requests, "worker.%d.failed_requests", "3.%d.4", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->harakiri_count, "worker.%d.harakiri_count", "3.%d.5", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->signals, "worker.%d.signals", "3.%d.6", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->respawn_count, "worker.%d.respawns", "3.%d.7", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_GAUGE, &w->avg_response_time, "worker.%d.avg_response_time", "3.%d.8", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->tx, "worker.%d.total_tx", "3.%d.9", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_GAUGE, &w->rss_size, "worker.%d.rss_size", "3.%d.10", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_GAUGE, &w->vsz_size, "worker.%d.vsz_size", "3.%d.11", i, -1);
+		uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &w->running_time, "worker.%d.running_time", "3.%d.12", i, -1);
+
+		char buf[128];
+		snprintf(buf, 128, "worker.%d.exceptions", i);
+		char *name = uwsgi_str(buf);
+		snprintf(buf, 128, "3.%d.13", i);
+		uwsgi_register_metric(name, uwsgi_str(buf), UWSGI_METRIC_COUNTER, UWSGI_METRIC_FUNC, uwsgi_metric_collector_worker_exceptions, 1, (void *) (long) i);
+
+		if (uwsgi.metrics_no_cores) continue;
+
+		for(j=0;j<uwsgi.cores;j++) {
+			struct uwsgi_core *uc = &w->cores[j];
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->requests, "worker.%d.core.%d.requests", "3.%d.2.%d.1", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->static_requests, "worker.%d.core.%d.static_requests", "3.%d.2.%d.2", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->routed_requests, "worker.%d.core.%d.routed_requests", "3.%d.2.%d.3", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->offloaded_requests, "worker.%d.core.%d.offloaded_requests", "3.%d.2.%d.4", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->write_errors, "worker.%d.core.%d.write_errors", "3.%d.2.%d.5", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->exceptions, "worker.%d.core.%d.exceptions", "3.%d.2.%d.6", i, j);
+			uwsgi_metric_register_ptr(UWSGI_METRIC_COUNTER, &uc->single_syscall_responses, "worker.%d.core.%d.single_syscall_responses", "3.%d.2.%d.7", i, j);
+		}
+	}
+
+	uwsgi_metrics_add_custom();
+
+	uwsgi_log("initialized %llu metrics\n", (unsigned long long) uwsgi.metrics_cnt);
+	if (uwsgi.metrics_dir) {
+		uwsgi_log("metrics collector will store values in %s\n", uwsgi.metrics_dir);
 	}
 }
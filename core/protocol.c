@@ -636,8 +636,10 @@ int uwsgi_parse_vars(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->uri_len > 0) {
 		wsgi_req->parsed = 1;
 		i = uwsgi_simple_parse_vars(wsgi_req, ptrbuf, bufferend);
-		if (i == 0)
+		if (i == 0) {
+			uwsgi_var_index_build(wsgi_req);
 			goto next;
+		}
 		return i;
 	}
 
@@ -690,6 +692,7 @@ int uwsgi_parse_vars(struct wsgi_request *wsgi_req) {
 						// var value
 						wsgi_req->hvec[wsgi_req->var_cnt].iov_base = ptrbuf;
 						wsgi_req->hvec[wsgi_req->var_cnt].iov_len = strsize;
+						uwsgi_var_index_add(wsgi_req, wsgi_req->var_cnt-1);
 						//uwsgi_log("%.*s = %.*s\n", wsgi_req->hvec[wsgi_req->var_cnt-1].iov_len, wsgi_req->hvec[wsgi_req->var_cnt-1].iov_base, wsgi_req->hvec[wsgi_req->var_cnt].iov_len, wsgi_req->hvec[wsgi_req->var_cnt].iov_base);
 						if (wsgi_req->var_cnt < uwsgi.vec_size - (4 + 1)) {
 							wsgi_req->var_cnt++;
@@ -1109,6 +1112,7 @@ char *uwsgi_req_append(struct wsgi_request *wsgi_req, char *key, uint16_t keylen
 	wsgi_req->hvec[wsgi_req->var_cnt].iov_base = ptr;
         wsgi_req->hvec[wsgi_req->var_cnt].iov_len = vallen;
 	wsgi_req->var_cnt++;
+	uwsgi_var_index_add(wsgi_req, wsgi_req->var_cnt-2);
 
 	wsgi_req->uh->pktsize += (2 + keylen + 2 + vallen);
 
@@ -243,6 +243,64 @@ char *uwsgi_request_body_readline(struct wsgi_request *wsgi_req, ssize_t hint, s
 
 }
 
+/*
+	read exactly "remains" bytes of request body from the socket
+
+	returns 0 on success, -1 on error and -2 on timeout
+*/
+static int uwsgi_request_body_recv(struct wsgi_request *wsgi_req, char *buf, size_t remains) {
+	int ret;
+	size_t done = 0;
+	while(remains > 0) {
+		// here we first try to read (as data could be already available)
+		ssize_t len = wsgi_req->socket->proto_read_body(wsgi_req, buf + done, remains);
+		if (len > 0) {
+			wsgi_req->post_pos+=len;
+			remains -= len;
+			done += len;
+			continue;
+		}
+		// client closed connection...
+		if (len == 0) {
+			uwsgi_read_error0(remains);
+			return -1;
+		}
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+				goto wait;
+			}
+			uwsgi_read_error(remains);
+			return -1;
+		}
+wait:
+		ret = uwsgi_wait_read_req(wsgi_req);
+        	if (ret > 0) {
+			len = wsgi_req->socket->proto_read_body(wsgi_req, buf + done, remains);
+			if (len > 0) {
+				wsgi_req->post_pos+=len;
+				remains -= len;
+                        	done += len;
+                        	continue;
+			}
+			if (len == 0) {
+				uwsgi_read_error0(remains);
+			}
+			else {
+				uwsgi_read_error(remains);
+			}
+			return -1;
+		}
+		// 0 means timeout
+		else if (ret == 0) {
+			uwsgi_read_timeout(remains);
+			return -2;
+		}
+		uwsgi_read_error(remains);
+		return -1;
+	}
+	return 0;
+}
+
 char *uwsgi_request_body_read(struct wsgi_request *wsgi_req, ssize_t hint, ssize_t *rlen) {
 
 	int ret = -1;
@@ -357,60 +415,111 @@ char *uwsgi_request_body_read(struct wsgi_request *wsgi_req, ssize_t hint, ssize
 	}
 
 	// ok read all the required bytes...
-	while(remains > 0) {
-		// here we first try to read (as data could be already available)
-		ssize_t len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_read_buf + *rlen , remains);
-		if (len > 0) {
-			wsgi_req->post_pos+=len;
-			remains -= len;
-			*rlen += len;
-			continue;
-		}
-		// client closed connection...
-		if (len == 0) {
-			*rlen = -1;
-			uwsgi_read_error0(remains);
-			return NULL;
+	ret = uwsgi_request_body_recv(wsgi_req, wsgi_req->post_read_buf + *rlen, remains);
+	if (ret) {
+		// 0 means timeout
+		*rlen = ret == -2 ? 0 : -1;
+		return NULL;
+	}
+	*rlen += remains;
+
+	return wsgi_req->post_read_buf;
+}
+
+/*
+	read up to "len" bytes of request body directly in the caller memory
+	(no intermediate allocation, useful for big uploads)
+
+	returns the number of bytes read (0 at the end of the body), -1 on error and -2 on timeout
+*/
+ssize_t uwsgi_request_body_readinto(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+
+	size_t done = 0;
+
+	// residual data from readline()
+	if (wsgi_req->post_readline_pos > 0) {
+		size_t avail = UMIN(len, wsgi_req->post_readline_watermark - wsgi_req->post_readline_pos);
+		memcpy(buf, wsgi_req->post_readline_buf + wsgi_req->post_readline_pos, avail);
+		wsgi_req->post_readline_pos += avail;
+		if (wsgi_req->post_readline_pos >= wsgi_req->post_readline_watermark) {
+			wsgi_req->post_readline_pos = 0;
+			wsgi_req->post_readline_watermark = 0;
 		}
-		if (len < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
-				goto wait;
-			}
-			*rlen = -1;
-			uwsgi_read_error(remains);
-			return NULL;
+		done += avail;
+	}
+
+	if (wsgi_req->post_pos >= wsgi_req->post_cl) return done;
+
+	size_t remains = UMIN(len - done, wsgi_req->post_cl - wsgi_req->post_pos);
+	if (remains == 0) return done;
+
+	if (wsgi_req->post_file) {
+		if (fread(buf + done, remains, 1, wsgi_req->post_file) != 1) {
+			uwsgi_error("uwsgi_request_body_readinto()/fread()");
+			return -1;
 		}
-wait:
-		ret = uwsgi_wait_read_req(wsgi_req);
-        	if (ret > 0) {
-			len = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->post_read_buf + *rlen, remains);
-			if (len > 0) {
-				wsgi_req->post_pos+=len;
-				remains -= len;
-                        	*rlen += len;
-                        	continue;
-			}
-			*rlen = -1;
-			if (len == 0) {
-				uwsgi_read_error0(remains);
-			}
-			else {
-				uwsgi_read_error(remains);
+		wsgi_req->post_pos += remains;
+		return done + remains;
+	}
+
+	if (uwsgi.post_buffering > 0) {
+		memcpy(buf + done, wsgi_req->post_buffering_buf + wsgi_req->post_pos, remains);
+		wsgi_req->post_pos += remains;
+		return done + remains;
+	}
+
+	int ret = uwsgi_request_body_recv(wsgi_req, buf + done, remains);
+	if (ret) return ret;
+	return done + remains;
+}
+
+/*
+	return a pointer to the next (up to "hint") bytes of a buffered request body without copying them.
+
+	Memory buffered bodies are directly exposed, disk buffered ones are mmap()'ed (and unmapped at the end of the request).
+	The memory is valid only until the end of the request.
+
+	NULL is returned (with *rlen = 0) when the body is not buffered (or residual readline() data are available),
+	so the caller should fallback to uwsgi_request_body_read()
+*/
+char *uwsgi_request_body_read_nocopy(struct wsgi_request *wsgi_req, ssize_t hint, ssize_t *rlen) {
+
+	*rlen = 0;
+
+	if (!uwsgi.post_buffering || wsgi_req->post_readline_pos > 0) return NULL;
+
+	if (!wsgi_req->post_cl || wsgi_req->post_pos >= wsgi_req->post_cl) {
+		return uwsgi.empty;
+	}
+
+	size_t remains = wsgi_req->post_cl - wsgi_req->post_pos;
+	if (hint > 0 && (size_t) hint < remains) {
+		remains = hint;
+	}
+
+	if (wsgi_req->post_file) {
+		if (!wsgi_req->post_mmap) {
+			char *map = mmap(NULL, wsgi_req->post_cl, PROT_READ, MAP_SHARED, fileno(wsgi_req->post_file), 0);
+			if (map == MAP_FAILED) {
+				uwsgi_error("uwsgi_request_body_read_nocopy()/mmap()");
+				return NULL;
 			}
-			return NULL;
+			wsgi_req->post_mmap = map;
 		}
-		// 0 means timeout
-		else if (ret == 0) {
-			*rlen = 0;
-			uwsgi_read_timeout(remains);
-			return NULL;
+		char *buf = wsgi_req->post_mmap + wsgi_req->post_pos;
+		wsgi_req->post_pos += remains;
+		// keep the file position in sync for read()/readline()
+		if (fseek(wsgi_req->post_file, wsgi_req->post_pos, SEEK_SET)) {
+			uwsgi_error("uwsgi_request_body_read_nocopy()/fseek()");
 		}
-		*rlen = -1;
-		uwsgi_read_error(remains);
-		return NULL;
+		*rlen = remains;
+		return buf;
 	}
 
-	return wsgi_req->post_read_buf;
+	char *buf = wsgi_req->post_buffering_buf + wsgi_req->post_pos;
+	wsgi_req->post_pos += remains;
+	*rlen = remains;
+	return buf;
 }
 
 /*
@@ -150,6 +150,172 @@ error:
 	return NULL;
 }
 
+/*
+
+	route dispatch tables
+
+	a rule whose regexp is anchored and has no metacharacters (like "^/foo$" or "^/static/")
+	is compiled to a literal (exact or prefix) and matched with memcmp.
+
+	consecutive literal rules on the same subject are grouped in a block indexed by an hash table
+	(exact matches) and by a list of distinct prefix sizes (prefix matches):
+	when the walker reaches a block it directly jumps to the first rule (from the current position)
+	that can match, so the order of the rules and the goto/label semantics are preserved.
+
+*/
+
+#define UWSGI_ROUTE_TABLE_SIZE 256
+
+struct uwsgi_route_table_item {
+	char *key;
+	size_t keylen;
+	int prefix;
+	// ordered by position
+	struct uwsgi_route **routes;
+	uint64_t routes_cnt;
+	struct uwsgi_route_table_item *next;
+};
+
+struct uwsgi_route_table {
+	struct uwsgi_route_table_item *hashtable[UWSGI_ROUTE_TABLE_SIZE];
+	size_t *prefixes;
+	uint64_t prefixes_cnt;
+	struct uwsgi_route *last;
+};
+
+static int uwsgi_route_literal_match(struct uwsgi_route *ur, char *subject, uint16_t subject_len) {
+	// pcre does not match a NULL subject
+	if (!subject) return -1;
+	if (subject_len < ur->literal_len) return -1;
+	if (memcmp(subject, ur->literal, ur->literal_len)) return -1;
+	if (ur->literal_prefix || subject_len == ur->literal_len) return 1;
+	// "$" matches before a trailing newline too
+	if (subject_len == ur->literal_len + 1 && subject[ur->literal_len] == '\n') return 1;
+	return -1;
+}
+
+static struct uwsgi_route *uwsgi_route_table_first(struct uwsgi_route_table *urt, char *key, size_t keylen, int prefix, uint64_t pos, struct uwsgi_route *found) {
+	struct uwsgi_route_table_item *urti = urt->hashtable[djb33x_hash(key, keylen) % UWSGI_ROUTE_TABLE_SIZE];
+	while(urti) {
+		if (urti->prefix == prefix && !uwsgi_strncmp(urti->key, urti->keylen, key, keylen)) {
+			uint64_t i;
+			for(i=0;i<urti->routes_cnt;i++) {
+				struct uwsgi_route *ur = urti->routes[i];
+				if (ur->pos < pos) continue;
+				if (found && found->pos <= ur->pos) return found;
+				return ur;
+			}
+			return found;
+		}
+		urti = urti->next;
+	}
+	return found;
+}
+
+static struct uwsgi_route *uwsgi_route_table_lookup(struct uwsgi_route_table *urt, char *subject, uint16_t subject_len, uint64_t pos) {
+	struct uwsgi_route *found = NULL;
+	if (!subject) return NULL;
+	found = uwsgi_route_table_first(urt, subject, subject_len, 0, pos, found);
+	if (subject_len > 0 && subject[subject_len-1] == '\n') {
+		found = uwsgi_route_table_first(urt, subject, subject_len-1, 0, pos, found);
+	}
+	uint64_t i;
+	for(i=0;i<urt->prefixes_cnt;i++) {
+		if (urt->prefixes[i] > subject_len) break;
+		found = uwsgi_route_table_first(urt, subject, urt->prefixes[i], 1, pos, found);
+	}
+	return found;
+}
+
+static void uwsgi_route_table_add(struct uwsgi_route_table *urt, struct uwsgi_route *ur) {
+	uint32_t slot = djb33x_hash(ur->literal, ur->literal_len) % UWSGI_ROUTE_TABLE_SIZE;
+	struct uwsgi_route_table_item *urti = urt->hashtable[slot];
+	while(urti) {
+		if (urti->prefix == ur->literal_prefix && !uwsgi_strncmp(urti->key, urti->keylen, ur->literal, ur->literal_len)) {
+			goto found;
+		}
+		urti = urti->next;
+	}
+	urti = uwsgi_calloc(sizeof(struct uwsgi_route_table_item));
+	urti->key = ur->literal;
+	urti->keylen = ur->literal_len;
+	urti->prefix = ur->literal_prefix;
+	urti->next = urt->hashtable[slot];
+	urt->hashtable[slot] = urti;
+
+	if (ur->literal_prefix) {
+		// keep prefix sizes unique and sorted
+		uint64_t i;
+		for(i=0;i<urt->prefixes_cnt;i++) {
+			if (urt->prefixes[i] == ur->literal_len) goto found;
+			if (urt->prefixes[i] > ur->literal_len) break;
+		}
+		urt->prefixes = realloc(urt->prefixes, sizeof(size_t) * (urt->prefixes_cnt + 1));
+		if (!urt->prefixes) {
+			uwsgi_error("uwsgi_route_table_add()/realloc()");
+			exit(1);
+		}
+		memmove(urt->prefixes + i + 1, urt->prefixes + i, sizeof(size_t) * (urt->prefixes_cnt - i));
+		urt->prefixes[i] = ur->literal_len;
+		urt->prefixes_cnt++;
+	}
+found:
+	// rules are added in order
+	urti->routes = realloc(urti->routes, sizeof(struct uwsgi_route *) * (urti->routes_cnt + 1));
+	if (!urti->routes) {
+		uwsgi_error("uwsgi_route_table_add()/realloc()");
+		exit(1);
+	}
+	urti->routes[urti->routes_cnt] = ur;
+	urti->routes_cnt++;
+	ur->table = urt;
+	urt->last = ur;
+}
+
+// check if the regexp can be matched as a literal
+static void uwsgi_route_literal(struct uwsgi_route *ur) {
+	char *re = ur->orig_route;
+	size_t len = strlen(re);
+	if (len < 1 || re[0] != '^') return;
+
+	char *literal = uwsgi_malloc(len);
+	size_t literal_len = 0;
+	int prefix = 1;
+	size_t i;
+	for(i=1;i<len;i++) {
+		char c = re[i];
+		if (c == '\\') {
+			// only escaped punctuation is a literal
+			if (i+1 >= len || isalnum((unsigned char) re[i+1])) goto nonliteral;
+			literal[literal_len++] = re[++i];
+			continue;
+		}
+		if (c == '$' && i == len-1) {
+			prefix = 0;
+			break;
+		}
+		if (strchr(".^$|?*+()[]{}", c)) goto nonliteral;
+		literal[literal_len++] = c;
+	}
+
+	ur->literal = literal;
+	ur->literal_len = literal_len;
+	ur->literal_prefix = prefix;
+	return;
+nonliteral:
+	free(literal);
+}
+
+uint64_t uwsgi_route_hits(struct uwsgi_route *ur) {
+	uint64_t hits = 0;
+	if (!ur->hits) return 0;
+	int i;
+	for(i=0;i<=uwsgi.numproc;i++) {
+		hits += ur->hits[i];
+	}
+	return hits;
+}
+
 static void uwsgi_routing_reset_memory(struct wsgi_request *wsgi_req, struct uwsgi_route *routes) {
 	// free dynamic memory structures
 	if (routes->if_func) {
@@ -207,7 +373,24 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 				subject = *subject2 ;
 				subject_len = *subject_len2;
 			}
-			n = uwsgi_regexp_match_ovec(routes->pattern, routes->pattern_extra, subject, subject_len, routes->ovector[wsgi_req->async_id], routes->ovn[wsgi_req->async_id]);
+			if (routes->table) {
+				struct uwsgi_route *ur = uwsgi_route_table_lookup(routes->table, subject, subject_len, routes->pos);
+				// no rule of the block can match, jump to its end
+				if (!ur) {
+					*r_pc += routes->table->last->pos - routes->pos;
+					routes = routes->table->last;
+					goto next;
+				}
+				*r_pc += ur->pos - routes->pos;
+				routes = ur;
+				n = 1;
+			}
+			else if (routes->literal) {
+				n = uwsgi_route_literal_match(routes, subject, subject_len);
+			}
+			else {
+				n = uwsgi_regexp_match_ovec(routes->pattern, routes->pattern_extra, subject, subject_len, routes->ovector[wsgi_req->async_id], routes->ovn[wsgi_req->async_id]);
+			}
 		}
 		else {
 			int ret = routes->if_func(wsgi_req, routes);
@@ -235,10 +418,20 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 
 run:
 		if (n >= 0) {
+			// cores of the same worker share the counter
+			__sync_fetch_and_add(&routes->hits[uwsgi.mywid], 1);
 			wsgi_req->is_routing = 1;
 			int ret = routes->func(wsgi_req, routes);
 			uwsgi_routing_reset_memory(wsgi_req, routes);
 			wsgi_req->is_routing = 0;
+			// name the transformations added by this rule (used for accounting)
+			if (wsgi_req->transformations) {
+				struct uwsgi_transformation *ut = wsgi_req->transformations;
+				while(ut) {
+					if (!ut->name) ut->name = routes->action;
+					ut = ut->next;
+				}
+			}
 			if (ret == UWSGI_ROUTE_BREAK) {
 				uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].routed_requests++;
 				return ret;
@@ -472,15 +665,43 @@ done:
 	exit(1);
 }
 
+static void uwsgi_route_table_build(struct uwsgi_route *ur, uint64_t n) {
+	struct uwsgi_route_table *urt = uwsgi_calloc(sizeof(struct uwsgi_route_table));
+	uint64_t i;
+	for(i=0;i<n;i++) {
+		uwsgi_route_table_add(urt, ur);
+		ur = ur->next;
+	}
+}
+
 void uwsgi_fixup_routes(struct uwsgi_route *ur) {
+	struct uwsgi_route *block = NULL;
+	uint64_t block_size = 0;
+	struct uwsgi_route *routes = ur;
 	while(ur) {
 		// prepare the main pointers
 		ur->ovn = uwsgi_calloc(sizeof(int) * uwsgi.cores);
 		ur->ovector = uwsgi_calloc(sizeof(int *) * uwsgi.cores);
 		ur->condition_ub = uwsgi_calloc( sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+		ur->hits = uwsgi_calloc_shared(sizeof(uint64_t) * (uwsgi.numproc + 1));
 
 		// fill them if needed... (this is an optimization for route with a static subject)
-		if (ur->subject && ur->subject_len) {
+		if (ur->subject && ur->subject_len && !ur->if_func) {
+			uwsgi_route_literal(ur);
+		}
+
+		if (ur->literal) {
+			// a block is made of consecutive literal rules on the same subject
+			if (block && block->subject == ur->subject) {
+				block_size++;
+			}
+			else {
+				if (block_size > 1) uwsgi_route_table_build(block, block_size);
+				block = ur;
+				block_size = 1;
+			}
+		}
+		else if (ur->subject && ur->subject_len) {
                 	if (uwsgi_regexp_build(ur->orig_route, &ur->pattern, &ur->pattern_extra)) {
                         	exit(1);
                 	}
@@ -493,8 +714,25 @@ void uwsgi_fixup_routes(struct uwsgi_route *ur) {
                 		}
 			}
 		}
+
+		if (!ur->literal) {
+			if (block_size > 1) uwsgi_route_table_build(block, block_size);
+			block = NULL;
+			block_size = 0;
+		}
 		ur = ur->next;
         }
+	if (block_size > 1) uwsgi_route_table_build(block, block_size);
+
+	uint64_t literals = 0, indexed = 0;
+	while(routes) {
+		if (routes->literal) literals++;
+		if (routes->table) indexed++;
+		routes = routes->next;
+	}
+	if (literals > 0) {
+		uwsgi_log("compiled %llu literal routing rules (%llu in dispatch tables)\n", (unsigned long long) literals, (unsigned long long) indexed);
+	}
 }
 
 int uwsgi_route_api_func(struct wsgi_request *wsgi_req, char *router, char *args) {
@@ -573,6 +811,69 @@ static int uwsgi_router_harakiri(struct uwsgi_route *ur, char *arg) {
 	return 0;
 }
 
+// metrics routes (metricinc/metricdec/metricset/metricmul/metricdiv name [value])
+static int uwsgi_router_metric_func(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
+	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
+	uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
+
+	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
+	if (!ub) return UWSGI_ROUTE_BREAK;
+	if (uwsgi_buffer_append(ub, "\0", 1)) {
+		uwsgi_buffer_destroy(ub);
+		return UWSGI_ROUTE_BREAK;
+	}
+
+	size_t name_len = ub->pos - 1;
+	int64_t value = 1;
+	char *space = memchr(ub->buf, ' ', name_len);
+	if (space) {
+		name_len = space - ub->buf;
+		value = strtoll(space + 1, NULL, 10);
+	}
+
+	switch(ur->custom) {
+		case 0:
+			uwsgi_metric_incn(ub->buf, name_len, value);
+			break;
+		case 1:
+			uwsgi_metric_decn(ub->buf, name_len, value);
+			break;
+		case 2:
+			uwsgi_metric_setn(ub->buf, name_len, value);
+			break;
+		case 3:
+			uwsgi_metric_muln(ub->buf, name_len, value);
+			break;
+		case 4:
+			uwsgi_metric_divn(ub->buf, name_len, value);
+			break;
+		default:
+			break;
+	}
+
+	uwsgi_buffer_destroy(ub);
+	return UWSGI_ROUTE_NEXT;
+}
+
+static int uwsgi_router_metric(struct uwsgi_route *ur, char *arg, uint64_t op) {
+	ur->func = uwsgi_router_metric_func;
+	ur->data = arg;
+	ur->data_len = strlen(arg);
+	ur->custom = op;
+	// set, mul and div have no sane default
+	if (op > 1 && !strchr(arg, ' ')) {
+		uwsgi_log("[uwsgi-route] invalid metric syntax, must be NAME VALUE\n");
+		exit(1);
+	}
+	return 0;
+}
+
+static int uwsgi_router_metricinc(struct uwsgi_route *ur, char *arg) { return uwsgi_router_metric(ur, arg, 0); }
+static int uwsgi_router_metricdec(struct uwsgi_route *ur, char *arg) { return uwsgi_router_metric(ur, arg, 1); }
+static int uwsgi_router_metricset(struct uwsgi_route *ur, char *arg) { return uwsgi_router_metric(ur, arg, 2); }
+static int uwsgi_router_metricmul(struct uwsgi_route *ur, char *arg) { return uwsgi_router_metric(ur, arg, 3); }
+static int uwsgi_router_metricdiv(struct uwsgi_route *ur, char *arg) { return uwsgi_router_metric(ur, arg, 4); }
+
 // flush response
 static int transform_flush(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
 	// avoid loops !!!
@@ -1552,6 +1853,14 @@ static char *uwsgi_route_var_time(struct wsgi_request *wsgi_req, char *key, uint
         return ret;
 }
 
+static char *uwsgi_route_var_metric(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t *vallen) {
+	struct uwsgi_metric *um = uwsgi_metric_find_by_namen(key, keylen);
+	if (!um) return NULL;
+	char *ret = uwsgi_64bit2str(uwsgi_metric_value(um));
+	*vallen = strlen(ret);
+	return ret;
+}
+
 static char *uwsgi_route_var_base64(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t *vallen) {
 	char *ret = NULL;
 	uint16_t var_vallen = 0;
@@ -1652,6 +1961,12 @@ void uwsgi_register_embedded_routers() {
 
         uwsgi_register_router("harakiri", uwsgi_router_harakiri);
 
+        uwsgi_register_router("metricinc", uwsgi_router_metricinc);
+        uwsgi_register_router("metricdec", uwsgi_router_metricdec);
+        uwsgi_register_router("metricset", uwsgi_router_metricset);
+        uwsgi_register_router("metricmul", uwsgi_router_metricmul);
+        uwsgi_register_router("metricdiv", uwsgi_router_metricdiv);
+
         uwsgi_register_route_condition("exists", uwsgi_route_condition_exists);
         uwsgi_register_route_condition("isfile", uwsgi_route_condition_isfile);
         uwsgi_register_route_condition("isdir", uwsgi_route_condition_isdir);
@@ -1699,6 +2014,9 @@ void uwsgi_register_embedded_routers() {
 
         urv = uwsgi_register_route_var("hex", uwsgi_route_var_hex);
 	urv->need_free = 1;
+
+        urv = uwsgi_register_route_var("metric", uwsgi_route_var_metric);
+	urv->need_free = 1;
 }
 
 struct uwsgi_router *uwsgi_register_router(char *name, int (*func) (struct uwsgi_route *, char *)) {
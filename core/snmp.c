@@ -22,7 +22,7 @@ static uint64_t get_uwsgi_custom_snmp_value(uint64_t, uint8_t *);
 
 static uint8_t snmp_int_to_snmp(uint64_t, uint8_t, uint8_t *);
 
-static ssize_t build_snmp_response(uint8_t, uint8_t, uint8_t *, int, uint8_t *, uint8_t *, uint8_t *);
+static ssize_t build_snmp_response(uint64_t, uint8_t, uint8_t *, int, uint8_t *, uint8_t *, uint8_t *);
 
 void manage_snmp(int fd, uint8_t * buffer, int size, struct sockaddr_in *client_addr) {
 
@@ -30,6 +30,8 @@ void manage_snmp(int fd, uint8_t * buffer, int size, struct sockaddr_in *client_
 	uint16_t oidlen;
 
 	uint8_t oid_part[2];
+	uint64_t snmp_val;
+	uint8_t oid_type;
 
 	int ptrdelta;
 
@@ -196,33 +198,53 @@ void manage_snmp(int fd, uint8_t * buffer, int size, struct sockaddr_in *client_
 	ptr++;
 
 	oidlen = *ptr;
-	if (oidlen != 11)
+	if (oidlen < 11)
 		return;
 	ptr++;
 
+	// the oid must be followed by null
+	if (ptr + oidlen + 2 > buffer + size)
+		return;
+
 	// and now parse the OID !!!
 	if (memcmp(ptr, SNMP_UWSGI_BASE, 9))
 		return;
 
 	ptr += 9;
 
-	oid_part[0] = *ptr;
+	// 1.X and 2.X are the classic uWSGI values
+	if (oidlen == 11 && (*ptr == 1 || *ptr == 2)) {
+		oid_part[0] = *ptr;
+		ptr++;
 
-	if (oid_part[0] != 1 && oid_part[0] != 2)
-		return;
-	ptr++;
+		oid_part[1] = *ptr;
+		if (oid_part[1] < 1 || oid_part[1] > 100)
+			return;
+		ptr++;
 
-	oid_part[1] = *ptr;
-	if (oid_part[1] < 1 || oid_part[1] > 100)
-		return;
-	ptr++;
+		if (oid_part[0] == 1) {
+			snmp_val = get_uwsgi_snmp_value(oid_part[1], &oid_type);
+		}
+		else {
+			snmp_val = get_uwsgi_custom_snmp_value(oid_part[1], &oid_type);
+		}
+	}
+	// metrics
+	else {
+		struct uwsgi_metric *um = uwsgi_metric_find_by_asn((char *) ptr, oidlen - 9);
+		if (!um)
+			return;
+		ptr += oidlen - 9;
+		snmp_val = (uint64_t) uwsgi_metric_value(um);
+		oid_type = um->type == UWSGI_METRIC_GAUGE ? SNMP_GAUGE : SNMP_COUNTER64;
+	}
 
 	// check for null
 	if (memcmp((char *) ptr, "\x05\x00", 2))
 		return;
 	ptr += 2;
 
-	size = build_snmp_response(oid_part[0], oid_part[1], buffer, size, seq1, seq2, seq3);
+	size = build_snmp_response(snmp_val, oid_type, buffer, size, seq1, seq2, seq3);
 
 	if (size > 0) {
 		if (sendto(fd, buffer, size, 0, (struct sockaddr *) client_addr, sizeof(struct sockaddr_in)) < 0) {
@@ -320,20 +342,8 @@ static uint8_t snmp_int_to_snmp(uint64_t snmp_val, uint8_t oid_type, uint8_t * b
 	return tlen + 1;
 }
 
-static ssize_t build_snmp_response(uint8_t oid1, uint8_t oid2, uint8_t * buffer, int size, uint8_t * seq1, uint8_t * seq2, uint8_t * seq3) {
-	uint64_t snmp_val;
+static ssize_t build_snmp_response(uint64_t snmp_val, uint8_t oid_type, uint8_t * buffer, int size, uint8_t * seq1, uint8_t * seq2, uint8_t * seq3) {
 	uint8_t oid_sz;
-	uint8_t oid_type;
-
-	if (oid1 == 1) {
-		snmp_val = get_uwsgi_snmp_value(oid2, &oid_type);
-	}
-	else if (oid1 == 2) {
-		snmp_val = get_uwsgi_custom_snmp_value(oid2, &oid_type);
-	}
-	else {
-		return -1;
-	}
 
 	buffer[size - 2] = oid_type;
 	oid_sz = snmp_int_to_snmp(snmp_val, oid_type, buffer + (size - 1));
@@ -617,7 +617,7 @@ socklen_t socket_to_in_addr(char *socket_name, char *port, int portn, struct soc
 
 }
 
-int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
+static int bind_to_tcp_do(char *socket_name, int listen_queue, char *tcp_port, int do_listen) {
 
 	int serverfd;
 #ifdef AF_INET6
@@ -757,6 +757,10 @@ int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
 		return -1;
 	}
 
+	// a reserved (bound but not listening) socket does not join the accept group
+	if (!do_listen)
+		goto end;
+
 #ifdef __linux__
 	long somaxconn = uwsgi_num_from_file("/proc/sys/net/core/somaxconn", 1);
 	if (somaxconn > 0 && uwsgi.listen_queue > somaxconn) {
@@ -772,13 +776,17 @@ int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
 		return -1;
 	}
 
-
+end:
 	if (tcp_port)
 		tcp_port[0] = ':';
 
 	return serverfd;
 }
 
+int bind_to_tcp(char *socket_name, int listen_queue, char *tcp_port) {
+	return bind_to_tcp_do(socket_name, listen_queue, tcp_port, 1);
+}
+
 // set non-blocking socket
 void uwsgi_socket_nb(int fd) {
 	int arg;
@@ -1395,6 +1403,162 @@ int uwsgi_is_bad_connection(int fd) {
 	return soopt;
 }
 
+// the cpu a shard is steered to, follows the --cpu-affinity mapping when available
+static int uwsgi_reuse_port_shard_cpu(int wid, int core) {
+	if (uwsgi.cpus < 1)
+		return 0;
+	if (uwsgi.cpu_affinity) {
+		return ((wid - 1) * uwsgi.cpu_affinity + (core % uwsgi.cpu_affinity)) % uwsgi.cpus;
+	}
+	int shards = uwsgi.threads > 1 ? uwsgi.threads : 1;
+	return ((wid - 1) * shards + core) % uwsgi.cpus;
+}
+
+static int uwsgi_reuse_port_shard_new(struct uwsgi_socket *uwsgi_sock, int wid, int core) {
+	char *tcp_port = strrchr(uwsgi_sock->name, ':');
+	if (!tcp_port)
+		return -1;
+	int fd = bind_to_tcp(uwsgi_sock->name, uwsgi.listen_queue, tcp_port);
+	if (fd < 0)
+		return -1;
+#ifdef SO_INCOMING_CPU
+	if (uwsgi.reuse_port_shard_cpu) {
+		int cpu = uwsgi_reuse_port_shard_cpu(wid, core);
+		if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(int))) {
+			uwsgi_error("uwsgi_reuse_port_shard_new()/setsockopt()");
+		}
+	}
+#endif
+	uwsgi_socket_nb(fd);
+	// shards are rebuilt by the new master on reload
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+static int uwsgi_reuse_port_shards_per_worker() {
+	return uwsgi.threads > 1 ? uwsgi.threads : 1;
+}
+
+/*
+	reuse-port sharding: the master only reserves the TCP address (bound, not listening)
+	and creates one SO_REUSEPORT listener for each worker (or for each worker thread).
+	Every worker keeps only its own listeners, so there is no thundering herd and no
+	accept serialization.
+
+	Shards are created by the master (with the same credentials used for the reserved socket,
+	so privileged ports and the SO_REUSEPORT uid check work with --uid/--gid) and they are
+	kept open by it: connections queued in the shard of a dead (or reloading) worker are
+	accepted by its replacement.
+
+	On a full reload (master re-exec) the shards are closed and rebuilt, so in that
+	window new connections are refused. Use chain/worker reloads to avoid it.
+*/
+void uwsgi_reuse_port_shards_create() {
+	if (!uwsgi.reuse_port_shard)
+		return;
+
+	int per_worker = uwsgi_reuse_port_shards_per_worker();
+
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		int listening = 0;
+		socklen_t solen = sizeof(int);
+		if (uwsgi_sock->fd < 0 || uwsgi_sock->lazy || uwsgi_sock->shared || uwsgi_sock->from_shared || uwsgi_sock->per_core || uwsgi_sock->fd_threads || uwsgi_sock->shards)
+			goto next;
+		if (uwsgi_sock->family != AF_INET
+#ifdef AF_INET6
+		    && uwsgi_sock->family != AF_INET6
+#endif
+		    )
+			goto next;
+		// only the reserved (not listening) sockets are sharded
+		if (getsockopt(uwsgi_sock->fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &solen) || listening)
+			goto next;
+
+		uwsgi_sock->shards = uwsgi_malloc(sizeof(int) * uwsgi.numproc * per_worker);
+		int i, j;
+		for (i = 0; i < uwsgi.numproc; i++) {
+			for (j = 0; j < per_worker; j++) {
+				int fd = uwsgi_reuse_port_shard_new(uwsgi_sock, i + 1, j);
+				if (fd < 0) {
+					uwsgi_log("unable to create reuse-port shard on %s\n", uwsgi_sock->name);
+					exit(1);
+				}
+				uwsgi_sock->shards[(i * per_worker) + j] = fd;
+			}
+		}
+		uwsgi_log("created %d reuse-port shards on %s\n", uwsgi.numproc * per_worker, uwsgi_sock->name);
+next:
+		uwsgi_sock = uwsgi_sock->next;
+	}
+}
+
+// called by each worker after fork: keep only its own shards
+void uwsgi_reuse_port_shards_init() {
+	if (!uwsgi.reuse_port_shard)
+		return;
+
+	int per_worker = uwsgi_reuse_port_shards_per_worker();
+	// thunder lock can be skipped only if all of the sockets are sharded
+	int all_sharded = 1;
+	int sharded = 0;
+
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		if (!uwsgi_sock->shards) {
+			if (uwsgi_sock->fd > -1 || uwsgi_sock->fd_threads)
+				all_sharded = 0;
+			goto next;
+		}
+
+		int i;
+		int base = (uwsgi.mywid - 1) * per_worker;
+		for (i = 0; i < uwsgi.numproc * per_worker; i++) {
+			if (i >= base && i < base + per_worker)
+				continue;
+			close(uwsgi_sock->shards[i]);
+		}
+
+		if (uwsgi.threads > 1) {
+			uwsgi_sock->fd_threads = uwsgi_malloc(sizeof(int) * uwsgi.threads);
+			for (i = 0; i < uwsgi.threads; i++) {
+				uwsgi_sock->fd_threads[i] = uwsgi_sock->shards[base + i];
+			}
+		}
+		else {
+			// the reserved socket is useless in the worker
+			close(uwsgi_sock->fd);
+			uwsgi_sock->fd = uwsgi_sock->shards[base];
+		}
+		free(uwsgi_sock->shards);
+		uwsgi_sock->shards = NULL;
+		uwsgi_sock->shard = 1;
+		sharded++;
+next:
+		uwsgi_sock = uwsgi_sock->next;
+	}
+
+	if (!sharded)
+		return;
+
+	uwsgi.reuse_port_sharded = all_sharded;
+	if (all_sharded)
+		return;
+
+	uwsgi.reuse_port_shard_mixed = 1;
+	uwsgi_listeners_nb();
+}
+
+// the sockets shared by the workers are accepted after an unlocked wait too, so they must not block
+void uwsgi_listeners_nb() {
+	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
+	while (uwsgi_sock) {
+		if (!uwsgi_sock->shard && uwsgi_sock->fd > -1)
+			uwsgi_socket_nb(uwsgi_sock->fd);
+		uwsgi_sock = uwsgi_sock->next;
+	}
+}
+
 int uwsgi_socket_is_already_bound(char *name) {
 	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
 	while (uwsgi_sock) {
@@ -1703,6 +1867,23 @@ void uwsgi_bind_sockets() {
 	union uwsgi_sockaddr usa;
 	union uwsgi_sockaddr_ptr gsa;
 
+	// with reuse-port sharding the master only reserves the TCP addresses, every worker will listen on its own copy
+	int tcp_listen = 1;
+	if (uwsgi.reuse_port_shard) {
+#ifdef SO_REUSEPORT
+		// a shard of a cheaped (or not yet spawned) worker would still get its share of the connections
+		if (uwsgi.status.is_cheap || uwsgi.idle > 0 || uwsgi.cheaper) {
+			uwsgi_log("reuse-port sharding is not compatible with cheap/idle/cheaper modes\n");
+			exit(1);
+		}
+		uwsgi.reuse_port = 1;
+		tcp_listen = 0;
+#else
+		uwsgi_log("reuse-port sharding requires SO_REUSEPORT support\n");
+		exit(1);
+#endif
+	}
+
 	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
 	while (uwsgi_sock) {
 		if (!uwsgi_sock->bound && !uwsgi_socket_is_already_bound(uwsgi_sock->name)) {
@@ -1718,13 +1899,13 @@ void uwsgi_bind_sockets() {
 			else {
 #ifdef AF_INET6
 				if (uwsgi_sock->name[0] == '[' && tcp_port[-1] == ']') {
-					uwsgi_sock->fd = bind_to_tcp(uwsgi_sock->name, uwsgi.listen_queue, tcp_port);
+					uwsgi_sock->fd = bind_to_tcp_do(uwsgi_sock->name, uwsgi.listen_queue, tcp_port, tcp_listen);
 					uwsgi_log("uwsgi socket %d bound to TCP6 address %s fd %d\n", uwsgi_get_socket_num(uwsgi_sock), uwsgi_sock->name, uwsgi_sock->fd);
 					uwsgi_sock->family = AF_INET6;
 				}
 				else {
 #endif
-					uwsgi_sock->fd = bind_to_tcp(uwsgi_sock->name, uwsgi.listen_queue, tcp_port);
+					uwsgi_sock->fd = bind_to_tcp_do(uwsgi_sock->name, uwsgi.listen_queue, tcp_port, tcp_listen);
 					uwsgi_log("uwsgi socket %d bound to TCP address %s fd %d\n", uwsgi_get_socket_num(uwsgi_sock), uwsgi_sock->name, uwsgi_sock->fd);
 					uwsgi_sock->family = AF_INET;
 #ifdef AF_INET6
@@ -1858,6 +2039,7 @@ setup_proto:
 			uwsgi_sock->proto_read_body = uwsgi_proto_base_read_body;
                         uwsgi_sock->proto_write = uwsgi_proto_base_write;
                         uwsgi_sock->proto_write_headers = uwsgi_proto_base_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
                         uwsgi_sock->proto_sendfile = uwsgi_proto_base_sendfile;
 			uwsgi_sock->proto_close = uwsgi_proto_base_close;
 			if (uwsgi.offload_threads > 0)
@@ -1873,6 +2055,7 @@ setup_proto:
 			uwsgi_sock->proto_read_body = uwsgi_proto_fastcgi_read_body;
                         uwsgi_sock->proto_write = uwsgi_proto_fastcgi_write;
                         uwsgi_sock->proto_write_headers = uwsgi_proto_fastcgi_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_fastcgi_writev;
                         uwsgi_sock->proto_sendfile = uwsgi_proto_fastcgi_sendfile;	
 			uwsgi_sock->proto_close = uwsgi_proto_fastcgi_close;
 		}
@@ -1885,6 +2068,7 @@ setup_proto:
                         uwsgi_sock->proto_read_body = uwsgi_proto_fastcgi_read_body;
                         uwsgi_sock->proto_write = uwsgi_proto_fastcgi_write;
                         uwsgi_sock->proto_write_headers = uwsgi_proto_fastcgi_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_fastcgi_writev;
                         uwsgi_sock->proto_sendfile = uwsgi_proto_fastcgi_sendfile;
                         uwsgi_sock->proto_close = uwsgi_proto_fastcgi_close;
                 }
@@ -1898,6 +2082,7 @@ setup_proto:
                         uwsgi_sock->proto_read_body = uwsgi_proto_base_read_body;
                         uwsgi_sock->proto_write = uwsgi_proto_base_write;
                         uwsgi_sock->proto_write_headers = uwsgi_proto_base_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
                         uwsgi_sock->proto_sendfile = uwsgi_proto_base_sendfile;
                         uwsgi_sock->proto_close = uwsgi_proto_base_close;
                 }
@@ -1911,11 +2096,30 @@ setup_proto:
                         uwsgi_sock->proto_read_body = uwsgi_proto_base_read_body;
                         uwsgi_sock->proto_write = uwsgi_proto_base_write;
                         uwsgi_sock->proto_write_headers = uwsgi_proto_base_write;
+                        uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
                         uwsgi_sock->proto_sendfile = uwsgi_proto_base_sendfile;
                         uwsgi_sock->proto_close = uwsgi_proto_base_close;
                 }
 
 
+		else if (requested_protocol && !strcmp("puwsgi", requested_protocol)) {
+			uwsgi_sock->proto = uwsgi_proto_uwsgi_parser;
+			uwsgi_sock->proto_accept = uwsgi_proto_base_accept;
+			uwsgi_sock->proto_prepare_headers = uwsgi_proto_base_prepare_headers;
+			uwsgi_sock->proto_add_header = uwsgi_proto_base_add_header;
+			uwsgi_sock->proto_fix_headers = uwsgi_proto_base_fix_headers;
+			uwsgi_sock->proto_read_body = uwsgi_proto_puwsgi_read_body;
+			uwsgi_sock->proto_write = uwsgi_proto_puwsgi_write;
+			uwsgi_sock->proto_write_headers = uwsgi_proto_puwsgi_write;
+			uwsgi_sock->proto_writev = uwsgi_proto_puwsgi_writev;
+			uwsgi_sock->proto_sendfile = uwsgi_proto_puwsgi_sendfile;
+			uwsgi_sock->proto_close = uwsgi_proto_puwsgi_close;
+			// map persistent connections to their socket
+			if (!uwsgi.persistent_sockets) {
+				uwsgi.persistent_sockets = uwsgi_calloc(sizeof(struct uwsgi_socket *) * uwsgi.max_fd);
+			}
+		}
+
 #ifdef UWSGI_ZEROMQ
 		else if (requested_protocol && !strcmp("zmq", requested_protocol)) {
 			uwsgi.zeromq = 1;
@@ -1930,6 +2134,7 @@ setup_proto:
 			uwsgi_sock->proto_read_body = uwsgi_proto_base_read_body;
 			uwsgi_sock->proto_write = uwsgi_proto_base_write;
 			uwsgi_sock->proto_write_headers = uwsgi_proto_base_write;
+			uwsgi_sock->proto_writev = uwsgi_proto_base_writev;
 			uwsgi_sock->proto_sendfile = uwsgi_proto_base_sendfile;
 			uwsgi_sock->proto_close = uwsgi_proto_base_close;
 			if (uwsgi.offload_threads > 0)
@@ -1,13 +1,288 @@
 #include "uwsgi.h"
 
+#if defined(UWSGI_EVENT_FILEMONITOR_USE_INOTIFY) && !defined(OBSOLETE_LINUX_KERNEL)
+#include <sys/inotify.h>
+#define UWSGI_SPOOLER_USE_INOTIFY
+#endif
+
 extern struct uwsgi_server uwsgi;
 
-static void spooler_readdir(struct uwsgi_spooler *, char *dir);
-#ifdef __linux__
-static void spooler_scandir(struct uwsgi_spooler *, char *dir);
-#endif
 static void spooler_manage_task(struct uwsgi_spooler *, char *, char *);
 
+/*
+
+	the spooler tasks index
+
+	the spool directory is the durable source of truth, but instead of scanning it on every cycle
+	each spooler process keeps an in-memory index of the tasks:
+
+	- the directory is fully scanned on startup (crash recovery), when the index is empty,
+	  and when inotify events are lost (or on every cycle if inotify is not available)
+	- new tasks (written by uwsgi_spooler_request() or by external tools) are added by inotify (IN_CLOSE_WRITE/IN_MOVED_TO)
+	- runnable tasks are in a binary heap ordered by priority, 'at' time (mtime) and name,
+	  tasks scheduled for the future are in a second heap ordered by 'at' time
+	- a task that is still there after being managed (re-spooled, locked...) is retried in the next cycle
+
+	every task is hashed by directory/name to avoid duplicates
+
+*/
+
+#define UWSGI_SPOOLER_HASHSIZE 65536
+
+struct spooler_dir {
+	char *path;
+	// lower values run first, tasks in the spooler directory run after the priority ones
+	uint64_t prio;
+	int wd;
+	struct spooler_dir *next;
+};
+
+struct spooler_task {
+	struct spooler_dir *dir;
+	char *name;
+	time_t at;
+	struct spooler_task *hnext;
+	struct spooler_task *next;
+};
+
+struct spooler_heap {
+	struct spooler_task **items;
+	size_t len;
+	size_t size;
+	int (*cmp) (struct spooler_task *, struct spooler_task *);
+};
+
+static int spooler_task_cmp_ready(struct spooler_task *t1, struct spooler_task *t2) {
+	if (t1->dir->prio != t2->dir->prio) return t1->dir->prio < t2->dir->prio ? -1 : 1;
+	if (t1->at != t2->at) return t1->at < t2->at ? -1 : 1;
+	return strcmp(t1->name, t2->name);
+}
+
+static int spooler_task_cmp_at(struct spooler_task *t1, struct spooler_task *t2) {
+	if (t1->at != t2->at) return t1->at < t2->at ? -1 : 1;
+	return spooler_task_cmp_ready(t1, t2);
+}
+
+static struct spooler_heap spooler_ready = { NULL, 0, 0, spooler_task_cmp_ready };
+static struct spooler_heap spooler_waiting = { NULL, 0, 0, spooler_task_cmp_at };
+static struct spooler_task *spooler_deferred = NULL;
+static struct spooler_task **spooler_hashtable = NULL;
+static struct spooler_dir *spooler_dirs = NULL;
+static struct spooler_dir *spooler_root = NULL;
+static uint64_t spooler_tasks_indexed = 0;
+static int spooler_inotify_fd = -1;
+
+static void spooler_heap_push(struct spooler_heap *sh, struct spooler_task *st) {
+	if (sh->len >= sh->size) {
+		size_t new_size = sh->size ? sh->size * 2 : 1024;
+		struct spooler_task **items = realloc(sh->items, sizeof(struct spooler_task *) * new_size);
+		if (!items) {
+			uwsgi_error("spooler_heap_push()/realloc()");
+			exit(1);
+		}
+		sh->items = items;
+		sh->size = new_size;
+	}
+	size_t pos = sh->len++;
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (sh->cmp(sh->items[parent], st) <= 0) break;
+		sh->items[pos] = sh->items[parent];
+		pos = parent;
+	}
+	sh->items[pos] = st;
+}
+
+static struct spooler_task *spooler_heap_pop(struct spooler_heap *sh) {
+	if (sh->len == 0) return NULL;
+	struct spooler_task *first = sh->items[0];
+	struct spooler_task *last = sh->items[--sh->len];
+	size_t pos = 0;
+	for (;;) {
+		size_t child = (pos * 2) + 1;
+		if (child >= sh->len) break;
+		if (child + 1 < sh->len && sh->cmp(sh->items[child + 1], sh->items[child]) < 0) child++;
+		if (sh->cmp(last, sh->items[child]) <= 0) break;
+		sh->items[pos] = sh->items[child];
+		pos = child;
+	}
+	if (sh->len > 0) sh->items[pos] = last;
+	return first;
+}
+
+static struct spooler_task **spooler_task_slot(struct spooler_dir *sd, char *name) {
+	uint32_t slot = djb33x_hash(name, strlen(name)) % UWSGI_SPOOLER_HASHSIZE;
+	struct spooler_task **st = &spooler_hashtable[slot];
+	while (*st) {
+		if ((*st)->dir == sd && !strcmp((*st)->name, name)) break;
+		st = &(*st)->hnext;
+	}
+	return st;
+}
+
+static void spooler_task_del(struct spooler_task *st) {
+	struct spooler_task **slot = spooler_task_slot(st->dir, st->name);
+	if (*slot) *slot = st->hnext;
+	free(st->name);
+	free(st);
+	spooler_tasks_indexed--;
+}
+
+static void spooler_dir_add(struct spooler_dir *, char *);
+
+static void spooler_task_add(struct spooler_dir *sd, char *name) {
+
+	int is_number = uwsgi.spooler_ordered && is_a_number(name);
+	if (strncmp("uwsgi_spoolfile_on_", name, 19) && !is_number) return;
+
+	struct spooler_task **slot = spooler_task_slot(sd, name);
+	if (*slot) return;
+
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%s/%s", sd->path, name) >= PATH_MAX) return;
+
+	struct stat sf_lstat;
+	if (lstat(path, &sf_lstat)) return;
+
+	if (S_ISDIR(sf_lstat.st_mode)) {
+		// only the spooler directory can have priorities
+		if (is_number && sd == spooler_root) spooler_dir_add(sd, name);
+		return;
+	}
+
+	if (!S_ISREG(sf_lstat.st_mode)) return;
+
+	struct spooler_task *st = uwsgi_calloc(sizeof(struct spooler_task));
+	st->dir = sd;
+	st->name = uwsgi_str(name);
+	st->at = sf_lstat.st_mtime;
+	*slot = st;
+	spooler_tasks_indexed++;
+
+	if (st->at > uwsgi_now()) {
+		spooler_heap_push(&spooler_waiting, st);
+	}
+	else {
+		spooler_heap_push(&spooler_ready, st);
+	}
+}
+
+static void spooler_dir_scan(struct spooler_dir *sd) {
+	DIR *sdir = opendir(sd->path);
+	if (!sdir) {
+		uwsgi_error("opendir()");
+		return;
+	}
+	struct dirent *dp;
+	while ((dp = readdir(sdir)) != NULL) {
+		spooler_task_add(sd, dp->d_name);
+	}
+	closedir(sdir);
+}
+
+static struct spooler_dir *spooler_dir_new(char *path, uint64_t prio) {
+	struct spooler_dir *sd = uwsgi_calloc(sizeof(struct spooler_dir));
+	sd->path = path;
+	sd->prio = prio;
+	sd->wd = -1;
+#ifdef UWSGI_SPOOLER_USE_INOTIFY
+	if (spooler_inotify_fd > -1) {
+		sd->wd = inotify_add_watch(spooler_inotify_fd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+		if (sd->wd < 0) {
+			uwsgi_error("spooler_dir_new()/inotify_add_watch()");
+		}
+	}
+#endif
+	sd->next = spooler_dirs;
+	spooler_dirs = sd;
+	return sd;
+}
+
+// add (and scan) a priority directory
+static void spooler_dir_add(struct spooler_dir *parent, char *name) {
+	char *path = uwsgi_concat3(parent->path, "/", name);
+	struct spooler_dir *sd = spooler_dirs;
+	while (sd) {
+		if (!strcmp(sd->path, path)) {
+			free(path);
+			break;
+		}
+		sd = sd->next;
+	}
+	if (!sd) {
+		sd = spooler_dir_new(path, strtoull(name, NULL, 10));
+	}
+	spooler_dir_scan(sd);
+}
+
+static void spooler_index_rescan(void) {
+	spooler_dir_scan(spooler_root);
+}
+
+#ifdef UWSGI_SPOOLER_USE_INOTIFY
+// returns 1 if a rescan is needed
+static int spooler_index_inotify(void) {
+	char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	int rescan = 0;
+	for (;;) {
+		ssize_t rlen = read(spooler_inotify_fd, buf, sizeof(buf));
+		if (rlen <= 0) break;
+		char *ptr = buf;
+		while (ptr < buf + rlen) {
+			struct inotify_event *ie = (struct inotify_event *) ptr;
+			ptr += sizeof(struct inotify_event) + ie->len;
+			if (ie->mask & IN_Q_OVERFLOW) {
+				rescan = 1;
+				continue;
+			}
+			if (!ie->len) continue;
+			struct spooler_dir *sd = spooler_dirs;
+			while (sd) {
+				if (sd->wd == ie->wd) break;
+				sd = sd->next;
+			}
+			if (!sd) continue;
+			// files are indexed only when closed (the writer keeps them locked)
+			if ((ie->mask & IN_CREATE) && !(ie->mask & IN_ISDIR)) continue;
+			spooler_task_add(sd, ie->name);
+		}
+	}
+	return rescan;
+}
+#endif
+
+// move the deferred tasks and the tasks whose time has come to the ready heap
+static void spooler_index_promote(void) {
+	while (spooler_deferred) {
+		struct spooler_task *st = spooler_deferred;
+		spooler_deferred = st->next;
+		st->next = NULL;
+		spooler_heap_push(&spooler_ready, st);
+	}
+	time_t now = uwsgi_now();
+	while (spooler_waiting.len > 0 && spooler_waiting.items[0]->at <= now) {
+		spooler_heap_push(&spooler_ready, spooler_heap_pop(&spooler_waiting));
+	}
+}
+
+static void spooler_index_init(struct uwsgi_spooler *uspool, int queue) {
+	spooler_hashtable = uwsgi_calloc(sizeof(struct spooler_task *) * UWSGI_SPOOLER_HASHSIZE);
+#ifdef UWSGI_SPOOLER_USE_INOTIFY
+	spooler_inotify_fd = inotify_init();
+	if (spooler_inotify_fd < 0) {
+		uwsgi_error("spooler_index_init()/inotify_init()");
+	}
+	else {
+		uwsgi_socket_nb(spooler_inotify_fd);
+		if (event_queue_add_fd_read(queue, spooler_inotify_fd)) {
+			close(spooler_inotify_fd);
+			spooler_inotify_fd = -1;
+		}
+	}
+#endif
+	spooler_root = spooler_dir_new(uspool->dir, UINT64_MAX);
+}
+
 // increment it whenever a signal is raised
 static uint64_t wakeup = 0;
 
@@ -348,6 +623,9 @@ void spooler(struct uwsgi_spooler *uspool) {
 	// reset the tasks counter
 	uspool->tasks = 0;
 
+	spooler_index_init(uspool, spooler_event_queue);
+	int rescan = 1;
+
 	for (;;) {
 
 
@@ -356,18 +634,44 @@ void spooler(struct uwsgi_spooler *uspool) {
 			exit(1);
 		}
 
-		if (uwsgi.spooler_ordered) {
-#ifdef __linux__
-			spooler_scandir(uspool, NULL);
-#else
-			spooler_readdir(uspool, NULL);
-#endif
+		// without inotify we cannot know about new tasks
+		if (rescan || spooler_tasks_indexed == 0 || spooler_inotify_fd < 0) {
+			spooler_index_rescan();
+			rescan = 0;
 		}
-		else {
-			spooler_readdir(uspool, NULL);
+
+		spooler_index_promote();
+
+		struct spooler_task *st = NULL;
+		while ((st = spooler_heap_pop(&spooler_ready))) {
+			if (chdir(st->dir->path)) {
+				uwsgi_error("chdir()");
+				spooler_task_del(st);
+				continue;
+			}
+			spooler_manage_task(uspool, st->dir->path, st->name);
+			// still there ? retry it in the next cycle
+			if (!access(st->name, F_OK)) {
+				st->next = spooler_deferred;
+				spooler_deferred = st;
+			}
+			else {
+				spooler_task_del(st);
+			}
+		}
+
+		if (chdir(uspool->dir)) {
+			uwsgi_error("chdir()");
+			exit(1);
 		}
 
 		int timeout = uwsgi.shared->spooler_frequency;
+		// wake up for the next task scheduled in the future
+		if (spooler_waiting.len > 0) {
+			time_t next = spooler_waiting.items[0]->at - uwsgi_now();
+			if (next < 0) next = 0;
+			if (next < timeout) timeout = next;
+		}
 		if (wakeup > 0) {
 			timeout = 0;
 		}
@@ -378,6 +682,11 @@ void spooler(struct uwsgi_spooler *uspool) {
 					uwsgi_receive_signal(interesting_fd, "spooler", (int) getpid());
 				}
 			}
+#ifdef UWSGI_SPOOLER_USE_INOTIFY
+			if (interesting_fd == spooler_inotify_fd) {
+				if (spooler_index_inotify()) rescan = 1;
+			}
+#endif
 		}
 
 		// avoid races
@@ -390,51 +699,6 @@ void spooler(struct uwsgi_spooler *uspool) {
 	}
 }
 
-#ifdef __linux__
-static void spooler_scandir(struct uwsgi_spooler *uspool, char *dir) {
-
-	struct dirent **tasklist;
-	int n, i;
-
-	if (!dir)
-		dir = uspool->dir;
-
-	n = scandir(dir, &tasklist, 0, versionsort);
-	if (n < 0) {
-		uwsgi_error("scandir()");
-		return;
-	}
-
-	for (i = 0; i < n; i++) {
-		spooler_manage_task(uspool, dir, tasklist[i]->d_name);
-		free(tasklist[i]);
-	}
-
-	free(tasklist);
-}
-#endif
-
-
-static void spooler_readdir(struct uwsgi_spooler *uspool, char *dir) {
-
-	DIR *sdir;
-	struct dirent *dp;
-
-	if (!dir)
-		dir = uspool->dir;
-
-	sdir = opendir(dir);
-	if (sdir) {
-		while ((dp = readdir(sdir)) != NULL) {
-			spooler_manage_task(uspool, dir, dp->d_name);
-		}
-		closedir(sdir);
-	}
-	else {
-		uwsgi_error("opendir()");
-	}
-}
-
 void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 
 	int i, ret;
@@ -460,21 +724,6 @@ void spooler_manage_task(struct uwsgi_spooler *uspool, char *dir, char *task) {
 			return;
 		}
 
-#ifdef __linux__
-		if (S_ISDIR(sf_lstat.st_mode) && uwsgi.spooler_ordered) {
-			if (chdir(task)) {
-				uwsgi_error("chdir()");
-				return;
-			}
-			char *prio_path = realpath(".", NULL);
-			spooler_scandir(uspool, prio_path);
-			free(prio_path);
-			if (chdir(dir)) {
-				uwsgi_error("chdir()");
-			}
-			return;
-		}
-#endif
 		if (!S_ISREG(sf_lstat.st_mode)) {
 			return;
 		}
@@ -1,21 +1,22 @@
 #include "uwsgi.h"
 
-extern struct uwsgi_server uwsgi;
+#if defined(UWSGI_EVENT_FILEMONITOR_USE_INOTIFY) && !defined(OBSOLETE_LINUX_KERNEL)
+#include <sys/inotify.h>
+#define UWSGI_STATIC_USE_INOTIFY
+#endif
 
-int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
-	// check for filename size
-	if (*filename_len + 4 > PATH_MAX) return 0;
-	// check for supported encodings
-	if (!uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) ) return 0;
+extern struct uwsgi_server uwsgi;
 
+// check if a gzip variant of the file should be searched
+static int uwsgi_static_gzip_match(char *filename, size_t filename_len) {
 	// check for 'all'
-	if (uwsgi.static_gzip_all) goto gzip;
+	if (uwsgi.static_gzip_all) return 1;
 
 	// check for dirs/prefix
 	struct uwsgi_string_list *usl = uwsgi.static_gzip_dir;
 	while(usl) {
-		if (!uwsgi_starts_with(filename, *filename_len, usl->value, usl->len)) {
-			goto gzip;
+		if (!uwsgi_starts_with(filename, filename_len, usl->value, usl->len)) {
+			return 1;
 		}
 		usl = usl->next;
 	} 
@@ -23,8 +24,8 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for ext/suffix
 	usl = uwsgi.static_gzip_ext;
         while(usl) {
-		if (!uwsgi_strncmp(filename + (*filename_len - usl->len), usl->len, usl->value, usl->len)) {
-			goto gzip;
+		if (!uwsgi_strncmp(filename + (filename_len - usl->len), usl->len, usl->value, usl->len)) {
+			return 1;
 		}
                 usl = usl->next;
         }
@@ -33,15 +34,22 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for regexp
 	struct uwsgi_regexp_list *url = uwsgi.static_gzip;
 	while(url) {
-		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, *filename_len) >= 0) {
-			goto gzip;
+		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, filename_len) >= 0) {
+			return 1;
 		}
 		url = url->next;
 	}
 #endif
 	return 0;
+}
+
+int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
+	// check for filename size
+	if (*filename_len + 4 > PATH_MAX) return 0;
+	// check for supported encodings
+	if (!uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4) ) return 0;
 
-gzip:
+	if (!uwsgi_static_gzip_match(filename, *filename_len)) return 0;
 
 	memcpy(filename + *filename_len, ".gz\0", 4);
 	*filename_len += 3;
@@ -171,34 +179,28 @@ static time_t parse_http_date(char *date, uint16_t len) {
 
 int uwsgi_add_expires_type(struct wsgi_request *wsgi_req, char *mime_type, int mime_type_len, struct stat *st) {
 
-	struct uwsgi_dyn_dict *udd = uwsgi.static_expires_type;
 	time_t now = wsgi_req->start_of_request / 1000000;
 	// 30+1
 	char expires[31];
 
-	while (udd) {
-		if (!uwsgi_strncmp(udd->key, udd->keylen, mime_type, mime_type_len)) {
-			int delta = uwsgi_str_num(udd->value, udd->vallen);
-			int size = uwsgi_http_date(now + delta, expires);
-			if (size > 0) {
-				if (uwsgi_response_add_header(wsgi_req, "Expires", 7, expires, size)) return -1;
-			}
-			return 0;
+	struct uwsgi_dyn_dict *udd = uwsgi_dyn_dict_index_get(uwsgi.static_expires_type_index, mime_type, mime_type_len);
+	if (udd) {
+		int delta = uwsgi_str_num(udd->value, udd->vallen);
+		int size = uwsgi_http_date(now + delta, expires);
+		if (size > 0) {
+			if (uwsgi_response_add_header(wsgi_req, "Expires", 7, expires, size)) return -1;
 		}
-		udd = udd->next;
+		return 0;
 	}
 
-	udd = uwsgi.static_expires_type_mtime;
-	while (udd) {
-		if (!uwsgi_strncmp(udd->key, udd->keylen, mime_type, mime_type_len)) {
-			int delta = uwsgi_str_num(udd->value, udd->vallen);
-			int size = uwsgi_http_date(st->st_mtime + delta, expires);
-			if (size > 0) {
-				if (uwsgi_response_add_header(wsgi_req, "Expires", 7, expires, size)) return -1;
-			}
-			return 0;
+	udd = uwsgi_dyn_dict_index_get(uwsgi.static_expires_type_mtime_index, mime_type, mime_type_len);
+	if (udd) {
+		int delta = uwsgi_str_num(udd->value, udd->vallen);
+		int size = uwsgi_http_date(st->st_mtime + delta, expires);
+		if (size > 0) {
+			if (uwsgi_response_add_header(wsgi_req, "Expires", 7, expires, size)) return -1;
 		}
-		udd = udd->next;
+		return 0;
 	}
 
 	return 0;
@@ -334,48 +336,13 @@ char *uwsgi_get_mime_type(char *name, int namelen, size_t *size) {
 		return NULL;
 
 
-	if (uwsgi.threads > 1)
-                pthread_mutex_lock(&uwsgi.lock_static);
-
-	struct uwsgi_dyn_dict *udd = uwsgi.mimetypes;
-	while (udd) {
-		if (!uwsgi_strncmp(ext, count, udd->key, udd->keylen)) {
-			udd->hits++;
-			// auto optimization
-			if (udd->prev) {
-				if (udd->hits > udd->prev->hits) {
-					struct uwsgi_dyn_dict *udd_parent = udd->prev->prev, *udd_prev = udd->prev;
-					if (udd_parent) {
-						udd_parent->next = udd;
-					}
-
-					if (udd->next) {
-						udd->next->prev = udd_prev;
-					}
-
-					udd_prev->prev = udd;
-					udd_prev->next = udd->next;
-
-					udd->prev = udd_parent;
-					udd->next = udd_prev;
-
-					if (udd->prev == NULL) {
-						uwsgi.mimetypes = udd;
-					}
-				}
-			}
-			*size = udd->vallen;
-			if (uwsgi.threads > 1)
-                		pthread_mutex_unlock(&uwsgi.lock_static);
-			return udd->value;
-		}
-		udd = udd->next;
-	}
-
-	if (uwsgi.threads > 1)
-        	pthread_mutex_unlock(&uwsgi.lock_static);
+	// the index is immutable after startup, no locking needed
+	struct uwsgi_dyn_dict *udd = uwsgi_dyn_dict_index_get(uwsgi.mimetypes_index, ext, count);
+	if (!udd)
+		return NULL;
 
-	return NULL;
+	*size = udd->vallen;
+	return udd->value;
 }
 
 ssize_t uwsgi_append_static_path(char *dir, size_t dir_len, char *file, size_t file_len) {
@@ -436,21 +403,34 @@ static int uwsgi_static_stat(struct wsgi_request *wsgi_req, char *filename, size
 	return -1;
 }
 
-int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
-
-	size_t mime_type_size = 0;
-	char http_last_modified[49];
-	int use_gzip = 0;
-
-	char *mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &mime_type_size);
-
-	// here we need to choose if we want the gzip variant;
-	if (uwsgi_static_want_gzip(wsgi_req, real_filename, &real_filename_len, st)) use_gzip = 1;
+// everything needed to send a static file (filled by the slow path or by the fd cache)
+struct uwsgi_static_response {
+	char *filename;
+	size_t filename_len;
+	struct stat st;
+	char *mime_type;
+	size_t mime_type_size;
+	int use_gzip;
+	// 30+1, computed on demand if empty
+	char last_modified[31];
+	int last_modified_len;
+	// -1 if the file must be opened by path
+	int fd;
+	int close_fd;
+};
+
+static int uwsgi_static_response_do(struct wsgi_request *wsgi_req, struct uwsgi_static_response *usr) {
+
+	struct stat *st = &usr->st;
+	char *real_filename = usr->filename;
+	size_t real_filename_len = usr->filename_len;
+	char *mime_type = usr->mime_type;
+	size_t mime_type_size = usr->mime_type_size;
 
 	if (wsgi_req->if_modified_since_len) {
 		time_t ims = parse_http_date(wsgi_req->if_modified_since, wsgi_req->if_modified_since_len);
 		if (st->st_mtime <= ims) {
-			uwsgi_response_prepare_headers(wsgi_req, "304 Not Modified", 16); 
+			uwsgi_response_prepare_headers(wsgi_req, "304 Not Modified", 16);
 			return uwsgi_response_write_headers_do(wsgi_req);
 		}
 	}
@@ -491,7 +471,7 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	uwsgi_add_expires_uri(wsgi_req, st);
 #endif
 
-	if (use_gzip) {
+	if (usr->use_gzip) {
 		if (uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4)) return -1;
 	}
 
@@ -505,19 +485,21 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	// increase static requests counter
 	uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].static_requests++;
 
+	if (!usr->last_modified_len) {
+		usr->last_modified_len = uwsgi_http_date(st->st_mtime, usr->last_modified);
+	}
+
 	// nginx
 	if (uwsgi.file_serve_mode == 1) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Accel-Redirect", 16, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, usr->last_modified, usr->last_modified_len)) return -1;
 	}
 	// apache
 	else if (uwsgi.file_serve_mode == 2) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Sendfile", 10, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, usr->last_modified, usr->last_modified_len)) return -1;
 	}
 	// raw
 	else {
@@ -527,8 +509,7 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 			// here use the original size !!!
 			if (uwsgi_response_add_content_range(wsgi_req, wsgi_req->range_from, wsgi_req->range_to, st->st_size)) return -1;
 		}
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, usr->last_modified, usr->last_modified_len)) return -1;
 
 		// if it is a HEAD request just skip transfer
 		if (!uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
@@ -538,95 +519,493 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 
 		// Ok, the file must be transferred from uWSGI
 		// offloading will be automatically managed
-		int fd = open(real_filename, O_RDONLY);
-		if (fd < 0) return -1;
-		// fd will be closed in the following function
-		uwsgi_response_sendfile_do(wsgi_req, fd, wsgi_req->range_from, fsize);
+		int fd = usr->fd;
+		int can_close = usr->close_fd;
+		if (fd < 0) {
+			fd = open(real_filename, O_RDONLY);
+			if (fd < 0) return -1;
+			can_close = 1;
+		}
+		// from now on the fd is owned by the sendfile subsystem
+		usr->fd = -1;
+		// fd will be closed in the following function (if allowed)
+		uwsgi_response_sendfile_do_can_close(wsgi_req, fd, wsgi_req->range_from, fsize, can_close);
 	}
 
 	wsgi_req->status = 200;
 	return 0;
 }
 
+static void uwsgi_static_response_release(struct uwsgi_static_response *usr) {
+	if (usr->close_fd && usr->fd > -1) {
+		close(usr->fd);
+		usr->fd = -1;
+	}
+}
+
+static int uwsgi_static_response(struct wsgi_request *wsgi_req, struct uwsgi_static_response *usr) {
+	int ret = uwsgi_static_response_do(wsgi_req, usr);
+	uwsgi_static_response_release(usr);
+	return ret;
+}
+
+int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
+
+	struct uwsgi_static_response usr;
+	memset(&usr, 0, sizeof(struct uwsgi_static_response));
+	usr.fd = -1;
+
+	usr.mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &usr.mime_type_size);
+
+	// here we need to choose if we want the gzip variant;
+	if (uwsgi_static_want_gzip(wsgi_req, real_filename, &real_filename_len, st)) usr.use_gzip = 1;
+
+	usr.filename = real_filename;
+	usr.filename_len = real_filename_len;
+	memcpy(&usr.st, st, sizeof(struct stat));
+
+	return uwsgi_static_response(wsgi_req, &usr);
+}
+
+/*
+	the static fd cache (--static-fd-cache)
+
+	Every worker maps the requested path (docroot + PATH_INFO) to the resolved file with its
+	open descriptor, stat data, mime type, precomputed Last-Modified value and gzip sibling.
+	A hit goes straight to the headers and to sendfile() without realpath()/stat()/open().
+
+	Items are invalidated by inotify (a watch on the directory of the resolved file) and
+	after --static-fd-cache-ttl seconds (default 2, or 1 when inotify is not available).
+	Symlinks changed above the resolved file (like the "current" link of a deploy) are only noticed by the ttl.
+
+	The cache is private to the worker, when multiple cores can use it at the same time
+	a hit returns a dup() of the descriptor, so evicting an item never breaks a transfer.
+*/
+
+struct uwsgi_static_fd_file {
+	int fd;
+	struct stat st;
+	char last_modified[31];
+	int last_modified_len;
+};
+
+struct uwsgi_static_fd_item {
+	char *key;
+	size_t key_len;
+	uint32_t hash;
+	// the resolved file, allocated with room for the .gz suffix
+	char *filename;
+	size_t filename_len;
+	struct uwsgi_string_list *index;
+	char *mime_type;
+	size_t mime_type_size;
+	struct uwsgi_static_fd_file file;
+	int has_gz;
+	struct uwsgi_static_fd_file gz;
+	time_t validated;
+	int wd;
+	struct uwsgi_static_fd_item *next;
+	// items watched by the same inotify descriptor
+	struct uwsgi_static_fd_item *wd_next;
+};
+
+struct uwsgi_static_fd_cache {
+	struct uwsgi_static_fd_item *items;
+	uint64_t used;
+	uint64_t victim;
+	struct uwsgi_static_fd_item *free;
+	struct uwsgi_static_fd_item **hashtable;
+	uint32_t mask;
+	int inotify_fd;
+	// items by inotify watch descriptor (same size of the hashtable)
+	struct uwsgi_static_fd_item **wd_hashtable;
+	pthread_mutex_t lock;
+};
+
+static struct uwsgi_static_fd_cache *static_fd_cache;
+
+#define static_fd_cache_lock if (uwsgi.threads > 1) pthread_mutex_lock(&static_fd_cache->lock)
+#define static_fd_cache_unlock if (uwsgi.threads > 1) pthread_mutex_unlock(&static_fd_cache->lock)
+
+// called by each worker (descriptors cannot be shared between processes)
+void uwsgi_static_fd_cache_init() {
+	if (!uwsgi.static_fd_cache) return;
+
+	struct uwsgi_static_fd_cache *sfc = uwsgi_calloc(sizeof(struct uwsgi_static_fd_cache));
+	uint32_t buckets = 1;
+	while (buckets < uwsgi.static_fd_cache && buckets < (1 << 24)) buckets <<= 1;
+	sfc->mask = buckets - 1;
+	sfc->hashtable = uwsgi_calloc(sizeof(struct uwsgi_static_fd_item *) * buckets);
+	sfc->items = uwsgi_calloc(sizeof(struct uwsgi_static_fd_item) * uwsgi.static_fd_cache);
+	sfc->inotify_fd = -1;
+#ifdef UWSGI_STATIC_USE_INOTIFY
+	sfc->inotify_fd = inotify_init();
+	if (sfc->inotify_fd < 0) {
+		uwsgi_error("uwsgi_static_fd_cache_init()/inotify_init()");
+	}
+	else {
+		uwsgi_socket_nb(sfc->inotify_fd);
+		sfc->wd_hashtable = uwsgi_calloc(sizeof(struct uwsgi_static_fd_item *) * buckets);
+	}
+#endif
+	pthread_mutex_init(&sfc->lock, NULL);
+	static_fd_cache = sfc;
+}
+
+static void uwsgi_static_fd_item_free(struct uwsgi_static_fd_item *item) {
+	struct uwsgi_static_fd_item **slot = &static_fd_cache->hashtable[item->hash & static_fd_cache->mask];
+	while (*slot) {
+		if (*slot == item) {
+			*slot = item->next;
+			break;
+		}
+		slot = &(*slot)->next;
+	}
+	if (item->wd > -1 && static_fd_cache->wd_hashtable) {
+		slot = &static_fd_cache->wd_hashtable[item->wd & static_fd_cache->mask];
+		while (*slot) {
+			if (*slot == item) {
+				*slot = item->wd_next;
+				break;
+			}
+			slot = &(*slot)->wd_next;
+		}
+	}
+	if (item->file.fd > -1) close(item->file.fd);
+	if (item->has_gz && item->gz.fd > -1) close(item->gz.fd);
+	free(item->key);
+	free(item->filename);
+	memset(item, 0, sizeof(struct uwsgi_static_fd_item));
+	item->next = static_fd_cache->free;
+	static_fd_cache->free = item;
+}
+
+#ifdef UWSGI_STATIC_USE_INOTIFY
+// check if an inotify event name refers to the item (or to its gzip sibling)
+static int uwsgi_static_fd_item_is(struct uwsgi_static_fd_item *item, char *name) {
+	char *base = uwsgi_get_last_charn(item->filename, item->filename_len, '/');
+	base = base ? base + 1 : item->filename;
+	size_t base_len = item->filename_len - (base - item->filename);
+	size_t name_len = strlen(name);
+	if (name_len == base_len) return !memcmp(name, base, base_len);
+	if (name_len == base_len + 3) return !memcmp(name, base, base_len) && !memcmp(name + base_len, ".gz", 3);
+	return 0;
+}
+
+// apply a block of inotify events (the cache must be locked)
+static void uwsgi_static_fd_cache_events(char *buf, ssize_t rlen) {
+	char *ptr = buf;
+	while (ptr < buf + rlen) {
+		struct inotify_event *ie = (struct inotify_event *) ptr;
+		ptr += sizeof(struct inotify_event) + ie->len;
+		// events have been lost, nothing can be trusted
+		if (ie->mask & IN_Q_OVERFLOW) {
+			uint64_t i;
+			for (i = 0; i < static_fd_cache->used; i++) {
+				struct uwsgi_static_fd_item *item = &static_fd_cache->items[i];
+				if (item->key) uwsgi_static_fd_item_free(item);
+			}
+			continue;
+		}
+		struct uwsgi_static_fd_item *item = static_fd_cache->wd_hashtable[ie->wd & static_fd_cache->mask];
+		while (item) {
+			struct uwsgi_static_fd_item *next = item->wd_next;
+			// directory indexes are invalidated by any change in the directory
+			if (item->wd == ie->wd && (!ie->len || item->index || uwsgi_static_fd_item_is(item, ie->name))) {
+				uwsgi_static_fd_item_free(item);
+			}
+			item = next;
+		}
+	}
+}
+
+// the events are read without holding the lock (the descriptor is non-blocking)
+static void uwsgi_static_fd_cache_inotify() {
+	char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t rlen = read(static_fd_cache->inotify_fd, buf, sizeof(buf));
+		if (rlen <= 0) break;
+		static_fd_cache_lock;
+		uwsgi_static_fd_cache_events(buf, rlen);
+		static_fd_cache_unlock;
+	}
+}
+#endif
+
+static struct uwsgi_static_fd_item *uwsgi_static_fd_cache_find(char *key, size_t key_len, uint32_t hash) {
+	struct uwsgi_static_fd_item *item = static_fd_cache->hashtable[hash & static_fd_cache->mask];
+	while (item) {
+		if (item->hash == hash && !uwsgi_strncmp(item->key, item->key_len, key, key_len)) {
+			return item;
+		}
+		item = item->next;
+	}
+	return NULL;
+}
+
+/*
+	fill a response from the cache, the resolved filename (followed by the ".gz" suffix when the gzip
+	variant is chosen) is copied in real_filename. Returns -1 on miss.
+*/
+static int uwsgi_static_fd_cache_get(struct wsgi_request *wsgi_req, char *key, size_t key_len, char *real_filename, size_t *real_filename_len, struct uwsgi_string_list **index, struct uwsgi_static_response *usr) {
+	uint32_t hash = djb33x_hash(key, key_len);
+	int ret = -1;
+
+#ifdef UWSGI_STATIC_USE_INOTIFY
+	if (static_fd_cache->inotify_fd > -1) {
+		uwsgi_static_fd_cache_inotify();
+	}
+#endif
+	static_fd_cache_lock;
+	struct uwsgi_static_fd_item *item = uwsgi_static_fd_cache_find(key, key_len, hash);
+	if (!item) goto end;
+
+	int ttl = uwsgi.static_fd_cache_ttl;
+	if (!ttl) ttl = item->wd < 0 ? 1 : 2;
+	if (uwsgi_now() - item->validated >= ttl) {
+		uwsgi_static_fd_item_free(item);
+		goto end;
+	}
+
+	struct uwsgi_static_fd_file *file = &item->file;
+	memset(usr, 0, sizeof(struct uwsgi_static_response));
+	memcpy(real_filename, item->filename, item->filename_len);
+	*real_filename_len = item->filename_len;
+	usr->filename_len = item->filename_len;
+	if (item->has_gz && uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4)) {
+		memcpy(real_filename + item->filename_len, ".gz", 3);
+		usr->filename_len += 3;
+		usr->use_gzip = 1;
+		file = &item->gz;
+	}
+	real_filename[usr->filename_len] = 0;
+	usr->filename = real_filename;
+	usr->mime_type = item->mime_type;
+	usr->mime_type_size = item->mime_type_size;
+	memcpy(&usr->st, &file->st, sizeof(struct stat));
+	memcpy(usr->last_modified, file->last_modified, file->last_modified_len);
+	usr->last_modified_len = file->last_modified_len;
+	usr->fd = file->fd;
+	if (usr->fd > -1 && uwsgi.cores > 1) {
+		usr->fd = dup(file->fd);
+		if (usr->fd < 0) {
+			uwsgi_error("uwsgi_static_fd_cache_get()/dup()");
+		}
+		else {
+			usr->close_fd = 1;
+		}
+	}
+	*index = item->index;
+	ret = 0;
+end:
+	static_fd_cache_unlock;
+	return ret;
+}
+
+static int uwsgi_static_fd_file_open(char *filename, struct uwsgi_static_fd_file *file) {
+	file->fd = -1;
+	// descriptors are needed only when uWSGI sends the file by itself
+	if (!uwsgi.file_serve_mode) {
+		file->fd = open(filename, O_RDONLY);
+		if (file->fd < 0) return -1;
+		if (fstat(file->fd, &file->st)) {
+			uwsgi_error("uwsgi_static_fd_file_open()/fstat()");
+			goto error;
+		}
+	}
+	else if (stat(filename, &file->st)) {
+		return -1;
+	}
+	if (!S_ISREG(file->st.st_mode)) goto error;
+	file->last_modified_len = uwsgi_http_date(file->st.st_mtime, file->last_modified);
+	return 0;
+error:
+	if (file->fd > -1) close(file->fd);
+	file->fd = -1;
+	return -1;
+}
+
+// store a resolved file (this is called only on the slow path)
+static void uwsgi_static_fd_cache_add(char *key, size_t key_len, char *real_filename, size_t real_filename_len, struct uwsgi_string_list *index) {
+	struct uwsgi_static_fd_file file, gz;
+	int has_gz = 0;
+	int wd = -1;
+
+	if (uwsgi_static_fd_file_open(real_filename, &file)) return;
+
+	if (real_filename_len + 4 <= PATH_MAX && uwsgi_static_gzip_match(real_filename, real_filename_len)) {
+		char gz_filename[PATH_MAX + 1];
+		memcpy(gz_filename, real_filename, real_filename_len);
+		memcpy(gz_filename + real_filename_len, ".gz\0", 4);
+		if (!uwsgi_static_fd_file_open(gz_filename, &gz)) has_gz = 1;
+	}
+
+	uint32_t hash = djb33x_hash(key, key_len);
+
+	static_fd_cache_lock;
+
+	// another core could have added it in the meantime
+	if (uwsgi_static_fd_cache_find(key, key_len, hash)) {
+		static_fd_cache_unlock;
+		if (file.fd > -1) close(file.fd);
+		if (has_gz && gz.fd > -1) close(gz.fd);
+		return;
+	}
+
+#ifdef UWSGI_STATIC_USE_INOTIFY
+	if (static_fd_cache->inotify_fd > -1) {
+		char *slash = uwsgi_get_last_charn(real_filename, real_filename_len, '/');
+		if (slash) {
+			*slash = 0;
+			wd = inotify_add_watch(static_fd_cache->inotify_fd, slash == real_filename ? "/" : real_filename, IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+			*slash = '/';
+			if (wd < 0) {
+				uwsgi_error("uwsgi_static_fd_cache_add()/inotify_add_watch()");
+			}
+		}
+	}
+#endif
+
+	struct uwsgi_static_fd_item *item = static_fd_cache->free;
+	if (item) {
+		static_fd_cache->free = item->next;
+	}
+	else if (static_fd_cache->used < uwsgi.static_fd_cache) {
+		item = &static_fd_cache->items[static_fd_cache->used++];
+	}
+	else {
+		// full, evict the oldest slot
+		item = &static_fd_cache->items[static_fd_cache->victim++ % uwsgi.static_fd_cache];
+		uwsgi_static_fd_item_free(item);
+		static_fd_cache->free = item->next;
+	}
+
+	item->key = uwsgi_concat2n(key, key_len, "", 0);
+	item->key_len = key_len;
+	item->hash = hash;
+	item->filename = uwsgi_malloc(real_filename_len + 4);
+	memcpy(item->filename, real_filename, real_filename_len);
+	item->filename[real_filename_len] = 0;
+	item->filename_len = real_filename_len;
+	item->index = index;
+	item->mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &item->mime_type_size);
+	memcpy(&item->file, &file, sizeof(struct uwsgi_static_fd_file));
+	item->has_gz = has_gz;
+	if (has_gz) {
+		memcpy(&item->gz, &gz, sizeof(struct uwsgi_static_fd_file));
+	}
+	item->validated = uwsgi_now();
+	item->wd = wd;
+	item->next = static_fd_cache->hashtable[hash & static_fd_cache->mask];
+	static_fd_cache->hashtable[hash & static_fd_cache->mask] = item;
+	if (wd > -1) {
+		item->wd_next = static_fd_cache->wd_hashtable[wd & static_fd_cache->mask];
+		static_fd_cache->wd_hashtable[wd & static_fd_cache->mask] = item;
+	}
+
+	static_fd_cache_unlock;
+}
+
 
 int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_t document_root_len, char *path_info, uint16_t path_info_len, int is_a_file) {
 
 	struct stat st;
 	char real_filename[PATH_MAX + 1];
 	size_t real_filename_len = 0;
-	char *filename = NULL;
+	char filename[PATH_MAX + 1];
 	size_t filename_len = 0;
 
 	struct uwsgi_string_list *index = NULL;
 
+	struct uwsgi_static_response usr;
+	int cached = 0;
+
 	if (!is_a_file) {
-		filename = uwsgi_concat3n(document_root, document_root_len, "/", 1, path_info, path_info_len);
 		filename_len = document_root_len + 1 + path_info_len;
+		if (filename_len > PATH_MAX) return -1;
+		memcpy(filename, document_root, document_root_len);
+		filename[document_root_len] = '/';
+		memcpy(filename + document_root_len + 1, path_info, path_info_len);
 	}
 	else {
-		filename = uwsgi_concat2n(document_root, document_root_len, "", 0);
 		filename_len = document_root_len;
+		if (filename_len > PATH_MAX) return -1;
+		memcpy(filename, document_root, document_root_len);
 	}
+	filename[filename_len] = 0;
 
 #ifdef UWSGI_DEBUG
 	uwsgi_log("[uwsgi-fileserve] checking for %s\n", filename);
 #endif
 
+	if (static_fd_cache) {
+		// only GET and HEAD are cached (other methods are never served)
+		if (!uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) || !uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
+			if (!uwsgi_static_fd_cache_get(wsgi_req, filename, filename_len, real_filename, &real_filename_len, &index, &usr)) {
+				cached = 1;
+				goto found;
+			}
+		}
+	}
+
 	if (uwsgi.static_cache_paths) {
-		uwsgi_rlock(uwsgi.static_cache_paths->lock);
+		uwsgi_cache_rlock(uwsgi.static_cache_paths, filename, filename_len);
 		uint64_t item_len;
 		char *item = uwsgi_cache_get2(uwsgi.static_cache_paths, filename, filename_len, &item_len);
 		if (item && item_len > 0 && item_len <= PATH_MAX) {
 			memcpy(real_filename, item, item_len);
 			real_filename_len = item_len;
 			real_filename[real_filename_len] = 0;
-			uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+			uwsgi_cache_rwunlock(uwsgi.static_cache_paths, filename, filename_len);
 			goto found;
 		}
-		uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+		uwsgi_cache_rwunlock(uwsgi.static_cache_paths, filename, filename_len);
 	}
 
 	if (!realpath(filename, real_filename)) {
 #ifdef UWSGI_DEBUG
 		uwsgi_log("[uwsgi-fileserve] unable to get realpath() of the static file\n");
 #endif
-		free(filename);
 		return -1;
 	}
 	real_filename_len = strlen(real_filename);
 
 	if (uwsgi.static_cache_paths) {
-		uwsgi_wlock(uwsgi.static_cache_paths->lock);
+		uwsgi_cache_wlock(uwsgi.static_cache_paths, filename, filename_len);
 		uwsgi_cache_set2(uwsgi.static_cache_paths, filename, filename_len, real_filename, real_filename_len, uwsgi.use_static_cache_paths, UWSGI_CACHE_FLAG_UPDATE);
-		uwsgi_rwunlock(uwsgi.static_cache_paths->lock);
+		uwsgi_cache_rwunlock(uwsgi.static_cache_paths, filename, filename_len);
 	}
 
 found:
-	free(filename);
 
 	if (uwsgi_starts_with(real_filename, real_filename_len, document_root, document_root_len)) {
 		struct uwsgi_string_list *safe = uwsgi.static_safe;
 		while(safe) {
 			if (!uwsgi_starts_with(real_filename, real_filename_len, safe->value, safe->len)) {
 				goto safe;
-			}		
+			}
 			safe = safe->next;
 		}
 		uwsgi_log("[uwsgi-fileserve] security error: %s is not under %.*s or a safe path\n", real_filename, document_root_len, document_root);
+		if (cached) uwsgi_static_response_release(&usr);
 		return -1;
 	}
 
 safe:
 
-	if (!uwsgi_static_stat(wsgi_req, real_filename, &real_filename_len, &st, &index)) {
+	if (cached || !uwsgi_static_stat(wsgi_req, real_filename, &real_filename_len, &st, &index)) {
 
 		if (index) {
 			// if we are here the PATH_INFO need to be changed
 			if (uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len)) {
+				if (cached) uwsgi_static_response_release(&usr);
                         	return -1;
                         }
 		}
 
+		// cached items already passed the following checks
+		if (cached) goto route;
+
 		// skip methods other than GET and HEAD
         	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
 			return -1;
@@ -643,14 +1022,22 @@ safe:
 			sse = sse->next;
 		}
 
+		if (static_fd_cache) {
+			uwsgi_static_fd_cache_add(filename, filename_len, real_filename, real_filename_len, index);
+		}
+
+route:
 #ifdef UWSGI_ROUTING
 		// before sending the file, we need to check if some rule applies
 		if (!wsgi_req->is_routing && uwsgi_apply_routes_do(uwsgi.routes, wsgi_req, NULL, 0) == UWSGI_ROUTE_BREAK) {
+			if (cached) uwsgi_static_response_release(&usr);
 			return 0;
 		}
 		wsgi_req->routes_applied = 1;
 #endif
 
+		if (cached) return uwsgi_static_response(wsgi_req, &usr);
+
 		return uwsgi_real_file_serve(wsgi_req, real_filename, real_filename_len, &st);
 	}
 
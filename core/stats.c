@@ -5,6 +5,12 @@
 
 extern struct uwsgi_server uwsgi;
 
+static int stats_ext_open(struct uwsgi_stats *, int);
+static int stats_ext_close(struct uwsgi_stats *);
+static int stats_ext_key(struct uwsgi_stats *, char *);
+static int stats_ext_string(struct uwsgi_stats *, char *, char *, size_t);
+static int stats_ext_number(struct uwsgi_stats *, char *, uint64_t, int);
+
 struct uwsgi_stats *uwsgi_stats_new(size_t chunk_size) {
 	struct uwsgi_stats *us = uwsgi_malloc(sizeof(struct uwsgi_stats));
 	us->base = uwsgi_malloc(chunk_size);
@@ -14,6 +20,7 @@ struct uwsgi_stats *uwsgi_stats_new(size_t chunk_size) {
 	us->size = chunk_size;
 	us->tabs = 1;
 	us->dirty = 0;
+	us->ext = NULL;
 	us->minified = uwsgi.stats_minified;
 	if (!us->minified) {
 		us->base[1] = '\n';
@@ -51,6 +58,8 @@ int uwsgi_stats_symbol_nl(struct uwsgi_stats *us, char sym) {
 
 
 int uwsgi_stats_comma(struct uwsgi_stats *us) {
+	if (us->ext)
+		return 0;
 	return uwsgi_stats_symbol_nl(us, ',');
 }
 
@@ -67,6 +76,8 @@ int uwsgi_stats_apply_tabs(struct uwsgi_stats *us) {
 
 
 int uwsgi_stats_object_open(struct uwsgi_stats *us) {
+	if (us->ext)
+		return stats_ext_open(us, 0);
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 	if (!us->minified)
@@ -75,6 +86,8 @@ int uwsgi_stats_object_open(struct uwsgi_stats *us) {
 }
 
 int uwsgi_stats_object_close(struct uwsgi_stats *us) {
+	if (us->ext)
+		return stats_ext_close(us);
 	if (!us->minified) {
 		if (uwsgi_stats_symbol(us, '\n'))
 			return -1;
@@ -86,11 +99,15 @@ int uwsgi_stats_object_close(struct uwsgi_stats *us) {
 }
 
 int uwsgi_stats_list_open(struct uwsgi_stats *us) {
+	if (us->ext)
+		return stats_ext_open(us, 1);
 	us->tabs++;
 	return uwsgi_stats_symbol_nl(us, '[');
 }
 
 int uwsgi_stats_list_close(struct uwsgi_stats *us) {
+	if (us->ext)
+		return stats_ext_close(us);
 	if (!us->minified) {
 		if (uwsgi_stats_symbol(us, '\n'))
 			return -1;
@@ -103,6 +120,9 @@ int uwsgi_stats_list_close(struct uwsgi_stats *us) {
 
 int uwsgi_stats_keyval(struct uwsgi_stats *us, char *key, char *value) {
 
+	if (us->ext)
+		return stats_ext_string(us, key, value, strlen(value));
+
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 
@@ -141,6 +161,14 @@ int uwsgi_stats_keyval_comma(struct uwsgi_stats *us, char *key, char *value) {
 
 int uwsgi_stats_keyvalnum(struct uwsgi_stats *us, char *key, char *value, unsigned long long num) {
 
+	if (us->ext) {
+		char *buf = uwsgi_malloc(strlen(value) + sizeof(UMAX64_STR) + 1);
+		int len = sprintf(buf, "%s%llu", value, num);
+		int ret = stats_ext_string(us, key, buf, len);
+		free(buf);
+		return ret;
+	}
+
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 
@@ -180,6 +208,9 @@ int uwsgi_stats_keyvalnum_comma(struct uwsgi_stats *us, char *key, char *value,
 
 int uwsgi_stats_keyvaln(struct uwsgi_stats *us, char *key, char *value, int vallen) {
 
+	if (us->ext)
+		return stats_ext_string(us, key, value, vallen);
+
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 
@@ -219,6 +250,9 @@ int uwsgi_stats_keyvaln_comma(struct uwsgi_stats *us, char *key, char *value, in
 
 int uwsgi_stats_key(struct uwsgi_stats *us, char *key) {
 
+	if (us->ext)
+		return stats_ext_key(us, key);
+
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 
@@ -249,6 +283,9 @@ int uwsgi_stats_key(struct uwsgi_stats *us, char *key) {
 
 int uwsgi_stats_str(struct uwsgi_stats *us, char *str) {
 
+	if (us->ext)
+		return stats_ext_string(us, NULL, str, strlen(str));
+
 	char *ptr = us->base + us->pos;
 	char *watermark = us->base + us->size;
 	size_t available = watermark - ptr;
@@ -279,6 +316,9 @@ int uwsgi_stats_str(struct uwsgi_stats *us, char *str) {
 
 int uwsgi_stats_keylong(struct uwsgi_stats *us, char *key, unsigned long long num) {
 
+	if (us->ext)
+		return stats_ext_number(us, key, num, 0);
+
 	if (uwsgi_stats_apply_tabs(us))
 		return -1;
 
@@ -317,6 +357,9 @@ int uwsgi_stats_keylong_comma(struct uwsgi_stats *us, char *key, unsigned long l
 
 int uwsgi_stats_keyslong(struct uwsgi_stats *us, char *key, long long num) {
 
+        if (us->ext)
+                return stats_ext_number(us, key, num, 1);
+
         if (uwsgi_stats_apply_tabs(us))
                 return -1;
 
@@ -621,3 +664,950 @@ int uwsgi_stats_dump_vars(struct uwsgi_stats *us, struct uwsgi_core *uc) {
 	if (uwsgi_stats_str(us, "")) return -1;
 	return 0;
 }
+
+/*
+	log-linear (HDR-style) histograms
+
+	values below UWSGI_HISTOGRAM_SUB are counted exactly, every following power of two
+	is split in UWSGI_HISTOGRAM_SUB linear buckets (so the relative error is bounded by
+	1/UWSGI_HISTOGRAM_SUB). Values over 2^UWSGI_HISTOGRAM_MAX_BITS end in the last bucket.
+
+	Every histogram has a single writer (the core owning it) so no locking is needed,
+	the master merges them while generating stats.
+*/
+
+static int uwsgi_histogram_bucket(uint64_t value) {
+	if (value < UWSGI_HISTOGRAM_SUB)
+		return value;
+	int msb = 63 - __builtin_clzll(value);
+	if (msb >= UWSGI_HISTOGRAM_MAX_BITS)
+		return UWSGI_HISTOGRAM_BUCKETS - 1;
+	return ((msb - UWSGI_HISTOGRAM_SUB_BITS + 1) * UWSGI_HISTOGRAM_SUB) + ((value >> (msb - UWSGI_HISTOGRAM_SUB_BITS)) & (UWSGI_HISTOGRAM_SUB - 1));
+}
+
+// the highest value counted by a bucket
+uint64_t uwsgi_histogram_bucket_max(int bucket) {
+	if (bucket < UWSGI_HISTOGRAM_SUB)
+		return bucket;
+	int shift = (bucket / UWSGI_HISTOGRAM_SUB) - 1;
+	uint64_t low = (uint64_t) (UWSGI_HISTOGRAM_SUB + (bucket % UWSGI_HISTOGRAM_SUB)) << shift;
+	return low + ((uint64_t) 1 << shift) - 1;
+}
+
+void uwsgi_histogram_add(struct uwsgi_histogram *uh, uint64_t value) {
+	uh->buckets[uwsgi_histogram_bucket(value)]++;
+	uh->count++;
+	uh->sum += value;
+	if (value > uh->max)
+		uh->max = value;
+}
+
+void uwsgi_histogram_merge(struct uwsgi_histogram *dst, struct uwsgi_histogram *src) {
+	int i;
+	for (i = 0; i < UWSGI_HISTOGRAM_BUCKETS; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+// value at the specified quantile (expressed in parts per thousand)
+uint64_t uwsgi_histogram_value_at(struct uwsgi_histogram *uh, uint64_t permille) {
+	uint64_t count = 0;
+	int i;
+	// the buckets could be updated while we read them, so do not trust uh->count
+	for (i = 0; i < UWSGI_HISTOGRAM_BUCKETS; i++) {
+		count += uh->buckets[i];
+	}
+	if (!count)
+		return 0;
+	uint64_t target = ((count * permille) + 999) / 1000;
+	if (!target)
+		target = 1;
+	uint64_t seen = 0;
+	for (i = 0; i < UWSGI_HISTOGRAM_BUCKETS; i++) {
+		seen += uh->buckets[i];
+		if (seen >= target) {
+			uint64_t value = uwsgi_histogram_bucket_max(i);
+			return value > uh->max ? uh->max : value;
+		}
+	}
+	return uh->max;
+}
+
+int uwsgi_stats_histogram(struct uwsgi_stats *us, char *key, struct uwsgi_histogram *uh) {
+	if (uwsgi_stats_key(us, key))
+		return -1;
+	if (uwsgi_stats_object_open(us))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "count", (unsigned long long) uh->count))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "sum", (unsigned long long) uh->sum))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "max", (unsigned long long) uh->max))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "p50", (unsigned long long) uwsgi_histogram_value_at(uh, 500)))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "p90", (unsigned long long) uwsgi_histogram_value_at(uh, 900)))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "p99", (unsigned long long) uwsgi_histogram_value_at(uh, 990)))
+		return -1;
+	if (uwsgi_stats_keylong_comma(us, "p999", (unsigned long long) uwsgi_histogram_value_at(uh, 999)))
+		return -1;
+
+	// only non-empty buckets are reported, keyed by their upper bound
+	if (uwsgi_stats_key(us, "buckets"))
+		return -1;
+	if (uwsgi_stats_object_open(us))
+		return -1;
+	int i, first = 1;
+	for (i = 0; i < UWSGI_HISTOGRAM_BUCKETS; i++) {
+		uint64_t hits = uh->buckets[i];
+		if (!hits)
+			continue;
+		if (!first) {
+			if (uwsgi_stats_comma(us))
+				return -1;
+		}
+		char bound[sizeof(UMAX64_STR) + 1];
+		snprintf(bound, sizeof(bound), "%llu", (unsigned long long) uwsgi_histogram_bucket_max(i));
+		if (uwsgi_stats_keylong(us, bound, (unsigned long long) hits))
+			return -1;
+		first = 0;
+	}
+	if (uwsgi_stats_object_close(us))
+		return -1;
+
+	return uwsgi_stats_object_close(us);
+}
+
+/*
+	extended stats output (used by the threaded stats server)
+
+	the stats generators are unaware of it: when us->ext is set every uwsgi_stats_*
+	helper is routed here. The writer keeps a stack of the opened containers to:
+
+	- select subtrees (dotted paths, lists do not add a component, so
+	  "workers.requests" selects the "requests" item of every worker)
+	- omit the values unchanged since the previous scrape with the same delta token
+	  (containers are always emitted, so the position of list items is preserved)
+	- encode the document as msgpack
+
+	separators are managed by the writer, explicit commas from the generators are ignored.
+*/
+
+#define UWSGI_STATS_EXT_SKIP 0
+#define UWSGI_STATS_EXT_PARTIAL 1
+#define UWSGI_STATS_EXT_FULL 2
+
+#define UWSGI_STATS_EXT_MAX_DEPTH 32
+#define UWSGI_STATS_EXT_MAX_SELECTORS 16
+#define UWSGI_STATS_DELTA_TOKENS 16
+
+struct uwsgi_stats_delta {
+	char token[64];
+	uint64_t mask;
+	uint64_t used;
+	uint64_t *ids;
+	uint64_t *values;
+	time_t last_seen;
+};
+
+struct uwsgi_stats_level {
+	int mode;
+	int is_list;
+	uint64_t items;
+	uint64_t pos;
+	uint64_t id;
+	size_t path_len;
+	off_t header;
+};
+
+struct uwsgi_stats_ext {
+	int msgpack;
+	int selectors_cnt;
+	char *selectors[UWSGI_STATS_EXT_MAX_SELECTORS];
+	// the snapshot of the previous scrape (lookups) and the one being built (inserts)
+	struct uwsgi_stats_delta *delta;
+	struct uwsgi_stats_delta *next_delta;
+	// key set by uwsgi_stats_key() waiting for its value
+	int has_key;
+	char key[256];
+	char path[1024];
+	int depth;
+	struct uwsgi_stats_level levels[UWSGI_STATS_EXT_MAX_DEPTH];
+};
+
+static uint64_t stats_ext_mix(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t stats_ext_hash(char *buf, size_t len, uint64_t seed) {
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t) buf[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static struct uwsgi_stats_delta *stats_delta_new(char *token) {
+	struct uwsgi_stats_delta *usd = uwsgi_calloc(sizeof(struct uwsgi_stats_delta));
+	strncpy(usd->token, token, sizeof(usd->token) - 1);
+	usd->mask = 1023;
+	usd->ids = uwsgi_calloc(sizeof(uint64_t) * (usd->mask + 1));
+	usd->values = uwsgi_calloc(sizeof(uint64_t) * (usd->mask + 1));
+	return usd;
+}
+
+static void stats_delta_destroy(struct uwsgi_stats_delta *usd) {
+	free(usd->ids);
+	free(usd->values);
+	free(usd);
+}
+
+// 0 is the empty slot marker
+static int stats_delta_find(struct uwsgi_stats_delta *usd, uint64_t id, uint64_t *value) {
+	if (!id)
+		id = 1;
+	uint64_t slot = id & usd->mask;
+	while (usd->ids[slot]) {
+		if (usd->ids[slot] == id) {
+			*value = usd->values[slot];
+			return 1;
+		}
+		slot = (slot + 1) & usd->mask;
+	}
+	return 0;
+}
+
+static void stats_delta_set(struct uwsgi_stats_delta *usd, uint64_t id, uint64_t value) {
+	if (!id)
+		id = 1;
+	if ((usd->used + 1) * 2 > usd->mask + 1) {
+		uint64_t old_mask = usd->mask;
+		uint64_t *old_ids = usd->ids;
+		uint64_t *old_values = usd->values;
+		usd->mask = (usd->mask << 1) | 1;
+		usd->ids = uwsgi_calloc(sizeof(uint64_t) * (usd->mask + 1));
+		usd->values = uwsgi_calloc(sizeof(uint64_t) * (usd->mask + 1));
+		usd->used = 0;
+		uint64_t i;
+		for (i = 0; i <= old_mask; i++) {
+			if (old_ids[i])
+				stats_delta_set(usd, old_ids[i], old_values[i]);
+		}
+		free(old_ids);
+		free(old_values);
+	}
+	uint64_t slot = id & usd->mask;
+	while (usd->ids[slot]) {
+		if (usd->ids[slot] == id) {
+			usd->values[slot] = value;
+			return;
+		}
+		slot = (slot + 1) & usd->mask;
+	}
+	usd->ids[slot] = id;
+	usd->values[slot] = value;
+	usd->used++;
+}
+
+static int stats_ext_append(struct uwsgi_stats *us, char *buf, size_t len) {
+	while (us->pos + len > us->size) {
+		// documents can be huge, grow geometrically
+		if (us->chunk < us->size)
+			us->chunk = us->size;
+		char *new_base = realloc(us->base, us->size + us->chunk);
+		if (!new_base)
+			return -1;
+		us->base = new_base;
+		us->size += us->chunk;
+	}
+	memcpy(us->base + us->pos, buf, len);
+	us->pos += len;
+	return 0;
+}
+
+static int stats_ext_mp_header(struct uwsgi_stats *us, uint8_t type, uint32_t n) {
+	char buf[5];
+	buf[0] = type;
+	n = htonl(n);
+	memcpy(buf + 1, &n, 4);
+	return stats_ext_append(us, buf, 5);
+}
+
+static int stats_ext_mp_str(struct uwsgi_stats *us, char *str, size_t len) {
+	char buf[5];
+	size_t hlen;
+	if (len < 32) {
+		buf[0] = 0xa0 | len;
+		hlen = 1;
+	}
+	else if (len < 256) {
+		buf[0] = 0xd9;
+		buf[1] = len;
+		hlen = 2;
+	}
+	else if (len < 65536) {
+		buf[0] = 0xda;
+		buf[1] = (len >> 8) & 0xff;
+		buf[2] = len & 0xff;
+		hlen = 3;
+	}
+	else {
+		buf[0] = 0xdb;
+		uint32_t n = htonl(len);
+		memcpy(buf + 1, &n, 4);
+		hlen = 5;
+	}
+	if (stats_ext_append(us, buf, hlen))
+		return -1;
+	return stats_ext_append(us, str, len);
+}
+
+static int stats_ext_mp_num(struct uwsgi_stats *us, uint64_t num, int is_signed) {
+	char buf[9];
+	size_t len, i;
+	int64_t snum = (int64_t) num;
+	if (!is_signed || snum >= 0) {
+		if (num < 128) {
+			buf[0] = num;
+			return stats_ext_append(us, buf, 1);
+		}
+		if (num <= 0xff) {
+			buf[0] = 0xcc;
+			len = 1;
+		}
+		else if (num <= 0xffff) {
+			buf[0] = 0xcd;
+			len = 2;
+		}
+		else if (num <= 0xffffffffULL) {
+			buf[0] = 0xce;
+			len = 4;
+		}
+		else {
+			buf[0] = 0xcf;
+			len = 8;
+		}
+	}
+	else {
+		if (snum >= -32) {
+			buf[0] = (int8_t) snum;
+			return stats_ext_append(us, buf, 1);
+		}
+		if (snum >= -128) {
+			buf[0] = 0xd0;
+			len = 1;
+		}
+		else if (snum >= -32768) {
+			buf[0] = 0xd1;
+			len = 2;
+		}
+		else if (snum >= -2147483648LL) {
+			buf[0] = 0xd2;
+			len = 4;
+		}
+		else {
+			buf[0] = 0xd3;
+			len = 8;
+		}
+	}
+	// big endian
+	for (i = 0; i < len; i++) {
+		buf[len - i] = (num >> (i * 8)) & 0xff;
+	}
+	return stats_ext_append(us, buf, len + 1);
+}
+
+// 2 -> the path is selected (or is below a selected one), 1 -> the path is an ancestor of a selector
+static int stats_ext_match(struct uwsgi_stats_ext *ue, size_t path_len) {
+	int i, ret = UWSGI_STATS_EXT_SKIP;
+	for (i = 0; i < ue->selectors_cnt; i++) {
+		char *sel = ue->selectors[i];
+		size_t sel_len = strlen(sel);
+		if (path_len >= sel_len) {
+			if (!memcmp(ue->path, sel, sel_len) && (path_len == sel_len || ue->path[sel_len] == '.'))
+				return UWSGI_STATS_EXT_FULL;
+		}
+		else if (!memcmp(ue->path, sel, path_len) && sel[path_len] == '.') {
+			ret = UWSGI_STATS_EXT_PARTIAL;
+		}
+	}
+	return ret;
+}
+
+/*
+	compute the mode and the identity of a new item of the current container,
+	the pending key is consumed when no explicit key is passed
+*/
+static int stats_ext_item(struct uwsgi_stats *us, char **key, int is_container, uint64_t *id, size_t *path_len) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	struct uwsgi_stats_level *parent = &ue->levels[ue->depth];
+
+	if (!*key && ue->has_key)
+		*key = ue->key;
+	ue->has_key = 0;
+
+	if (*key) {
+		*id = stats_ext_mix(stats_ext_hash(*key, strlen(*key), parent->id));
+	}
+	else {
+		*id = stats_ext_mix(parent->id + ++parent->pos);
+	}
+
+	int mode = parent->mode;
+	*path_len = parent->path_len;
+	if (mode == UWSGI_STATS_EXT_PARTIAL && *key) {
+		size_t key_len = strlen(*key);
+		if (*path_len + key_len + 2 > sizeof(ue->path)) {
+			mode = UWSGI_STATS_EXT_SKIP;
+		}
+		else {
+			if (*path_len)
+				ue->path[(*path_len)++] = '.';
+			memcpy(ue->path + *path_len, *key, key_len);
+			*path_len += key_len;
+			mode = stats_ext_match(ue, *path_len);
+		}
+	}
+	if (mode == UWSGI_STATS_EXT_PARTIAL && !is_container)
+		return UWSGI_STATS_EXT_SKIP;
+	return mode;
+}
+
+// write the separator and the key of a new item
+static int stats_ext_begin(struct uwsgi_stats *us, char *key) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	struct uwsgi_stats_level *parent = &ue->levels[ue->depth];
+	parent->items++;
+
+	if (ue->msgpack) {
+		if (key)
+			return stats_ext_mp_str(us, key, strlen(key));
+		return 0;
+	}
+
+	if (parent->items > 1) {
+		if (uwsgi_stats_symbol_nl(us, ','))
+			return -1;
+	}
+	us->tabs = ue->depth + 1;
+	if (uwsgi_stats_apply_tabs(us))
+		return -1;
+	if (key) {
+		if (uwsgi_stats_symbol(us, '"'))
+			return -1;
+		if (stats_ext_append(us, key, strlen(key)))
+			return -1;
+		if (stats_ext_append(us, "\":", 2))
+			return -1;
+	}
+	return 0;
+}
+
+static int stats_ext_open(struct uwsgi_stats *us, int is_list) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	if (ue->depth + 1 >= UWSGI_STATS_EXT_MAX_DEPTH)
+		return -1;
+
+	char *key = NULL;
+	uint64_t id;
+	size_t path_len;
+	int mode = stats_ext_item(us, &key, 1, &id, &path_len);
+	if (mode != UWSGI_STATS_EXT_SKIP) {
+		if (stats_ext_begin(us, key))
+			return -1;
+	}
+
+	struct uwsgi_stats_level *usl = &ue->levels[++ue->depth];
+	memset(usl, 0, sizeof(struct uwsgi_stats_level));
+	usl->mode = mode;
+	usl->is_list = is_list;
+	usl->id = id;
+	usl->path_len = path_len;
+	if (mode == UWSGI_STATS_EXT_SKIP)
+		return 0;
+
+	if (ue->msgpack) {
+		usl->header = us->pos;
+		return stats_ext_mp_header(us, is_list ? 0xdd : 0xdf, 0);
+	}
+	return uwsgi_stats_symbol_nl(us, is_list ? '[' : '{');
+}
+
+static int stats_ext_close(struct uwsgi_stats *us) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	int depth = ue->depth;
+	struct uwsgi_stats_level *usl = &ue->levels[depth];
+	// the root object is closed by the last call
+	if (depth > 0)
+		ue->depth--;
+	ue->has_key = 0;
+	if (usl->mode == UWSGI_STATS_EXT_SKIP)
+		return 0;
+
+	if (ue->msgpack) {
+		uint32_t items = htonl(usl->items);
+		memcpy(us->base + usl->header + 1, &items, 4);
+		return 0;
+	}
+
+	if (!us->minified) {
+		if (uwsgi_stats_symbol(us, '\n'))
+			return -1;
+		us->tabs = depth;
+		if (uwsgi_stats_apply_tabs(us))
+			return -1;
+	}
+	return uwsgi_stats_symbol(us, usl->is_list ? ']' : '}');
+}
+
+// returns 1 if the value must not be written (filtered out or unchanged since the last scrape)
+static int stats_ext_skip(struct uwsgi_stats *us, char **key, uint64_t value_hash) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	uint64_t id, old;
+	size_t path_len;
+	if (stats_ext_item(us, key, 0, &id, &path_len) == UWSGI_STATS_EXT_SKIP)
+		return 1;
+	if (ue->next_delta) {
+		stats_delta_set(ue->next_delta, id, value_hash);
+		if (ue->delta && stats_delta_find(ue->delta, id, &old) && old == value_hash)
+			return 1;
+	}
+	return 0;
+}
+
+static int stats_ext_string(struct uwsgi_stats *us, char *key, char *value, size_t value_len) {
+	if (stats_ext_skip(us, &key, stats_ext_hash(value, value_len, 0)))
+		return 0;
+	if (stats_ext_begin(us, key))
+		return -1;
+	if (us->ext->msgpack)
+		return stats_ext_mp_str(us, value, value_len);
+	if (uwsgi_stats_symbol(us, '"'))
+		return -1;
+	if (stats_ext_append(us, value, value_len))
+		return -1;
+	return uwsgi_stats_symbol(us, '"');
+}
+
+static int stats_ext_number(struct uwsgi_stats *us, char *key, uint64_t num, int is_signed) {
+	if (stats_ext_skip(us, &key, stats_ext_mix(num)))
+		return 0;
+	if (stats_ext_begin(us, key))
+		return -1;
+	if (us->ext->msgpack)
+		return stats_ext_mp_num(us, num, is_signed);
+	char buf[sizeof(UMAX64_STR) + 2];
+	int ret = snprintf(buf, sizeof(buf), is_signed ? "%lld" : "%llu", (unsigned long long) num);
+	if (ret <= 0)
+		return -1;
+	return stats_ext_append(us, buf, ret);
+}
+
+static int stats_ext_key(struct uwsgi_stats *us, char *key) {
+	struct uwsgi_stats_ext *ue = us->ext;
+	strncpy(ue->key, key, sizeof(ue->key) - 1);
+	ue->key[sizeof(ue->key) - 1] = 0;
+	ue->has_key = 1;
+	return 0;
+}
+
+/*
+	the stats server
+
+	it runs in a master thread with its own event queue: clients are accepted, read
+	and written in non-blocking mode, so slow scrapers do not stall anything.
+
+	In http mode (--stats-http) the query string can request:
+
+	select=<path>[,<path>...]	only the specified subtrees ("workers[].requests" and "workers.requests" are equivalent)
+	delta=<token>			omit the values unchanged since the previous request with the same token
+	format=json|msgpack		the encoding of the document
+
+	without options the classic json document is generated.
+*/
+
+struct uwsgi_stats_client {
+	int fd;
+	int writing;
+	time_t deadline;
+	char buf[4096];
+	size_t len;
+	struct uwsgi_buffer *ub;
+	size_t ub_pos;
+	struct uwsgi_stats *us;
+	size_t us_pos;
+	struct uwsgi_stats_client *prev;
+	struct uwsgi_stats_client *next;
+};
+
+// only the stats server thread accesses the delta snapshots
+static struct uwsgi_stats_delta *stats_deltas[UWSGI_STATS_DELTA_TOKENS];
+
+static struct uwsgi_stats_delta *stats_delta_get(char *token) {
+	int i;
+	for (i = 0; i < UWSGI_STATS_DELTA_TOKENS; i++) {
+		if (stats_deltas[i] && !strcmp(stats_deltas[i]->token, token))
+			return stats_deltas[i];
+	}
+	return NULL;
+}
+
+// store a snapshot replacing the previous one of the same token (or the least recently used)
+static void stats_delta_store(struct uwsgi_stats_delta *usd) {
+	int i, slot = 0;
+	usd->last_seen = uwsgi_now();
+	for (i = 0; i < UWSGI_STATS_DELTA_TOKENS; i++) {
+		if (!stats_deltas[i] || !strcmp(stats_deltas[i]->token, usd->token)) {
+			slot = i;
+			break;
+		}
+		if (stats_deltas[i]->last_seen < stats_deltas[slot]->last_seen)
+			slot = i;
+	}
+	if (stats_deltas[slot])
+		stats_delta_destroy(stats_deltas[slot]);
+	stats_deltas[slot] = usd;
+}
+
+// parse the query string (in place), returns -1 on invalid values
+static int stats_server_parse_query(char *query, size_t len, struct uwsgi_stats_ext *ue, char **token) {
+	char *end = query + len;
+	while (query < end) {
+		char *item_end = memchr(query, '&', end - query);
+		if (!item_end)
+			item_end = end;
+		*item_end = 0;
+		char *equal = strchr(query, '=');
+		if (equal) {
+			*equal = 0;
+			char *value = equal + 1;
+			uint16_t value_len = strlen(value);
+			http_url_decode(value, &value_len, value);
+			value[value_len] = 0;
+			if (!strcmp(query, "select")) {
+				char *ctx = NULL;
+				char *p, *sel = strtok_r(value, ",", &ctx);
+				while (sel) {
+					if (ue->selectors_cnt >= UWSGI_STATS_EXT_MAX_SELECTORS)
+						return -1;
+					// lists do not add a path component
+					while ((p = strstr(sel, "[]")) != NULL) {
+						memmove(p, p + 2, strlen(p + 2) + 1);
+					}
+					if (*sel)
+						ue->selectors[ue->selectors_cnt++] = sel;
+					sel = strtok_r(NULL, ",", &ctx);
+				}
+			}
+			else if (!strcmp(query, "delta")) {
+				if (!*value || value_len >= sizeof(((struct uwsgi_stats_delta *) 0)->token))
+					return -1;
+				*token = value;
+			}
+			else if (!strcmp(query, "format")) {
+				if (!strcmp(value, "msgpack")) {
+					ue->msgpack = 1;
+				}
+				else if (strcmp(value, "json")) {
+					return -1;
+				}
+			}
+		}
+		query = item_end + 1;
+	}
+	return 0;
+}
+
+static struct uwsgi_stats *stats_server_generate(struct uwsgi_stats_client *usc, char *query, size_t query_len) {
+	char *token = NULL;
+	struct uwsgi_stats_ext *ue = uwsgi_calloc(sizeof(struct uwsgi_stats_ext));
+	char *content_type = "application/json";
+	char *delta_mode = NULL;
+
+	struct uwsgi_stats *us = NULL;
+
+	if (stats_server_parse_query(query, query_len, ue, &token)) {
+		usc->ub = uwsgi_buffer_new(uwsgi.page_size);
+		if (uwsgi_buffer_append(usc->ub, "HTTP/1.0 400 Bad Request\r\nConnection: close\r\n\r\n", 47)) {
+			uwsgi_buffer_destroy(usc->ub);
+			usc->ub = NULL;
+		}
+		goto end;
+	}
+
+	// the classic document
+	if (!ue->selectors_cnt && !token && !ue->msgpack) {
+		us = uwsgi_master_generate_stats();
+		goto headers;
+	}
+
+	if (token) {
+		ue->delta = stats_delta_get(token);
+		ue->next_delta = stats_delta_new(token);
+		delta_mode = ue->delta ? "incremental" : "full";
+	}
+
+	us = uwsgi_stats_new(8192);
+	us->ext = ue;
+	ue->levels[0].mode = ue->selectors_cnt ? UWSGI_STATS_EXT_PARTIAL : UWSGI_STATS_EXT_FULL;
+	ue->levels[0].id = 0x9e3779b97f4a7c15ULL;
+	if (ue->msgpack) {
+		content_type = "application/x-msgpack";
+		us->pos = 0;
+		if (stats_ext_mp_header(us, 0xdf, 0)) {
+			free(us->base);
+			free(us);
+			us = NULL;
+		}
+	}
+
+	if (us)
+		us = uwsgi_master_fill_stats(us);
+	if (!us) {
+		if (ue->next_delta)
+			stats_delta_destroy(ue->next_delta);
+		goto end;
+	}
+	us->ext = NULL;
+	if (ue->next_delta)
+		stats_delta_store(ue->next_delta);
+
+headers:
+	if (!us)
+		goto end;
+	usc->ub = uwsgi_buffer_new(uwsgi.page_size);
+	if (uwsgi_buffer_append(usc->ub, "HTTP/1.0 200 OK\r\nConnection: close\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: ", 82))
+		goto error;
+	if (uwsgi_buffer_append(usc->ub, content_type, strlen(content_type)))
+		goto error;
+	if (uwsgi_buffer_append(usc->ub, "\r\nContent-Length: ", 18))
+		goto error;
+	if (uwsgi_buffer_num64(usc->ub, us->pos))
+		goto error;
+	if (delta_mode) {
+		if (uwsgi_buffer_append(usc->ub, "\r\nX-Stats-Delta: ", 17))
+			goto error;
+		if (uwsgi_buffer_append(usc->ub, delta_mode, strlen(delta_mode)))
+			goto error;
+	}
+	if (uwsgi_buffer_append(usc->ub, "\r\n\r\n", 4))
+		goto error;
+	goto end;
+
+error:
+	free(us->base);
+	free(us);
+	us = NULL;
+end:
+	free(ue);
+	return us;
+}
+
+// returns -1 on error, 0 if the request is not complete, 1 when the request is ready
+static int stats_client_read(struct uwsgi_stats_client *usc) {
+	ssize_t len = read(usc->fd, usc->buf + usc->len, (sizeof(usc->buf) - 1) - usc->len);
+	if (len <= 0) {
+		if (len < 0 && uwsgi_is_again())
+			return 0;
+		return -1;
+	}
+	usc->len += len;
+	usc->buf[usc->len] = 0;
+	if (strstr(usc->buf, "\r\n\r\n") || strstr(usc->buf, "\n\n"))
+		return 1;
+	// too big, try with what we have
+	if (usc->len >= sizeof(usc->buf) - 1)
+		return 1;
+	return 0;
+}
+
+static int stats_client_prepare(struct uwsgi_stats_client *usc) {
+	if (!uwsgi.stats_http) {
+		usc->us = uwsgi_master_generate_stats();
+		return usc->us ? 0 : -1;
+	}
+
+	char *query = NULL;
+	size_t query_len = 0;
+	// GET /?query HTTP/1.x
+	char *uri = strchr(usc->buf, ' ');
+	if (uri) {
+		uri++;
+		char *uri_end = uri + strcspn(uri, " \r\n");
+		char *qs = memchr(uri, '?', uri_end - uri);
+		if (qs) {
+			query = qs + 1;
+			query_len = uri_end - query;
+		}
+	}
+	usc->us = stats_server_generate(usc, query, query_len);
+	// bad requests only have headers
+	return usc->ub ? 0 : -1;
+}
+
+// returns -1 on error, 0 if the socket is not ready, 1 when the whole response has been sent
+static int stats_client_write(struct uwsgi_stats_client *usc) {
+	for (;;) {
+		char *buf;
+		size_t remains;
+		size_t *pos;
+		if (usc->ub && usc->ub_pos < usc->ub->pos) {
+			buf = usc->ub->buf + usc->ub_pos;
+			remains = usc->ub->pos - usc->ub_pos;
+			pos = &usc->ub_pos;
+		}
+		else if (usc->us && usc->us_pos < (size_t) usc->us->pos) {
+			buf = usc->us->base + usc->us_pos;
+			remains = usc->us->pos - usc->us_pos;
+			pos = &usc->us_pos;
+		}
+		else {
+			return 1;
+		}
+		ssize_t len = write(usc->fd, buf, remains);
+		if (len <= 0) {
+			if (len < 0 && uwsgi_is_again())
+				return 0;
+			if (len < 0)
+				uwsgi_error("uwsgi_stats_server_loop()/write()");
+			return -1;
+		}
+		*pos += len;
+	}
+}
+
+static void stats_client_destroy(struct uwsgi_stats_client **clients, struct uwsgi_stats_client *usc) {
+	close(usc->fd);
+	if (usc->prev)
+		usc->prev->next = usc->next;
+	else
+		*clients = usc->next;
+	if (usc->next)
+		usc->next->prev = usc->prev;
+	if (usc->ub)
+		uwsgi_buffer_destroy(usc->ub);
+	if (usc->us) {
+		free(usc->us->base);
+		free(usc->us);
+	}
+	free(usc);
+}
+
+void uwsgi_stats_server_loop(struct uwsgi_thread *ut) {
+	struct uwsgi_stats_client *clients = NULL;
+	int max_events = 64;
+	void *events = event_queue_alloc(max_events);
+
+	uwsgi_socket_nb(uwsgi.stats_fd);
+	if (event_queue_add_fd_read(ut->queue, uwsgi.stats_fd) < 0) {
+		uwsgi_log("[uwsgi-stats-server] unable to monitor the stats socket\n");
+		return;
+	}
+
+	for (;;) {
+		int i, nevents = event_queue_wait_multi(ut->queue, 1, events, max_events);
+		time_t now = uwsgi_now();
+		int timeout = uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT];
+
+		for (i = 0; i < nevents; i++) {
+			int interesting_fd = event_queue_interesting_fd(events, i);
+
+			if (interesting_fd == uwsgi.stats_fd) {
+				struct sockaddr_un client_src;
+				socklen_t client_src_len = sizeof(struct sockaddr_un);
+				int client_fd = accept(interesting_fd, (struct sockaddr *) &client_src, &client_src_len);
+				if (client_fd < 0) {
+					if (!uwsgi_is_again())
+						uwsgi_error("uwsgi_stats_server_loop()/accept()");
+					continue;
+				}
+				uwsgi_socket_nb(client_fd);
+				struct uwsgi_stats_client *usc = uwsgi_calloc(sizeof(struct uwsgi_stats_client));
+				usc->fd = client_fd;
+				usc->deadline = now + timeout;
+				usc->next = clients;
+				if (clients)
+					clients->prev = usc;
+				clients = usc;
+				// raw mode, the document is sent as soon as the client connects
+				if (!uwsgi.stats_http) {
+					if (stats_client_prepare(usc)) {
+						stats_client_destroy(&clients, usc);
+						continue;
+					}
+					usc->writing = 1;
+					if (event_queue_add_fd_write(ut->queue, client_fd) < 0)
+						stats_client_destroy(&clients, usc);
+					continue;
+				}
+				if (event_queue_add_fd_read(ut->queue, client_fd) < 0)
+					stats_client_destroy(&clients, usc);
+				continue;
+			}
+
+			struct uwsgi_stats_client *usc = clients;
+			while (usc) {
+				if (usc->fd == interesting_fd)
+					break;
+				usc = usc->next;
+			}
+			if (!usc) {
+				// the master does not talk with us
+				if (interesting_fd == ut->pipe[1]) {
+					char buf[4096];
+					if (read(interesting_fd, buf, 4096) <= 0) {
+						uwsgi_log("[uwsgi-stats-server] goodbye...\n");
+						return;
+					}
+				}
+				continue;
+			}
+
+			if (!usc->writing) {
+				int ret = stats_client_read(usc);
+				if (ret < 0) {
+					stats_client_destroy(&clients, usc);
+					continue;
+				}
+				if (ret == 0)
+					continue;
+				if (stats_client_prepare(usc)) {
+					stats_client_destroy(&clients, usc);
+					continue;
+				}
+				usc->writing = 1;
+				usc->deadline = now + timeout;
+				if (event_queue_fd_read_to_write(ut->queue, usc->fd) < 0)
+					stats_client_destroy(&clients, usc);
+				continue;
+			}
+
+			int ret = stats_client_write(usc);
+			if (ret)
+				stats_client_destroy(&clients, usc);
+			else
+				usc->deadline = now + timeout;
+		}
+
+		// drop stuck clients
+		struct uwsgi_stats_client *usc = clients;
+		while (usc) {
+			struct uwsgi_stats_client *next = usc->next;
+			if (usc->deadline < now)
+				stats_client_destroy(&clients, usc);
+			usc = next;
+		}
+	}
+}
@@ -78,7 +78,7 @@ struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_slo
 }
 
 // least reference count
-static struct uwsgi_subscribe_node *uwsgi_subscription_algo_lrc(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node) {
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_lrc(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, uint64_t hash) {
 	// if node is NULL we are in the second step (in lrc mode we do not use the first step)
 	if (node)
 		return NULL;
@@ -106,7 +106,7 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_lrc(struct uwsgi_sub
 }
 
 // weighted least reference count
-static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wlrc(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node) {
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wlrc(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, uint64_t hash) {
 	// if node is NULL we are in the second step (in wlrc mode we do not use the first step)
 	if (node)
 		return NULL;
@@ -140,7 +140,7 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wlrc(struct uwsgi_su
 }
 
 // weighted round robin algo
-static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wrr(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node) {
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wrr(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, uint64_t hash) {
 	// if node is NULL we are in the second step
 	if (node) {
 		if (node->death_mark == 0 && node->wrr > 0) {
@@ -179,6 +179,272 @@ static struct uwsgi_subscribe_node *uwsgi_subscription_algo_wrr(struct uwsgi_sub
 	return choosen_node;
 }
 
+/*
+	latency-aware power of two choices
+
+	two random nodes are taken from the slot index and the one with the lowest
+	(ewma_rt + 1) * (in-flight requests + 1) / weight wins, so every pick is O(1).
+	The response times are measured by the routers up to the first response byte
+	(see uwsgi_subscribe_node_rt()), upgraded and raw connections are not measured.
+	The in-flight requests are the reference count.
+
+	As the whole list is not walked anymore, every pick checks one more node
+	(round robin) for liveness and removes it when dead and unused.
+*/
+
+static uint64_t uwsgi_subscription_rand() {
+	static uint64_t state = 0;
+	if (!state)
+		state = (uwsgi_micros() ^ ((uint64_t) getpid() << 32)) | 1;
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+static int uwsgi_subscription_node_alive(struct uwsgi_subscribe_node *node, time_t now) {
+	if (node->death_mark)
+		return 0;
+	if (now - node->last_check > uwsgi.subscription_tolerance) {
+		uwsgi_log("[uwsgi-subscription for pid %d] %.*s => marking %.*s as failed (no announce received in %d seconds)\n", (int) uwsgi.mypid, (int) node->slot->keylen, node->slot->key, (int) node->len, node->name, uwsgi.subscription_tolerance);
+		node->failcnt++;
+		node->death_mark = 1;
+		return 0;
+	}
+	return 1;
+}
+
+// liveness sweep, the slot cannot be removed as the choosen node is still there
+static void uwsgi_subscription_sweep(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, struct uwsgi_subscribe_node *choosen_node, time_t now) {
+	struct uwsgi_subscribe_node *swept = current_slot->nodes_index[current_slot->sweep++ % current_slot->nodes_cnt];
+	if (swept != choosen_node && swept != node && !uwsgi_subscription_node_alive(swept, now) && swept->reference == 0) {
+		uwsgi_remove_subscribe_node(NULL, swept);
+	}
+}
+
+static double uwsgi_subscription_node_cost(struct uwsgi_subscribe_node *node) {
+	// node->weight is always >= 1, we can safely use it as divider
+	return ((double) node->ewma_rt + 1) * (double) (node->reference + 1) / (double) node->weight;
+}
+
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_ewma(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, uint64_t hash) {
+	// only the first step (the head of the list) is used
+	if (!node || node != current_slot->nodes || !current_slot->nodes_cnt)
+		return NULL;
+
+	time_t now = uwsgi_now();
+	uint64_t n = current_slot->nodes_cnt;
+	struct uwsgi_subscribe_node *choosen_node = NULL;
+	int i;
+	for (i = 0; i < 4 && !choosen_node; i++) {
+		uint64_t a = uwsgi_subscription_rand() % n;
+		struct uwsgi_subscribe_node *node_a = current_slot->nodes_index[a];
+		struct uwsgi_subscribe_node *node_b = NULL;
+		if (n > 1)
+			node_b = current_slot->nodes_index[(a + 1 + (uwsgi_subscription_rand() % (n - 1))) % n];
+		if (!uwsgi_subscription_node_alive(node_a, now))
+			node_a = NULL;
+		if (node_b && !uwsgi_subscription_node_alive(node_b, now))
+			node_b = NULL;
+		if (node_a && node_b)
+			choosen_node = uwsgi_subscription_node_cost(node_b) < uwsgi_subscription_node_cost(node_a) ? node_b : node_a;
+		else
+			choosen_node = node_a ? node_a : node_b;
+	}
+
+	// too many dead nodes, fallback to a full scan
+	if (!choosen_node) {
+		uint64_t j;
+		double min_cost = 0;
+		for (j = 0; j < n; j++) {
+			struct uwsgi_subscribe_node *candidate = current_slot->nodes_index[j];
+			if (!uwsgi_subscription_node_alive(candidate, now))
+				continue;
+			double cost = uwsgi_subscription_node_cost(candidate);
+			if (!choosen_node || cost < min_cost) {
+				min_cost = cost;
+				choosen_node = candidate;
+			}
+		}
+		if (!choosen_node)
+			return NULL;
+	}
+
+	choosen_node->reference++;
+	uwsgi_subscription_sweep(current_slot, node, choosen_node, now);
+	return choosen_node;
+}
+
+// account a response time (in microseconds, up to the first response byte) measured by a router
+void uwsgi_subscribe_node_rt(struct uwsgi_subscribe_node *node, uint64_t rt) {
+	// alpha = 1/8
+	if (!node->ewma_rt) {
+		node->ewma_rt = rt ? rt : 1;
+		return;
+	}
+	node->ewma_rt = node->ewma_rt - (node->ewma_rt >> 3) + (rt >> 3);
+	if (!node->ewma_rt)
+		node->ewma_rt = 1;
+}
+
+/*
+	bounded-load consistent hashing
+
+	every node gets UWSGI_SUBSCRIPTION_CHASH_POINTS points for each unit of its weight on a ring,
+	the hash of the request var (--subscription-chash-var) selects the first point clockwise.
+	The points of a node only depend on its name and weight, so adding or removing a node
+	(or changing its weight) only moves the keys of its own points.
+	Weights over UWSGI_SUBSCRIPTION_CHASH_MAX_WEIGHT are capped (to bound the ring size).
+
+	To avoid hot spots a node is skipped (moving to the next point) when its in-flight requests
+	are over --subscription-chash-load percent (default 125) of its weighted share.
+	Dead nodes are skipped too but they stay on the ring until removed, so their keys come back
+	to them when they are available again.
+*/
+
+#define UWSGI_SUBSCRIPTION_CHASH_POINTS 64
+#define UWSGI_SUBSCRIPTION_CHASH_MAX_WEIGHT 64
+
+static uint64_t uwsgi_subscription_hash_seed(char *buf, size_t len, uint64_t seed) {
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t) buf[i];
+		h *= 0x100000001b3ULL;
+	}
+	// final mix, fnv alone is badly distributed on short keys
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	// 0 means "no hash"
+	return h ? h : 1;
+}
+
+static int uwsgi_subscription_ring_cmp(const void *a, const void *b) {
+	const struct uwsgi_subscribe_ring_point *p1 = a, *p2 = b;
+	if (p1->hash < p2->hash)
+		return -1;
+	return p1->hash > p2->hash;
+}
+
+static void uwsgi_subscription_ring_build(struct uwsgi_subscribe_slot *current_slot) {
+	uint64_t i, j, points = 0;
+	uint64_t *node_points = uwsgi_malloc(sizeof(uint64_t) * current_slot->nodes_cnt);
+	for (i = 0; i < current_slot->nodes_cnt; i++) {
+		uint64_t weight = current_slot->nodes_index[i]->weight;
+		if (weight > UWSGI_SUBSCRIPTION_CHASH_MAX_WEIGHT)
+			weight = UWSGI_SUBSCRIPTION_CHASH_MAX_WEIGHT;
+		node_points[i] = UWSGI_SUBSCRIPTION_CHASH_POINTS * weight;
+		points += node_points[i];
+	}
+
+	free(current_slot->ring);
+	current_slot->ring = uwsgi_malloc(sizeof(struct uwsgi_subscribe_ring_point) * points);
+	current_slot->ring_len = 0;
+	for (i = 0; i < current_slot->nodes_cnt; i++) {
+		struct uwsgi_subscribe_node *node = current_slot->nodes_index[i];
+		for (j = 0; j < node_points[i]; j++) {
+			struct uwsgi_subscribe_ring_point *point = &current_slot->ring[current_slot->ring_len++];
+			point->hash = uwsgi_subscription_hash_seed(node->name, node->len, j);
+			point->node = node;
+		}
+	}
+	free(node_points);
+
+	qsort(current_slot->ring, current_slot->ring_len, sizeof(struct uwsgi_subscribe_ring_point), uwsgi_subscription_ring_cmp);
+	current_slot->ring_dirty = 0;
+}
+
+static struct uwsgi_subscribe_node *uwsgi_subscription_algo_chash(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node, uint64_t hash) {
+	// only the first step (the head of the list) is used
+	if (!node || node != current_slot->nodes || !current_slot->nodes_cnt)
+		return NULL;
+
+	if (current_slot->ring_dirty || !current_slot->ring)
+		uwsgi_subscription_ring_build(current_slot);
+
+	// no request var, spread the load
+	if (!hash)
+		hash = uwsgi_subscription_rand();
+
+	// first point >= hash
+	uint64_t low = 0, high = current_slot->ring_len;
+	while (low < high) {
+		uint64_t mid = low + ((high - low) / 2);
+		if (current_slot->ring[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	time_t now = uwsgi_now();
+	uint64_t load = uwsgi.subscription_chash_load > 100 ? uwsgi.subscription_chash_load : 125;
+	int has_bound = 0;
+	double bound = 0;
+	struct uwsgi_subscribe_node *choosen_node = NULL, *fallback = NULL;
+	uint64_t i;
+	for (i = 0; i < current_slot->ring_len; i++) {
+		struct uwsgi_subscribe_node *candidate = current_slot->ring[(low + i) % current_slot->ring_len].node;
+		if (!uwsgi_subscription_node_alive(candidate, now))
+			continue;
+		if (!fallback)
+			fallback = candidate;
+		// an idle node is always under the bound
+		if (candidate->reference == 0) {
+			choosen_node = candidate;
+			break;
+		}
+		// compute the per-weight bound only when required
+		if (!has_bound) {
+			uint64_t j, inflight = 0, weights = 0;
+			for (j = 0; j < current_slot->nodes_cnt; j++) {
+				struct uwsgi_subscribe_node *n = current_slot->nodes_index[j];
+				if (n->death_mark)
+					continue;
+				inflight += n->reference;
+				weights += n->weight;
+			}
+			bound = ((double) (inflight + 1) * (double) load) / (100.0 * (double) weights);
+			has_bound = 1;
+		}
+		if ((double) candidate->reference < bound * (double) candidate->weight) {
+			choosen_node = candidate;
+			break;
+		}
+	}
+
+	if (!choosen_node)
+		choosen_node = fallback;
+	if (!choosen_node)
+		return NULL;
+
+	choosen_node->reference++;
+	uwsgi_subscription_sweep(current_slot, node, choosen_node, now);
+	return choosen_node;
+}
+
+static void uwsgi_subscription_index_add(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node) {
+	if (current_slot->nodes_cnt >= current_slot->nodes_index_size) {
+		current_slot->nodes_index_size = current_slot->nodes_index_size ? current_slot->nodes_index_size * 2 : 8;
+		struct uwsgi_subscribe_node **nodes_index = realloc(current_slot->nodes_index, sizeof(struct uwsgi_subscribe_node *) * current_slot->nodes_index_size);
+		if (!nodes_index) {
+			uwsgi_error("uwsgi_subscription_index_add()/realloc()");
+			exit(1);
+		}
+		current_slot->nodes_index = nodes_index;
+	}
+	node->index_pos = current_slot->nodes_cnt;
+	current_slot->nodes_index[current_slot->nodes_cnt++] = node;
+	current_slot->ring_dirty = 1;
+}
+
+static void uwsgi_subscription_index_del(struct uwsgi_subscribe_slot *current_slot, struct uwsgi_subscribe_node *node) {
+	struct uwsgi_subscribe_node *last = current_slot->nodes_index[--current_slot->nodes_cnt];
+	current_slot->nodes_index[node->index_pos] = last;
+	last->index_pos = node->index_pos;
+	current_slot->ring_dirty = 1;
+}
+
 void uwsgi_subscription_set_algo(char *algo) {
 
 	if (!algo)
@@ -199,15 +465,36 @@ void uwsgi_subscription_set_algo(char *algo) {
 		return;
 	}
 
+	if (!strcmp(algo, "ewma") || !strcmp(algo, "p2c")) {
+		uwsgi.subscription_algo = uwsgi_subscription_algo_ewma;
+		return;
+	}
+
+	if (!strcmp(algo, "chash")) {
+		uwsgi.subscription_algo = uwsgi_subscription_algo_chash;
+		if (!uwsgi.subscription_chash_var)
+			uwsgi.subscription_chash_var = "REQUEST_URI";
+		return;
+	}
+
 wrr:
 	uwsgi.subscription_algo = uwsgi_subscription_algo_wrr;
 }
 
 struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen) {
+	return uwsgi_get_subscribe_node_hashed(slot, key, keylen, NULL, 0);
+}
+
+// hkey is the request element used by hash-based algos (can be NULL)
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_hashed(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen, char *hkey, uint16_t hkey_len) {
 
 	if (keylen > 0xff)
 		return NULL;
 
+	uint64_t hash = 0;
+	if (hkey)
+		hash = uwsgi_subscription_hash_seed(hkey, hkey_len, 0);
+
 	struct uwsgi_subscribe_slot *current_slot = uwsgi_get_subscribe_slot(slot, key, keylen);
 	if (!current_slot)
 		return NULL;
@@ -236,14 +523,14 @@ struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slo
 			continue;
 		}
 
-		struct uwsgi_subscribe_node *choosen_node = uwsgi.subscription_algo(current_slot, node);
+		struct uwsgi_subscribe_node *choosen_node = uwsgi.subscription_algo(current_slot, node, hash);
 		if (choosen_node)
 			return choosen_node;
 
 		node = node->next;
 	}
 
-	return uwsgi.subscription_algo(current_slot, node);
+	return uwsgi.subscription_algo(current_slot, node, hash);
 }
 
 struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_slot **slot, char *key, uint16_t keylen, char *val, uint16_t vallen) {
@@ -278,6 +565,8 @@ int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi
 	// over-engineering to avoid race conditions
 	node->len = 0;
 
+	uwsgi_subscription_index_del(node_slot, node);
+
 	if (node == node_slot->nodes) {
 		node_slot->nodes = node->next;
 	}
@@ -306,6 +595,8 @@ int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi
 				EVP_MD_CTX_destroy(node_slot->sign_ctx);
 			}
 #endif
+			free(node_slot->nodes_index);
+			free(node_slot->ring);
 			free(node_slot);
 			slot[hash_key] = NULL;
 			goto end;
@@ -329,6 +620,8 @@ int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **slot, struct uwsgi
 			EVP_MD_CTX_destroy(node_slot->sign_ctx);
 		}
 #endif
+		free(node_slot->nodes_index);
+		free(node_slot->ring);
 		free(node_slot);
 	}
 
@@ -373,9 +666,10 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 				node->last_check = uwsgi_now();
 				node->cores = usr->cores;
 				node->load = usr->load;
-				node->weight = usr->weight;
-				if (!node->weight)
-					node->weight = 1;
+				uint64_t weight = usr->weight ? usr->weight : 1;
+				if (node->weight != weight)
+					current_slot->ring_dirty = 1;
+				node->weight = weight;
 				node->last_requests = 0;
 				return node;
 			}
@@ -407,6 +701,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		if (!node->weight)
 			node->weight = 1;
 		node->wrr = 0;
+		node->ewma_rt = 0;
 		node->last_check = uwsgi_now();
 		node->slot = current_slot;
 		memcpy(node->name, usr->address, usr->address_len);
@@ -414,6 +709,7 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 			old_node->next = node;
 		}
 		node->next = NULL;
+		uwsgi_subscription_index_add(current_slot, node);
 		uwsgi_log("[uwsgi-subscription for pid %d] %.*s => new node: %.*s\n", (int) uwsgi.mypid, usr->keylen, usr->key, usr->address_len, usr->address);
 		return node;
 	}
@@ -466,6 +762,13 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		memcpy(current_slot->key, usr->key, usr->keylen);
 		current_slot->key[usr->keylen] = 0;
 		current_slot->hits = 0;
+		current_slot->nodes_index = NULL;
+		current_slot->nodes_cnt = 0;
+		current_slot->nodes_index_size = 0;
+		current_slot->sweep = 0;
+		current_slot->ring = NULL;
+		current_slot->ring_len = 0;
+		current_slot->ring_dirty = 1;
 
 		current_slot->nodes = uwsgi_malloc(sizeof(struct uwsgi_subscribe_node));
 		current_slot->nodes->slot = current_slot;
@@ -485,10 +788,12 @@ struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slo
 		if (!current_slot->nodes->weight)
 			current_slot->nodes->weight = 1;
 		current_slot->nodes->wrr = 0;
+		current_slot->nodes->ewma_rt = 0;
 		memcpy(current_slot->nodes->name, usr->address, usr->address_len);
 		current_slot->nodes->last_check = uwsgi_now();
 
 		current_slot->nodes->next = NULL;
+		uwsgi_subscription_index_add(current_slot, current_slot->nodes);
 
 		a_slot = slot[hash_key];
 		while (a_slot) {
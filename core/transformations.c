@@ -6,6 +6,9 @@
 
 	each body chunk is passed (in chain) to every transformation
 
+	buffers are handed from a stage to the next one (they are copied only when a
+	stage is accumulating data or when the chunk comes from the application)
+
 	some of them supports streaming, other requires buffering
 
 	at the end of the request the "final chain" is called (and the whole chain freed)
@@ -16,30 +19,68 @@
 
 extern struct uwsgi_server uwsgi;
 
+/*
+
+	hand the output of the previous stage (t_buf/t_len, owned by prev->chunk) to the next one
+
+	if the receiving buffer is empty the two buffers are simply swapped (no copy),
+	the data is appended only when the stage is accumulating (buffering transformations)
+	or when the chunk comes from the application (it is not ours)
+
+*/
+static int uwsgi_transformation_feed(struct uwsgi_transformation *ut, struct uwsgi_transformation *prev, char *t_buf, size_t t_len) {
+	ut->bytes_in += t_len;
+	if (t_len > 0 && prev && prev->chunk && prev->chunk->buf == t_buf && (!ut->chunk || ut->chunk->pos == 0)) {
+		struct uwsgi_buffer *ub = ut->chunk;
+		ut->chunk = prev->chunk;
+		ut->chunk->pos = t_len;
+		// the previous stage will reuse our (empty) buffer
+		prev->chunk = ub;
+		return 0;
+	}
+	if (!ut->chunk) {
+		if (t_len > 0) {
+			ut->chunk = uwsgi_buffer_new(t_len);
+		}
+		else {
+			ut->chunk = uwsgi_buffer_new(uwsgi.page_size);
+		}
+	}
+	if (t_len == 0) return 0;
+	ut->bytes_copied += t_len;
+	return uwsgi_buffer_append(ut->chunk, t_buf, t_len);
+}
+
+static int uwsgi_transformation_run(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
+	uint64_t now = uwsgi_micros();
+	ut->round++;
+	int ret = ut->func(wsgi_req, ut);
+	ut->micros += uwsgi_micros() - now;
+	if (!ret && ut->chunk) ut->bytes_out += ut->chunk->pos;
+	return ret;
+}
+
 // -1 error, 0 = no buffer, send the body, 1 = buffer
 int uwsgi_apply_transformations(struct wsgi_request *wsgi_req, char *buf, size_t len) {
 	wsgi_req->transformed_chunk = NULL;
 	wsgi_req->transformed_chunk_len = 0;
 	struct uwsgi_transformation *ut = wsgi_req->transformations;
+	// the transformation owning t_buf (NULL for the application chunk)
+	struct uwsgi_transformation *prev = NULL;
 	char *t_buf = buf;
 	size_t t_len = len;
 	uint8_t flushed = 0;
 	while(ut) {
-		// allocate the buffer (if needed)
-		if (!ut->chunk) {
-			ut->chunk = uwsgi_buffer_new(t_len);
-		}
 		// skip final transformations before appending data
 		if (ut->is_final) goto next;
-		if (uwsgi_buffer_append(ut->chunk, t_buf, t_len)) {
+		if (uwsgi_transformation_feed(ut, prev, t_buf, t_len)) {
 			return -1;
 		}
 
 		// if the transformation cannot stream, continue buffering (the func will be called at the end)
 		if (!ut->can_stream) return 1;
 		
-		ut->round++;
-		if (ut->func(wsgi_req, ut)) {
+		if (uwsgi_transformation_run(wsgi_req, ut)) {
 			return -1;
 		}
 
@@ -49,6 +90,7 @@ int uwsgi_apply_transformations(struct wsgi_request *wsgi_req, char *buf, size_t
 		t_len = ut->chunk->pos;
 		// we reset the buffer, so we do not waste memory
 		ut->chunk->pos = 0;
+		prev = ut;
 next:
 		ut = ut->next;
 	}
@@ -72,6 +114,7 @@ int uwsgi_apply_final_transformations(struct wsgi_request *wsgi_req) {
 	struct uwsgi_transformation *ut = wsgi_req->transformations;
 	wsgi_req->transformed_chunk = NULL;
         wsgi_req->transformed_chunk_len = 0;
+	struct uwsgi_transformation *prev = NULL;
 	char *t_buf = NULL;
 	size_t t_len = 0;
 	uint8_t flushed = 0;
@@ -82,32 +125,28 @@ int uwsgi_apply_final_transformations(struct wsgi_request *wsgi_req) {
 				found_nostream = 1;
 			}
 			else {
-				// stop the chain if no chunk is available
-				if (!ut->chunk) return 0;
-				t_buf = ut->chunk->buf;
-                		t_len = ut->chunk->pos;
+				// stop the chain if the transformation never received data
+				if (!ut->round) return 0;
+				// its buffer could have been handed to the next stage
+				if (ut->chunk) {
+					t_buf = ut->chunk->buf;
+                			t_len = ut->chunk->pos;
+				}
+				else {
+					t_buf = NULL;
+					t_len = 0;
+				}
+				prev = ut;
 				goto next;
 			}
 		}
 
-		if (!ut->chunk) {
-			if (t_len > 0) {
-				ut->chunk = uwsgi_buffer_new(t_len);
-			}
-			else {
-				ut->chunk = uwsgi_buffer_new(uwsgi.page_size);
-			}
-		}
-		
-		if (t_len > 0) {
-			if (uwsgi_buffer_append(ut->chunk, t_buf, t_len)) {
-				return -1;
-                	}
+		if (uwsgi_transformation_feed(ut, prev, t_buf, t_len)) {
+			return -1;
 		}
 		
 		// run the transformation
-		ut->round++;
-		if (ut->func(wsgi_req, ut)) {
+		if (uwsgi_transformation_run(wsgi_req, ut)) {
 			return -1;
                 }
 
@@ -115,6 +154,7 @@ int uwsgi_apply_final_transformations(struct wsgi_request *wsgi_req) {
 
 		t_buf = ut->chunk->buf;
 		t_len = ut->chunk->pos;
+		prev = ut;
 next:
 		ut = ut->next;
 	}
@@ -127,7 +167,40 @@ next:
         return 0;
 }
 
+static void uwsgi_transformations_log(struct wsgi_request *wsgi_req) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	struct uwsgi_transformation *ut = wsgi_req->transformations;
+	while(ut) {
+		if (uwsgi_buffer_append(ub, " ", 1)) goto end;
+		if (ut->name) {
+			if (uwsgi_buffer_append(ub, ut->name, strlen(ut->name))) goto end;
+		}
+		else {
+			if (uwsgi_buffer_append(ub, "-", 1)) goto end;
+		}
+		if (uwsgi_buffer_append(ub, ut->is_final ? "[final]" : (ut->can_stream ? "" : "[buffered]"), ut->is_final ? 7 : (ut->can_stream ? 0 : 10))) goto end;
+		if (uwsgi_buffer_append(ub, "(calls=", 7)) goto end;
+		if (uwsgi_buffer_num64(ub, ut->round)) goto end;
+		if (uwsgi_buffer_append(ub, " in=", 4)) goto end;
+		if (uwsgi_buffer_num64(ub, ut->bytes_in)) goto end;
+		if (uwsgi_buffer_append(ub, " out=", 5)) goto end;
+		if (uwsgi_buffer_num64(ub, ut->bytes_out)) goto end;
+		if (uwsgi_buffer_append(ub, " copied=", 8)) goto end;
+		if (uwsgi_buffer_num64(ub, ut->bytes_copied)) goto end;
+		if (uwsgi_buffer_append(ub, " micros=", 8)) goto end;
+		if (uwsgi_buffer_num64(ub, ut->micros)) goto end;
+		if (uwsgi_buffer_append(ub, ")", 1)) goto end;
+		ut = ut->next;
+	}
+	uwsgi_log("[transformations] %.*s %.*s =>%.*s\n", wsgi_req->method_len, wsgi_req->method, wsgi_req->uri_len, wsgi_req->uri, (int) ub->pos, ub->buf);
+end:
+	uwsgi_buffer_destroy(ub);
+}
+
 void uwsgi_free_transformations(struct wsgi_request *wsgi_req) {
+	if (uwsgi.log_transformations) {
+		uwsgi_transformations_log(wsgi_req);
+	}
 	struct uwsgi_transformation *ut = wsgi_req->transformations;
 	while(ut) {
 		struct uwsgi_transformation *current_ut = ut;
@@ -639,6 +639,12 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].write_errors += wsgi_req->write_errors;
 		// this is used for MAX_REQUESTS
 		uwsgi.workers[uwsgi.mywid].delta_requests++;
+		// the core is the only writer of its histograms
+		struct uwsgi_histogram *histograms = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].histograms;
+		if (histograms) {
+			uwsgi_histogram_add(&histograms[UWSGI_HISTOGRAM_RT], tmp_rt);
+			uwsgi_histogram_add(&histograms[UWSGI_HISTOGRAM_SIZE], wsgi_req->response_size + wsgi_req->headers_size);
+		}
 	}
 
 #ifdef UWSGI_ROUTING
@@ -646,12 +652,19 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	uwsgi_apply_final_routes(wsgi_req);
 #endif
 
+	// send the coalesced websocket frames
+	uwsgi_websocket_flush(wsgi_req);
+
 	// close the connection with the client
 	if (!wsgi_req->fd_closed) {
 		// NOTE, if we close the socket before receiving eventually sent data, socket layer will send a RST
 		wsgi_req->socket->proto_close(wsgi_req);
 	}
 
+	if (wsgi_req->post_mmap) {
+		munmap(wsgi_req->post_mmap, wsgi_req->post_cl);
+	}
+
 	if (wsgi_req->post_file) {
 		fclose(wsgi_req->post_file);
 	}
@@ -898,6 +911,7 @@ void wsgi_req_setup(struct wsgi_request *wsgi_req, int async_id, struct uwsgi_so
 	wsgi_req->sendfile_fd = -1;
 
 	wsgi_req->hvec = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].hvec;
+	wsgi_req->var_index = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].var_index;
 	// skip the first 4 bytes;
 	wsgi_req->uh = (struct uwsgi_header *) uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].buffer;
 	wsgi_req->buffer = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].buffer+4;
@@ -1030,6 +1044,17 @@ void uwsgi_heartbeat() {
 
 }
 
+// true if the core waits on fds not shared with the other workers
+static int wsgi_req_accept_has_private_fds(struct wsgi_request *wsgi_req) {
+	// some of the sockets are reuse-port shards of this worker
+	if (uwsgi.reuse_port_shard_mixed)
+		return 1;
+	// persistent connections registered in the queue of this core
+	if (uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].persistent_fds > 0)
+		return 1;
+	return 0;
+}
+
 // accept a request
 int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 
@@ -1037,9 +1062,18 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 	int interesting_fd = -1;
 	struct uwsgi_socket *uwsgi_sock = uwsgi.sockets;
 	int timeout = -1;
+	int locked = 0;
 
-
-	thunder_lock;
+	/*
+		a core waiting (under the thunder lock) on fds the other cores do not monitor would stall them,
+		and it cannot queue on the lock either (its holder could wait forever for a new connection):
+		such a core waits and accepts without the lock (the shared sockets are non-blocking,
+		so losing the race for a connection is harmless)
+	*/
+	if (!wsgi_req_accept_has_private_fds(wsgi_req)) {
+		thunder_lock;
+		locked = 1;
+	}
 
 	// heartbeat
 	// in multithreaded mode we are now locked
@@ -1062,7 +1096,9 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 
 	ret = event_queue_wait(queue, timeout, &interesting_fd);
 	if (ret < 0) {
-		thunder_unlock;
+		if (locked) {
+			thunder_unlock;
+		}
 		return -1;
 	}
 
@@ -1071,7 +1107,9 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 		uwsgi_heartbeat();
 		// no need to continue if timed-out
 		if (ret == 0) {
-			thunder_unlock;
+			if (locked) {
+				thunder_unlock;
+			}
 			return -1;
 		}
 	}
@@ -1082,7 +1120,9 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 
 	if (uwsgi.signal_socket > -1 && (interesting_fd == uwsgi.signal_socket || interesting_fd == uwsgi.my_signal_socket)) {
 
-		thunder_unlock;
+		if (locked) {
+			thunder_unlock;
+		}
 
 		uwsgi_receive_signal(interesting_fd, "worker", uwsgi.mywid);
 
@@ -1092,11 +1132,24 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 	}
 
 
+	// a new request on a persistent connection
+	if (uwsgi.persistent_sockets && interesting_fd > -1 && uwsgi.persistent_sockets[interesting_fd]) {
+		wsgi_req->socket = uwsgi.persistent_sockets[interesting_fd];
+		wsgi_req->fd = interesting_fd;
+		if (locked) {
+			thunder_unlock;
+		}
+		return 0;
+	}
+
+
 	while (uwsgi_sock) {
 		if (interesting_fd == uwsgi_sock->fd || (uwsgi_sock->retry && uwsgi_sock->retry[wsgi_req->async_id]) || (uwsgi_sock->fd_threads && interesting_fd == uwsgi_sock->fd_threads[wsgi_req->async_id])) {
 			wsgi_req->socket = uwsgi_sock;
 			wsgi_req->fd = wsgi_req->socket->proto_accept(wsgi_req, interesting_fd);
-			thunder_unlock;
+			if (locked) {
+				thunder_unlock;
+			}
 			if (wsgi_req->fd < 0) {
 				if (uwsgi.threads > 1)
 					pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ret);
@@ -1113,7 +1166,9 @@ int wsgi_req_accept(int queue, struct wsgi_request *wsgi_req) {
 		uwsgi_sock = uwsgi_sock->next;
 	}
 
-	thunder_unlock;
+	if (locked) {
+		thunder_unlock;
+	}
 	if (uwsgi.threads > 1)
 		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ret);
 	return -1;
@@ -1785,6 +1840,57 @@ void uwsgi_dyn_dict_del(struct uwsgi_dyn_dict *item) {
 	free(item);
 }
 
+/*
+	immutable hash index of a dyn dict (by key), used for read-mostly dictionaries
+	(like mime types) looked up on every request without locking.
+	When a key is repeated the first item wins, like a linear scan of the list.
+*/
+struct uwsgi_dyn_dict_index *uwsgi_dyn_dict_index_build(struct uwsgi_dyn_dict *dd) {
+	uint64_t count = 0;
+	struct uwsgi_dyn_dict *udd = dd;
+	while (udd) {
+		count++;
+		udd = udd->next;
+	}
+	if (!count)
+		return NULL;
+
+	uint32_t size = 1;
+	while (size < count * 2)
+		size <<= 1;
+
+	struct uwsgi_dyn_dict_index *uddi = uwsgi_malloc(sizeof(struct uwsgi_dyn_dict_index));
+	uddi->mask = size - 1;
+	uddi->items = uwsgi_calloc(sizeof(struct uwsgi_dyn_dict *) * size);
+
+	udd = dd;
+	while (udd) {
+		uint32_t pos = djb33x_hash(udd->key, udd->keylen) & uddi->mask;
+		while (uddi->items[pos]) {
+			if (!uwsgi_strncmp(uddi->items[pos]->key, uddi->items[pos]->keylen, udd->key, udd->keylen))
+				goto next;
+			pos = (pos + 1) & uddi->mask;
+		}
+		uddi->items[pos] = udd;
+next:
+		udd = udd->next;
+	}
+
+	return uddi;
+}
+
+struct uwsgi_dyn_dict *uwsgi_dyn_dict_index_get(struct uwsgi_dyn_dict_index *uddi, char *key, int keylen) {
+	if (!uddi)
+		return NULL;
+	uint32_t pos = djb33x_hash(key, keylen) & uddi->mask;
+	while (uddi->items[pos]) {
+		if (!uwsgi_strncmp(uddi->items[pos]->key, uddi->items[pos]->keylen, key, keylen))
+			return uddi->items[pos];
+		pos = (pos + 1) & uddi->mask;
+	}
+	return NULL;
+}
+
 void *uwsgi_malloc_shared(size_t size) {
 
 	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
@@ -2743,19 +2849,59 @@ void http_url_decode(char *buf, uint16_t * len, char *dst) {
 
 
 /*
-	we scan the table in reverse, as updated values are at the end
+	the vars index is built while parsing the request (an updated key points to the newest item),
+	vars added without updating it are scanned in reverse, as updated values are at the end
 */
+void uwsgi_var_index_add(struct wsgi_request *wsgi_req, uint16_t pos) {
+	// the index must cover a contiguous area
+	if (!wsgi_req->var_index || pos != wsgi_req->var_indexed) return;
+	if (pos == 0) {
+		memset(wsgi_req->var_index, 0, sizeof(uint16_t) * uwsgi.var_index_size);
+	}
+	uint32_t mask = uwsgi.var_index_size - 1;
+	uint32_t slot = djb33x_hash(wsgi_req->hvec[pos].iov_base, wsgi_req->hvec[pos].iov_len) & mask;
+	for(;;) {
+		uint16_t item = wsgi_req->var_index[slot];
+		if (!item) break;
+		if (!uwsgi_strncmp(wsgi_req->hvec[pos].iov_base, wsgi_req->hvec[pos].iov_len, wsgi_req->hvec[item-1].iov_base, wsgi_req->hvec[item-1].iov_len)) break;
+		slot = (slot + 1) & mask;
+	}
+	wsgi_req->var_index[slot] = pos + 1;
+	wsgi_req->var_indexed = pos + 2;
+}
+
+void uwsgi_var_index_build(struct wsgi_request *wsgi_req) {
+	uint16_t i;
+	for(i=wsgi_req->var_indexed;i+1<wsgi_req->var_cnt;i+=2) {
+		uwsgi_var_index_add(wsgi_req, i);
+	}
+}
+
 char *uwsgi_get_var(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t * len) {
 
 	int i;
 
-	for (i = wsgi_req->var_cnt-1; i > 0; i -= 2) {
+	for (i = wsgi_req->var_cnt-1; i > wsgi_req->var_indexed; i -= 2) {
 		if (!uwsgi_strncmp(key, keylen, wsgi_req->hvec[i-1].iov_base, wsgi_req->hvec[i-1].iov_len)) {
 			*len = wsgi_req->hvec[i].iov_len;
 			return wsgi_req->hvec[i].iov_base;
 		}
 	}
 
+	if (!wsgi_req->var_indexed) return NULL;
+
+	uint32_t mask = uwsgi.var_index_size - 1;
+	uint32_t slot = djb33x_hash(key, keylen) & mask;
+	for(;;) {
+		uint16_t item = wsgi_req->var_index[slot];
+		if (!item) break;
+		if (!uwsgi_strncmp(key, keylen, wsgi_req->hvec[item-1].iov_base, wsgi_req->hvec[item-1].iov_len)) {
+			*len = wsgi_req->hvec[item].iov_len;
+			return wsgi_req->hvec[item].iov_base;
+		}
+		slot = (slot + 1) & mask;
+	}
+
 	return NULL;
 }
 
@@ -38,6 +38,7 @@ UWSGI_DECLARE_EMBEDDED_PLUGINS;
 static struct uwsgi_option uwsgi_base_options[] = {
 	{"socket", required_argument, 's', "bind to the specified UNIX/TCP socket using default protocol", uwsgi_opt_add_socket, NULL, 0},
 	{"uwsgi-socket", required_argument, 's', "bind to the specified UNIX/TCP socket using uwsgi protocol", uwsgi_opt_add_socket, "uwsgi", 0},
+	{"puwsgi-socket", required_argument, 0, "bind to the specified UNIX/TCP socket using persistent uwsgi protocol (puwsgi)", uwsgi_opt_add_socket, "puwsgi", 0},
 
 	{"http-socket", required_argument, 0, "bind to the specified UNIX/TCP socket using HTTP protocol", uwsgi_opt_add_socket, "http", 0},
 	{"http-socket-modifier1", required_argument, 0, "force the specified modifier1 when using HTTP protocol", uwsgi_opt_set_64bit, &uwsgi.http_modifier1, 0},
@@ -388,6 +389,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"stats-server", required_argument, 0, "enable the stats server on the specified address", uwsgi_opt_set_str, &uwsgi.stats, UWSGI_OPT_MASTER},
 	{"stats-http", no_argument, 0, "prefix stats server json output with http headers", uwsgi_opt_true, &uwsgi.stats_http, UWSGI_OPT_MASTER},
 	{"stats-minified", no_argument, 0, "minify statistics json output", uwsgi_opt_true, &uwsgi.stats_minified, UWSGI_OPT_MASTER},
+	{"stats-histograms", no_argument, 0, "collect request time and response size histograms for each core (exposed by the stats subsystem)", uwsgi_opt_true, &uwsgi.stats_histograms, 0},
 	{"stats-min", no_argument, 0, "minify statistics json output", uwsgi_opt_true, &uwsgi.stats_minified, UWSGI_OPT_MASTER},
 	{"stats-push", required_argument, 0, "push the stats json to the specified destination", uwsgi_opt_add_string_list, &uwsgi.requested_stats_pushers, UWSGI_OPT_MASTER},
 	{"stats-pusher-default-freq", required_argument, 0, "set the default frequency of stats pushers", uwsgi_opt_set_int, &uwsgi.stats_pusher_default_freq, UWSGI_OPT_MASTER},
@@ -418,6 +420,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"subscriptions-sign-check-tolerance", required_argument, 0, "set the maximum tolerance (in seconds) of clock skew for secured subscription system", uwsgi_opt_set_int, &uwsgi.subscriptions_sign_check_tolerance, UWSGI_OPT_MASTER},
 #endif
 	{"subscription-algo", required_argument, 0, "set load balancing algorithm for the subscription system", uwsgi_opt_ssa, NULL, 0},
+	{"subscription-chash-var", required_argument, 0, "set the request var hashed by the chash subscription algo (default REQUEST_URI)", uwsgi_opt_set_str, &uwsgi.subscription_chash_var, 0},
+	{"subscription-chash-load", required_argument, 0, "set the max load (percent of the weighted average) of a node before the chash subscription algo skips it (default 125)", uwsgi_opt_set_int, &uwsgi.subscription_chash_load, 0},
 	{"subscription-dotsplit", no_argument, 0, "try to fallback to the next part (dot based) in subscription key", uwsgi_opt_true, &uwsgi.subscription_dotsplit, 0},
 	{"subscribe-to", required_argument, 0, "subscribe to the specified subscription server", uwsgi_opt_add_string_list, &uwsgi.subscriptions, UWSGI_OPT_MASTER},
 	{"st", required_argument, 0, "subscribe to the specified subscription server", uwsgi_opt_add_string_list, &uwsgi.subscriptions, UWSGI_OPT_MASTER},
@@ -428,6 +432,11 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"unsubscribe-on-graceful-reload", no_argument, 0, "force unsubscribe request even during graceful reload", uwsgi_opt_true, &uwsgi.unsubscribe_on_graceful_reload, 0},
 	{"snmp", optional_argument, 0, "enable the embedded snmp server", uwsgi_opt_snmp, NULL, 0},
 	{"snmp-community", required_argument, 0, "set the snmp community string", uwsgi_opt_snmp_community, NULL, 0},
+	{"enable-metrics", no_argument, 0, "enable the metrics subsystem", uwsgi_opt_true, &uwsgi.has_metrics, UWSGI_OPT_MASTER},
+	{"metric", required_argument, 0, "add a custom metric", uwsgi_opt_add_string_list, &uwsgi.additional_metrics, UWSGI_OPT_MASTER},
+	{"metrics-dir", required_argument, 0, "store metrics values as text files in the specified directory", uwsgi_opt_set_str, &uwsgi.metrics_dir, UWSGI_OPT_MASTER},
+	{"metrics-dir-restore", no_argument, 0, "restore the initial values of metrics from the metrics directory", uwsgi_opt_true, &uwsgi.metrics_dir_restore, UWSGI_OPT_MASTER},
+	{"metrics-no-cores", no_argument, 0, "disable generation of cores-related metrics", uwsgi_opt_true, &uwsgi.metrics_no_cores, UWSGI_OPT_MASTER},
 #ifdef UWSGI_SSL
 	{"ssl-verbose", no_argument, 0, "be verbose about SSL errors", uwsgi_opt_true, &uwsgi.ssl_verbose, 0},
 	// force master, as ssl sessions caching initialize locking early
@@ -467,6 +476,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"logger-list", no_argument, 0, "list enabled loggers", uwsgi_opt_true, &uwsgi.loggers_list, 0},
 	{"loggers-list", no_argument, 0, "list enabled loggers", uwsgi_opt_true, &uwsgi.loggers_list, 0},
 	{"threaded-logger", no_argument, 0, "offload log writing to a thread", uwsgi_opt_true, &uwsgi.threaded_logger, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
+	{"req-log-ring", required_argument, 0, "pass request logs to the master via per-core shared memory rings of the specified size (records are dropped when a ring is full)", uwsgi_opt_set_64bit, &uwsgi.req_log_ring_size, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
+	{"req-log-ring-drain", required_argument, 0, "set the interval (in milliseconds) between request log rings scans (default 10)", uwsgi_opt_set_int, &uwsgi.req_log_ring_drain, 0},
 #ifdef UWSGI_PCRE
 	{"log-drain", required_argument, 0, "drain (do not show) log lines matching the specified regexp", uwsgi_opt_add_regexp_list, &uwsgi.log_drain_rules, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
 	{"log-filter", required_argument, 0, "show only log lines matching the specified regexp", uwsgi_opt_add_regexp_list, &uwsgi.log_filter_rules, UWSGI_OPT_MASTER | UWSGI_OPT_LOG_MASTER},
@@ -511,6 +522,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"log-big", required_argument, 0, "log requestes bigger than the specified size", uwsgi_opt_set_dyn, (void *) UWSGI_OPTION_LOG_BIG, 0},
 	{"log-sendfile", required_argument, 0, "log sendfile requests", uwsgi_opt_dyn_true, (void *) UWSGI_OPTION_LOG_SENDFILE, 0},
 	{"log-micros", no_argument, 0, "report response time in microseconds instead of milliseconds", uwsgi_opt_true, &uwsgi.log_micros, 0},
+	{"log-transformations", no_argument, 0, "log bytes and time spent in each response transformation", uwsgi_opt_true, &uwsgi.log_transformations, 0},
 	{"log-x-forwarded-for", no_argument, 0, "use the ip from X-Forwarded-For header instead of REMOTE_ADDR", uwsgi_opt_true, &uwsgi.log_x_forwarded_for, 0},
 	{"master-as-root", no_argument, 0, "leave master process running as root", uwsgi_opt_true, &uwsgi.master_as_root, 0},
 	{"chdir", required_argument, 0, "chdir to specified directory before apps loading", uwsgi_opt_set_str, &uwsgi.chdir, 0},
@@ -595,6 +607,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 	{"websockets-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
 	{"websocket-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
+	{"websockets-coalesce", required_argument, 0, "coalesce outgoing websocket frames on TCP sockets (TCP_CORK) for up to the specified milliseconds (the kernel sends them after 200 ms at most)", uwsgi_opt_set_int, &uwsgi.websockets_coalesce, 0},
+	{"websocket-coalesce", required_argument, 0, "coalesce outgoing websocket frames on TCP sockets (TCP_CORK) for up to the specified milliseconds (the kernel sends them after 200 ms at most)", uwsgi_opt_set_int, &uwsgi.websockets_coalesce, 0},
 
 	{"chunked-input-limit", required_argument, 0, "set the max size of a chunked input part (default 1MB, in bytes)", uwsgi_opt_set_64bit, &uwsgi.chunked_input_limit, 0},
 	{"chunked-input-timeout", required_argument, 0, "set default timeout for chunked input", uwsgi_opt_set_int, &uwsgi.chunked_input_timeout, 0},
@@ -618,6 +632,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"static-safe", required_argument, 0, "skip security checks if the file is under the specified path", uwsgi_opt_add_string_list, &uwsgi.static_safe, UWSGI_OPT_MIME},
 	{"static-cache-paths", required_argument, 0, "put resolved paths in the uWSGI cache for the specified amount of seconds", uwsgi_opt_set_int, &uwsgi.use_static_cache_paths, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
 	{"static-cache-paths-name", required_argument, 0, "use the specified cache for static paths", uwsgi_opt_set_str, &uwsgi.static_cache_paths_name, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
+	{"static-fd-cache", required_argument, 0, "keep open descriptors, stat data and headers of up to n static files in each worker", uwsgi_opt_set_64bit, &uwsgi.static_fd_cache, UWSGI_OPT_MIME},
+	{"static-fd-cache-ttl", required_argument, 0, "revalidate static fd cache items after the specified number of seconds (default: 2 with inotify, 1 without)", uwsgi_opt_set_int, &uwsgi.static_fd_cache_ttl, UWSGI_OPT_MIME},
 	{"mimefile", required_argument, 0, "set mime types file path (default /etc/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
 	{"mime-file", required_argument, 0, "set mime types file path (default /etc/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
 
@@ -669,6 +685,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"ns-net", required_argument, 0, "add network namespace", uwsgi_opt_set_str, &uwsgi.ns_net, 0},
 #endif
 	{"reuse-port", no_argument, 0, "enable REUSE_PORT flag on socket (BSD only)", uwsgi_opt_true, &uwsgi.reuse_port, 0},
+	{"reuse-port-shard", no_argument, 0, "give each worker (or thread) its own SO_REUSEPORT listener on TCP sockets instead of sharing (and locking) a single one (connections are refused during a full reload, not compatible with cheap/idle/cheaper modes)", uwsgi_opt_true, &uwsgi.reuse_port_shard, 0},
+	{"reuse-port-shard-cpu", no_argument, 0, "steer reuse-port shards by cpu (SO_INCOMING_CPU), best used with --cpu-affinity", uwsgi_opt_true, &uwsgi.reuse_port_shard_cpu, 0},
 	{"tcp-fast-open", required_argument, 0, "enable TCP_FASTOPEN flag on TCP sockets with the specified qlen value", uwsgi_opt_set_int, &uwsgi.tcp_fast_open, 0},
 	{"tcp-fastopen", required_argument, 0, "enable TCP_FASTOPEN flag on TCP sockets with the specified qlen value", uwsgi_opt_set_int, &uwsgi.tcp_fast_open, 0},
 	{"tcp-fast-open-client", no_argument, 0, "use sendto(..., MSG_FASTOPEN, ...) instead of connect() if supported", uwsgi_opt_true, &uwsgi.tcp_fast_open_client, 0},
@@ -2287,6 +2305,10 @@ int uwsgi_start(void *v_argv) {
 			}
 			umd = umd->next;
 		}
+		// the dictionaries are immutable from now on, index them for lock-free lookups
+		uwsgi.mimetypes_index = uwsgi_dyn_dict_index_build(uwsgi.mimetypes);
+		uwsgi.static_expires_type_index = uwsgi_dyn_dict_index_build(uwsgi.static_expires_type);
+		uwsgi.static_expires_type_mtime_index = uwsgi_dyn_dict_index_build(uwsgi.static_expires_type_mtime);
 	}
 
 	if (uwsgi.async > 1) {
@@ -2396,6 +2418,9 @@ int uwsgi_start(void *v_argv) {
 		//now bind all the unbound sockets
 		uwsgi_bind_sockets();
 
+		// the per-worker listeners must be created before forking (and dropping privileges)
+		uwsgi_reuse_port_shards_create();
+
 		// put listening socket in non-blocking state and set the protocol
 		uwsgi_set_sockets_protocols();
 
@@ -2555,6 +2580,9 @@ unsafe:
 	// initialize workers/master shared memory segments
 	uwsgi_setup_workers();
 
+	// register metrics (values are in shared memory too)
+	uwsgi_setup_metrics();
+
 	// create signal pipes if master is enabled
 	if (uwsgi.master_process) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
@@ -2901,6 +2929,15 @@ void uwsgi_worker_run() {
 	}
 #endif
 
+	// pick the per-worker listeners before the event queues and the threads are created
+	uwsgi_reuse_port_shards_init();
+	// cores with persistent (puwsgi) connections wait for them without thunder lock
+	if (uwsgi.persistent_sockets)
+		uwsgi_listeners_nb();
+
+	// open files cache for static serving (private to the worker)
+	uwsgi_static_fd_cache_init();
+
 	//postpone the queue initialization as kevent
 	//do not pass kfd after fork()
 	if (uwsgi.async > 1) {
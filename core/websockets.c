@@ -1,5 +1,11 @@
 #include "uwsgi.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
 
         uWSGI websockets functions
@@ -10,27 +16,25 @@
 
 extern struct uwsgi_server uwsgi;
 
-static struct uwsgi_buffer *uwsgi_websocket_message(char *msg, size_t len) {
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(10 + len);
-	if (uwsgi_buffer_u8(ub, 0x81)) goto error;
+// encode the header of a text frame (max 10 bytes), returns its size
+static size_t uwsgi_websocket_header(uint8_t *hdr, size_t len) {
+	hdr[0] = 0x81;
 	if (len < 126) {
-		if (uwsgi_buffer_u8(ub, len)) goto error;
+		hdr[1] = len;
+		return 2;
 	}
-	else if (len <= (uint16_t) 0xffff) {
-		if (uwsgi_buffer_u8(ub, 126)) goto error;
-		if (uwsgi_buffer_u16be(ub, len)) goto error;
+	if (len <= (uint16_t) 0xffff) {
+		hdr[1] = 126;
+		hdr[2] = (uint8_t) ((len >> 8) & 0xff);
+		hdr[3] = (uint8_t) (len & 0xff);
+		return 4;
 	}
-	else {
-		if (uwsgi_buffer_u8(ub, 127)) goto error;
-                if (uwsgi_buffer_u64be(ub, len)) goto error;
+	hdr[1] = 127;
+	int i;
+	for(i=0;i<8;i++) {
+		hdr[2+i] = (uint8_t) ((((uint64_t) len) >> (56 - (i*8))) & 0xff);
 	}
-
-	if (uwsgi_buffer_append(ub, msg, len)) goto error;
-	return ub;
-
-error:
-	uwsgi_buffer_destroy(ub);
-	return NULL;
+	return 10;
 }
 
 static int uwsgi_websockets_ping(struct wsgi_request *wsgi_req) {
@@ -66,56 +70,173 @@ static int uwsgi_websockets_check_pingpong(struct wsgi_request *wsgi_req) {
 	return 0;
 }
 
-static int uwsgi_websocket_send_do(struct wsgi_request *wsgi_req, char *msg, size_t len) {
-	struct uwsgi_buffer *ub = uwsgi_websocket_message(msg, len);
-	if (!ub) return -1;
+/*
+	coalescing (--websockets-coalesce <ms>)
 
-	ssize_t ret = uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
+	frames are written as soon as they are sent, but the TCP socket is corked (TCP_CORK),
+	so the kernel merges them in full segments instead of sending a packet per frame.
+	The socket is uncorked (and the pending data sent):
+
+	- by the first send after --websockets-coalesce milliseconds from the corking
+	- before waiting for incoming messages (and by websocket_flush())
+	- at the end of the request
+
+	when the application stops sending without receiving, the kernel sends the pending data
+	after 200 milliseconds (the TCP_CORK ceiling), so that is the max delay in every case.
+	Unix sockets cannot be corked (and have no packets to merge), they are left alone.
+*/
+#ifdef TCP_CORK
+static void uwsgi_websocket_cork(struct wsgi_request *wsgi_req) {
+	int on = 1;
+	if (setsockopt(wsgi_req->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(int))) {
+		// do not try again
+		wsgi_req->websocket_corked = -1;
+		return;
+	}
+	wsgi_req->websocket_corked = 1;
+	wsgi_req->websocket_cork_start = uwsgi_micros();
+}
+#endif
+
+// send the coalesced frames
+int uwsgi_websocket_flush(struct wsgi_request *wsgi_req) {
+#ifdef TCP_CORK
+	if (wsgi_req->websocket_corked != 1) return 0;
+	int off = 0;
+	wsgi_req->websocket_corked = 0;
+	if (setsockopt(wsgi_req->fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(int))) {
+		uwsgi_error("uwsgi_websocket_flush()/setsockopt()");
+		wsgi_req->websocket_closed = 1;
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+static int uwsgi_websocket_send_iovec(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len) {
+#ifdef TCP_CORK
+	if (uwsgi.websockets_coalesce > 0 && wsgi_req->websocket_corked == 0) {
+		uwsgi_websocket_cork(wsgi_req);
+	}
+#endif
+	int ret = uwsgi_response_writev_body_do(wsgi_req, iov, iov_len);
+	if (ret < 0) return ret;
+#ifdef TCP_CORK
+	// the deadline is checked on every send
+	if (wsgi_req->websocket_corked == 1 && uwsgi_micros() - wsgi_req->websocket_cork_start >= (uint64_t) uwsgi.websockets_coalesce * 1000) {
+		return uwsgi_websocket_flush(wsgi_req);
+	}
+#endif
 	return ret;
-	
 }
 
 int uwsgi_websocket_send(struct wsgi_request *wsgi_req, char *msg, size_t len) {
 	if (wsgi_req->websocket_closed) {
                 return -1;
         }
-	ssize_t ret = uwsgi_websocket_send_do(wsgi_req, msg, len);
+	uint8_t hdr[10];
+	struct iovec iov[2];
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = uwsgi_websocket_header(hdr, len);
+	iov[1].iov_base = msg;
+	iov[1].iov_len = len;
+	int ret = uwsgi_websocket_send_iovec(wsgi_req, iov, 2);
+	if (ret < 0) {
+		wsgi_req->websocket_closed = 1;
+	}
+	return ret;
+}
+
+// send multiple messages with a single syscall
+int uwsgi_websocket_send_many(struct wsgi_request *wsgi_req, struct iovec *msgs, size_t n) {
+	if (wsgi_req->websocket_closed) {
+                return -1;
+        }
+	if (n == 0) return 0;
+	size_t i;
+	uint8_t *hdrs = uwsgi_malloc(10 * n);
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * n * 2);
+	for(i=0;i<n;i++) {
+		iov[i*2].iov_base = hdrs + (i*10);
+		iov[i*2].iov_len = uwsgi_websocket_header(hdrs + (i*10), msgs[i].iov_len);
+		iov[(i*2)+1] = msgs[i];
+	}
+	int ret = uwsgi_websocket_send_iovec(wsgi_req, iov, n * 2);
+	free(iov);
+	free(hdrs);
 	if (ret < 0) {
 		wsgi_req->websocket_closed = 1;
 	}
 	return ret;
 }
 
-static void uwsgi_websocket_parse_header(struct wsgi_request *wsgi_req) {
-	uint8_t byte1 = wsgi_req->websocket_buf->buf[0];
-	uint8_t byte2 = wsgi_req->websocket_buf->buf[1];
+static void uwsgi_websocket_parse_header(struct wsgi_request *wsgi_req, char *frame) {
+	uint8_t byte1 = frame[0];
+	uint8_t byte2 = frame[1];
 	wsgi_req->websocket_opcode = byte1 & 0xf;
 	wsgi_req->websocket_has_mask = byte2 >> 7;
 	wsgi_req->websocket_size = byte2 & 0x7f;
 }
 
-static struct uwsgi_buffer *uwsgi_websockets_parse(struct wsgi_request *wsgi_req) {
-	// de-mask buffer
-	uint8_t *ptr = (uint8_t *) (wsgi_req->websocket_buf->buf + (wsgi_req->websocket_pktsize - wsgi_req->websocket_size));
-	size_t i;
+/*
+	unmask the payload in place.
 
-	if (wsgi_req->websocket_has_mask) {
-		uint8_t *mask = ptr-4;
-		for(i=0;i<wsgi_req->websocket_size;i++) {
-			ptr[i] = ptr[i] ^ mask[i%4];	
-		}
+	The mask is 4 bytes long, so it can be repeated to unmask 8 (or 16/32 with SSE2/AVX2) bytes at a time
+*/
+static void uwsgi_websocket_unmask(uint8_t *ptr, size_t len, uint8_t *mask) {
+	size_t i = 0;
+	uint64_t mask64;
+	memcpy(&mask64, mask, 4);
+	memcpy(((uint8_t *) &mask64) + 4, mask, 4);
+
+#if defined(__AVX2__)
+	__m256i mask256 = _mm256_set1_epi64x((long long) mask64);
+	for(;i+32<=len;i+=32) {
+		__m256i chunk = _mm256_loadu_si256((__m256i *) (ptr+i));
+		_mm256_storeu_si256((__m256i *) (ptr+i), _mm256_xor_si256(chunk, mask256));
 	}
+#endif
+#if defined(__SSE2__)
+	__m128i mask128 = _mm_set1_epi64x((long long) mask64);
+	for(;i+16<=len;i+=16) {
+		__m128i chunk = _mm_loadu_si128((__m128i *) (ptr+i));
+		_mm_storeu_si128((__m128i *) (ptr+i), _mm_xor_si128(chunk, mask128));
+	}
+#endif
+	for(;i+8<=len;i+=8) {
+		uint64_t chunk;
+		memcpy(&chunk, ptr+i, 8);
+		chunk ^= mask64;
+		memcpy(ptr+i, &chunk, 8);
+	}
+	for(;i<len;i++) {
+		ptr[i] ^= mask[i%4];
+	}
+}
 
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(wsgi_req->websocket_size);
-	if (uwsgi_buffer_append(ub, (char *) ptr, wsgi_req->websocket_size)) goto error;	
-	if (uwsgi_buffer_decapitate(wsgi_req->websocket_buf, wsgi_req->websocket_pktsize)) goto error;
+// mark the current frame as consumed (the buffer is compacted only when more data is needed)
+static void uwsgi_websocket_consume(struct wsgi_request *wsgi_req) {
+	wsgi_req->websocket_offset += wsgi_req->websocket_pktsize;
+	if (wsgi_req->websocket_offset >= wsgi_req->websocket_buf->pos) {
+		wsgi_req->websocket_offset = 0;
+		wsgi_req->websocket_buf->pos = 0;
+	}
 	wsgi_req->websocket_phase = 0;
 	wsgi_req->websocket_need = 2;
-	return ub;
-error:
-	uwsgi_buffer_destroy(ub);
-	return NULL;
+}
+
+static char *uwsgi_websockets_parse(struct wsgi_request *wsgi_req, char *frame, size_t *len) {
+	// de-mask buffer
+	uint8_t *ptr = (uint8_t *) (frame + (wsgi_req->websocket_pktsize - wsgi_req->websocket_size));
+
+	if (wsgi_req->websocket_has_mask) {
+		uwsgi_websocket_unmask(ptr, wsgi_req->websocket_size, ptr-4);
+	}
+
+	*len = wsgi_req->websocket_size;
+	// the message memory is still valid until the next recv
+	uwsgi_websocket_consume(wsgi_req);
+	return (char *) ptr;
 }
 
 
@@ -133,6 +254,8 @@ static ssize_t uwsgi_websockets_recv_pkt(struct wsgi_request *wsgi_req, int nb)
 					if (uwsgi_websockets_check_pingpong(wsgi_req)) {
 						return -1;
 					}
+					// the application is going to wait for the peer
+					if (uwsgi_websocket_flush(wsgi_req)) return -1;
 					return 0;
 				}
                                 goto wait;
@@ -142,6 +265,8 @@ static ssize_t uwsgi_websockets_recv_pkt(struct wsgi_request *wsgi_req, int nb)
                 }
 
 wait:
+		// do not keep coalesced frames (or the ping) while waiting for the peer
+		if (uwsgi_websocket_flush(wsgi_req)) return -1;
                 ret = uwsgi.wait_read_hook(wsgi_req->fd, uwsgi.websockets_ping_freq);
                 if (ret > 0) {
 			rlen = wsgi_req->socket->proto_read_body(wsgi_req, wsgi_req->websocket_buf->buf + wsgi_req->websocket_buf->pos, wsgi_req->websocket_buf->len - wsgi_req->websocket_buf->pos);
@@ -162,7 +287,12 @@ wait:
 }
 
 
-static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_req, int nb) {
+/*
+	returns 0 when a message is available (in msg/len, pointing to the websocket buffer), -1 on error/close
+
+	in non-blocking mode an empty message is returned when no data is available
+*/
+static int uwsgi_websocket_recv_do(struct wsgi_request *wsgi_req, int nb, char **msg, size_t *msg_len) {
 	if (!wsgi_req->websocket_buf) {
 		// this buffer will be destroyed on connection close
 		wsgi_req->websocket_buf = uwsgi_buffer_new(uwsgi.page_size);
@@ -171,13 +301,14 @@ static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_re
 	}
 
 	for(;;) {
-		size_t remains = wsgi_req->websocket_buf->pos;
+		char *frame = wsgi_req->websocket_buf->buf + wsgi_req->websocket_offset;
+		size_t remains = wsgi_req->websocket_buf->pos - wsgi_req->websocket_offset;
 		// i have data;
 		if (remains >= wsgi_req->websocket_need) {
 			switch(wsgi_req->websocket_phase) {
 				// header
 				case 0:
-					uwsgi_websocket_parse_header(wsgi_req);
+					uwsgi_websocket_parse_header(wsgi_req, frame);
 					wsgi_req->websocket_pktsize = 2 + (wsgi_req->websocket_has_mask*4);
 					if (wsgi_req->websocket_size == 126) {
 						wsgi_req->websocket_need += 2;
@@ -196,18 +327,18 @@ static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_re
 				// size
 				case 1:
 					if (wsgi_req->websocket_size == 126) {
-						wsgi_req->websocket_size = uwsgi_be16(wsgi_req->websocket_buf->buf+2);
+						wsgi_req->websocket_size = uwsgi_be16(frame+2);
 					}
 					else if (wsgi_req->websocket_size == 127) {
-						wsgi_req->websocket_size = uwsgi_be64(wsgi_req->websocket_buf->buf+2);
+						wsgi_req->websocket_size = uwsgi_be64(frame+2);
 					}
 					else {
 						uwsgi_log("[uwsgi-websocket] BUG error in websocket parser\n");
-						return NULL;
+						return -1;
 					}
 					if (wsgi_req->websocket_size > (uwsgi.websockets_max_size*1024)) {
 						uwsgi_log("[uwsgi-websocket] invalid packet size received: %llu, max allowed: %llu\n", wsgi_req->websocket_size, uwsgi.websockets_max_size * 1024);
-						return NULL;
+						return -1;
 					}
 					wsgi_req->websocket_phase = 2;
 					break;
@@ -218,6 +349,7 @@ static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_re
 						wsgi_req->websocket_phase = 3;
 					}
 					else {
+						wsgi_req->websocket_pktsize += wsgi_req->websocket_size;
 						wsgi_req->websocket_need += wsgi_req->websocket_size;
 						wsgi_req->websocket_phase = 4;
 					}
@@ -235,14 +367,15 @@ static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_re
 						case 0:
 						case 1:
 						case 2:
-							return uwsgi_websockets_parse(wsgi_req);
+							*msg = uwsgi_websockets_parse(wsgi_req, frame, msg_len);
+							return 0;
 						// close
 						case 0x8:
-							return NULL;
+							return -1;
 						// ping
 						case 0x9:
 							if (uwsgi_websockets_pong(wsgi_req)) {
-								return NULL;
+								return -1;
 							}
 							break;
 						// pong
@@ -253,56 +386,83 @@ static struct uwsgi_buffer *uwsgi_websocket_recv_do(struct wsgi_request *wsgi_re
 							break;	
 					}
 					// reset the status
-					wsgi_req->websocket_phase = 0;	
-					wsgi_req->websocket_need = 2;	
-					// decapitate the buffer
-					if (uwsgi_buffer_decapitate(wsgi_req->websocket_buf, wsgi_req->websocket_pktsize)) return NULL;
+					uwsgi_websocket_consume(wsgi_req);
 					break;
 				// oops
 				default:
 					uwsgi_log("[uwsgi-websocket] BUG error in websocket parser\n");
-					return NULL;
+					return -1;
 			}
 		}
 		// need more data
 		else {
-			if (uwsgi_buffer_ensure(wsgi_req->websocket_buf, uwsgi.page_size)) return NULL;
+			// move the partial frame to the start of the buffer
+			if (wsgi_req->websocket_offset > 0) {
+				if (uwsgi_buffer_decapitate(wsgi_req->websocket_buf, wsgi_req->websocket_offset)) return -1;
+				wsgi_req->websocket_offset = 0;
+			}
+			if (uwsgi_buffer_ensure(wsgi_req->websocket_buf, uwsgi.page_size)) return -1;
 			ssize_t len = uwsgi_websockets_recv_pkt(wsgi_req, nb);
 			if (len <= 0) {
 				if (nb == 1 && len == 0) {
-					// return an empty buffer to signal blocking event
-					return uwsgi_buffer_new(0);
+					// return an empty message to signal blocking event
+					*msg = uwsgi.empty;
+					*msg_len = 0;
+					return 0;
 				}
-				return NULL;	
+				return -1;	
 			}
 			// update buffer size
 			wsgi_req->websocket_buf->pos+=len;
 		}
 	}
 
-	return NULL;
+	return -1;
 }
 
-struct uwsgi_buffer *uwsgi_websocket_recv(struct wsgi_request *wsgi_req) {
+static char *uwsgi_websocket_recv_view_do(struct wsgi_request *wsgi_req, int nb, size_t *len) {
 	if (wsgi_req->websocket_closed) {
 		return NULL;
 	}
-	struct uwsgi_buffer *ub = uwsgi_websocket_recv_do(wsgi_req, 0);
-	if (!ub) {
+	char *msg = NULL;
+	if (uwsgi_websocket_recv_do(wsgi_req, nb, &msg, len)) {
+		wsgi_req->websocket_closed = 1;
+		return NULL;
+	}
+	return msg;
+}
+
+/*
+	zero-copy api: the returned memory is part of the websocket buffer
+	and it is valid only until the next recv
+*/
+char *uwsgi_websocket_recv_view(struct wsgi_request *wsgi_req, size_t *len) {
+	return uwsgi_websocket_recv_view_do(wsgi_req, 0, len);
+}
+
+char *uwsgi_websocket_recv_view_nb(struct wsgi_request *wsgi_req, size_t *len) {
+	return uwsgi_websocket_recv_view_do(wsgi_req, 1, len);
+}
+
+static struct uwsgi_buffer *uwsgi_websocket_recv_copy(struct wsgi_request *wsgi_req, int nb) {
+	size_t len = 0;
+	char *msg = uwsgi_websocket_recv_view_do(wsgi_req, nb, &len);
+	if (!msg) return NULL;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(len);
+	if (uwsgi_buffer_append(ub, msg, len)) {
+		uwsgi_buffer_destroy(ub);
 		wsgi_req->websocket_closed = 1;
+		return NULL;
 	}
 	return ub;
 }
 
+struct uwsgi_buffer *uwsgi_websocket_recv(struct wsgi_request *wsgi_req) {
+	return uwsgi_websocket_recv_copy(wsgi_req, 0);
+}
+
 struct uwsgi_buffer *uwsgi_websocket_recv_nb(struct wsgi_request *wsgi_req) {
-        if (wsgi_req->websocket_closed) {
-                return NULL;
-        }
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv_do(wsgi_req, 1);
-        if (!ub) {
-                wsgi_req->websocket_closed = 1;
-        }
-        return ub;
+	return uwsgi_websocket_recv_copy(wsgi_req, 1);
 }
 
 
@@ -166,11 +166,8 @@ int uwsgi_response_add_header_force(struct wsgi_request *wsgi_req, char *key, ui
         return uwsgi_response_add_header_do(wsgi_req, key, key_len, value, value_len);
 }
 
-int uwsgi_response_write_headers_do(struct wsgi_request *wsgi_req) {
-	if (wsgi_req->headers_sent || !wsgi_req->headers || wsgi_req->response_size || wsgi_req->write_errors) {
-		return UWSGI_OK;
-	}
-
+// add the additional headers and let the protocol fix them
+static int uwsgi_response_finalize_headers(struct wsgi_request *wsgi_req) {
 	struct uwsgi_string_list *ah = uwsgi.additional_headers;
 	while(ah) {
 		if (uwsgi_response_add_header(wsgi_req, NULL, 0, ah->value, ah->len)) return -1;
@@ -185,6 +182,30 @@ int uwsgi_response_write_headers_do(struct wsgi_request *wsgi_req) {
 
 
 	if (wsgi_req->socket->proto_fix_headers(wsgi_req)) { wsgi_req->write_errors++ ; return -1;}
+	return 0;
+}
+
+// returns 1 when all of the iovecs have been consumed
+int uwsgi_iovec_consume(struct iovec *iov, size_t iov_len, size_t len) {
+	size_t i;
+	for(i=0;i<iov_len;i++) {
+		if (len < iov[i].iov_len) {
+			iov[i].iov_base = ((char *) iov[i].iov_base) + len;
+			iov[i].iov_len -= len;
+			return 0;
+		}
+		len -= iov[i].iov_len;
+		iov[i].iov_len = 0;
+	}
+	return 1;
+}
+
+int uwsgi_response_write_headers_do(struct wsgi_request *wsgi_req) {
+	if (wsgi_req->headers_sent || !wsgi_req->headers || wsgi_req->response_size || wsgi_req->write_errors) {
+		return UWSGI_OK;
+	}
+
+	if (uwsgi_response_finalize_headers(wsgi_req)) return -1;
 
 	for(;;) {
                 int ret = wsgi_req->socket->proto_write_headers(wsgi_req, wsgi_req->headers->buf, wsgi_req->headers->pos);
@@ -215,6 +236,56 @@ int uwsgi_response_write_headers_do(struct wsgi_request *wsgi_req) {
         return UWSGI_OK;
 }
 
+// send headers and the first chunk of the body with a single syscall (if the protocol supports it)
+static int uwsgi_response_writev_headers_and_body_do(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+
+	if (uwsgi_response_finalize_headers(wsgi_req)) return -1;
+
+	size_t headers_len = wsgi_req->headers->pos;
+	struct iovec iov[2];
+	iov[0].iov_base = wsgi_req->headers->buf;
+	iov[0].iov_len = headers_len;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = len;
+
+	int syscalls = 0;
+	for(;;) {
+		int ret = wsgi_req->socket->proto_writev(wsgi_req, iov, 2);
+		syscalls++;
+		if (ret < 0) {
+			if (!uwsgi.ignore_write_errors) {
+				uwsgi_error("uwsgi_response_writev_headers_and_body_do()");
+			}
+			wsgi_req->write_errors++;
+			return -1;
+		}
+		if (ret == UWSGI_OK) {
+			break;
+		}
+		ret = uwsgi_wait_write_req(wsgi_req);
+		if (ret < 0) { wsgi_req->write_errors++; return -1;}
+		if (ret == 0) {
+			uwsgi_log("uwsgi_response_writev_headers_and_body_do() TIMEOUT !!!\n");
+			wsgi_req->write_errors++;
+			return -1;
+		}
+	}
+
+	if (syscalls == 1) {
+		uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].single_syscall_responses++;
+	}
+
+	wsgi_req->headers_size += headers_len;
+	if (wsgi_req->write_pos > headers_len) {
+		wsgi_req->response_size += wsgi_req->write_pos - headers_len;
+	}
+	// reset for the next write
+	wsgi_req->write_pos = 0;
+	wsgi_req->headers_sent = 1;
+
+	return UWSGI_OK;
+}
+
 // this is the function called by all request plugins to send chunks to the client
 int uwsgi_response_write_body_do(struct wsgi_request *wsgi_req, char *buf, size_t len) {
 
@@ -242,6 +313,10 @@ int uwsgi_response_write_body_do(struct wsgi_request *wsgi_req, char *buf, size_
 write:
 	// send headers if not already sent
 	if (!wsgi_req->headers_sent) {
+		// gather them with the body
+		if (len > 0 && wsgi_req->headers && !wsgi_req->response_size && wsgi_req->socket->proto_writev) {
+			return uwsgi_response_writev_headers_and_body_do(wsgi_req, buf, len);
+		}
 		int ret = uwsgi_response_write_headers_do(wsgi_req);
                 if (ret == UWSGI_OK) goto sendbody;
                 if (ret == UWSGI_AGAIN) return UWSGI_AGAIN;
@@ -281,6 +356,69 @@ sendbody:
 	return UWSGI_OK;	
 }
 
+/*
+	send an array of body chunks with a single syscall (or one syscall every UWSGI_WRITEV_MAX chunks).
+
+	The iovec array is consumed. Protocols without writev() support and transformations
+	fallback to uwsgi_response_write_body_do()
+*/
+#define UWSGI_WRITEV_MAX 1024
+int uwsgi_response_writev_body_do(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len) {
+
+	size_t i;
+
+	if (wsgi_req->write_errors) return -1;
+	if (wsgi_req->ignore_body) return UWSGI_OK;
+
+	if (wsgi_req->transformations || !wsgi_req->socket->proto_writev) {
+		for(i=0;i<iov_len;i++) {
+			if (uwsgi_response_write_body_do(wsgi_req, iov[i].iov_base, iov[i].iov_len)) return -1;
+		}
+		return UWSGI_OK;
+	}
+
+	if (!wsgi_req->headers_sent) {
+		int ret = uwsgi_response_write_headers_do(wsgi_req);
+		if (ret == UWSGI_AGAIN) return UWSGI_AGAIN;
+		if (ret != UWSGI_OK) {
+			wsgi_req->write_errors++;
+			return -1;
+		}
+	}
+
+	while(iov_len > 0) {
+		size_t chunk = UMIN(iov_len, UWSGI_WRITEV_MAX);
+		for(;;) {
+			int ret = wsgi_req->socket->proto_writev(wsgi_req, iov, chunk);
+			if (ret < 0) {
+				if (!uwsgi.ignore_write_errors) {
+					uwsgi_error("uwsgi_response_writev_body_do()");
+				}
+				wsgi_req->write_errors++;
+				return -1;
+			}
+			if (ret == UWSGI_OK) {
+				break;
+			}
+			ret = uwsgi_wait_write_req(wsgi_req);
+			if (ret < 0) { wsgi_req->write_errors++; return -1;}
+			if (ret == 0) {
+				uwsgi_log("uwsgi_response_writev_body_do() TIMEOUT !!!\n");
+				wsgi_req->write_errors++;
+				return -1;
+			}
+		}
+		iov += chunk;
+		iov_len -= chunk;
+	}
+
+	wsgi_req->response_size += wsgi_req->write_pos;
+	// reset for the next write
+	wsgi_req->write_pos = 0;
+
+	return UWSGI_OK;
+}
+
 int uwsgi_response_sendfile_do(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
 	return uwsgi_response_sendfile_do_can_close(wsgi_req, fd, pos, len, 1);	
 }
@@ -134,6 +134,28 @@ end:
 }
 
 
+/*
+	finish a gzip stream without freeing it (the caller can deflateReset() it for the next response),
+	input still pending in z->next_in/z->avail_in is compressed too
+*/
+int uwsgi_gzip_finish(z_stream *z, uint32_t crc32, struct uwsgi_buffer *ub, size_t len) {
+	unsigned char out[8192];
+	for(;;) {
+		z->avail_out = 8192;
+		z->next_out = out;
+		int ret = deflate(z, Z_FINISH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return -1;
+		if (uwsgi_buffer_append(ub, (char *) out, 8192 - z->avail_out)) return -1;
+		if (ret == Z_STREAM_END) break;
+		// no progress and no more room needed: something is really wrong
+		if (ret == Z_BUF_ERROR && z->avail_out == 8192) return -1;
+	}
+	if (uwsgi_buffer_u32le(ub, crc32)) return -1;
+	if (uwsgi_buffer_u32le(ub, len)) return -1;
+	return 0;
+}
+
+
 char *uwsgi_deflate(z_stream *z, char *buf, size_t len, size_t *dlen) {
 
 	// calculate the amount of bytes needed for output (+30 should be enough)
@@ -78,10 +78,10 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "get", 3)) {
 		uint64_t vallen = 0;
 		uint64_t expires = 0;
-		uwsgi_rlock(uc->lock);
+		uwsgi_cache_rlock(uc, ucmc->key, ucmc->key_len);
 		char *value = uwsgi_cache_get3(uc, ucmc->key, ucmc->key_len, &vallen, &expires);
 		if (!value) {
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
 			return;
 		}
 		// we are still locked !!!
@@ -95,7 +95,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
 		if (uwsgi_buffer_append(ub, value, vallen)) goto error;
 		// unlock !!!
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
 		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
 		uwsgi_buffer_destroy(ub);
 		return;	
@@ -103,9 +103,9 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	// cache exists
 	if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "exists", 6)) {
-                uwsgi_rlock(uc->lock);
+                uwsgi_cache_rlock(uc, ucmc->key, ucmc->key_len);
                 if (!uwsgi_cache_exists2(uc, ucmc->key, ucmc->key_len)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
                         return;
                 }
                 // we are still locked !!!
@@ -114,7 +114,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
                 if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -122,9 +122,9 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	// cache del
         if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "del", 3)) {
-                uwsgi_wlock(uc->lock);
+                uwsgi_cache_wlock(uc, ucmc->key, ucmc->key_len);
                 if (uwsgi_cache_del2(uc, ucmc->key, ucmc->key_len, 0, 0)) {
-                        uwsgi_rwunlock(uc->lock);
+                        uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
                         return;
                 }
                 // we are still locked !!!
@@ -133,7 +133,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
                 if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -142,20 +142,18 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 	// cache clear
         if (!uwsgi_strncmp(ucmc->cmd, ucmc->cmd_len, "clear", 5)) {
 		uint64_t i;
-		uwsgi_wlock(uc->lock);
-		for (i = 1; i < uwsgi.caches->max_items; i++) {
-			if (uwsgi_cache_del2(uc, NULL, 0, i, 0)) {
-                                uwsgi_rwunlock(uc->lock);
-                                return;
-                        }	
+		uwsgi_cache_wlock_all(uc);
+		// free slots are simply skipped by uwsgi_cache_del2()
+		for (i = 1; i < uc->max_items; i++) {
+			uwsgi_cache_del2(uc, NULL, 0, i, 0);
 		}
                 // we are still locked !!!
                 ub = uwsgi_buffer_new(uwsgi.page_size);
                 ub->pos = 4;
-                if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
-                if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
+                if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error_all;
+                if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error_all;
                 // unlock !!!
-                uwsgi_rwunlock(uc->lock);
+                uwsgi_cache_rwunlock_all(uc);
                 uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -170,9 +168,9 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 		char *value = uwsgi_request_body_read(wsgi_req, ucmc->size, &rlen);
 		if (rlen != (ssize_t) ucmc->size) return;
 		// ok let's lock
-		uwsgi_wlock(uc->lock);
+		uwsgi_cache_wlock(uc, ucmc->key, ucmc->key_len);
 		if (uwsgi_cache_set2(uc, ucmc->key, ucmc->key_len, value, ucmc->size, ucmc->expires, ucmc->cmd_len > 3 ? UWSGI_CACHE_FLAG_UPDATE : 0)) {
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
 			return;
 		}
 		// we are still locked !!!
@@ -181,7 +179,7 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
                 if (uwsgi_buffer_append_keyval(ub, "status", 6, "ok", 2)) goto error;
 		if (uwsgi_buffer_set_uh(ub, 111, 17)) goto error;
 		// unlock !!!
-		uwsgi_rwunlock(uc->lock);
+		uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
 		uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
                 uwsgi_buffer_destroy(ub);
                 return;
@@ -189,7 +187,11 @@ static void manage_magic_context(struct wsgi_request *wsgi_req, struct uwsgi_cac
 
 	return;
 error:
-	uwsgi_rwunlock(uc->lock);
+	uwsgi_cache_rwunlock(uc, ucmc->key, ucmc->key_len);
+	uwsgi_buffer_destroy(ub);
+	return;
+error_all:
+	uwsgi_cache_rwunlock_all(uc);
 	uwsgi_buffer_destroy(ub);
 }
 
@@ -271,7 +273,7 @@ static int uwsgi_cache_request(struct wsgi_request *wsgi_req) {
 
 			if (!uc) break;
 
-			uwsgi_wlock(uc->lock);
+			uwsgi_cache_rlock_all(uc);
 			struct uwsgi_buffer *cache_dump = uwsgi_buffer_new(uwsgi.page_size + uc->filesize);
 			cache_dump->pos = 4;
 			if (uwsgi_buffer_append_keynum(cache_dump, "items", 5, uc->max_items)) {
@@ -282,6 +284,15 @@ static int uwsgi_cache_request(struct wsgi_request *wsgi_req) {
 				uwsgi_buffer_destroy(cache_dump);
 				break;
 			}
+			// the stripes layout of the items
+			if (uwsgi_buffer_append_keynum(cache_dump, "stripes", 7, uc->stripes)) {
+				uwsgi_buffer_destroy(cache_dump);
+				break;
+			}
+			if (uwsgi_buffer_append_keynum(cache_dump, "hashsize", 8, uc->hashsize)) {
+				uwsgi_buffer_destroy(cache_dump);
+				break;
+			}
 
 			if (uwsgi_buffer_set_uh(cache_dump, 111, 7)) {
 				uwsgi_buffer_destroy(cache_dump);
@@ -293,7 +304,7 @@ static int uwsgi_cache_request(struct wsgi_request *wsgi_req) {
 				break;
 			}
 
-			uwsgi_rwunlock(uc->lock);
+			uwsgi_cache_rwunlock_all(uc);
 
 			uwsgi_response_write_body_do(wsgi_req, cache_dump->buf, cache_dump->pos);
 			uwsgi_buffer_destroy(cache_dump);
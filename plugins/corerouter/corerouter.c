@@ -56,6 +56,144 @@ struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *cs) {
 	return peers;
 }
 
+#define UWSGI_CR_UPSTREAM_POOLS 256
+
+/*
+
+	upstream connections pool
+
+	backends bound with --puwsgi-socket frame their responses and terminate them
+	with an empty frame instead of closing the connection. Terminated connections are
+	parked in a per-backend pool (up to ucr->upstream_pool items) and reused
+	by the next session mapped to the same backend.
+
+*/
+
+static struct corerouter_upstream_pool *uwsgi_cr_upstream_pool(struct uwsgi_corerouter *ucr, char *address, uint64_t address_len) {
+	uint32_t slot = djb33x_hash(address, address_len) % UWSGI_CR_UPSTREAM_POOLS;
+	struct corerouter_upstream_pool *cup = ucr->upstream_pools[slot];
+	while(cup) {
+		if (!uwsgi_strncmp(cup->address, cup->address_len, address, address_len)) {
+			return cup;
+		}
+		cup = cup->next;
+	}
+
+	cup = uwsgi_calloc(sizeof(struct corerouter_upstream_pool));
+	cup->address = uwsgi_concat2n(address, address_len, "", 0);
+	cup->address_len = address_len;
+	cup->fds = uwsgi_malloc(sizeof(int) * ucr->upstream_pool);
+	cup->ts = uwsgi_malloc(sizeof(time_t) * ucr->upstream_pool);
+	cup->next = ucr->upstream_pools[slot];
+	ucr->upstream_pools[slot] = cup;
+	return cup;
+}
+
+// close the connections idle for more than upstream_pool_ttl seconds (the oldest are at the bottom of the stack)
+static void uwsgi_cr_upstream_pool_expire(struct uwsgi_corerouter *ucr, struct corerouter_upstream_pool *cup, time_t now) {
+	int expired = 0;
+	while(expired < cup->idle && cup->ts[expired] + ucr->upstream_pool_ttl <= now) {
+		close(cup->fds[expired]);
+		expired++;
+	}
+	if (!expired) return;
+	cup->idle -= expired;
+	memmove(cup->fds, cup->fds + expired, sizeof(int) * cup->idle);
+	memmove(cup->ts, cup->ts + expired, sizeof(time_t) * cup->idle);
+	ucr->upstream_pool_discarded += expired;
+}
+
+static void uwsgi_cr_upstream_sweep(struct uwsgi_corerouter *ucr, time_t now) {
+	int i;
+	for(i=0;i<UWSGI_CR_UPSTREAM_POOLS;i++) {
+		struct corerouter_upstream_pool *cup = ucr->upstream_pools[i];
+		while(cup) {
+			uwsgi_cr_upstream_pool_expire(ucr, cup, now);
+			cup = cup->next;
+		}
+	}
+	ucr->upstream_pool_last_sweep = now;
+}
+
+// get an idle connection to the peer backend (-1 if none is available)
+int uwsgi_cr_upstream_get(struct corerouter_peer *peer) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+	if (!ucr->upstream_pool) return -1;
+
+	// backends frame their responses on new connections too
+	peer->upstream_framed = 1;
+
+	struct corerouter_upstream_pool *cup = uwsgi_cr_upstream_pool(ucr, peer->instance_address, peer->instance_address_len);
+	uwsgi_cr_upstream_pool_expire(ucr, cup, uwsgi_now());
+
+	while(cup->idle > 0) {
+		cup->idle--;
+		int fd = cup->fds[cup->idle];
+		// health check: an idle connection must be still open and with nothing to read
+		char byte;
+		ssize_t rlen = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+		if (rlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			cup->hits++;
+			ucr->upstream_pool_hits++;
+			return fd;
+		}
+		close(fd);
+		ucr->upstream_pool_discarded++;
+	}
+
+	cup->misses++;
+	ucr->upstream_pool_misses++;
+	return -1;
+}
+
+// park the connection of a terminated response in the pool
+static int uwsgi_cr_upstream_put(struct corerouter_peer *peer) {
+	struct uwsgi_corerouter *ucr = peer->session->corerouter;
+	if (!ucr->upstream_pool || !peer->instance_address_len) return -1;
+
+	// stop monitoring it
+	if (uwsgi_cr_set_hooks(peer, NULL, NULL)) return -1;
+
+	struct corerouter_upstream_pool *cup = uwsgi_cr_upstream_pool(ucr, peer->instance_address, peer->instance_address_len);
+	time_t now = uwsgi_now();
+	uwsgi_cr_upstream_pool_expire(ucr, cup, now);
+	if (cup->idle >= ucr->upstream_pool) return -1;
+
+	cup->fds[cup->idle] = peer->fd;
+	cup->ts[cup->idle] = now;
+	cup->idle++;
+	return 0;
+}
+
+// read the payload of a framed response (0 on end of response)
+ssize_t uwsgi_cr_upstream_read(struct corerouter_peer *peer, char *buf, size_t len) {
+	if (peer->upstream_done) return 0;
+
+	if (peer->upstream_frame == 0) {
+		ssize_t rlen = read(peer->fd, peer->upstream_frame_hdr + peer->upstream_frame_hdr_pos, 4 - peer->upstream_frame_hdr_pos);
+		if (rlen <= 0) return rlen;
+		peer->upstream_frame_hdr_pos += rlen;
+		if (peer->upstream_frame_hdr_pos < 4) {
+			errno = EAGAIN;
+			return -1;
+		}
+		peer->upstream_frame_hdr_pos = 0;
+		uint8_t *hdr = (uint8_t *) peer->upstream_frame_hdr;
+		peer->upstream_frame = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t) hdr[3] << 24);
+		// the empty frame terminates the response
+		if (peer->upstream_frame == 0) {
+			peer->upstream_done = 1;
+			return 0;
+		}
+	}
+
+	ssize_t rlen = read(peer->fd, buf, UMIN(len, peer->upstream_frame));
+	if (rlen > 0) {
+		peer->upstream_frame -= rlen;
+	}
+	return rlen;
+}
+
 // reset a peer (allows it to connect to another backend)
 void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
 	if (peer->tmp_socket_name) {
@@ -65,7 +203,10 @@ void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
 	cr_del_timeout(peer->session->corerouter, peer);
 	
 	if (peer->fd != -1) {
-		close(peer->fd);
+		// terminated responses leave the connection reusable
+		if (!peer->upstream_done || uwsgi_cr_upstream_put(peer)) {
+			close(peer->fd);
+		}
 		peer->session->corerouter->cr_table[peer->fd] = NULL;
 		peer->fd = -1;
 		peer->hook_read = NULL;
@@ -77,7 +218,13 @@ void uwsgi_cr_peer_reset(struct corerouter_peer *peer) {
 	peer->timed_out = 0;
 
 	peer->un = NULL;
+	peer->un_start = 0;
 	peer->static_node = NULL;
+
+	peer->upstream_framed = 0;
+	peer->upstream_frame = 0;
+	peer->upstream_frame_hdr_pos = 0;
+	peer->upstream_done = 0;
 }
 
 // destroy a peer
@@ -273,12 +420,26 @@ void corerouter_manage_subscription(char *key, uint16_t keylen, char *val, uint1
 	}
 }
 
+// report the time to the first response byte of a backend peer (only once per peer)
+static void corerouter_peer_rt(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
+	if (ucr->subscriptions && peer->un && peer->un->len > 0) {
+		cr_subscriptions_lock(ucr);
+		uwsgi_subscribe_node_rt(peer->un, uwsgi_micros() - peer->un_start);
+		cr_subscriptions_unlock(ucr);
+	}
+	peer->un_start = 0;
+}
+
 void corerouter_close_peer(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
 	struct corerouter_session *cs = peer->session;
+	// in threads mode the subscription node could be freed by another thread as soon as its reference is released
+	int subscriptions_locked = 0;
 
 	
 	// manage subscription reference count
 	if (ucr->subscriptions && peer->un && peer->un->len > 0) {
+		cr_subscriptions_lock(ucr);
+		subscriptions_locked = 1;
                 // decrease reference count
 #ifdef UWSGI_DEBUG
                uwsgi_log("[1] node %.*s refcnt: %llu\n", peer->un->len, peer->un->name, peer->un->reference);
@@ -331,6 +492,11 @@ void corerouter_close_peer(struct uwsgi_corerouter *ucr, struct corerouter_peer
 		if (peer->retries >= (size_t) ucr->max_retries) goto end;
 
 		peer->retries++;	
+		// the mapper will lock the subscriptions again
+		if (subscriptions_locked) {
+			cr_subscriptions_unlock(ucr);
+			subscriptions_locked = 0;
+		}
 		// reset the peer
 		uwsgi_cr_peer_reset(peer);
 		// set new timeout
@@ -365,6 +531,9 @@ void corerouter_close_peer(struct uwsgi_corerouter *ucr, struct corerouter_peer
 
 end:
 	uwsgi_cr_peer_del(peer);
+	if (subscriptions_locked) {
+		cr_subscriptions_unlock(ucr);
+	}
 
 	if (peer == cs->main_peer) {
 		cs->main_peer = NULL;
@@ -391,10 +560,16 @@ void corerouter_close_session(struct uwsgi_corerouter *ucr, struct corerouter_se
 		struct corerouter_peer *tmp_peer = peers;
 		peers = peers->next;
 		// special case here for subscription system
+		int subscriptions_locked = 0;
 		if (ucr->subscriptions && tmp_peer->un && tmp_peer->un->len) {
+			cr_subscriptions_lock(ucr);
+			subscriptions_locked = 1;
 			tmp_peer->un->reference--;
 		}
 		uwsgi_cr_peer_del(tmp_peer);
+		if (subscriptions_locked) {
+			cr_subscriptions_unlock(ucr);
+		}
 	}
 
 	// could be used to free additional resources
@@ -605,6 +780,18 @@ struct corerouter_session *corerouter_alloc_session(struct uwsgi_corerouter *ucr
 	return cs;
 }
 
+static void corerouter_loop_run(struct uwsgi_corerouter *, int);
+
+static void *corerouter_thread(void *arg) {
+	struct uwsgi_corerouter *ucr = (struct uwsgi_corerouter *) arg;
+	// signals are managed by the main thread
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+	corerouter_loop_run(ucr, ucr->gateway_id);
+	return NULL;
+}
+
 void uwsgi_corerouter_loop(int id, void *data) {
 
 	int i;
@@ -621,18 +808,15 @@ void uwsgi_corerouter_loop(int id, void *data) {
 
 	ucr->i_am_cheap = ucr->cheap;
 
-	void *events = uwsgi_corerouter_setup_event_queue(ucr, id);
-
-	if (ucr->has_subscription_sockets)
-		event_queue_add_fd_read(ucr->queue, ushared->gateways[id].internal_subscription_pipe[1]);
-
-
 	if (!ucr->socket_timeout)
 		ucr->socket_timeout = 60;
 
 	if (!ucr->static_node_gracetime)
 		ucr->static_node_gracetime = 30;
 
+	if (ucr->upstream_pool > 0 && !ucr->upstream_pool_ttl)
+		ucr->upstream_pool_ttl = 30;
+
 	int i_am_the_first = 1;
 	for(i=0;i<id;i++) {
 		if (!strcmp(ushared->gateways[i].name, ucr->name)) {
@@ -654,7 +838,6 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			ucr->cr_stats_server = bind_to_unix(ucr->stats_server, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
 		}
 
-		event_queue_add_fd_read(ucr->queue, ucr->cr_stats_server);
 		uwsgi_log("*** %s stats server enabled on %s fd: %d ***\n", ucr->short_name, ucr->stats_server, ucr->cr_stats_server);
 	}
 
@@ -675,22 +858,10 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			ucr->pb_base_dir = "/tmp";
 	}
 
-	int nevents;
-
-	time_t delta;
-
-	struct uwsgi_rb_timer *min_timeout;
-
-	int new_connection;
-
-
 	if (ucr->pattern) {
 		init_magic_table(ucr->magic_table);
 	}
 
-	union uwsgi_sockaddr cr_addr;
-	socklen_t cr_addr_len = sizeof(struct sockaddr_un);
-
 	ucr->mapper = uwsgi_cr_map_use_void;
 
 			if (ucr->use_cache) {
@@ -723,6 +894,57 @@ void uwsgi_corerouter_loop(int id, void *data) {
                                 ucr->mapper = uwsgi_cr_map_use_static_nodes;
                         }
 
+	ucr->gateway_id = id;
+
+	if (ucr->threads > 1) {
+		ucr->subscriptions_lock = uwsgi_malloc(sizeof(pthread_mutex_t));
+		pthread_mutex_init(ucr->subscriptions_lock, NULL);
+		ucr->thread_crs = uwsgi_calloc(sizeof(struct uwsgi_corerouter *) * ucr->threads);
+		ucr->thread_crs[0] = ucr;
+		// every thread gets a copy of the fully configured corerouter (cr_table and subscriptions are shared)
+		for (i = 1; i < ucr->threads; i++) {
+			struct uwsgi_corerouter *tucr = uwsgi_malloc(sizeof(struct uwsgi_corerouter));
+			memcpy(tucr, ucr, sizeof(struct uwsgi_corerouter));
+			tucr->thread_id = i;
+			ucr->thread_crs[i] = tucr;
+		}
+		for (i = 1; i < ucr->threads; i++) {
+			pthread_t tid;
+			if (pthread_create(&tid, NULL, corerouter_thread, ucr->thread_crs[i])) {
+				uwsgi_error("uwsgi_corerouter_loop()/pthread_create()");
+				exit(1);
+			}
+		}
+		uwsgi_log("[%s pid %d] running with %d threads\n", ucr->name, (int) uwsgi.mypid, ucr->threads);
+	}
+
+	corerouter_loop_run(ucr, id);
+}
+
+// the event loop of a corerouter thread
+static void corerouter_loop_run(struct uwsgi_corerouter *ucr, int id) {
+
+	int i;
+	int nevents;
+	time_t delta;
+	struct uwsgi_rb_timer *min_timeout;
+	int new_connection;
+	union uwsgi_sockaddr cr_addr;
+	socklen_t cr_addr_len = sizeof(struct sockaddr_un);
+
+	void *events = uwsgi_corerouter_setup_event_queue(ucr, id);
+
+	// subscriptions and stats are managed by the first thread
+	if (!ucr->thread_id) {
+		if (ucr->has_subscription_sockets)
+			event_queue_add_fd_read(ucr->queue, ushared->gateways[id].internal_subscription_pipe[1]);
+		if (ucr->cr_stats_server > -1)
+			event_queue_add_fd_read(ucr->queue, ucr->cr_stats_server);
+	}
+
+	if (ucr->upstream_pool > 0)
+		ucr->upstream_pools = uwsgi_calloc(sizeof(struct corerouter_upstream_pool *) * UWSGI_CR_UPSTREAM_POOLS);
+
 	ucr->timeouts = uwsgi_init_rb_timer();
 
 	for (;;) {
@@ -742,7 +964,8 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			}
 		}
 
-		if (uwsgi.master_process && ucr->harakiri > 0) {
+		// harakiri is tracked by the first thread
+		if (uwsgi.master_process && ucr->harakiri > 0 && !ucr->thread_id) {
 			ushared->gateways_harakiri[id] = 0;
 		}
 
@@ -751,7 +974,7 @@ void uwsgi_corerouter_loop(int id, void *data) {
 
 		now = uwsgi_now();
 
-		if (uwsgi.master_process && ucr->harakiri > 0) {
+		if (uwsgi.master_process && ucr->harakiri > 0 && !ucr->thread_id) {
 			ushared->gateways_harakiri[id] = now + ucr->harakiri;
 		}
 
@@ -759,6 +982,10 @@ void uwsgi_corerouter_loop(int id, void *data) {
 			corerouter_expire_timeouts(ucr, now);
 		}
 
+		if (ucr->upstream_pools && now != ucr->upstream_pool_last_sweep) {
+			uwsgi_cr_upstream_sweep(ucr, now);
+		}
+
 		for (i = 0; i < nevents; i++) {
 
 			// get the interesting fd
@@ -836,10 +1063,12 @@ void uwsgi_corerouter_loop(int id, void *data) {
 				peer->session->main_peer->timeout = corerouter_reset_timeout_fast(ucr, peer->session->main_peer, now);
 
 				ssize_t (*hook)(struct corerouter_peer *) = NULL;
+				int is_read = 0;
 
 				// call event hook
 				if (event_queue_interesting_fd_is_read(events, i)) {
 					hook = peer->hook_read;	
+					is_read = 1;
 				}
 				else if (event_queue_interesting_fd_is_write(events, i)) {
 					hook = peer->hook_write;	
@@ -861,6 +1090,11 @@ void uwsgi_corerouter_loop(int id, void *data) {
 					corerouter_close_peer(ucr, peer);
 					continue;
 				}
+
+				// the first response bytes from a backend feed the latency-aware balancer
+				if (is_read && peer->un_start && peer != peer->session->main_peer) {
+					corerouter_peer_rt(ucr, peer);
+				}
 				
 			}
 		}
@@ -905,6 +1139,11 @@ int uwsgi_corerouter_init(struct uwsgi_corerouter *ucr) {
 
 		if (!ucr->max_retries)
 			ucr->max_retries = 3;
+
+		if (ucr->threads > 1 && ucr->cheap) {
+			uwsgi_log("the %s cheap mode is not supported in threads mode\n", ucr->name);
+			exit(1);
+		}
 	
 
 		ucr->has_backends = uwsgi_corerouter_has_backends(ucr);
@@ -952,6 +1191,21 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
                 }
         }
 
+	// in threads mode the counters are summed over all of the threads
+	int cr_threads = ucr->threads > 1 ? ucr->threads : 1;
+	uint64_t active_sessions = 0;
+	uint64_t upstream_pool_hits = 0;
+	uint64_t upstream_pool_misses = 0;
+	uint64_t upstream_pool_discarded = 0;
+	int t;
+	for(t=0;t<cr_threads;t++) {
+		struct uwsgi_corerouter *tucr = ucr->thread_crs ? ucr->thread_crs[t] : ucr;
+		active_sessions += tucr->active_sessions;
+		upstream_pool_hits += tucr->upstream_pool_hits;
+		upstream_pool_misses += tucr->upstream_pool_misses;
+		upstream_pool_discarded += tucr->upstream_pool_discarded;
+	}
+
 	struct uwsgi_stats *us = uwsgi_stats_new(8192);
 
         if (uwsgi_stats_keyval_comma(us, "version", UWSGI_VERSION)) goto end;
@@ -962,7 +1216,8 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
         char *cwd = uwsgi_get_cwd();
         if (uwsgi_stats_keyval_comma(us, "cwd", cwd)) goto end0;
 
-        if (uwsgi_stats_keylong_comma(us, "active_sessions", (unsigned long long) ucr->active_sessions)) goto end0;
+        if (uwsgi_stats_keylong_comma(us, "active_sessions", (unsigned long long) active_sessions)) goto end0;
+        if (uwsgi_stats_keylong_comma(us, "threads", (unsigned long long) cr_threads)) goto end0;
 
 	if (uwsgi_stats_key(us , ucr->short_name)) goto end0;
         if (uwsgi_stats_list_open(us)) goto end0;
@@ -1007,54 +1262,57 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 		if (uwsgi_stats_key(us , "subscriptions")) goto end0;
 		if (uwsgi_stats_list_open(us)) goto end0;
 
+		cr_subscriptions_lock(ucr);
+
 		int i;
 		int first_processed = 0;
 		for(i=0;i<UMAX16;i++) {
 			struct uwsgi_subscribe_slot *s_slot = ucr->subscriptions[i];
 			if (s_slot && first_processed) {
-				if (uwsgi_stats_comma(us)) goto end0;
+				if (uwsgi_stats_comma(us)) goto end1;
 			}
 			while (s_slot) {
 				first_processed = 1;
-				if (uwsgi_stats_object_open(us)) goto end0;
-				if (uwsgi_stats_keyvaln_comma(us, "key", s_slot->key, s_slot->keylen)) goto end0;
-				if (uwsgi_stats_keylong_comma(us, "hash", (unsigned long long) s_slot->hash)) goto end0;
-				if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) s_slot->hits)) goto end0;
+				if (uwsgi_stats_object_open(us)) goto end1;
+				if (uwsgi_stats_keyvaln_comma(us, "key", s_slot->key, s_slot->keylen)) goto end1;
+				if (uwsgi_stats_keylong_comma(us, "hash", (unsigned long long) s_slot->hash)) goto end1;
+				if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) s_slot->hits)) goto end1;
 
-				if (uwsgi_stats_key(us , "nodes")) goto end0;
-				if (uwsgi_stats_list_open(us)) goto end0;
+				if (uwsgi_stats_key(us , "nodes")) goto end1;
+				if (uwsgi_stats_list_open(us)) goto end1;
 
 				struct uwsgi_subscribe_node *s_node = s_slot->nodes;
 				while (s_node) {
-					if (uwsgi_stats_object_open(us)) goto end0;
-
-					if (uwsgi_stats_keyvaln_comma(us, "name", s_node->name, s_node->len)) goto end0;
-
-					if (uwsgi_stats_keylong_comma(us, "modifier1", (unsigned long long) s_node->modifier1)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "modifier2", (unsigned long long) s_node->modifier2)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "last_check", (unsigned long long) s_node->last_check)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "requests", (unsigned long long) s_node->requests)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "last_requests", (unsigned long long) s_node->last_requests)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "tx", (unsigned long long) s_node->transferred)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "cores", (unsigned long long) s_node->cores)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "load", (unsigned long long) s_node->load)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "weight", (unsigned long long) s_node->weight)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "wrr", (unsigned long long) s_node->wrr)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "ref", (unsigned long long) s_node->reference)) goto end0;
-					if (uwsgi_stats_keylong_comma(us, "failcnt", (unsigned long long) s_node->failcnt)) goto end0;
-					if (uwsgi_stats_keylong(us, "death_mark", (unsigned long long) s_node->death_mark)) goto end0;
-
-					if (uwsgi_stats_object_close(us)) goto end0;
+					if (uwsgi_stats_object_open(us)) goto end1;
+
+					if (uwsgi_stats_keyvaln_comma(us, "name", s_node->name, s_node->len)) goto end1;
+
+					if (uwsgi_stats_keylong_comma(us, "modifier1", (unsigned long long) s_node->modifier1)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "modifier2", (unsigned long long) s_node->modifier2)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "last_check", (unsigned long long) s_node->last_check)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "requests", (unsigned long long) s_node->requests)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "last_requests", (unsigned long long) s_node->last_requests)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "tx", (unsigned long long) s_node->transferred)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "cores", (unsigned long long) s_node->cores)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "load", (unsigned long long) s_node->load)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "weight", (unsigned long long) s_node->weight)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "wrr", (unsigned long long) s_node->wrr)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "ref", (unsigned long long) s_node->reference)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "ewma_rt", (unsigned long long) s_node->ewma_rt)) goto end1;
+					if (uwsgi_stats_keylong_comma(us, "failcnt", (unsigned long long) s_node->failcnt)) goto end1;
+					if (uwsgi_stats_keylong(us, "death_mark", (unsigned long long) s_node->death_mark)) goto end1;
+
+					if (uwsgi_stats_object_close(us)) goto end1;
 					if (s_node->next) {
-						if (uwsgi_stats_comma(us)) goto end0;
+						if (uwsgi_stats_comma(us)) goto end1;
 					}
 					s_node = s_node->next;
 				}
 
-				if (uwsgi_stats_list_close(us)) goto end0;
-				if (uwsgi_stats_object_close(us)) goto end0;
+				if (uwsgi_stats_list_close(us)) goto end1;
+				if (uwsgi_stats_object_close(us)) goto end1;
 				if (s_slot->next) {
-					if (uwsgi_stats_comma(us)) goto end0;
+					if (uwsgi_stats_comma(us)) goto end1;
 				}
 
 				s_slot = s_slot->next;
@@ -1064,10 +1322,52 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
 			}
 		}
 
+		cr_subscriptions_unlock(ucr);
+
 			if (uwsgi_stats_list_close(us)) goto end0;
 			if (uwsgi_stats_comma(us)) goto end0;
 	}
 
+	if (ucr->upstream_pools) {
+		if (uwsgi_stats_key(us , "upstream_pool")) goto end0;
+		if (uwsgi_stats_object_open(us)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "max_idle", (unsigned long long) ucr->upstream_pool)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "ttl", (unsigned long long) ucr->upstream_pool_ttl)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) upstream_pool_hits)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "misses", (unsigned long long) upstream_pool_misses)) goto end0;
+		if (uwsgi_stats_keylong_comma(us, "discarded", (unsigned long long) upstream_pool_discarded)) goto end0;
+
+		if (uwsgi_stats_key(us , "backends")) goto end0;
+		if (uwsgi_stats_list_open(us)) goto end0;
+		int i;
+		int first_processed = 0;
+		// pools are never freed, so the ones of the other threads can be safely walked
+		for(t=0;t<cr_threads;t++) {
+		struct uwsgi_corerouter *tucr = ucr->thread_crs ? ucr->thread_crs[t] : ucr;
+		if (!tucr->upstream_pools) continue;
+		for(i=0;i<UWSGI_CR_UPSTREAM_POOLS;i++) {
+			struct corerouter_upstream_pool *cup = tucr->upstream_pools[i];
+			while(cup) {
+				if (first_processed) {
+					if (uwsgi_stats_comma(us)) goto end0;
+				}
+				first_processed = 1;
+				if (uwsgi_stats_object_open(us)) goto end0;
+				if (uwsgi_stats_keyvaln_comma(us, "name", cup->address, cup->address_len)) goto end0;
+				if (uwsgi_stats_keylong_comma(us, "idle", (unsigned long long) cup->idle)) goto end0;
+				if (uwsgi_stats_keylong_comma(us, "hits", (unsigned long long) cup->hits)) goto end0;
+				if (uwsgi_stats_keylong_comma(us, "misses", (unsigned long long) cup->misses)) goto end0;
+				if (uwsgi_stats_keylong(us, "thread", (unsigned long long) t)) goto end0;
+				if (uwsgi_stats_object_close(us)) goto end0;
+				cup = cup->next;
+			}
+		}
+		}
+		if (uwsgi_stats_list_close(us)) goto end0;
+		if (uwsgi_stats_object_close(us)) goto end0;
+		if (uwsgi_stats_comma(us)) goto end0;
+	}
+
 	if (uwsgi_stats_keylong(us, "cheap", (unsigned long long) ucr->i_am_cheap)) goto end0;	
 
 	if (uwsgi_stats_object_close(us)) goto end0;
@@ -1090,6 +1390,10 @@ void corerouter_send_stats(struct uwsgi_corerouter *ucr) {
                 remains -= res;
         }
 
+	goto end0;
+
+end1:
+	cr_subscriptions_unlock(ucr);
 end0:
         free(cwd);
 end:
@@ -35,7 +35,8 @@
 
 #define cr_write_complete_buf(peer, buf) buf##_pos == buf->pos
 
-#define cr_connect(peer, f) peer->fd = uwsgi_connectn(peer->instance_address, peer->instance_address_len, 0, 1);\
+#define cr_connect(peer, f) peer->fd = uwsgi_cr_upstream_get(peer);\
+	if (peer->fd < 0) peer->fd = uwsgi_connectn(peer->instance_address, peer->instance_address_len, 0, 1);\
         if (peer->fd < 0) {\
                 peer->failed = 1;\
                 peer->soopt = errno;\
@@ -45,7 +46,7 @@
         peer->connecting = 1;\
 	cr_write_to_backend(peer, f);
 
-#define cr_read(peer, f) read(peer->fd, peer->in->buf + peer->in->pos, peer->in->len - peer->in->pos);\
+#define cr_read(peer, f) (peer->upstream_framed ? uwsgi_cr_upstream_read(peer, peer->in->buf + peer->in->pos, peer->in->len - peer->in->pos) : read(peer->fd, peer->in->buf + peer->in->pos, peer->in->len - peer->in->pos));\
 	if (len < 0) {\
                 cr_try_again;\
                 uwsgi_cr_error(peer, f);\
@@ -117,6 +118,9 @@
 	}\
 
 
+#define cr_subscriptions_lock(ucr) if (ucr->subscriptions_lock) pthread_mutex_lock(ucr->subscriptions_lock)
+#define cr_subscriptions_unlock(ucr) if (ucr->subscriptions_lock) pthread_mutex_unlock(ucr->subscriptions_lock)
+
 struct corerouter_session;
 
 // a peer is a connection to a socket (a client or a backend) and can be monitored for events.
@@ -154,6 +158,11 @@ struct corerouter_peer {
 
 	// backend info
         struct uwsgi_subscribe_node *un;
+	// when the subscription node has been choosen (for response time tracking)
+	uint64_t un_start;
+	// the request element hashed by the chash subscription algo
+	char *hash_key;
+	uint16_t hash_key_len;
         struct uwsgi_string_list *static_node;
 
 	// incoming data 
@@ -175,6 +184,15 @@ struct corerouter_peer {
 	// how many retries ?
 	uint16_t retries;
 
+	// the backend speaks persistent uwsgi (framed responses)
+	int upstream_framed;
+	// bytes still to read in the current frame
+	uint32_t upstream_frame;
+	char upstream_frame_hdr[4];
+	uint8_t upstream_frame_hdr_pos;
+	// the response has been terminated, the connection can go back to the pool
+	int upstream_done;
+
 	// parsed key
         char *key;
         uint16_t key_len;
@@ -186,6 +204,22 @@ struct corerouter_peer {
 	struct corerouter_peer *next;
 };
 
+// idle persistent connections to a backend
+struct corerouter_upstream_pool {
+	char *address;
+	uint64_t address_len;
+
+	// LIFO stack of idle connections (the most recently used is the warmest)
+	int *fds;
+	time_t *ts;
+	int idle;
+
+	uint64_t hits;
+	uint64_t misses;
+
+	struct corerouter_upstream_pool *next;
+};
+
 struct uwsgi_corerouter {
 
 	char *name;
@@ -258,6 +292,23 @@ struct uwsgi_corerouter {
 
 	uint64_t active_sessions;
 
+	// threads mode: every thread runs a copy of the corerouter with its own queue, timers and pool
+	int threads;
+	int thread_id;
+	int gateway_id;
+	struct uwsgi_corerouter **thread_crs;
+	// subscription slots are shared by the threads
+	pthread_mutex_t *subscriptions_lock;
+
+	// max idle persistent connections per backend (0 disables the pool)
+	int upstream_pool;
+	int upstream_pool_ttl;
+	struct corerouter_upstream_pool **upstream_pools;
+	time_t upstream_pool_last_sweep;
+	uint64_t upstream_pool_hits;
+	uint64_t upstream_pool_misses;
+	uint64_t upstream_pool_discarded;
+
 };
 
 // a session is started when a client connect to the router
@@ -341,3 +392,6 @@ struct corerouter_peer *uwsgi_cr_peer_add(struct corerouter_session *);
 struct corerouter_peer *uwsgi_cr_peer_find_by_sid(struct corerouter_session *, uint32_t);
 void corerouter_close_peer(struct uwsgi_corerouter *, struct corerouter_peer *);
 struct uwsgi_rb_timer *corerouter_reset_timeout(struct uwsgi_corerouter *, struct corerouter_peer *);
+
+int uwsgi_cr_upstream_get(struct corerouter_peer *);
+ssize_t uwsgi_cr_upstream_read(struct corerouter_peer *, char *, size_t);
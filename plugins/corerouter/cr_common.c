@@ -97,8 +97,20 @@ void *uwsgi_corerouter_setup_event_queue(struct uwsgi_corerouter *ucr, int id) {
 	struct uwsgi_gateway_socket *ugs = uwsgi.gateway_sockets;
 	while (ugs) {
 		if (!strcmp(ucr->name, ugs->owner)) {
-			if (!ucr->cheap || ugs->subscription) {
-				event_queue_add_fd_read(ucr->queue, ugs->fd);
+			if (ugs->subscription) {
+				// subscriptions are managed by the first thread
+				if (!ucr->thread_id) {
+					event_queue_add_fd_read(ucr->queue, ugs->fd);
+				}
+			}
+			else if (!ucr->cheap) {
+				// in threads mode a new connection wakes up a single thread
+				if (ucr->threads > 1) {
+					event_queue_add_fd_read_exclusive(ucr->queue, ugs->fd);
+				}
+				else {
+					event_queue_add_fd_read(ucr->queue, ugs->fd);
+				}
 			}
 			ugs->gateway = &ushared->gateways[id];
 		}
@@ -124,6 +136,7 @@ void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id,
 			usr.base_len = len - 4 - (2 + 4 + 2 + usr.sign_len);
 		}
 
+		cr_subscriptions_lock(ucr);
 		// subscribe request ?
 		if (bbuf[3] == 0) {
 			if (uwsgi_add_subscribe_node(ucr->subscriptions, &usr) && ucr->i_am_cheap) {
@@ -145,11 +158,11 @@ void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id,
 #ifdef UWSGI_SSL
 				if (uwsgi.subscriptions_sign_check_dir) {
 					if (usr.sign_len == 0 || usr.base_len == 0)
-						return;
+						goto unlock;
 					if (usr.unix_check <= node->unix_check)
-						return;
+						goto unlock;
 					if (!uwsgi_subscription_sign_check(node->slot, &usr)) {
-						return;
+						goto unlock;
 					}
 				}
 #endif
@@ -167,6 +180,8 @@ void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id,
 			}
 		}
 
+		cr_subscriptions_unlock(ucr);
+
 		// propagate the subscription to other nodes
 		for (i = 0; i < ushared->gateways_cnt; i++) {
 			if (i == id)
@@ -178,7 +193,12 @@ void uwsgi_corerouter_manage_subscription(struct uwsgi_corerouter *ucr, int id,
 			}
 		}
 	}
-
+	return;
+#ifdef UWSGI_SSL
+unlock:
+	// invalid signature, do not propagate
+	cr_subscriptions_unlock(ucr);
+#endif
 }
 
 void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *ucr, int fd) {
@@ -192,6 +212,7 @@ void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *ucr,
 		memset(&usr, 0, sizeof(struct uwsgi_subscribe_req));
 		uwsgi_hooked_parse(bbuf + 4, len - 4, corerouter_manage_subscription, &usr);
 
+		cr_subscriptions_lock(ucr);
 		// subscribe request ?
 		if (bbuf[3] == 0) {
 			if (uwsgi_add_subscribe_node(ucr->subscriptions, &usr) && ucr->i_am_cheap) {
@@ -223,6 +244,7 @@ void uwsgi_corerouter_manage_internal_subscription(struct uwsgi_corerouter *ucr,
 				}
 			}
 		}
+		cr_subscriptions_unlock(ucr);
 	}
 
 }
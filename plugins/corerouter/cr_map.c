@@ -10,7 +10,7 @@ int uwsgi_cr_map_use_void(struct uwsgi_corerouter *ucr, struct corerouter_peer *
 
 int uwsgi_cr_map_use_cache(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
 	uint64_t hits = 0;
-	uwsgi_rlock(ucr->cache->lock);
+	uwsgi_cache_rlock(ucr->cache, peer->key, peer->key_len);
 	char *value = uwsgi_cache_get4(ucr->cache, peer->key, peer->key_len, &peer->instance_address_len, &hits);
 	if (!value) goto end;
 	peer->tmp_socket_name = uwsgi_concat2n(value, peer->instance_address_len, "", 0);
@@ -31,7 +31,7 @@ int uwsgi_cr_map_use_cache(struct uwsgi_corerouter *ucr, struct corerouter_peer
 		peer->instance_address_len = (cs_mod - peer->instance_address);
 	}
 end:
-	uwsgi_rwunlock(ucr->cache->lock);
+	uwsgi_cache_rwunlock(ucr->cache, peer->key, peer->key_len);
 	return 0;
 }
 
@@ -48,8 +48,10 @@ int uwsgi_cr_map_use_pattern(struct uwsgi_corerouter *ucr, struct corerouter_pee
 
 int uwsgi_cr_map_use_subscription(struct uwsgi_corerouter *ucr, struct corerouter_peer *peer) {
 
-	peer->un = uwsgi_get_subscribe_node(ucr->subscriptions, peer->key, peer->key_len);
+	cr_subscriptions_lock(ucr);
+	peer->un = uwsgi_get_subscribe_node_hashed(ucr->subscriptions, peer->key, peer->key_len, peer->hash_key, peer->hash_key_len);
 	if (peer->un && peer->un->len) {
+		peer->un_start = uwsgi_micros();
 		peer->instance_address = peer->un->name;
 		peer->instance_address_len = peer->un->len;
 		peer->modifier1 = peer->un->modifier1;
@@ -57,6 +59,7 @@ int uwsgi_cr_map_use_subscription(struct uwsgi_corerouter *ucr, struct coreroute
 	else if (ucr->cheap && !ucr->i_am_cheap && uwsgi_no_subscriptions(ucr->subscriptions)) {
 		uwsgi_gateway_go_cheap(ucr->name, ucr->queue, &ucr->i_am_cheap);
 	}
+	cr_subscriptions_unlock(ucr);
 
 	return 0;
 }
@@ -66,11 +69,13 @@ int uwsgi_cr_map_use_subscription_dotsplit(struct uwsgi_corerouter *ucr, struct
 	char *name = peer->key;
 	uint16_t name_len = peer->key_len;
 
+	cr_subscriptions_lock(ucr);
+
 split:
 #ifdef UWSGI_DEBUG
 	uwsgi_log("trying with %.*s\n", name_len, name);
 #endif
-        peer->un = uwsgi_get_subscribe_node(ucr->subscriptions, name, name_len);
+        peer->un = uwsgi_get_subscribe_node_hashed(ucr->subscriptions, name, name_len, peer->hash_key, peer->hash_key_len);
 	if (!peer->un) {
 		char *next = memchr(name+1, '.', name_len-1);
 		if (next) {
@@ -81,6 +86,7 @@ split:
 	}
 
         if (peer->un && peer->un->len) {
+                peer->un_start = uwsgi_micros();
                 peer->instance_address = peer->un->name;
                 peer->instance_address_len = peer->un->len;
                 peer->modifier1 = peer->un->modifier1;
@@ -88,6 +94,7 @@ split:
         else if (ucr->cheap && !ucr->i_am_cheap && uwsgi_no_subscriptions(ucr->subscriptions)) {
                 uwsgi_gateway_go_cheap(ucr->name, ucr->queue, &ucr->i_am_cheap);
         }
+	cr_subscriptions_unlock(ucr);
 
         return 0;
 }
@@ -37,6 +37,7 @@ static struct uwsgi_option fastrouter_options[] = {
 	{"fastrouter-events", required_argument, 0, "set the maximum number of concurrent events", uwsgi_opt_set_int, &ufr.cr.nevents, 0},
 	{"fastrouter-quiet", required_argument, 0, "do not report failed connections to instances", uwsgi_opt_true, &ufr.cr.quiet, 0},
 	{"fastrouter-cheap", no_argument, 0, "run the fastrouter in cheap mode", uwsgi_opt_true, &ufr.cr.cheap, 0},
+	{"fastrouter-threads", required_argument, 0, "run the fastrouter with the specified number of event loop threads", uwsgi_opt_set_int, &ufr.cr.threads, 0},
 	{"fastrouter-subscription-server", required_argument, 0, "run the fastrouter subscription server on the spcified address", uwsgi_opt_corerouter_ss, &ufr, 0},
 	{"fastrouter-subscription-slot", required_argument, 0, "*** deprecated ***", uwsgi_opt_deprecated, (void *) "useless thanks to the new implementation", 0},
 
@@ -47,6 +48,8 @@ static struct uwsgi_option fastrouter_options[] = {
 	{"fastrouter-stats", required_argument, 0, "run the fastrouter stats server", uwsgi_opt_set_str, &ufr.cr.stats_server, 0},
 	{"fastrouter-stats-server", required_argument, 0, "run the fastrouter stats server", uwsgi_opt_set_str, &ufr.cr.stats_server, 0},
 	{"fastrouter-ss", required_argument, 0, "run the fastrouter stats server", uwsgi_opt_set_str, &ufr.cr.stats_server, 0},
+	{"fastrouter-upstream-pool", required_argument, 0, "keep up to the specified number of idle connections per backend (backends must be bound with --puwsgi-socket)", uwsgi_opt_set_int, &ufr.cr.upstream_pool, 0},
+	{"fastrouter-upstream-pool-ttl", required_argument, 0, "close idle backend connections after the specified number of seconds (default 30)", uwsgi_opt_set_int, &ufr.cr.upstream_pool_ttl, 0},
 	{"fastrouter-harakiri", required_argument, 0, "enable fastrouter harakiri", uwsgi_opt_set_int, &ufr.cr.harakiri, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
@@ -57,6 +60,13 @@ static void fr_get_hostname(char *key, uint16_t keylen, char *val, uint16_t vall
 	struct fastrouter_session *fr = (struct fastrouter_session *) peer->session;
 
 	//uwsgi_log("%.*s = %.*s\n", keylen, key, vallen, val);
+
+	// the request element used by the chash subscription algo
+	if (uwsgi.subscription_chash_var && !uwsgi_strncmp(uwsgi.subscription_chash_var, strlen(uwsgi.subscription_chash_var), key, keylen)) {
+		peer->hash_key = val;
+		peer->hash_key_len = vallen;
+	}
+
 	if (!uwsgi_strncmp("SERVER_NAME", 11, key, keylen) && !peer->key_len) {
 		peer->key = val;
 		peer->key_len = vallen;
@@ -47,15 +47,34 @@ struct uwsgi_option http_options[] = {
 
 	{"http-quiet", required_argument, 0, "do not report failed connections to instances", uwsgi_opt_true, &uhttp.cr.quiet, 0},
         {"http-cheap", no_argument, 0, "run the http router in cheap mode", uwsgi_opt_true, &uhttp.cr.cheap, 0},
+        {"http-threads", required_argument, 0, "run the http router with the specified number of event loop threads", uwsgi_opt_set_int, &uhttp.cr.threads, 0},
 
 	{"http-stats", required_argument, 0, "run the http router stats server", uwsgi_opt_set_str, &uhttp.cr.stats_server, 0},
 	{"http-stats-server", required_argument, 0, "run the http router stats server", uwsgi_opt_set_str, &uhttp.cr.stats_server, 0},
 	{"http-ss", required_argument, 0, "run the http router stats server", uwsgi_opt_set_str, &uhttp.cr.stats_server, 0},
 	{"http-harakiri", required_argument, 0, "enable http router harakiri", uwsgi_opt_set_int, &uhttp.cr.harakiri, 0},
+	{"http-upstream-pool", required_argument, 0, "keep up to the specified number of idle connections per backend (backends must be bound with --puwsgi-socket)", uwsgi_opt_set_int, &uhttp.cr.upstream_pool, 0},
+	{"http-upstream-pool-ttl", required_argument, 0, "close idle backend connections after the specified number of seconds (default 30)", uwsgi_opt_set_int, &uhttp.cr.upstream_pool_ttl, 0},
 	{"http-stud-prefix", required_argument, 0, "expect a stud prefix (1byte family + 4/16 bytes address) on connections from the specified address", uwsgi_opt_add_addr_list, &uhttp.stud_prefix, 0},
 	{0, 0, 0, 0, 0, 0, 0},
 };
 
+// the request element used by the chash subscription algo
+static void http_set_hash_key(struct corerouter_peer *peer, char *prefix, size_t prefix_len, char *key, uint16_t keylen, char *val, uint16_t vallen) {
+	char *var = uwsgi.subscription_chash_var;
+	size_t var_len = strlen(var);
+	if (prefix_len) {
+		if (var_len <= prefix_len || memcmp(var, prefix, prefix_len))
+			return;
+		var += prefix_len;
+		var_len -= prefix_len;
+	}
+	if (!uwsgi_strncmp(var, var_len, key, keylen)) {
+		peer->hash_key = val;
+		peer->hash_key_len = vallen;
+	}
+}
+
 int http_add_uwsgi_header(struct corerouter_peer *peer, char *hh, uint16_t hhlen) {
 
 	struct uwsgi_buffer *out = peer->out;
@@ -145,9 +164,14 @@ int http_add_uwsgi_header(struct corerouter_peer *peer, char *hh, uint16_t hhlen
 done:
 
 	if (uwsgi_strncmp("CONTENT_TYPE", 12, hh, keylen) && uwsgi_strncmp("CONTENT_LENGTH", 14, hh, keylen)) {
+		if (uwsgi.subscription_chash_var)
+			http_set_hash_key(peer, "HTTP_", 5, hh, keylen, val, vallen);
 		keylen += 5;
 		prefix = 1;
 	}
+	else if (uwsgi.subscription_chash_var) {
+		http_set_hash_key(peer, NULL, 0, hh, keylen, val, vallen);
+	}
 
 	if (uwsgi_buffer_u16le(out, keylen)) return -1;
 
@@ -250,6 +274,12 @@ int http_headers_parse(struct corerouter_peer *peer) {
 			else {
 				if (uwsgi_buffer_append_keyval(out, "QUERY_STRING", 12, query_string, ptr - query_string)) return -1;
 			}
+			if (uwsgi.subscription_chash_var) {
+				http_set_hash_key(peer, NULL, 0, "REQUEST_URI", 11, base, ptr - base);
+				http_set_hash_key(peer, NULL, 0, "PATH_INFO", 9, hr->path_info, hr->path_info_len);
+				if (query_string)
+					http_set_hash_key(peer, NULL, 0, "QUERY_STRING", 12, query_string, ptr - query_string);
+			}
 			ptr++;
 			found = 1;
 			break;
@@ -731,6 +761,8 @@ ssize_t http_parse(struct corerouter_peer *main_peer) {
 
 			if (hr->websockets > 2 && hr->websocket_key_len > 0) {
 				hr->raw_body = 1;
+				// upgraded connections do not feed the latency-aware balancer
+				new_peer->un_start = 0;
 			}
 			new_peer->can_retry = 1;
                 	cr_connect(new_peer, hr_instance_connected);
@@ -18,8 +18,23 @@ ssize_t uwsgi_file_logger(struct uwsgi_logger *ul, char *message, size_t len) {
 
 }
 
+// a whole batch of records with a single syscall
+ssize_t uwsgi_file_logger_batch(struct uwsgi_logger *ul, struct iovec *iov, size_t cnt) {
+
+	// open the file if needed
+	if (!ul->configured) {
+		uwsgi_file_logger(ul, NULL, 0);
+	}
+
+	if (ul->fd >= 0) {
+		return writev(ul->fd, iov, cnt);
+	}
+	return 0;
+}
+
 void uwsgi_file_logger_register() {
 	uwsgi_register_logger("file", uwsgi_file_logger);
+	uwsgi_register_logger_batch("file", uwsgi_file_logger_batch);
 }
 
 struct uwsgi_plugin logfile_plugin = {
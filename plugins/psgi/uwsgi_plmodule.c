@@ -452,20 +452,56 @@ XS(XS_websocket_send) {
 	XSRETURN_UNDEF;
 }
 
+XS(XS_websocket_send_many) {
+	dXSARGS;
+
+	int i;
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * (items+1));
+	for(i=0;i<items;i++) {
+		STRLEN message_len = 0;
+		iov[i].iov_base = SvPV(ST(i), message_len);
+		iov[i].iov_len = message_len;
+	}
+
+        struct wsgi_request *wsgi_req = current_wsgi_req();
+
+	int ret = uwsgi_websocket_send_many(wsgi_req, iov, items);
+	free(iov);
+        if (ret) {
+                croak("unable to send websocket messages");
+        }
+
+	XSRETURN_UNDEF;
+}
+
+XS(XS_websocket_flush) {
+	dXSARGS;
+
+	psgi_check_args(0);
+
+        struct wsgi_request *wsgi_req = current_wsgi_req();
+
+        if (uwsgi_websocket_flush(wsgi_req)) {
+                croak("unable to send websocket messages");
+        }
+
+	XSRETURN_UNDEF;
+}
+
 XS(XS_websocket_recv) {
 	dXSARGS;
 
 	psgi_check_args(0);
 
         struct wsgi_request *wsgi_req = current_wsgi_req();
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv(wsgi_req);
-        if (!ub) {
+	size_t len = 0;
+        char *msg = uwsgi_websocket_recv_view(wsgi_req, &len);
+        if (!msg) {
         	croak("unable to receive websocket message");
 		XSRETURN_UNDEF;
         }
 
-	ST(0) = newSVpv(ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
+	ST(0) = newSVpvn(msg, len);
         sv_2mortal(ST(0));
 
         XSRETURN(1);
@@ -477,14 +513,14 @@ XS(XS_websocket_recv_nb) {
         psgi_check_args(0);
 
         struct wsgi_request *wsgi_req = current_wsgi_req();
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv_nb(wsgi_req);
-        if (!ub) {
+        size_t len = 0;
+        char *msg = uwsgi_websocket_recv_view_nb(wsgi_req, &len);
+        if (!msg) {
                 croak("unable to receive websocket message");
                 XSRETURN_UNDEF;
         }
 
-        ST(0) = newSVpv(ub->buf, ub->pos);
-        uwsgi_buffer_destroy(ub);
+        ST(0) = newSVpvn(msg, len);
         sv_2mortal(ST(0));
 
         XSRETURN(1);
@@ -554,6 +590,8 @@ void init_perl_embedded_module() {
 	psgi_xs(websocket_recv);
 	psgi_xs(websocket_recv_nb);
 	psgi_xs(websocket_send);
+	psgi_xs(websocket_send_many);
+	psgi_xs(websocket_flush);
 	psgi_xs(postfork);
 	psgi_xs(atexit);
 
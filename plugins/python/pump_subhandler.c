@@ -104,6 +104,7 @@ void *uwsgi_request_subhandler_pump(struct wsgi_request *wsgi_req, struct uwsgi_
         // create wsgi.input custom object
         wsgi_req->async_input = (PyObject *) PyObject_New(uwsgi_Input, &uwsgi_InputType);
         ((uwsgi_Input*)wsgi_req->async_input)->wsgi_req = wsgi_req;
+        ((uwsgi_Input*)wsgi_req->async_input)->body = NULL;
 
         PyDict_SetItemString(wsgi_req->async_environ, "body", wsgi_req->async_input);
 
@@ -14,6 +14,9 @@ struct uwsgi_python up;
 #include <glob.h>
 
 extern PyTypeObject uwsgi_InputType;
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+extern PyTypeObject uwsgi_InputBodyType;
+#endif
 
 void uwsgi_opt_pythonpath(char *opt, char *value, void *foobar) {
 
@@ -151,6 +154,7 @@ struct uwsgi_option uwsgi_python_options[] = {
 
 	{"wsgi-env-behaviour", required_argument, 0, "set the strategy for allocating/deallocating the WSGI env", uwsgi_opt_set_str, &up.wsgi_env_behaviour, 0},
 	{"wsgi-env-behavior", required_argument, 0, "set the strategy for allocating/deallocating the WSGI env", uwsgi_opt_set_str, &up.wsgi_env_behaviour, 0},
+	{"wsgi-input-memoryview", no_argument, 0, "wsgi.input read() returns memoryviews over the buffered request body", uwsgi_opt_true, &up.wsgi_input_memoryview, 0},
 	{"start_response-nodelay", no_argument, 0, "send WSGI http headers as soon as possible (PEP violation)", uwsgi_opt_true, &up.start_response_nodelay, 0},
 
 	{"python-version", no_argument, 0, "report python version", uwsgi_opt_pyver, NULL, UWSGI_OPT_IMMEDIATE},
@@ -573,6 +577,14 @@ void init_uwsgi_embedded_module() {
 		exit(1);
 	}
 
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+	if (PyType_Ready(&uwsgi_InputBodyType) < 0) {
+		PyErr_Print();
+		uwsgi_log("could not initialize the uwsgi python module\n");
+		exit(1);
+	}
+#endif
+
 	/* initialize for stats */
 	up.workers_tuple = PyTuple_New(uwsgi.numproc);
 	for (i = 0; i < uwsgi.numproc; i++) {
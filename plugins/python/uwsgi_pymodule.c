@@ -1063,6 +1063,72 @@ PyObject *py_uwsgi_websocket_send(PyObject * self, PyObject * args) {
         return Py_None;
 }
 
+PyObject *py_uwsgi_websocket_send_many(PyObject * self, PyObject * args) {
+	PyObject *messages = NULL;
+
+	if (!PyArg_ParseTuple(args, "O:websocket_send_many", &messages)) {
+		return NULL;
+	}
+
+	// a tuple cannot be changed (releasing the strings) while the GIL is released
+	PyObject *seq = PySequence_Tuple(messages);
+	if (!seq) return NULL;
+
+	Py_ssize_t i, n = PyTuple_GET_SIZE(seq);
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * (n+1));
+	for(i=0;i<n;i++) {
+		PyObject *item = PyTuple_GET_ITEM(seq, i);
+		if (PyString_Check(item)) {
+			iov[i].iov_base = PyString_AsString(item);
+			iov[i].iov_len = PyString_Size(item);
+			continue;
+		}
+#ifdef PYTHREE
+		// like websocket_send() (s#), str is sent utf-8 encoded (the buffer is cached by the object)
+		if (PyUnicode_Check(item)) {
+			Py_ssize_t item_len = 0;
+			iov[i].iov_base = (char *) PyUnicode_AsUTF8AndSize(item, &item_len);
+			if (!iov[i].iov_base) {
+				free(iov);
+				Py_DECREF(seq);
+				return NULL;
+			}
+			iov[i].iov_len = item_len;
+			continue;
+		}
+#endif
+		free(iov);
+		Py_DECREF(seq);
+		return PyErr_Format(PyExc_TypeError, "websocket_send_many() requires a sequence of strings");
+	}
+
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+
+	// the tuple keeps a reference to the strings
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_send_many(wsgi_req, iov, n);
+	UWSGI_GET_GIL
+	free(iov);
+	Py_DECREF(seq);
+	if (ret < 0) {
+		return PyErr_Format(PyExc_IOError, "unable to send websocket messages");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject *py_uwsgi_websocket_flush(PyObject * self, PyObject * args) {
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_flush(wsgi_req);
+	UWSGI_GET_GIL
+	if (ret < 0) {
+		return PyErr_Format(PyExc_IOError, "unable to send websocket messages");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 PyObject *py_uwsgi_chunked_read(PyObject * self, PyObject * args) {
 	int timeout = 0; 
 	if (!PyArg_ParseTuple(args, "|i:chunked_read", &timeout)) {
@@ -1101,30 +1167,28 @@ PyObject *py_uwsgi_chunked_read_nb(PyObject * self, PyObject * args) {
 
 PyObject *py_uwsgi_websocket_recv(PyObject * self, PyObject * args) {
 	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+	size_t len = 0;
 	UWSGI_RELEASE_GIL	
-	struct uwsgi_buffer *ub = uwsgi_websocket_recv(wsgi_req);
+	char *msg = uwsgi_websocket_recv_view(wsgi_req, &len);
 	UWSGI_GET_GIL	
-	if (!ub) {
+	if (!msg) {
 		return PyErr_Format(PyExc_IOError, "unable to receive websocket message");
 	}
 
-	PyObject *ret = PyString_FromStringAndSize(ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
-	return ret;
+	return PyString_FromStringAndSize(msg, len);
 }
 
 PyObject *py_uwsgi_websocket_recv_nb(PyObject * self, PyObject * args) {
         struct wsgi_request *wsgi_req = py_current_wsgi_req();
+        size_t len = 0;
         UWSGI_RELEASE_GIL
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv_nb(wsgi_req);
+        char *msg = uwsgi_websocket_recv_view_nb(wsgi_req, &len);
         UWSGI_GET_GIL
-        if (!ub) {
+        if (!msg) {
                 return PyErr_Format(PyExc_IOError, "unable to receive websocket message");
         }
 
-        PyObject *ret = PyString_FromStringAndSize(ub->buf, ub->pos);
-        uwsgi_buffer_destroy(ub);
-        return ret;
+        return PyString_FromStringAndSize(msg, len);
 }
 
 
@@ -2428,6 +2492,52 @@ PyObject *py_uwsgi_suspend(PyObject * self, PyObject * args) {
 
 }
 
+PyObject *py_uwsgi_metric_get(PyObject * self, PyObject * args) {
+	char *key = NULL;
+	if (!PyArg_ParseTuple(args, "s:metric_get", &key)) {
+		return NULL;
+	}
+
+	int64_t value = uwsgi_metric_get(key, NULL);
+	return PyLong_FromLongLong(value);
+}
+
+static PyObject *py_uwsgi_metric_update(PyObject * args, int (*func)(char *, char *, int64_t), char *fmt) {
+	char *key = NULL;
+	long long value = 1;
+	if (!PyArg_ParseTuple(args, fmt, &key, &value)) {
+		return NULL;
+	}
+
+	if (func(key, NULL, value)) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	Py_INCREF(Py_True);
+	return Py_True;
+}
+
+PyObject *py_uwsgi_metric_set(PyObject * self, PyObject * args) {
+	return py_uwsgi_metric_update(args, uwsgi_metric_set, "sL:metric_set");
+}
+
+PyObject *py_uwsgi_metric_inc(PyObject * self, PyObject * args) {
+	return py_uwsgi_metric_update(args, uwsgi_metric_inc, "s|L:metric_inc");
+}
+
+PyObject *py_uwsgi_metric_dec(PyObject * self, PyObject * args) {
+	return py_uwsgi_metric_update(args, uwsgi_metric_dec, "s|L:metric_dec");
+}
+
+PyObject *py_uwsgi_metric_mul(PyObject * self, PyObject * args) {
+	return py_uwsgi_metric_update(args, uwsgi_metric_mul, "s|L:metric_mul");
+}
+
+PyObject *py_uwsgi_metric_div(PyObject * self, PyObject * args) {
+	return py_uwsgi_metric_update(args, uwsgi_metric_div, "s|L:metric_div");
+}
+
 static PyMethodDef uwsgi_advanced_methods[] = {
 	{"reload", py_uwsgi_reload, METH_VARARGS, ""},
 	{"stop", py_uwsgi_stop, METH_VARARGS, ""},
@@ -2521,6 +2631,8 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"websocket_recv", py_uwsgi_websocket_recv, METH_VARARGS, ""},
 	{"websocket_recv_nb", py_uwsgi_websocket_recv_nb, METH_VARARGS, ""},
 	{"websocket_send", py_uwsgi_websocket_send, METH_VARARGS, ""},
+	{"websocket_send_many", py_uwsgi_websocket_send_many, METH_VARARGS, ""},
+	{"websocket_flush", py_uwsgi_websocket_flush, METH_VARARGS, ""},
 	{"websocket_handshake", py_uwsgi_websocket_handshake, METH_VARARGS, ""},
 
 	{"chunked_read", py_uwsgi_chunked_read, METH_VARARGS, ""},
@@ -2528,6 +2640,13 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 
 	{"ready_fd", py_uwsgi_ready_fd, METH_VARARGS, ""},
 
+	{"metric_get", py_uwsgi_metric_get, METH_VARARGS, ""},
+	{"metric_set", py_uwsgi_metric_set, METH_VARARGS, ""},
+	{"metric_inc", py_uwsgi_metric_inc, METH_VARARGS, ""},
+	{"metric_dec", py_uwsgi_metric_dec, METH_VARARGS, ""},
+	{"metric_mul", py_uwsgi_metric_mul, METH_VARARGS, ""},
+	{"metric_div", py_uwsgi_metric_div, METH_VARARGS, ""},
+
 	{NULL, NULL},
 };
 
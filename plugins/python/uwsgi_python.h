@@ -30,6 +30,10 @@
 #define PYTHREE
 #endif
 
+#if (PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION >= 7) || PY_MAJOR_VERSION > 2
+#define UWSGI_PYTHON_HAS_MEMORYVIEW
+#endif
+
 #define UWSGI_GET_GIL up.gil_get();
 #define UWSGI_RELEASE_GIL up.gil_release();
 
@@ -87,8 +91,32 @@ PyAPI_FUNC(PyObject *) PyMarshal_ReadObjectFromString(char *, Py_ssize_t);
 typedef struct uwsgi_Input {
         PyObject_HEAD
         struct wsgi_request *wsgi_req;
+        // owner of the memory exposed by the zero-copy read()
+        PyObject *body;
 } uwsgi_Input;
 
+// interned WSGI environ keys (CGI variable names)
+#define UWSGI_PYTHON_ENV_KEYS_SLOTS	256
+#define UWSGI_PYTHON_ENV_KEYS_MAX	1024
+
+struct uwsgi_python_env_key {
+	char *key;
+	uint16_t keylen;
+	PyObject *obj;
+	struct uwsgi_python_env_key *next;
+};
+
+// python objects cannot be shared between interpreters, so every app has its own table
+struct uwsgi_python_env_keys {
+	struct uwsgi_python_env_key *slots[UWSGI_PYTHON_ENV_KEYS_SLOTS];
+	uint64_t cnt;
+	PyObject *input;
+	PyObject *url_scheme;
+	PyObject *core;
+	PyObject *scheme_http;
+	PyObject *scheme_https;
+};
+
 struct uwsgi_python {
 
 	char *home;
@@ -165,6 +193,7 @@ struct uwsgi_python {
 
 
 	int pep3333_input;
+	int wsgi_input_memoryview;
 
 	void (*extension)(void);
 
@@ -227,9 +256,11 @@ char *get_uwsgi_pymodule(char *);
 PyObject *get_uwsgi_pydict(char *);
 
 int uwsgi_request_wsgi(struct wsgi_request *);
+void uwsgi_python_release_input(struct wsgi_request *);
 void uwsgi_after_request_wsgi(struct wsgi_request *);
 
 void *uwsgi_request_subhandler_wsgi(struct wsgi_request *, struct uwsgi_app*);
+PyObject *uwsgi_python_env_key(struct uwsgi_python_env_keys *, char *, uint16_t);
 int uwsgi_response_subhandler_wsgi(struct wsgi_request *);
 
 void gil_real_get(void);
@@ -47,9 +47,148 @@ PyObject *uwsgi_Input_next(PyObject* self) {
 }
 
 static void uwsgi_Input_free(uwsgi_Input *self) {
+	Py_XDECREF(self->body);
     	PyObject_Del(self);
 }
 
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+/*
+	the zero-copy read() exports the buffered body via this object, counting the views.
+
+	At the end of the request the memory is detached (new exports fail), but if some view
+	is still alive the object takes over the memory: the mmap() region is not unmapped by the core
+	and the post buffering memory of the core is replaced with a new one.
+*/
+#define UWSGI_INPUT_BODY_MMAP	1
+#define UWSGI_INPUT_BODY_MALLOC	2
+// the core memory allocated at startup, it cannot be freed
+#define UWSGI_INPUT_BODY_STARTUP	3
+
+typedef struct uwsgi_InputBody {
+	PyObject_HEAD
+	char *base;
+	size_t len;
+	Py_ssize_t exports;
+	int owned;
+} uwsgi_InputBody;
+
+// cores whose post buffering memory has been replaced (malloc()'ed)
+static char *uwsgi_input_body_replaced;
+
+static void uwsgi_InputBody_free(uwsgi_InputBody *self) {
+	if (self->owned == UWSGI_INPUT_BODY_MMAP) {
+		munmap(self->base, self->len);
+	}
+	else if (self->owned == UWSGI_INPUT_BODY_MALLOC) {
+		free(self->base);
+	}
+	PyObject_Del(self);
+}
+
+static int uwsgi_InputBody_getbuffer(uwsgi_InputBody *self, Py_buffer *view, int flags) {
+	if (!self->base) {
+		PyErr_SetString(PyExc_BufferError, "the wsgi.input body is no more available");
+		return -1;
+	}
+	if (PyBuffer_FillInfo(view, (PyObject *) self, self->base, self->len, 1, flags)) {
+		return -1;
+	}
+	self->exports++;
+	return 0;
+}
+
+static void uwsgi_InputBody_releasebuffer(uwsgi_InputBody *self, Py_buffer *view) {
+	self->exports--;
+}
+
+static PyBufferProcs uwsgi_InputBody_as_buffer = {
+#ifndef PYTHREE
+	0, 0, 0, 0,
+#endif
+	(getbufferproc) uwsgi_InputBody_getbuffer,
+	(releasebufferproc) uwsgi_InputBody_releasebuffer,
+};
+
+PyTypeObject uwsgi_InputBodyType = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+        "uwsgi._InputBody",  /*tp_name */
+        sizeof(uwsgi_InputBody),     /*tp_basicsize */
+        0,                      /*tp_itemsize */
+        (destructor) uwsgi_InputBody_free,	/*tp_dealloc */
+        0,                      /*tp_print */
+        0,                      /*tp_getattr */
+        0,                      /*tp_setattr */
+        0,                      /*tp_compare */
+        0,                      /*tp_repr */
+        0,                      /*tp_as_number */
+        0,                      /*tp_as_sequence */
+        0,                      /*tp_as_mapping */
+        0,                      /*tp_hash */
+        0,                      /*tp_call */
+        0,                      /*tp_str */
+        0,                      /*tp_getattr */
+        0,                      /*tp_setattr */
+        &uwsgi_InputBody_as_buffer,	/*tp_as_buffer */
+#if defined(Py_TPFLAGS_HAVE_NEWBUFFER)
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+#else
+        Py_TPFLAGS_DEFAULT,
+#endif
+        "uwsgi input body.",      /* tp_doc */
+};
+
+// a memoryview of rlen bytes at buf (in the buffered body)
+static PyObject *uwsgi_Input_body_view(uwsgi_Input *self, char *buf, ssize_t rlen) {
+	struct wsgi_request *wsgi_req = self->wsgi_req;
+	if (!self->body) {
+		uwsgi_InputBody *body = PyObject_New(uwsgi_InputBody, &uwsgi_InputBodyType);
+		if (!body) return NULL;
+		body->base = wsgi_req->post_file ? wsgi_req->post_mmap : wsgi_req->post_buffering_buf;
+		body->len = wsgi_req->post_cl;
+		body->exports = 0;
+		body->owned = 0;
+		self->body = (PyObject *) body;
+	}
+	uwsgi_InputBody *body = (uwsgi_InputBody *) self->body;
+	Py_ssize_t offset = buf - body->base;
+	PyObject *mv = PyMemoryView_FromObject(self->body);
+	if (!mv) return NULL;
+	PyObject *view = PySequence_GetSlice(mv, offset, offset + rlen);
+	Py_DECREF(mv);
+	return view;
+}
+
+// must be called (with the GIL) before the request memory is released
+void uwsgi_python_release_input(struct wsgi_request *wsgi_req) {
+	uwsgi_Input *input = (uwsgi_Input *) wsgi_req->async_input;
+	if (!input || !input->body) return;
+
+	uwsgi_InputBody *body = (uwsgi_InputBody *) input->body;
+	input->body = NULL;
+
+	if (body->exports > 0) {
+		if (wsgi_req->post_file) {
+			// the core will not unmap it
+			wsgi_req->post_mmap = NULL;
+			body->owned = UWSGI_INPUT_BODY_MMAP;
+		}
+		else {
+			if (!uwsgi_input_body_replaced) {
+				uwsgi_input_body_replaced = uwsgi_calloc(uwsgi.cores);
+			}
+			body->owned = uwsgi_input_body_replaced[wsgi_req->async_id] ? UWSGI_INPUT_BODY_MALLOC : UWSGI_INPUT_BODY_STARTUP;
+			uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].post_buf = uwsgi_malloc(uwsgi.post_buffering_bufsize);
+			uwsgi_input_body_replaced[wsgi_req->async_id] = 1;
+		}
+	}
+	else {
+		body->base = NULL;
+	}
+
+	Py_DECREF((PyObject *) body);
+}
+#endif
+
 static PyObject *uwsgi_Input_read(uwsgi_Input *self, PyObject *args) {
 
 	long arg_len = 0;
@@ -61,6 +200,21 @@ static PyObject *uwsgi_Input_read(uwsgi_Input *self, PyObject *args) {
 	struct wsgi_request *wsgi_req = self->wsgi_req;
 	ssize_t rlen = 0;
 
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+	// expose the buffered body (memory or mmap()'ed file) without copying it
+	if (up.wsgi_input_memoryview) {
+		char *buf = uwsgi_request_body_read_nocopy(wsgi_req, arg_len, &rlen);
+		if (buf == uwsgi.empty) {
+			return PyString_FromString("");
+		}
+		if (buf) {
+			return uwsgi_Input_body_view(self, buf, rlen);
+		}
+		// not buffered, fallback to read()
+		rlen = 0;
+	}
+#endif
+
 	UWSGI_RELEASE_GIL
 	char *buf = uwsgi_request_body_read(wsgi_req, arg_len, &rlen);
 	UWSGI_GET_GIL
@@ -82,6 +236,34 @@ static PyObject *uwsgi_Input_read(uwsgi_Input *self, PyObject *args) {
 		
 }
 
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+static PyObject *uwsgi_Input_readinto(uwsgi_Input *self, PyObject *args) {
+
+	Py_buffer pb;
+
+	if (!PyArg_ParseTuple(args, "w*:readinto", &pb)) {
+		return NULL;
+	}
+
+	struct wsgi_request *wsgi_req = self->wsgi_req;
+
+	UWSGI_RELEASE_GIL
+	ssize_t rlen = uwsgi_request_body_readinto(wsgi_req, pb.buf, pb.len);
+	UWSGI_GET_GIL
+	PyBuffer_Release(&pb);
+
+	if (rlen >= 0) {
+		return PyInt_FromLong(rlen);
+	}
+
+	if (rlen == -2) {
+		return PyErr_Format(PyExc_IOError, "timeout during readinto() on wsgi.input");
+	}
+
+	return PyErr_Format(PyExc_IOError, "error during readinto() on wsgi.input");
+}
+#endif
+
 static PyObject *uwsgi_Input_readline(uwsgi_Input *self, PyObject *args) {
 
 	long hint = 0;
@@ -185,6 +367,9 @@ static PyMethodDef uwsgi_Input_methods[] = {
 	{ "read",      (PyCFunction)uwsgi_Input_read,      METH_VARARGS, 0 },
 	{ "readline",  (PyCFunction)uwsgi_Input_readline,  METH_VARARGS, 0 },
 	{ "readlines", (PyCFunction)uwsgi_Input_readlines, METH_VARARGS, 0 },
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+	{ "readinto",  (PyCFunction)uwsgi_Input_readinto,  METH_VARARGS, 0 },
+#endif
 // add close to allow mod_wsgi compatibility
 	{ "close",     (PyCFunction)uwsgi_Input_close,     METH_VARARGS, 0 },
 	{ "seek",     (PyCFunction)uwsgi_Input_seek,     METH_VARARGS, 0 },
@@ -419,6 +604,10 @@ int uwsgi_request_wsgi(struct wsgi_request *wsgi_req) {
 	// this object must be freed/cleared always
 end:
 	if (wsgi_req->async_input) {
+#ifdef UWSGI_PYTHON_HAS_MEMORYVIEW
+		// outstanding memoryviews must not see the next request (or an unmapped region)
+		uwsgi_python_release_input(wsgi_req);
+#endif
                 Py_DECREF((PyObject *)wsgi_req->async_input);
         }
         if (wsgi_req->async_environ) {
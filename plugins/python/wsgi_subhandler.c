@@ -43,6 +43,91 @@ static void uwsgi_python_consume_file_wrapper_read(struct wsgi_request *wsgi_req
         Py_DECREF(read_method);
 }
 
+/*
+	CGI variable names are always the same, so we keep an interned python object for each of them
+	(saving an allocation and a hash computation for every key of every request).
+
+	The table is filled by each worker for each app (as the objects belong to the app interpreter)
+	and it is capped, as clients can send arbitrary HTTP_* headers
+*/
+PyObject *uwsgi_python_env_key(struct uwsgi_python_env_keys *upeks, char *key, uint16_t keylen) {
+	PyObject *obj;
+
+	uint32_t slot = djb33x_hash(key, keylen) % UWSGI_PYTHON_ENV_KEYS_SLOTS;
+	struct uwsgi_python_env_key *upek = upeks->slots[slot];
+	while(upek) {
+		if (upek->keylen == keylen && !memcmp(upek->key, key, keylen)) {
+			Py_INCREF(upek->obj);
+			return upek->obj;
+		}
+		upek = upek->next;
+	}
+
+#ifdef PYTHREE
+	obj = PyUnicode_DecodeLatin1(key, keylen, NULL);
+#else
+	obj = PyString_FromStringAndSize(key, keylen);
+#endif
+	if (!obj || upeks->cnt >= UWSGI_PYTHON_ENV_KEYS_MAX) return obj;
+
+#ifdef PYTHREE
+	PyUnicode_InternInPlace(&obj);
+#else
+	PyString_InternInPlace(&obj);
+#endif
+
+	upek = uwsgi_malloc(sizeof(struct uwsgi_python_env_key));
+	upek->key = uwsgi_concat2n(key, keylen, "", 0);
+	upek->keylen = keylen;
+	// the table holds its own reference
+	Py_INCREF(obj);
+	upek->obj = obj;
+	upek->next = upeks->slots[slot];
+	upeks->slots[slot] = upek;
+	upeks->cnt++;
+	return obj;
+}
+
+// the entries of the environ not depending on the request, built once per app and merged in every request
+static PyObject *uwsgi_python_env_constants(struct uwsgi_app *wi) {
+
+	PyObject *constants = PyDict_New();
+	if (!constants) return NULL;
+
+	PyDict_SetItemString(constants, "wsgi.file_wrapper", wi->sendfile);
+
+	if (uwsgi.async > 1) {
+		PyDict_SetItemString(constants, "x-wsgiorg.fdevent.readable", wi->eventfd_read);
+		PyDict_SetItemString(constants, "x-wsgiorg.fdevent.writable", wi->eventfd_write);
+		PyDict_SetItemString(constants, "x-wsgiorg.fdevent.timeout", Py_None);
+	}
+
+	PyDict_SetItemString(constants, "wsgi.version", wi->gateway_version);
+
+	PyDict_SetItemString(constants, "wsgi.errors", wi->error);
+
+	PyDict_SetItemString(constants, "wsgi.run_once", Py_False);
+
+	if (uwsgi.threads > 1) {
+		PyDict_SetItemString(constants, "wsgi.multithread", Py_True);
+	}
+	else {
+		PyDict_SetItemString(constants, "wsgi.multithread", Py_False);
+	}
+	if (uwsgi.numproc == 1) {
+		PyDict_SetItemString(constants, "wsgi.multiprocess", Py_False);
+	}
+	else {
+		PyDict_SetItemString(constants, "wsgi.multiprocess", Py_True);
+	}
+
+	PyDict_SetItemString(constants, "uwsgi.version", wi->uwsgi_version);
+
+	PyDict_SetItemString(constants, "uwsgi.node", wi->uwsgi_node);
+
+	return constants;
+}
+
 void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_app *wi) {
 
 
@@ -51,15 +136,29 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
 	PyObject *pydictkey, *pydictvalue;
 	char *path_info;
 
+	struct uwsgi_python_env_keys *upeks = (struct uwsgi_python_env_keys *) wi->environ_keys;
+	if (!upeks) {
+		upeks = uwsgi_calloc(sizeof(struct uwsgi_python_env_keys));
+		upeks->input = uwsgi_python_env_key(upeks, "wsgi.input", 10);
+		upeks->url_scheme = uwsgi_python_env_key(upeks, "wsgi.url_scheme", 15);
+		upeks->core = uwsgi_python_env_key(upeks, "uwsgi.core", 10);
+		upeks->scheme_http = UWSGI_PYFROMSTRING("http");
+		upeks->scheme_https = UWSGI_PYFROMSTRING("https");
+		wi->environ_keys = upeks;
+	}
+
+	if (!wi->environ_constants) {
+		wi->environ_constants = uwsgi_python_env_constants(wi);
+	}
+
         for (i = 0; i < wsgi_req->var_cnt; i += 2) {
 #ifdef UWSGI_DEBUG
                 uwsgi_debug("%.*s: %.*s\n", wsgi_req->hvec[i].iov_len, wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i+1].iov_len, wsgi_req->hvec[i+1].iov_base);
 #endif
+                pydictkey = uwsgi_python_env_key(upeks, wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len);
 #ifdef PYTHREE
-                pydictkey = PyUnicode_DecodeLatin1(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len, NULL);
                 pydictvalue = PyUnicode_DecodeLatin1(wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len, NULL);
 #else
-                pydictkey = PyString_FromStringAndSize(wsgi_req->hvec[i].iov_base, wsgi_req->hvec[i].iov_len);
                 pydictvalue = PyString_FromStringAndSize(wsgi_req->hvec[i + 1].iov_base, wsgi_req->hvec[i + 1].iov_len);
 #endif
 
@@ -91,55 +190,33 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
         // create wsgi.input custom object
         wsgi_req->async_input = (PyObject *) PyObject_New(uwsgi_Input, &uwsgi_InputType);
         ((uwsgi_Input*)wsgi_req->async_input)->wsgi_req = wsgi_req;
+        ((uwsgi_Input*)wsgi_req->async_input)->body = NULL;
 
 
-        PyDict_SetItemString(wsgi_req->async_environ, "wsgi.input", wsgi_req->async_input);
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.file_wrapper", wi->sendfile);
-
-	if (uwsgi.async > 1) {
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.readable", wi->eventfd_read);
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.writable", wi->eventfd_write);
-		PyDict_SetItemString(wsgi_req->async_environ, "x-wsgiorg.fdevent.timeout", Py_None);
-	}
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.version", wi->gateway_version);
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.errors", wi->error);
-
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.run_once", Py_False);
-
+        PyDict_SetItem(wsgi_req->async_environ, upeks->input, wsgi_req->async_input);
 
-
-	if (uwsgi.threads > 1) {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multithread", Py_True);
-	}
-	else {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multithread", Py_False);
-	}
-	if (uwsgi.numproc == 1) {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multiprocess", Py_False);
-	}
-	else {
-		PyDict_SetItemString(wsgi_req->async_environ, "wsgi.multiprocess", Py_True);
+	// merge the constant entries (they override request vars with the same name)
+	if (wi->environ_constants) {
+		PyDict_Merge(wsgi_req->async_environ, wi->environ_constants, 1);
 	}
 
-
 	if (wsgi_req->scheme_len > 0) {
 		zero = UWSGI_PYFROMSTRINGSIZE(wsgi_req->scheme, wsgi_req->scheme_len);
 	}
 	else if (wsgi_req->https_len > 0) {
 		if (!strncasecmp(wsgi_req->https, "on", 2) || wsgi_req->https[0] == '1') {
-			zero = UWSGI_PYFROMSTRING("https");
+			zero = upeks->scheme_https;
 		}
 		else {
-			zero = UWSGI_PYFROMSTRING("http");
+			zero = upeks->scheme_http;
 		}
+		Py_INCREF(zero);
 	}
 	else {
-		zero = UWSGI_PYFROMSTRING("http");
+		zero = upeks->scheme_http;
+		Py_INCREF(zero);
 	}
-	PyDict_SetItemString(wsgi_req->async_environ, "wsgi.url_scheme", zero);
+	PyDict_SetItem(wsgi_req->async_environ, upeks->url_scheme, zero);
 	Py_DECREF(zero);
 
 	wsgi_req->async_app = wi->callable;
@@ -149,16 +226,12 @@ void *uwsgi_request_subhandler_wsgi(struct wsgi_request *wsgi_req, struct uwsgi_
 		PyDict_SetItemString(up.embedded_dict, "env", wsgi_req->async_environ);
 	}
 
-	PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.version", wi->uwsgi_version);
-
 	if (uwsgi.cores > 1) {
 		zero = PyInt_FromLong(wsgi_req->async_id);
-		PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.core", zero);
+		PyDict_SetItem(wsgi_req->async_environ, upeks->core, zero);
 		Py_DECREF(zero);
 	}
 
-	PyDict_SetItemString(wsgi_req->async_environ, "uwsgi.node", wi->uwsgi_node);
-
 	// call
 	PyTuple_SetItem(wsgi_req->async_args, 0, wsgi_req->async_environ);
 	return python_call(wsgi_req->async_app, wsgi_req->async_args, uwsgi.catch_exceptions, wsgi_req);
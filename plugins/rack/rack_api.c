@@ -996,31 +996,59 @@ static VALUE uwsgi_ruby_websocket_send(VALUE *class, VALUE *msg) {
 	return Qnil;
 }
 
+static VALUE uwsgi_ruby_websocket_send_many(VALUE *class, VALUE *msgs) {
+	Check_Type(msgs, T_ARRAY);
+	long i, n = RARRAY_LEN(msgs);
+	struct iovec *iov = uwsgi_malloc(sizeof(struct iovec) * (n+1));
+	for(i=0;i<n;i++) {
+		VALUE msg = rb_ary_entry(msgs, i);
+		if (TYPE(msg) != T_STRING) {
+			free(iov);
+                	rb_raise(rb_eRuntimeError, "websocket_send_many() requires an array of strings");
+		}
+		iov[i].iov_base = RSTRING_PTR(msg);
+		iov[i].iov_len = RSTRING_LEN(msg);
+	}
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	int ret = uwsgi_websocket_send_many(wsgi_req, iov, n);
+	free(iov);
+	if (ret) {
+                rb_raise(rb_eRuntimeError, "unable to send websocket messages");
+        }
+	return Qnil;
+}
+
+static VALUE uwsgi_ruby_websocket_flush(VALUE *class) {
+	struct wsgi_request *wsgi_req = current_wsgi_req();
+	if (uwsgi_websocket_flush(wsgi_req)) {
+                rb_raise(rb_eRuntimeError, "unable to send websocket messages");
+        }
+	return Qnil;
+}
+
 static VALUE uwsgi_ruby_websocket_recv(VALUE *class) {
 
 	struct wsgi_request *wsgi_req = current_wsgi_req();
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv(wsgi_req);
-        if (!ub) {
+	size_t len = 0;
+        char *msg = uwsgi_websocket_recv_view(wsgi_req, &len);
+        if (!msg) {
                 rb_raise(rb_eRuntimeError, "unable to receive websocket message");
 		return Qnil;
         }
-	VALUE ret = rb_str_new(ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
-	return ret;
+	return rb_str_new(msg, len);
 
 }
 
 static VALUE uwsgi_ruby_websocket_recv_nb(VALUE *class) {
 
         struct wsgi_request *wsgi_req = current_wsgi_req();
-        struct uwsgi_buffer *ub = uwsgi_websocket_recv_nb(wsgi_req);
-        if (!ub) {
+        size_t len = 0;
+        char *msg = uwsgi_websocket_recv_view_nb(wsgi_req, &len);
+        if (!msg) {
                 rb_raise(rb_eRuntimeError, "unable to receive websocket message");
                 return Qnil;
         }
-        VALUE ret = rb_str_new(ub->buf, ub->pos);
-        uwsgi_buffer_destroy(ub);
-        return ret;
+        return rb_str_new(msg, len);
 
 }
 
@@ -1051,6 +1079,8 @@ void uwsgi_rack_init_api() {
 
         uwsgi_rack_api("websocket_handshake", uwsgi_ruby_websocket_handshake, -1);
         uwsgi_rack_api("websocket_send", uwsgi_ruby_websocket_send, 1);
+        uwsgi_rack_api("websocket_send_many", uwsgi_ruby_websocket_send_many, 1);
+        uwsgi_rack_api("websocket_flush", uwsgi_ruby_websocket_flush, 0);
         uwsgi_rack_api("websocket_recv", uwsgi_ruby_websocket_recv, 0);
         uwsgi_rack_api("websocket_recv_nb", uwsgi_ruby_websocket_recv_nb, 0);
 
@@ -44,6 +44,7 @@ static struct uwsgi_option rawrouter_options[] = {
 	{"rawrouter-max-retries", required_argument, 0, "set the maximum number of retries/fallbacks to other nodes", uwsgi_opt_set_int, &urr.cr.max_retries, 0},
 	{"rawrouter-quiet", required_argument, 0, "do not report failed connections to instances", uwsgi_opt_true, &urr.cr.quiet, 0},
 	{"rawrouter-cheap", no_argument, 0, "run the rawrouter in cheap mode", uwsgi_opt_true, &urr.cr.cheap, 0},
+	{"rawrouter-threads", required_argument, 0, "run the rawrouter with the specified number of event loop threads", uwsgi_opt_set_int, &urr.cr.threads, 0},
 	{"rawrouter-subscription-server", required_argument, 0, "run the rawrouter subscription server on the spcified address", uwsgi_opt_corerouter_ss, &urr, 0},
 	{"rawrouter-subscription-slot", required_argument, 0, "*** deprecated ***", uwsgi_opt_deprecated, (void *) "useless thanks to the new implementation", 0},
 
@@ -202,6 +203,8 @@ static int rr_retry(struct corerouter_peer *peer) {
         if (peer->instance_address_len == 0) {
                 return -1;
 	}
+	// raw streams do not feed the latency-aware balancer
+	peer->un_start = 0;
 
 retry:
 	// start async connect (again)
@@ -254,6 +257,8 @@ static int rawrouter_alloc_session(struct uwsgi_corerouter *ucr, struct uwsgi_ga
         if (peer->instance_address_len == 0) {
 		return -1;
         }
+	// raw streams do not feed the latency-aware balancer
+	peer->un_start = 0;
 
 	peer->can_retry = 1;
 	cr_connect(peer, rr_instance_connected);
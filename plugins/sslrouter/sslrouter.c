@@ -143,6 +143,7 @@ static struct uwsgi_option sslrouter_options[] = {
 	{"sslrouter-max-retries", required_argument, 0, "set the maximum number of retries/fallbacks to other nodes", uwsgi_opt_set_int, &usr.cr.max_retries, 0},
 	{"sslrouter-quiet", required_argument, 0, "do not report failed connections to instances", uwsgi_opt_true, &usr.cr.quiet, 0},
 	{"sslrouter-cheap", no_argument, 0, "run the sslrouter in cheap mode", uwsgi_opt_true, &usr.cr.cheap, 0},
+	{"sslrouter-threads", required_argument, 0, "run the sslrouter with the specified number of event loop threads", uwsgi_opt_set_int, &usr.cr.threads, 0},
 	{"sslrouter-subscription-server", required_argument, 0, "run the sslrouter subscription server on the spcified address", uwsgi_opt_corerouter_ss, &usr, 0},
 
 	{"sslrouter-timeout", required_argument, 0, "set sslrouter timeout", uwsgi_opt_set_int, &usr.cr.socket_timeout, 0},
@@ -215,6 +216,8 @@ static int sr_retry(struct corerouter_peer *peer) {
         if (peer->instance_address_len == 0) {
                 return -1;
 	}
+	// raw streams do not feed the latency-aware balancer
+	peer->un_start = 0;
 
 retry:
 	// start async connect (again)
@@ -307,6 +310,8 @@ static ssize_t sr_read(struct corerouter_peer *main_peer) {
         		if (peer->instance_address_len == 0) {
                 		return -1;
         		}
+			// raw streams do not feed the latency-aware balancer
+			peer->un_start = 0;
 
 			peer->can_retry = 1;
         		cr_connect(peer, sr_instance_connected);
@@ -111,6 +111,17 @@ static void stats_pusher_statsd(struct uwsgi_stats_pusher_instance *uspi, time_t
 	// send workers metrics
 	for(i=1;i<=uwsgi.numproc;i++) {
 		if (statsd_send_worker_gauge(ub, uspi, i, "requests", 8, uwsgi.workers[i].requests)) goto end;
+		if (uwsgi.stats_histograms) {
+			struct uwsgi_histogram rt;
+			memset(&rt, 0, sizeof(struct uwsgi_histogram));
+			for(j=0;j<uwsgi.cores;j++) {
+				uwsgi_histogram_merge(&rt, &uwsgi.workers[i].cores[j].histograms[UWSGI_HISTOGRAM_RT]);
+			}
+			if (statsd_send_worker_gauge(ub, uspi, i, "rt_p50", 6, uwsgi_histogram_value_at(&rt, 500))) goto end;
+			if (statsd_send_worker_gauge(ub, uspi, i, "rt_p90", 6, uwsgi_histogram_value_at(&rt, 900))) goto end;
+			if (statsd_send_worker_gauge(ub, uspi, i, "rt_p99", 6, uwsgi_histogram_value_at(&rt, 990))) goto end;
+			if (statsd_send_worker_gauge(ub, uspi, i, "rt_p999", 7, uwsgi_histogram_value_at(&rt, 999))) goto end;
+		}
 		for(j=0;j<uwsgi.cores;j++) {
 			if (statsd_send_core_gauge(ub, uspi, i, j, "exceptions", 10, uwsgi.workers[i].cores[j].exceptions)) goto end;
 			if (statsd_send_core_gauge(ub, uspi, i, j, "requests", 8, uwsgi.workers[i].cores[j].requests)) goto end;
@@ -10,25 +10,89 @@
 
 */
 
+/*
+
+	gzip:cache=<name>[,key=<key>][,expires=<secs>]
+
+	buffer the whole body and store the compressed version in the specified cache,
+	keyed by <key> (default: ${REQUEST_URI}) plus a fingerprint of the uncompressed body
+	(size, crc32 and djb33x hash), so identical responses are compressed only once
+
+*/
+struct uwsgi_router_gzip_conf {
+	char *cache;
+	char *key;
+	size_t key_len;
+	char *expires_str;
+	uint64_t expires;
+};
+
 struct uwsgi_transformation_gzip {
 	z_stream z;
 	uint32_t crc32;
 	size_t len;
 	uint8_t header;
+	// cache mode
+	struct uwsgi_buffer *cache_key;
+	struct uwsgi_router_gzip_conf *urgc;
 };
 
+extern struct uwsgi_server uwsgi;
 extern char gzheader[];
 
+/*
+	deflate streams are expensive to allocate (~400k each), so every core
+	keeps the last used one and resets it (deflateReset) for the next response.
+	The pool is allocated after fork and each core only touches its own slot, so no locking is needed.
+*/
+static struct uwsgi_transformation_gzip **gzip_pool;
+
+static struct uwsgi_transformation_gzip *gzip_stream_get(struct wsgi_request *wsgi_req) {
+	struct uwsgi_transformation_gzip *utgz = NULL;
+	if (gzip_pool) {
+		utgz = gzip_pool[wsgi_req->async_id];
+		gzip_pool[wsgi_req->async_id] = NULL;
+	}
+	if (utgz) {
+		uwsgi_crc32(&utgz->crc32, NULL, 0);
+		return utgz;
+	}
+	utgz = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip));
+	if (uwsgi_gzip_prepare(&utgz->z, NULL, 0, &utgz->crc32)) {
+		free(utgz);
+		return NULL;
+	}
+	return utgz;
+}
+
+static void gzip_stream_put(struct wsgi_request *wsgi_req, struct uwsgi_transformation_gzip *utgz, int reusable) {
+	if (utgz->cache_key) {
+		uwsgi_buffer_destroy(utgz->cache_key);
+		utgz->cache_key = NULL;
+	}
+	utgz->urgc = NULL;
+	utgz->len = 0;
+	utgz->header = 0;
+	if (reusable && gzip_pool && !gzip_pool[wsgi_req->async_id] && deflateReset(&utgz->z) == Z_OK) {
+		gzip_pool[wsgi_req->async_id] = utgz;
+		return;
+	}
+	deflateEnd(&utgz->z);
+	free(utgz);
+}
+
 static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
 	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
 	struct uwsgi_buffer *ub = ut->chunk;
 
 	if (ut->is_final) {
-		if (uwsgi_gzip_fix(&utgz->z, utgz->crc32, ub, utgz->len)) {
-			free(utgz);
+		// the last chunk has already been consumed
+		utgz->z.avail_in = 0;
+		if (uwsgi_gzip_finish(&utgz->z, utgz->crc32, ub, utgz->len)) {
+			gzip_stream_put(wsgi_req, utgz, 0);
 			return -1;
 		}
-		free(utgz);
+		gzip_stream_put(wsgi_req, utgz, 1);
 		return 0;
 	}
 
@@ -49,12 +113,87 @@ static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transforma
 	return 0;
 }
 
+// buffered version, the whole body is available
+static int transform_gzip_cache(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
+	struct uwsgi_router_gzip_conf *urgc = utgz->urgc;
+	struct uwsgi_buffer *ub = ut->chunk;
+	struct uwsgi_buffer *gz = NULL;
+	int ret = -1;
+
+	// nothing to compress
+	if (ub->pos == 0) {
+		gzip_stream_put(wsgi_req, utgz, 1);
+		return 0;
+	}
+
+	uint32_t body_crc32 = 0;
+	uwsgi_crc32(&body_crc32, NULL, 0);
+	uwsgi_crc32(&body_crc32, ub->buf, ub->pos);
+
+	// <key>|<size>|<crc32>|<djb33x>
+	if (uwsgi_buffer_append(utgz->cache_key, "|", 1)) goto end;
+	if (uwsgi_buffer_num64(utgz->cache_key, ub->pos)) goto end;
+	if (uwsgi_buffer_append(utgz->cache_key, "|", 1)) goto end;
+	if (uwsgi_buffer_num64(utgz->cache_key, body_crc32)) goto end;
+	if (uwsgi_buffer_append(utgz->cache_key, "|", 1)) goto end;
+	if (uwsgi_buffer_num64(utgz->cache_key, djb33x_hash(ub->buf, ub->pos))) goto end;
+
+	int cacheable = utgz->cache_key->pos <= 0xffff;
+
+	if (cacheable) {
+		uint64_t valsize = 0;
+		char *value = uwsgi_cache_magic_get(utgz->cache_key->buf, utgz->cache_key->pos, &valsize, NULL, urgc->cache);
+		if (value) {
+			uwsgi_buffer_map(ub, value, valsize);
+			uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4);
+			ret = 0;
+			goto end;
+		}
+	}
+
+	// compress the whole body in a single pass
+	gz = uwsgi_buffer_new(10 + (ub->pos / 2) + 64);
+	if (uwsgi_buffer_append(gz, gzheader, 10)) goto end;
+	utgz->z.next_in = (Bytef *) ub->buf;
+	utgz->z.avail_in = ub->pos;
+	if (uwsgi_gzip_finish(&utgz->z, body_crc32, gz, ub->pos)) goto end;
+
+	// do not cache errors
+	if (cacheable && wsgi_req->status == 200) {
+		// a failure here (e.g. a too big item) only means the next response will be compressed again
+		uwsgi_cache_magic_set(utgz->cache_key->buf, utgz->cache_key->pos, gz->buf, gz->pos, urgc->expires, UWSGI_CACHE_FLAG_UPDATE, urgc->cache);
+	}
+
+	uwsgi_buffer_map(ub, gz->buf, gz->pos);
+	gz->buf = NULL;
+	uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4);
+	ret = 0;
+end:
+	if (gz) uwsgi_buffer_destroy(gz);
+	gzip_stream_put(wsgi_req, utgz, !ret);
+	return ret;
+}
+
 static int uwsgi_routing_func_gzip(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_transformation_gzip *utgz = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip));
-	if (uwsgi_gzip_prepare(&utgz->z, NULL, 0, &utgz->crc32)) {
-		free(utgz);
-		return UWSGI_ROUTE_BREAK;
+	struct uwsgi_router_gzip_conf *urgc = (struct uwsgi_router_gzip_conf *) ur->data2;
+	struct uwsgi_transformation_gzip *utgz = gzip_stream_get(wsgi_req);
+	if (!utgz) return UWSGI_ROUTE_BREAK;
+
+	if (urgc) {
+		char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
+		uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
+		utgz->cache_key = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urgc->key, urgc->key_len);
+		if (!utgz->cache_key) {
+			gzip_stream_put(wsgi_req, utgz, 1);
+			return UWSGI_ROUTE_BREAK;
+		}
+		utgz->urgc = urgc;
+		// a single buffered transformation (it frees the memory too)
+		uwsgi_add_transformation(wsgi_req, transform_gzip_cache, utgz);
+		return UWSGI_ROUTE_NEXT;
 	}
+
 	struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_gzip, utgz);
 	ut->can_stream = 1;
 	// this is the trasformation clearing the memory
@@ -65,7 +204,43 @@ static int uwsgi_routing_func_gzip(struct wsgi_request *wsgi_req, struct uwsgi_r
 
 static int uwsgi_router_gzip(struct uwsgi_route *ur, char *args) {
 	ur->func = uwsgi_routing_func_gzip;
+	if (!args || !args[0]) return 0;
+
+	struct uwsgi_router_gzip_conf *urgc = uwsgi_calloc(sizeof(struct uwsgi_router_gzip_conf));
+	if (uwsgi_kvlist_parse(args, strlen(args), ',', '=',
+			"cache", &urgc->cache,
+			"key", &urgc->key,
+			"expires", &urgc->expires_str, NULL)) {
+		uwsgi_log("invalid gzip route syntax: %s\n", args);
+		goto error;
+	}
+
+	if (!urgc->cache) {
+		uwsgi_log("invalid gzip route syntax: you need to specify a cache name\n");
+		goto error;
+	}
+
+	if (!urgc->key) {
+		urgc->key = "${REQUEST_URI}";
+	}
+	urgc->key_len = strlen(urgc->key);
+
+	if (urgc->expires_str) {
+		urgc->expires = strtoul(urgc->expires_str, NULL, 10);
+	}
+
+	ur->data2 = urgc;
 	return 0;
+error:
+	if (urgc->cache) free(urgc->cache);
+	if (urgc->key) free(urgc->key);
+	if (urgc->expires_str) free(urgc->expires_str);
+	free(urgc);
+	return -1;
+}
+
+static void router_gzip_post_fork(void) {
+	gzip_pool = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip *) * uwsgi.cores);
 }
 
 static void router_gzip_register(void) {
@@ -75,6 +250,7 @@ static void router_gzip_register(void) {
 struct uwsgi_plugin transformation_gzip_plugin = {
 	.name = "transformation_gzip",
 	.on_load = router_gzip_register,
+	.post_fork = router_gzip_post_fork,
 };
 #else
 struct uwsgi_plugin transformation_gzip_plugin = {
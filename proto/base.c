@@ -182,6 +182,23 @@ int uwsgi_proto_base_write(struct wsgi_request * wsgi_req, char *buf, size_t len
         return -1;
 }
 
+int uwsgi_proto_base_writev(struct wsgi_request * wsgi_req, struct iovec *iov, size_t iov_len) {
+	ssize_t wlen = writev(wsgi_req->fd, iov, iov_len);
+	if (wlen > 0) {
+		wsgi_req->write_pos += wlen;
+		if (uwsgi_iovec_consume(iov, iov_len, wlen)) {
+			return UWSGI_OK;
+		}
+		return UWSGI_AGAIN;
+	}
+	if (wlen < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+			return UWSGI_AGAIN;
+		}
+	}
+	return -1;
+}
+
 int uwsgi_proto_base_sendfile(struct wsgi_request * wsgi_req, int fd, size_t pos, size_t len) {
         ssize_t wlen = uwsgi_sendfile_do(wsgi_req->fd, fd, pos+wsgi_req->write_pos, len-wsgi_req->write_pos);
         if (wlen > 0) {
@@ -264,6 +264,77 @@ int uwsgi_proto_fastcgi_write(struct wsgi_request *wsgi_req, char *buf, size_t l
 
 }
 
+// the same as uwsgi_proto_fastcgi_write() but the record is sent with the data in a single writev()
+int uwsgi_proto_fastcgi_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len) {
+
+	struct iovec fiov[8];
+	struct fcgi_record fr;
+	size_t fiov_cnt = 0;
+	int new_record = 0;
+	size_t i, remains = 0;
+
+	for(i=0;i<iov_len;i++) remains += iov[i].iov_len;
+	if (remains == 0) return UWSGI_OK;
+
+	// fastcgi packets are limited to 64k
+	if (wsgi_req->proto_parser_status == 0) {
+		uint16_t fcgi_len = UMIN(remains, 0xffff);
+		wsgi_req->proto_parser_status = fcgi_len;
+		fr.version = 1;
+		fr.type = 6;
+		fr.req1 = 0;
+		fr.req0 = 1;
+		fr.pad = 0;
+		fr.reserved = 0;
+		fr.cl0 = (uint8_t) (fcgi_len & 0xff);
+		fr.cl1 = (uint8_t) ((fcgi_len >> 8) & 0xff);
+		fiov[0].iov_base = &fr;
+		fiov[0].iov_len = sizeof(struct fcgi_record);
+		fiov_cnt = 1;
+		new_record = 1;
+	}
+
+	// map the iovecs to the current record
+	size_t record_remains = wsgi_req->proto_parser_status;
+	for(i=0;i<iov_len && fiov_cnt < 8 && record_remains > 0;i++) {
+		if (iov[i].iov_len == 0) continue;
+		fiov[fiov_cnt].iov_base = iov[i].iov_base;
+		fiov[fiov_cnt].iov_len = UMIN(iov[i].iov_len, record_remains);
+		record_remains -= fiov[fiov_cnt].iov_len;
+		fiov_cnt++;
+	}
+
+	ssize_t wlen = writev(wsgi_req->fd, fiov, fiov_cnt);
+	if (wlen > 0) {
+		if (new_record) {
+			// ensure the record header is fully sent
+			if (wlen < (ssize_t) sizeof(struct fcgi_record)) {
+				if (uwsgi_write_true_nb(wsgi_req->fd, ((char *) &fr) + wlen, sizeof(struct fcgi_record) - wlen, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) {
+					return -1;
+				}
+				wlen = 0;
+			}
+			else {
+				wlen -= sizeof(struct fcgi_record);
+			}
+		}
+		wsgi_req->write_pos += wlen;
+		wsgi_req->proto_parser_status -= wlen;
+		if (uwsgi_iovec_consume(iov, iov_len, wlen)) {
+			return UWSGI_OK;
+		}
+		return UWSGI_AGAIN;
+	}
+	if (wlen < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+			// the record has not been sent
+			if (new_record) wsgi_req->proto_parser_status = 0;
+			return UWSGI_AGAIN;
+		}
+	}
+	return -1;
+}
+
 void uwsgi_proto_fastcgi_close(struct wsgi_request *wsgi_req) {
 	// special case here, we run i nvoid context, so we need to wait directly here
 	(void) uwsgi_write_true_nb(wsgi_req->fd, (char *) FCGI_END_REQUEST, sizeof(FCGI_END_REQUEST), uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT]);
@@ -152,3 +152,182 @@ int uwsgi_proto_uwsgi_parser_unix(struct wsgi_request *wsgi_req) {
 }
 
 */
+
+/*
+
+	persistent uwsgi protocol (puwsgi)
+
+	requests are plain uwsgi packets, but every chunk of the response is prefixed
+	by its size (4 bytes, little endian). An empty chunk marks the end of the response:
+	the connection is left open and the worker will wait for another request on it.
+
+	If the connection cannot be reused (unread body, websockets, the worker is going to die...)
+	it is simply closed without sending the terminator, like with the plain uwsgi protocol.
+
+*/
+
+static int uwsgi_proto_puwsgi_frame(struct wsgi_request *wsgi_req, char *buf, uint32_t len) {
+	buf[0] = (uint8_t) (len & 0xff);
+	buf[1] = (uint8_t) ((len >> 8) & 0xff);
+	buf[2] = (uint8_t) ((len >> 16) & 0xff);
+	buf[3] = (uint8_t) ((len >> 24) & 0xff);
+	wsgi_req->proto_parser_status = len;
+	return 4;
+}
+
+ssize_t uwsgi_proto_puwsgi_read_body(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	ssize_t rlen = uwsgi_proto_base_read_body(wsgi_req, buf, len);
+	if (rlen > 0) {
+		wsgi_req->proto_body_read += rlen;
+	}
+	return rlen;
+}
+
+int uwsgi_proto_puwsgi_write(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+
+	if (wsgi_req->proto_parser_status == 0) {
+		char frame[4];
+		uwsgi_proto_puwsgi_frame(wsgi_req, frame, len - wsgi_req->write_pos);
+		if (uwsgi_write_true_nb(wsgi_req->fd, frame, 4, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) {
+			return -1;
+		}
+	}
+
+	ssize_t wlen = write(wsgi_req->fd, buf + wsgi_req->write_pos, wsgi_req->proto_parser_status);
+	if (wlen > 0) {
+		wsgi_req->write_pos += wlen;
+		wsgi_req->proto_parser_status -= wlen;
+		if (wsgi_req->write_pos == len) {
+			return UWSGI_OK;
+		}
+		return UWSGI_AGAIN;
+	}
+	if (wlen < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+			return UWSGI_AGAIN;
+		}
+	}
+	return -1;
+}
+
+// the frame header is sent with the data in a single writev()
+int uwsgi_proto_puwsgi_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len) {
+
+	struct iovec fiov[8];
+	char frame[4];
+	size_t fiov_cnt = 1;
+	int new_frame = 0;
+	size_t i, remains = 0;
+
+	// a frame maps at most 7 iovecs (the first slot is for the frame header)
+	for (i = 0; i < iov_len && fiov_cnt < 8; i++) {
+		if (iov[i].iov_len == 0) continue;
+		fiov[fiov_cnt].iov_base = iov[i].iov_base;
+		fiov[fiov_cnt].iov_len = iov[i].iov_len;
+		remains += iov[i].iov_len;
+		fiov_cnt++;
+	}
+	if (remains == 0) return UWSGI_OK;
+
+	if (wsgi_req->proto_parser_status == 0) {
+		fiov[0].iov_base = frame;
+		fiov[0].iov_len = uwsgi_proto_puwsgi_frame(wsgi_req, frame, remains);
+		new_frame = 1;
+	}
+	else {
+		// continue the current frame without crossing its boundary
+		size_t frame_remains = wsgi_req->proto_parser_status;
+		for (i = 1; i < fiov_cnt; i++) {
+			if (fiov[i].iov_len >= frame_remains) {
+				fiov[i].iov_len = frame_remains;
+				fiov_cnt = i + 1;
+				break;
+			}
+			frame_remains -= fiov[i].iov_len;
+		}
+	}
+
+	ssize_t wlen = writev(wsgi_req->fd, new_frame ? fiov : fiov + 1, new_frame ? fiov_cnt : fiov_cnt - 1);
+	if (wlen > 0) {
+		if (new_frame) {
+			// ensure the frame header is fully sent
+			if (wlen < 4) {
+				if (uwsgi_write_true_nb(wsgi_req->fd, frame + wlen, 4 - wlen, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) {
+					return -1;
+				}
+				wlen = 0;
+			}
+			else {
+				wlen -= 4;
+			}
+		}
+		wsgi_req->write_pos += wlen;
+		wsgi_req->proto_parser_status -= wlen;
+		if (uwsgi_iovec_consume(iov, iov_len, wlen)) {
+			return UWSGI_OK;
+		}
+		return UWSGI_AGAIN;
+	}
+	if (wlen < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+			// the frame has not been sent
+			if (new_frame) wsgi_req->proto_parser_status = 0;
+			return UWSGI_AGAIN;
+		}
+	}
+	return -1;
+}
+
+int uwsgi_proto_puwsgi_sendfile(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
+
+	if (wsgi_req->proto_parser_status == 0) {
+		char frame[4];
+		uwsgi_proto_puwsgi_frame(wsgi_req, frame, len - wsgi_req->write_pos);
+		if (uwsgi_write_true_nb(wsgi_req->fd, frame, 4, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) {
+			return -1;
+		}
+	}
+
+	ssize_t wlen = uwsgi_sendfile_do(wsgi_req->fd, fd, pos + wsgi_req->write_pos, wsgi_req->proto_parser_status);
+	if (wlen > 0) {
+		wsgi_req->write_pos += wlen;
+		wsgi_req->proto_parser_status -= wlen;
+		if (wsgi_req->write_pos == len) {
+			return UWSGI_OK;
+		}
+		return UWSGI_AGAIN;
+	}
+	if (wlen < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS) {
+			return UWSGI_AGAIN;
+		}
+	}
+	return -1;
+}
+
+void uwsgi_proto_puwsgi_close(struct wsgi_request *wsgi_req) {
+	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
+	int fd = wsgi_req->fd;
+
+	// only completed requests with a fully consumed body (and no pending frame) can leave the connection open
+	if (!uc->queue || !uwsgi.workers[uwsgi.mywid].manage_next_request || !wsgi_req->end_of_request) goto end;
+	if (wsgi_req->write_errors || wsgi_req->proto_parser_status || wsgi_req->proto_parser_remains) goto end;
+	if (wsgi_req->proto_body_read != wsgi_req->post_cl || wsgi_req->websocket_buf) goto end;
+
+	char terminator[4] = {0, 0, 0, 0};
+	if (uwsgi_write_true_nb(fd, terminator, 4, uwsgi.shared->options[UWSGI_OPTION_SOCKET_TIMEOUT])) goto end;
+
+	// the first time, start monitoring the connection in the loop queue
+	if (!uwsgi.persistent_sockets[fd]) {
+		if (event_queue_add_fd_read(uc->queue, fd)) goto end;
+		uwsgi.persistent_sockets[fd] = wsgi_req->socket;
+		uc->persistent_fds++;
+	}
+	return;
+end:
+	if (uwsgi.persistent_sockets[fd]) {
+		uwsgi.persistent_sockets[fd] = NULL;
+		uc->persistent_fds--;
+	}
+	close(fd);
+}
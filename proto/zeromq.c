@@ -528,6 +528,27 @@ int uwsgi_proto_zeromq_write(struct wsgi_request *wsgi_req, char *buf, size_t le
 	return UWSGI_OK;
 }
 
+// headers and body are sent in the same message
+int uwsgi_proto_zeromq_writev(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len) {
+	size_t i, len = 0;
+	for(i=0;i<iov_len;i++) len += iov[i].iov_len;
+
+	char *buf = uwsgi_malloc(len);
+	char *ptr = buf;
+	for(i=0;i<iov_len;i++) {
+		memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+		ptr += iov[i].iov_len;
+	}
+
+	int ret = uwsgi_proto_zeromq_write(wsgi_req, buf, len);
+	free(buf);
+	if (ret == UWSGI_OK) {
+		wsgi_req->write_pos += len;
+		uwsgi_iovec_consume(iov, iov_len, len);
+	}
+	return ret;
+}
+
 /*
 
 	we have a problem... recent Mongrel2 releases introduced a ring buffer that limit the amount of messages we can send (or better, the amount of
@@ -605,6 +626,7 @@ void uwsgi_proto_zeromq_setup(struct uwsgi_socket *uwsgi_sock) {
 	uwsgi_sock->proto_read_body = uwsgi_proto_zeromq_read_body;
 	uwsgi_sock->proto_write = uwsgi_proto_zeromq_write;
 	uwsgi_sock->proto_write_headers = uwsgi_proto_zeromq_write;
+	uwsgi_sock->proto_writev = uwsgi_proto_zeromq_writev;
 	uwsgi_sock->proto_sendfile = uwsgi_proto_zeromq_sendfile;
 	uwsgi_sock->proto_close = uwsgi_proto_zeromq_close;
 
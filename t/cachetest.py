@@ -1,3 +1,12 @@
+# ./uwsgi --plugin python --cache 2000 --cache-blocksize 10000 \
+#   --cache2 name=striped,items=2000,blocksize=1000,stripes=8 \
+#   --cache2 name=striped_bitmap,items=2000,blocks=32768,blocksize=64,bitmap=1,stripes=8 \
+#   --cache2 name=lru,items=256,blocksize=64,stripes=4,evict=lru \
+#   --cache2 name=clock,items=256,blocksize=64,stripes=4,evict=clock \
+#   --cache2 name=lfu,items=256,blocksize=64,stripes=4,evict=lfu \
+#   --cache2 name=lru_bitmap,items=256,blocks=1024,blocksize=64,bitmap=1,stripes=4,evict=lru \
+#   --cache2 name=noevict,items=256,blocksize=64,stripes=4 \
+#   --pyrun t/cachetest.py
 import uwsgi
 
 import random
@@ -31,3 +40,72 @@ for key in items.keys():
          raise Exception('CACHE TEST FAILED AFTER %d ITERATIONS !!!' % count)
 
 print "TEST PASSED"
+
+# striped caches: every stripe has its own lock, items and blocks
+def check_cache(name, items):
+    for key in items.keys():
+        val = uwsgi.cache_get(key, name)
+        if val != items[key]:
+            raise Exception('CACHE TEST FAILED on "%s" for key %s (%s)' % (name, key, val is None and 'missing' or 'corrupted'))
+
+for name in ('striped', 'striped_bitmap'):
+    print 'filling cache "%s"...' % name
+    items = {}
+    for i in range(0, 1000):
+        key = 'item%d_%s' % (i, gen_rand_s(gen_rand_n(32)))
+        items[key] = gen_rand_s(gen_rand_n(1000))
+        if not uwsgi.cache_set(key, items[key], 0, name):
+            raise Exception('CACHE TEST FAILED: unable to store %s in "%s"' % (key, name))
+    check_cache(name, items)
+    print 'deleting and updating items in cache "%s"...' % name
+    for i, key in enumerate(items.keys()):
+        if i % 2:
+            uwsgi.cache_del(key, name)
+            if uwsgi.cache_exists(key, name):
+                raise Exception('CACHE TEST FAILED: %s still in "%s" after cache_del' % (key, name))
+            del(items[key])
+        else:
+            items[key] = gen_rand_s(gen_rand_n(1000))
+            uwsgi.cache_update(key, items[key], 0, name)
+    check_cache(name, items)
+
+# eviction under pressure: hot items must survive, everything still
+# in the cache must be the last value stored for its key
+for name in ('lru', 'clock', 'lfu', 'lru_bitmap'):
+    print 'checking eviction on cache "%s"...' % name
+    hot = {}
+    for i in range(0, 16):
+        hot['hot%d' % i] = gen_rand_s(gen_rand_n(50))
+        uwsgi.cache_set('hot%d' % i, hot['hot%d' % i], 0, name)
+    cold = {}
+    for i in range(0, 5000):
+        key = 'cold%d' % random.randint(0, 2000)
+        cold[key] = gen_rand_s(gen_rand_n(name.endswith('_bitmap') and 1000 or 50))
+        if not uwsgi.cache_update(key, cold[key], 0, name):
+            raise Exception('CACHE TEST FAILED: unable to store %s in "%s" (eviction did not free space)' % (key, name))
+        for key in hot.keys():
+            uwsgi.cache_get(key, name)
+    check_cache(name, hot)
+    found = 0
+    for key in cold.keys():
+        val = uwsgi.cache_get(key, name)
+        if val is None:
+            continue
+        if val != cold[key]:
+            raise Exception('CACHE TEST FAILED: %s corrupted in "%s"' % (key, name))
+        found += 1
+    if found + len(hot) > 256:
+        raise Exception('CACHE TEST FAILED: "%s" holds more than 256 items' % name)
+
+# without an eviction policy a full cache refuses new items
+print 'checking full cache "noevict"...'
+items = {}
+for i in range(0, 300):
+    key = 'item%d' % i
+    if uwsgi.cache_set(key, str(i), 0, 'noevict'):
+        items[key] = str(i)
+if len(items) > 256 or len(items) == 300:
+    raise Exception('CACHE TEST FAILED: "noevict" stored %d items' % len(items))
+check_cache('noevict', items)
+
+print "STRIPES AND EVICTION TEST PASSED"
@@ -1,4 +1,5 @@
 #!./uwsgi --https :8443,foobar.crt,foobar.key --http-websockets --gevent 100 --module tests.websocket
+# framing checks: python tests/websockets_client.py 127.0.0.1:8080 /foobar/ (with --http-socket :8080)
 import uwsgi
 import gevent
 from gevent.queue import JoinableQueue
@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+# websockets framing checks, run them against tests/websockets_echo.py or tests/websockets.py
+#
+#   python tests/websockets_client.py 127.0.0.1:8080 /foobar/ [many]
+#
+# (use --http-socket :8080 instead of --https, this client speaks plain http)
+#
+# "many" enables the websocket_send_many() check (only tests/websockets_echo.py implements it)
+import sys
+import os
+import socket
+import struct
+import base64
+import time
+
+
+class Client(object):
+
+    def __init__(self, addr, path):
+        host, port = addr.rsplit(':', 1)
+        self.s = socket.create_connection((host, int(port)))
+        self.s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.s.settimeout(10)
+        key = base64.b64encode(os.urandom(16))
+        self.s.sendall(b'GET ' + path.encode() + b' HTTP/1.1\r\nHost: ' + addr.encode() +
+                       b'\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: ' + key +
+                       b'\r\nSec-WebSocket-Version: 13\r\n\r\n')
+        self.buf = b''
+        while b'\r\n\r\n' not in self.buf:
+            self.fill()
+        headers, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        if b' 101 ' not in headers.split(b'\r\n')[0]:
+            raise Exception('websocket handshake failed: %r' % headers)
+
+    def fill(self):
+        chunk = self.s.recv(65536)
+        if not chunk:
+            raise Exception('connection closed by the server')
+        self.buf += chunk
+
+    def need(self, n):
+        while len(self.buf) < n:
+            self.fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def recv(self):
+        while True:
+            b0, b1 = struct.unpack('BB', self.need(2))
+            size = b1 & 0x7f
+            if size == 126:
+                size, = struct.unpack('>H', self.need(2))
+            elif size == 127:
+                size, = struct.unpack('>Q', self.need(8))
+            payload = self.need(size)
+            # answer pings (the server closes the connection without a pong)
+            if b0 & 0x0f == 0x9:
+                self.s.sendall(frame(payload, opcode=0xA))
+                continue
+            return payload
+
+
+def frame(payload, masked=True, opcode=0x1):
+    header = bytearray([0x80 | opcode])
+    mask_bit = masked and 0x80 or 0
+    size = len(payload)
+    if size < 126:
+        header.append(mask_bit | size)
+    elif size < 65536:
+        header.append(mask_bit | 126)
+        header += struct.pack('>H', size)
+    else:
+        header.append(mask_bit | 127)
+        header += struct.pack('>Q', size)
+    if not masked:
+        return bytes(header) + payload
+    mask = bytearray(os.urandom(4))
+    data = bytearray(payload)
+    for i in range(len(data)):
+        data[i] ^= mask[i % 4]
+    return bytes(header) + bytes(mask) + bytes(data)
+
+
+def message(size):
+    # the prefix is truncated for the smaller sizes (a 1 byte message is b'1')
+    prefix = ('%d:' % size).encode()[:size]
+    return prefix + b'x' * (size - len(prefix))
+
+
+failures = 0
+
+
+def check(name, ok):
+    global failures
+    print('%s: %s' % (name, 'ok' if ok else 'FAILED'))
+    if not ok:
+        failures += 1
+
+
+def main(addr, path, many):
+    c = Client(addr, path)
+
+    # 7, 16 and 64 bit lengths, masked and unmasked
+    for size in (1, 125, 126, 127, 65535, 65536, 100000):
+        for masked in (True, False):
+            msg = message(size)
+            c.s.sendall(frame(msg, masked))
+            check('%s frame of %d bytes' % (masked and 'masked' or 'unmasked', size), c.recv().endswith(msg))
+
+    # a frame split across reads (the header too)
+    msg = message(70000)
+    data = frame(msg)
+    for i in range(0, 14):
+        c.s.sendall(data[i:i + 1])
+        time.sleep(0.01)
+    for i in range(14, len(data), 4096):
+        c.s.sendall(data[i:i + 4096])
+        time.sleep(0.001)
+    check('frame split across reads', c.recv().endswith(msg))
+
+    # multiple frames in a single read
+    msgs = [message(size) for size in (10, 125, 200, 65536, 5)]
+    c.s.sendall(b''.join([frame(msg) for msg in msgs]))
+    check('multiple frames in a single read', all([c.recv().endswith(msg) for msg in msgs]))
+
+    # multiple frames with boundaries in the middle of headers and masks
+    msgs = [message(size) for size in (3, 300, 7, 126, 70000, 1)]
+    data = b''.join([frame(msg, i % 2 == 0) for i, msg in enumerate(msgs)])
+    for i in range(0, len(data), 7):
+        c.s.sendall(data[i:i + 7])
+        if i < 1024:
+            time.sleep(0.001)
+    check('multiple frames split across reads', all([c.recv().endswith(msg) for msg in msgs]))
+
+    if many:
+        c.s.sendall(frame(b'many:5:hello'))
+        check('websocket_send_many()', all([c.recv().endswith(('hello-%d' % i).encode()) for i in range(5)]))
+        c.s.sendall(frame(b'many:3:' + message(70000)))
+        check('websocket_send_many() with 64 bit lengths', all([c.recv().endswith(('-%d' % i).encode()) for i in range(3)]))
+
+    if failures:
+        print('%d CHECKS FAILED' % failures)
+        sys.exit(1)
+    print('TEST PASSED')
+
+
+if __name__ == '__main__':
+    main(sys.argv[1], sys.argv[2], len(sys.argv) > 3 and sys.argv[3] == 'many')
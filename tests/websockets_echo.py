@@ -1,4 +1,5 @@
 #!./uwsgi --https :8443,foobar.crt,foobar.key --http-raw-body --gevent 100 --module tests.websocket_echo
+# framing checks: python tests/websockets_client.py 127.0.0.1:8080 /foobar/ many (with --http-socket :8080)
 import uwsgi
 import time
 
@@ -53,4 +54,9 @@ def application(env, sr):
         print "websockets..."
         while True:
             msg = uwsgi.websocket_recv()
-            uwsgi.websocket_send("[%s] %s" % (time.time(), msg))
+            # many:<n>:<text> is answered with n frames (text-0 ... text-<n-1>) sent by a single websocket_send_many()
+            if msg.startswith('many:'):
+                n, text = msg[5:].split(':', 1)
+                uwsgi.websocket_send_many(["[%s] %s-%d" % (time.time(), text, i) for i in range(int(n))])
+            else:
+                uwsgi.websocket_send("[%s] %s" % (time.time(), msg))
@@ -0,0 +1,88 @@
+# wsgi.input read()/readinto() checks
+#
+#   ./uwsgi --http-socket :8080 --post-buffering 4096 --wsgi-input-memoryview --wsgi-file tests/wsgi_input.py
+#   python tests/wsgi_input.py 127.0.0.1:8080
+#
+# run it with and without --post-buffering and --wsgi-input-memoryview: bodies bigger than
+# --post-buffering are mmap()'ed from the temp file, the smaller ones are in memory.
+# The memoryviews returned by read() are kept and checked again in the following requests
+# (they must survive the end of their request).
+import sys
+
+
+def body(size):
+    return b''.join([('%08d' % i).encode() for i in range(size // 8 + 1)])[:size]
+
+
+def to_bytes(chunk):
+    if isinstance(chunk, memoryview):
+        return chunk.tobytes()
+    return chunk
+
+kept = []
+
+
+def check_kept():
+    for view, expected in kept:
+        if view.tobytes() != expected:
+            return 'a memoryview of a previous request changed'
+
+
+def application(env, start_response):
+    size = int(env.get('CONTENT_LENGTH') or 0)
+    expected = body(size)
+    wsgi_input = env['wsgi.input']
+
+    if env['PATH_INFO'] == '/read':
+        first = wsgi_input.read(1000)
+        data = to_bytes(first) + to_bytes(wsgi_input.read())
+        if isinstance(first, memoryview):
+            kept.append((first, expected[:1000]))
+            del kept[:-20]
+    elif env['PATH_INFO'] == '/readinto':
+        buf = bytearray(size)
+        view = memoryview(buf)
+        pos = 0
+        while pos < size:
+            n = wsgi_input.readinto(view[pos:pos + 3000])
+            if not n:
+                break
+            pos += n
+        data = bytes(buf[:pos])
+    else:
+        data = to_bytes(wsgi_input.read(10))
+        buf = bytearray(size)
+        n = wsgi_input.readinto(buf)
+        data += bytes(buf[:n])
+        if to_bytes(wsgi_input.read()) != b'':
+            data = b'not at the end of the body'
+
+    start_response('200 OK', [('Content-Type', 'text/plain')])
+    if data != expected:
+        return [('FAILED: %d bytes read instead of the %d expected ones' % (len(data), size)).encode()]
+    error = check_kept()
+    if error:
+        return [('FAILED: %s' % error).encode()]
+    return [b'ok']
+
+
+if __name__ == '__main__':
+    try:
+        from http.client import HTTPConnection
+    except ImportError:
+        from httplib import HTTPConnection
+    host, port = sys.argv[1].rsplit(':', 1)
+    failures = 0
+    for size in (1, 100, 4095, 4096, 4097, 100000, 1000000):
+        for path in ('/read', '/readinto', '/mixed'):
+            c = HTTPConnection(host, int(port))
+            c.request('POST', path, body(size), {'Content-Type': 'application/octet-stream'})
+            response = c.getresponse().read()
+            c.close()
+            print('%s with %d bytes: %s' % (path, size, response.decode()))
+            if response != b'ok':
+                failures += 1
+    if failures:
+        print('%d CHECKS FAILED' % failures)
+        sys.exit(1)
+    print('TEST PASSED')
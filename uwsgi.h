@@ -34,7 +34,7 @@ extern "C" {
 
 #define wsgi_req_time ((wsgi_req->end_of_request-wsgi_req->start_of_request)/1000)
 
-#define thunder_lock if (!uwsgi.is_et) {\
+#define thunder_lock if (!uwsgi.is_et && !uwsgi.reuse_port_sharded) {\
                         if (uwsgi.use_thunder_lock) {\
                                 uwsgi_lock(uwsgi.the_thunder_lock);\
                         }\
@@ -43,7 +43,7 @@ extern "C" {
                         }\
                     }
 
-#define thunder_unlock if (!uwsgi.is_et) {\
+#define thunder_unlock if (!uwsgi.is_et && !uwsgi.reuse_port_sharded) {\
                         if (uwsgi.use_thunder_lock) {\
                                 uwsgi_unlock(uwsgi.the_thunder_lock);\
                         }\
@@ -328,6 +328,21 @@ extern int pivot_root(const char *new_root, const char *put_old);
 #define UWSGI_CACHE_FLAG_DIV	1 << 8
 #define UWSGI_CACHE_FLAG_FIXEXPIRE	1 << 9
 
+#define UWSGI_CACHE_FREE_RUNS_BUCKETS	16
+#define UWSGI_CACHE_OPTIMISTIC_RETRIES	4
+// one slot per second, must be a power of 2
+#define UWSGI_CACHE_EXPIRE_SLOTS	4096
+// max number of items deleted by the sweeper for each lock acquisition
+#define UWSGI_CACHE_SWEEP_BATCH	1024
+
+#define UWSGI_CACHE_EVICT_LRU	1
+#define UWSGI_CACHE_EVICT_CLOCK	2
+#define UWSGI_CACHE_EVICT_LFU	3
+// candidates compared by the lru and lfu policies
+#define UWSGI_CACHE_EVICT_SAMPLES	8
+// max number of items evicted to make room for a single value
+#define UWSGI_CACHE_EVICT_MAX	64
+
 #ifdef UWSGI_SSL
 #include "openssl/conf.h"
 #include "openssl/ssl.h"
@@ -437,6 +452,11 @@ struct uwsgi_dyn_dict {
 	struct uwsgi_dyn_dict *next;
 };
 
+struct uwsgi_dyn_dict_index {
+	uint32_t mask;
+	struct uwsgi_dyn_dict **items;
+};
+
 #ifdef UWSGI_PCRE
 struct uwsgi_regexp_list {
 
@@ -577,6 +597,8 @@ struct uwsgi_logger {
 	char *buf;
 	// used by choosen logger
 	char *arg;
+	// optional, receives a whole batch of records (see --req-log-ring)
+	 ssize_t(*func_batch) (struct uwsgi_logger *, struct iovec *, size_t);
 	struct uwsgi_logger *next;
 };
 
@@ -701,6 +723,8 @@ struct uwsgi_cache_item {
 	uint64_t expires;
 	// 64bit hits
 	uint64_t hits;
+	// last access (lru) or reference bit (clock)
+	uint64_t access;
 	// previous same-hash item
 	uint64_t prev;
 	// next same-hash item
@@ -709,6 +733,56 @@ struct uwsgi_cache_item {
 	char key[];
 } __attribute__ ((__packed__));
 
+// maintain alignment here (each stripe lives in its own cache lines) !!!
+struct uwsgi_cache_stripe {
+	struct uwsgi_lock_item *lock;
+	// incremented before and after each change (used by optimistic readers)
+	volatile uint64_t seq;
+
+	// range of items managed by the stripe
+	uint64_t first_item;
+	uint64_t last_item;
+	uint64_t first_available_item;
+	uint64_t unused_items_stack_ptr;
+	uint64_t n_items;
+
+	// range of blocks managed by the stripe (bitmap mode)
+	uint64_t first_block;
+	uint64_t last_block;
+	uint64_t blocks_bitmap_pos;
+
+	// expiration wheel (list heads indexed by expires % UWSGI_CACHE_EXPIRE_SLOTS)
+	uint64_t *expire_wheel;
+	// the next second to be checked by the sweeper
+	uint64_t expire_next;
+
+	// next candidate for eviction
+	uint64_t evict_hand;
+
+	// contended lock acquisitions (atomically updated)
+	uint64_t lock_waits;
+	// microseconds
+	uint64_t lock_wait_time;
+	// lock holders and waiters, writers between them, and a writer holds the lock
+	uint64_t lock_users;
+	uint64_t lock_writers;
+	int lock_writer;
+	uint64_t optimistic_reads;
+	uint64_t optimistic_retries;
+	// hits and misses of the optimistic readers (atomically updated)
+	uint64_t hits;
+	uint64_t miss;
+	// lru stamps (atomically updated)
+	uint64_t access_clock;
+} __attribute__ ((aligned (64)));
+
+// links items with an expiration in the same slot of the wheel
+struct uwsgi_cache_expire_link {
+	uint64_t slot;
+	uint64_t prev;
+	uint64_t next;
+};
+
 struct uwsgi_cache {
 	char *name;
 	uint16_t name_len;
@@ -721,20 +795,24 @@ struct uwsgi_cache {
 	uint64_t *hashtable;
 	uint32_t hashsize;
 
-	uint64_t first_available_block;
 	uint64_t *unused_blocks_stack;
-	uint64_t unused_blocks_stack_ptr;
 
 	uint8_t use_blocks_bitmap;
-	uint8_t *blocks_bitmap;
-	uint64_t blocks_bitmap_pos;
+	uint64_t *blocks_bitmap;
 	uint64_t blocks_bitmap_size;
 
 	uint64_t max_items;
 	uint64_t max_item_size;
-	uint64_t n_items;
 	struct uwsgi_cache_item *items;
 
+	uint64_t stripes;
+	uint64_t stripe_items;
+	struct uwsgi_cache_stripe *stripe;
+
+	// NULL when expiration is disabled
+	struct uwsgi_cache_expire_link *expire_links;
+	uint64_t *expire_wheel;
+
 	uint8_t use_last_modified;
 	time_t last_modified_at;
 
@@ -745,6 +823,10 @@ struct uwsgi_cache {
 	uint64_t hits;
 	uint64_t miss;
 
+	// eviction policy (0 to fail when full)
+	uint8_t evict;
+	uint64_t evictions;
+
 	char *store;
 	uint64_t filesize;
 	uint64_t store_sync;
@@ -885,6 +967,8 @@ struct uwsgi_socket {
 	int (*proto_write) (struct wsgi_request *, char *, size_t);
 	// call that to write headers (if a special case is needed for them)
 	int (*proto_write_headers) (struct wsgi_request *, char *, size_t);
+	// call that to write a gathered response (headers + body) with a single syscall, iovecs are consumed on partial writes
+	int (*proto_writev) (struct wsgi_request *, struct iovec *, size_t);
 	// call that when sendfile() is invoked
 	int (*proto_sendfile) (struct wsgi_request *, int, size_t, size_t);
 	// call that to read the body of a request (could map to a simple read())
@@ -928,6 +1012,10 @@ struct uwsgi_socket {
 	int lazy;
 	int shared;
 	int from_shared;
+	// the worker owns a private SO_REUSEPORT listener (or one per thread in fd_threads)
+	int shard;
+	// the listeners created by the master for every worker (numproc * threads)
+	int *shards;
 };
 
 struct uwsgi_server;
@@ -1041,6 +1129,10 @@ struct uwsgi_app {
 	void *gateway_version;
 	void *uwsgi_version;
 	void *uwsgi_node;
+	// prebuilt constant entries of the request environ
+	void *environ_constants;
+	// interned keys of the request environ
+	void *environ_keys;
 
 	time_t started_at;
 	time_t startup_time;
@@ -1076,6 +1168,8 @@ struct uwsgi_spooler {
 // close the request
 #define UWSGI_ROUTE_BREAK 2
 
+struct uwsgi_route_table;
+
 struct uwsgi_route {
 
 	pcre *pattern;
@@ -1121,6 +1215,16 @@ struct uwsgi_route {
 	char *regexp;
 	char *action;
 
+	// anchored patterns without metacharacters are matched with memcmp
+	char *literal;
+	size_t literal_len;
+	int literal_prefix;
+	// dispatch table shared by a block of literal rules on the same subject
+	struct uwsgi_route_table *table;
+
+	// hits counters (one for each worker, in shared memory, atomically updated)
+	uint64_t *hits;
+
 	// this is used by virtual route to free resources
 	void (*free)(struct uwsgi_route *);
 
@@ -1236,6 +1340,12 @@ struct uwsgi_transformation {
 	struct uwsgi_buffer *ub;
 	uint64_t len;
 	uint64_t custom64;
+	// accounting (name is the route action that added the transformation)
+	char *name;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t bytes_copied;
+	uint64_t micros;
 	struct uwsgi_transformation *next;
 };
 
@@ -1349,6 +1459,11 @@ struct wsgi_request {
 	uint16_t var_cnt;
 	uint16_t header_cnt;
 
+	// open addressing index of the vars (hvec position + 1 of each key)
+	uint16_t *var_index;
+	// number of hvec items covered by the index
+	uint16_t var_indexed;
+
 	int do_not_log;
 
 	int do_not_add_to_async_queue;
@@ -1400,6 +1515,8 @@ struct wsgi_request {
 	char *post_read_buf;
 	size_t post_read_buf_size;
 	char *post_buffering_buf;
+	// mmap()'ed disk buffered body (for zero-copy reads)
+	char *post_mmap;
 	// when set, do not send warnings about bad behaviours
 	int post_warning;
 
@@ -1420,6 +1537,8 @@ struct wsgi_request {
 	uint64_t proto_parser_buf_size;
 	void *proto_parser_remains_buf;
 	size_t proto_parser_remains;
+	// body bytes read from the socket (used by persistent protocols)
+	size_t proto_body_read;
 
 	char *buffer;
 
@@ -1439,6 +1558,12 @@ struct wsgi_request {
 	size_t websocket_has_mask;
 	size_t websocket_size;
 	size_t websocket_pktsize;
+	// start of the current frame in websocket_buf
+	size_t websocket_offset;
+	// coalesced frames waiting to be sent
+	// TCP_CORK status of coalescing (-1 = not corkable)
+	int websocket_corked;
+	uint64_t websocket_cork_start;
 	time_t websocket_last_ping;
 	time_t websocket_last_pong;
 	int websocket_closed;
@@ -1654,6 +1779,12 @@ struct uwsgi_server {
 	uint64_t master_cycles;
 
 	int reuse_port;
+	int reuse_port_shard;
+	int reuse_port_shard_cpu;
+	// set in the worker when every socket is sharded (no need for thunder lock)
+	int reuse_port_sharded;
+	// set in the worker when only some of the sockets are sharded
+	int reuse_port_shard_mixed;
 	int tcp_fast_open;
 	int tcp_fast_open_client;
 
@@ -1850,6 +1981,7 @@ struct uwsgi_server {
 
 	int logdate;
 	int log_micros;
+	int log_transformations;
 	char *log_strftime;
 	int log_x_forwarded_for;
 
@@ -1865,6 +1997,8 @@ struct uwsgi_server {
 	int log_master;
 	char *log_master_buf;
 	size_t log_master_bufsize;
+	uint64_t req_log_ring_size;
+	int req_log_ring_drain;
 
 	int log_reopen;
 	int log_truncate;
@@ -1942,6 +2076,7 @@ struct uwsgi_server {
 	struct uwsgi_dyn_dict *static_maps2;
 	struct uwsgi_dyn_dict *check_static;
 	struct uwsgi_dyn_dict *mimetypes;
+	struct uwsgi_dyn_dict_index *mimetypes_index;
 	struct uwsgi_string_list *static_skip_ext;
 	struct uwsgi_string_list *static_index;
 	struct uwsgi_string_list *static_safe;
@@ -1950,6 +2085,8 @@ struct uwsgi_server {
 	int use_static_cache_paths;
 	char *static_cache_paths_name;
 	struct uwsgi_cache *static_cache_paths;
+	uint64_t static_fd_cache;
+	int static_fd_cache_ttl;
 	int cache_expire_freq;
 	int cache_report_freed_items;
 	int cache_no_expire;
@@ -1964,6 +2101,8 @@ struct uwsgi_server {
 
 	struct uwsgi_dyn_dict *static_expires_type;
 	struct uwsgi_dyn_dict *static_expires_type_mtime;
+	struct uwsgi_dyn_dict_index *static_expires_type_index;
+	struct uwsgi_dyn_dict_index *static_expires_type_mtime_index;
 
 	struct uwsgi_dyn_dict *static_expires;
 	struct uwsgi_dyn_dict *static_expires_mtime;
@@ -2076,6 +2215,18 @@ struct uwsgi_server {
 	struct uwsgi_lock_item *snmp_lock;
 	int snmp_fd;
 
+	int has_metrics;
+	int metrics_no_cores;
+	char *metrics_dir;
+	int metrics_dir_restore;
+	struct uwsgi_string_list *additional_metrics;
+	struct uwsgi_metric *metrics;
+	struct uwsgi_metric **metrics_hashtable;
+	uint64_t metrics_cnt;
+	// shared memory slots for metrics values
+	int64_t *metrics_slots;
+	uint64_t metrics_slots_free;
+
 	int udp_fd;
 
 	uint16_t buffer_size;
@@ -2125,6 +2276,7 @@ struct uwsgi_server {
 
 	int max_vars;
 	int vec_size;
+	uint32_t var_index_size;
 
 	// shared area
 	char *sharedarea;
@@ -2220,6 +2372,8 @@ struct uwsgi_server {
 	struct uwsgi_string_list *file_write_list;
 
 	char *protocol;
+	// maps persistent (puwsgi) connections to their socket
+	struct uwsgi_socket **persistent_sockets;
 
 	int signal_socket;
 	int my_signal_socket;
@@ -2305,6 +2459,7 @@ struct uwsgi_server {
 	int stats_fd;
 	int stats_http;
 	int stats_minified;
+	int stats_histograms;
 	struct uwsgi_string_list *requested_stats_pushers;
 	struct uwsgi_stats_pusher *stats_pushers;
 	struct uwsgi_stats_pusher_instance *stats_pusher_instances;
@@ -2342,8 +2497,11 @@ struct uwsgi_server {
 	struct uwsgi_string_list *subscriptions;
 	struct uwsgi_string_list *subscriptions2;
 
-	struct uwsgi_subscribe_node *(*subscription_algo) (struct uwsgi_subscribe_slot *, struct uwsgi_subscribe_node *);
+	struct uwsgi_subscribe_node *(*subscription_algo) (struct uwsgi_subscribe_slot *, struct uwsgi_subscribe_node *, uint64_t);
 	int subscription_dotsplit;
+	// request var hashed by the chash algo and its load bound (percent of the average)
+	char *subscription_chash_var;
+	int subscription_chash_load;
 
 	int never_swap;
 
@@ -2388,6 +2546,7 @@ struct uwsgi_server {
 	int websockets_ping_freq;
 	int websockets_pong_tolerance;
 	uint64_t websockets_max_size;
+	int websockets_coalesce;
 
 	int chunked_input_timeout;
 	uint64_t chunked_input_limit;
@@ -2419,6 +2578,80 @@ struct uwsgi_snmp_custom_value {
 
 int uwsgi_setup_snmp(void);
 
+#define UWSGI_METRIC_COUNTER	0
+#define UWSGI_METRIC_GAUGE	1
+#define UWSGI_METRIC_ABSOLUTE	2
+
+#define UWSGI_METRIC_MANUAL	0
+#define UWSGI_METRIC_PTR	1
+#define UWSGI_METRIC_FUNC	2
+#define UWSGI_METRIC_FILE	3
+
+#define UWSGI_METRICS_HASHSIZE	1024
+
+struct uwsgi_metric {
+	char *name;
+	size_t name_len;
+	char *oid;
+
+	// pre-computed snmp representation of the oid (relative to the uWSGI base)
+	char *asn;
+	size_t asn_len;
+
+	// ABSOLUTE/COUNTER/GAUGE
+	uint8_t type;
+
+	// MANUAL/PTR/FUNC/FILE
+	uint8_t collect_way;
+
+	// taken from the metrics directory (if restore is enabled), always added to collected values
+	int64_t initial_value;
+	// the value of the metric (points to a shared memory area)
+	int64_t *value;
+
+	// a custom blob you can attach to a metric
+	void *custom;
+
+	// the collection frequency (0 means on request)
+	uint32_t freq;
+	time_t last_update;
+
+	// run this function to collect the value
+	int64_t (*collector)(struct uwsgi_metric *);
+	// take the value from this pointer to a 64bit value
+	int64_t *ptr;
+	// get the value from this file
+	char *filename;
+
+	// last value written in the metrics directory
+	int64_t stored_value;
+	int stored;
+
+	struct uwsgi_metric *hash_next;
+	struct uwsgi_metric *next;
+};
+
+struct uwsgi_metric *uwsgi_register_metric(char *, char *, uint8_t, uint8_t, void *, uint32_t, void *);
+struct uwsgi_metric *uwsgi_metric_find_by_name(char *);
+struct uwsgi_metric *uwsgi_metric_find_by_namen(char *, size_t);
+struct uwsgi_metric *uwsgi_metric_find_by_oid(char *);
+struct uwsgi_metric *uwsgi_metric_find_by_asn(char *, size_t);
+int64_t uwsgi_metric_getn(char *, size_t);
+int64_t uwsgi_metric_value(struct uwsgi_metric *);
+int64_t uwsgi_metric_get(char *, char *);
+int uwsgi_metric_set(char *, char *, int64_t);
+int uwsgi_metric_inc(char *, char *, int64_t);
+int uwsgi_metric_dec(char *, char *, int64_t);
+int uwsgi_metric_mul(char *, char *, int64_t);
+int uwsgi_metric_div(char *, char *, int64_t);
+int uwsgi_metric_setn(char *, size_t, int64_t);
+int uwsgi_metric_incn(char *, size_t, int64_t);
+int uwsgi_metric_decn(char *, size_t, int64_t);
+int uwsgi_metric_muln(char *, size_t, int64_t);
+int uwsgi_metric_divn(char *, size_t, int64_t);
+void uwsgi_setup_metrics(void);
+void uwsgi_metrics_start_collector(void);
+
 struct uwsgi_snmp_server_value {
 	uint8_t type;
 	uint64_t *val;
@@ -2511,6 +2744,39 @@ struct uwsgi_shared {
 	int ready;
 };
 
+#define UWSGI_HISTOGRAM_SUB_BITS 4
+#define UWSGI_HISTOGRAM_SUB (1 << UWSGI_HISTOGRAM_SUB_BITS)
+#define UWSGI_HISTOGRAM_MAX_BITS 40
+#define UWSGI_HISTOGRAM_BUCKETS ((UWSGI_HISTOGRAM_MAX_BITS - UWSGI_HISTOGRAM_SUB_BITS + 1) * UWSGI_HISTOGRAM_SUB)
+
+// request time (microseconds) and response size (bytes) histograms of each core
+#define UWSGI_HISTOGRAM_RT 0
+#define UWSGI_HISTOGRAM_SIZE 1
+#define UWSGI_HISTOGRAMS 2
+
+struct uwsgi_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[UWSGI_HISTOGRAM_BUCKETS];
+};
+
+/*
+	single-producer (a worker core) single-consumer (the master logger thread)
+	ring of request log records (uint32_t length + payload)
+*/
+struct uwsgi_log_ring {
+	// written only by the producer
+	volatile uint64_t head;
+	uint64_t records;
+	uint64_t overflows;
+	char pad0[40];
+	// written only by the consumer
+	volatile uint64_t tail;
+	char pad1[56];
+	char data[];
+};
+
 struct uwsgi_core {
 
 	//time_t harakiri;
@@ -2520,6 +2786,8 @@ struct uwsgi_core {
 	uint64_t static_requests;
 	uint64_t routed_requests;
 	uint64_t offloaded_requests;
+	// responses whose headers and body went out with a single syscall
+	uint64_t single_syscall_responses;
 
 	uint64_t write_errors;
 	uint64_t exceptions;
@@ -2535,8 +2803,20 @@ struct uwsgi_core {
 
 	char *buffer;
 	struct iovec *hvec;
+	uint16_t *var_index;
 	char *post_buf;
 
+	// UWSGI_HISTOGRAMS items in shared memory (only with --stats-histograms)
+	struct uwsgi_histogram *histograms;
+
+	// request log ring in shared memory (only with --req-log-ring)
+	struct uwsgi_log_ring *req_log_ring;
+
+	// event queue of the simple loop (monitors persistent connections)
+	int queue;
+	// persistent connections monitored by the queue (they are waited for without thunder lock)
+	int persistent_fds;
+
 	struct wsgi_request req;
 };
 
@@ -2656,6 +2936,9 @@ void grace_them_all(int);
 void end_me(int);
 int bind_to_unix(char *, int, int, int);
 int bind_to_tcp(char *, int, char *);
+void uwsgi_reuse_port_shards_init(void);
+void uwsgi_reuse_port_shards_create(void);
+void uwsgi_listeners_nb(void);
 int bind_to_udp(char *, int, int);
 int bind_to_unix_dgram(char *);
 int timed_connect(struct pollfd *, const struct sockaddr *, int, int, int);
@@ -2859,6 +3142,7 @@ void *uwsgi_calloc(size_t);
 int event_queue_init(void);
 void *event_queue_alloc(int);
 int event_queue_add_fd_read(int, int);
+int event_queue_add_fd_read_exclusive(int, int);
 int event_queue_add_fd_write(int, int);
 int event_queue_del_fd(int, int, int);
 int event_queue_wait(int, int, int *);
@@ -2976,6 +3260,18 @@ int uwsgi_list_has_num(char *, int);
 int uwsgi_list_has_str(char *, char *);
 
 void uwsgi_cache_fix(struct uwsgi_cache *);
+uint64_t uwsgi_cache_free_runs(struct uwsgi_cache *, uint64_t *, uint64_t *);
+uint64_t uwsgi_cache_n_items(struct uwsgi_cache *);
+uint64_t uwsgi_cache_hits(struct uwsgi_cache *);
+uint64_t uwsgi_cache_miss(struct uwsgi_cache *);
+void uwsgi_cache_rlock(struct uwsgi_cache *, char *, uint16_t);
+void uwsgi_cache_wlock(struct uwsgi_cache *, char *, uint16_t);
+void uwsgi_cache_rwunlock(struct uwsgi_cache *, char *, uint16_t);
+void uwsgi_cache_wlock_item(struct uwsgi_cache *, uint64_t);
+void uwsgi_cache_rwunlock_item(struct uwsgi_cache *, uint64_t);
+void uwsgi_cache_rlock_all(struct uwsgi_cache *);
+void uwsgi_cache_wlock_all(struct uwsgi_cache *);
+void uwsgi_cache_rwunlock_all(struct uwsgi_cache *);
 
 struct uwsgi_async_request {
 
@@ -3013,6 +3309,7 @@ char *uwsgi_amqp_consume(int, uint64_t *, char **);
 int uwsgi_file_serve(struct wsgi_request *, char *, uint16_t, char *, uint16_t, int);
 int uwsgi_starts_with(char *, int, char *, int);
 int uwsgi_static_want_gzip(struct wsgi_request *, char *, size_t *, struct stat *);
+void uwsgi_static_fd_cache_init(void);
 
 #ifdef __sun__
 time_t timegm(struct tm *);
@@ -3023,6 +3320,8 @@ size_t uwsgi_str_occurence(char *, size_t, char);
 
 int uwsgi_proto_uwsgi_parser(struct wsgi_request *);
 int uwsgi_proto_base_write(struct wsgi_request *, char *, size_t);
+int uwsgi_proto_base_writev(struct wsgi_request *, struct iovec *, size_t);
+int uwsgi_iovec_consume(struct iovec *, size_t, size_t);
 int uwsgi_proto_base_write_header(struct wsgi_request *, char *, size_t);
 ssize_t uwsgi_proto_base_read_body(struct wsgi_request *, char *, size_t);
 
@@ -3030,6 +3329,7 @@ int uwsgi_proto_http_parser(struct wsgi_request *);
 
 int uwsgi_proto_fastcgi_parser(struct wsgi_request *);
 int uwsgi_proto_fastcgi_write(struct wsgi_request *, char *, size_t);
+int uwsgi_proto_fastcgi_writev(struct wsgi_request *, struct iovec *, size_t);
 int uwsgi_proto_fastcgi_write_header(struct wsgi_request *, char *, size_t);
 int uwsgi_proto_fastcgi_sendfile(struct wsgi_request *, int, size_t, size_t);
 void uwsgi_proto_fastcgi_close(struct wsgi_request *);
@@ -3037,6 +3337,12 @@ ssize_t uwsgi_proto_fastcgi_read_body(struct wsgi_request *, char *, size_t);
 
 int uwsgi_proto_scgi_parser(struct wsgi_request *);
 
+ssize_t uwsgi_proto_puwsgi_read_body(struct wsgi_request *, char *, size_t);
+int uwsgi_proto_puwsgi_write(struct wsgi_request *, char *, size_t);
+int uwsgi_proto_puwsgi_writev(struct wsgi_request *, struct iovec *, size_t);
+int uwsgi_proto_puwsgi_sendfile(struct wsgi_request *, int, size_t, size_t);
+void uwsgi_proto_puwsgi_close(struct wsgi_request *);
+
 
 int uwsgi_proto_base_accept(struct wsgi_request *, int);
 void uwsgi_proto_base_close(struct wsgi_request *);
@@ -3152,6 +3458,8 @@ int uwsgi_simple_parse_vars(struct wsgi_request *, char *, char *);
 void uwsgi_build_mime_dict(char *);
 struct uwsgi_dyn_dict *uwsgi_dyn_dict_new(struct uwsgi_dyn_dict **, char *, int, char *, int);
 void uwsgi_dyn_dict_del(struct uwsgi_dyn_dict *);
+struct uwsgi_dyn_dict_index *uwsgi_dyn_dict_index_build(struct uwsgi_dyn_dict *);
+struct uwsgi_dyn_dict *uwsgi_dyn_dict_index_get(struct uwsgi_dyn_dict_index *, char *, int);
 
 
 void uwsgi_apply_config_pass(char symbol, char *(*)(char *));
@@ -3201,6 +3509,11 @@ struct uwsgi_subscribe_node {
 	uint64_t weight;
 	uint64_t wrr;
 
+	// moving average of the response time (usec) measured by the routers
+	uint64_t ewma_rt;
+	// position in the slot nodes index
+	uint64_t index_pos;
+
 	time_t unix_check;
 
 	struct uwsgi_subscribe_slot *slot;
@@ -3208,6 +3521,11 @@ struct uwsgi_subscribe_node {
 	struct uwsgi_subscribe_node *next;
 };
 
+struct uwsgi_subscribe_ring_point {
+	uint64_t hash;
+	struct uwsgi_subscribe_node *node;
+};
+
 struct uwsgi_subscribe_slot {
 
 	char key[0xff];
@@ -3225,6 +3543,17 @@ struct uwsgi_subscribe_slot {
 
 	struct uwsgi_subscribe_node *nodes;
 
+	// random access to the nodes (for O(1) picks)
+	struct uwsgi_subscribe_node **nodes_index;
+	uint64_t nodes_cnt;
+	uint64_t nodes_index_size;
+	uint64_t sweep;
+
+	// consistent hashing ring (rebuilt when the nodes change)
+	struct uwsgi_subscribe_ring_point *ring;
+	uint64_t ring_len;
+	int ring_dirty;
+
 	struct uwsgi_subscribe_slot *prev;
 	struct uwsgi_subscribe_slot *next;
 };
@@ -3237,8 +3566,10 @@ void create_msg_pipe(int *, int);
 struct uwsgi_subscribe_slot *uwsgi_get_subscribe_slot(struct uwsgi_subscribe_slot **, char *, uint16_t);
 struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_by_name(struct uwsgi_subscribe_slot **, char *, uint16_t, char *, uint16_t);
 struct uwsgi_subscribe_node *uwsgi_get_subscribe_node(struct uwsgi_subscribe_slot **, char *, uint16_t);
+struct uwsgi_subscribe_node *uwsgi_get_subscribe_node_hashed(struct uwsgi_subscribe_slot **, char *, uint16_t, char *, uint16_t);
 int uwsgi_remove_subscribe_node(struct uwsgi_subscribe_slot **, struct uwsgi_subscribe_node *);
 struct uwsgi_subscribe_node *uwsgi_add_subscribe_node(struct uwsgi_subscribe_slot **, struct uwsgi_subscribe_req *);
+void uwsgi_subscribe_node_rt(struct uwsgi_subscribe_node *, uint64_t);
 
 ssize_t uwsgi_mule_get_msg(int, int, char *, size_t, int);
 
@@ -3279,6 +3610,8 @@ struct uwsgi_logger *uwsgi_get_logger_from_id(char *);
 
 char *uwsgi_getsockname(int);
 char *uwsgi_get_var(struct wsgi_request *, char *, uint16_t, uint16_t *);
+void uwsgi_var_index_add(struct wsgi_request *, uint16_t);
+void uwsgi_var_index_build(struct wsgi_request *);
 
 struct uwsgi_gateway_socket *uwsgi_new_gateway_socket(char *, char *);
 struct uwsgi_gateway_socket *uwsgi_new_gateway_socket_from_fd(int, char *);
@@ -3429,6 +3762,7 @@ struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *, struct uwsgi
 int uwsgi_route_api_func(struct wsgi_request *, char *, char *);
 struct uwsgi_route_condition *uwsgi_register_route_condition(char *, int (*) (struct wsgi_request *, struct uwsgi_route *));
 void uwsgi_fixup_routes(struct uwsgi_route *);
+uint64_t uwsgi_route_hits(struct uwsgi_route *);
 #endif
 
 void uwsgi_reload(char **);
@@ -3486,6 +3820,7 @@ int uwsgi_is_link(char *);
 void uwsgi_receive_signal(int, char *, int);
 void uwsgi_exec_atexit(void);
 
+struct uwsgi_stats_ext;
 struct uwsgi_stats {
 	char *base;
 	off_t pos;
@@ -3494,8 +3829,16 @@ struct uwsgi_stats {
 	size_t size;
 	int minified;
 	int dirty;
+	// selection/delta/msgpack state of the stats server
+	struct uwsgi_stats_ext *ext;
 };
 
+void uwsgi_histogram_add(struct uwsgi_histogram *, uint64_t);
+void uwsgi_histogram_merge(struct uwsgi_histogram *, struct uwsgi_histogram *);
+uint64_t uwsgi_histogram_value_at(struct uwsgi_histogram *, uint64_t);
+uint64_t uwsgi_histogram_bucket_max(int);
+int uwsgi_stats_histogram(struct uwsgi_stats *, char *, struct uwsgi_histogram *);
+
 struct uwsgi_stats_pusher_instance;
 
 struct uwsgi_stats_pusher {
@@ -3524,6 +3867,8 @@ void uwsgi_stats_pusher_socket(struct uwsgi_stats_pusher_instance *, time_t, cha
 void uwsgi_stats_pusher_setup(void);
 void uwsgi_send_stats(int, struct uwsgi_stats *(*func) (void));
 struct uwsgi_stats *uwsgi_master_generate_stats(void);
+struct uwsgi_stats *uwsgi_master_fill_stats(struct uwsgi_stats *);
+void uwsgi_stats_server_loop(struct uwsgi_thread *);
 struct uwsgi_stats_pusher * uwsgi_register_stats_pusher(char *, void (*)(struct uwsgi_stats_pusher_instance *, time_t, char *, size_t));
 
 struct uwsgi_stats *uwsgi_stats_new(size_t);
@@ -3920,6 +4265,10 @@ void uwsgi_websockets_init(void);
 int uwsgi_websocket_send(struct wsgi_request *, char *, size_t);
 struct uwsgi_buffer *uwsgi_websocket_recv(struct wsgi_request *);
 struct uwsgi_buffer *uwsgi_websocket_recv_nb(struct wsgi_request *);
+int uwsgi_websocket_send_many(struct wsgi_request *, struct iovec *, size_t);
+int uwsgi_websocket_flush(struct wsgi_request *);
+char *uwsgi_websocket_recv_view(struct wsgi_request *, size_t *);
+char *uwsgi_websocket_recv_view_nb(struct wsgi_request *, size_t *);
 
 char *uwsgi_chunked_read(struct wsgi_request *, size_t *, int, int);
 
@@ -3944,11 +4293,14 @@ int uwsgi_simple_wait_read_hook(int, int);
 int uwsgi_response_write_headers_do(struct wsgi_request *);
 char *uwsgi_request_body_read(struct wsgi_request *, ssize_t , ssize_t *);
 char *uwsgi_request_body_readline(struct wsgi_request *, ssize_t, ssize_t *);
+ssize_t uwsgi_request_body_readinto(struct wsgi_request *, char *, size_t);
+char *uwsgi_request_body_read_nocopy(struct wsgi_request *, ssize_t, ssize_t *);
 void uwsgi_request_body_seek(struct wsgi_request *, off_t);
 
 struct uwsgi_buffer *uwsgi_proto_base_prepare_headers(struct wsgi_request *, char *, uint16_t);
 struct uwsgi_buffer *uwsgi_proto_base_cgi_prepare_headers(struct wsgi_request *, char *, uint16_t);
 int uwsgi_response_write_body_do(struct wsgi_request *, char *, size_t);
+int uwsgi_response_writev_body_do(struct wsgi_request *, struct iovec *, size_t);
 
 int uwsgi_proto_base_sendfile(struct wsgi_request *, int, size_t, size_t);
 
@@ -3974,6 +4326,7 @@ void uwsgi_master_manage_emperor(void);
 void uwsgi_master_manage_udp(int);
 
 void uwsgi_threaded_logger_spawn(void);
+void uwsgi_register_logger_batch(char *, ssize_t(*func) (struct uwsgi_logger *, struct iovec *, size_t));
 
 void uwsgi_master_check_idle(void);
 void uwsgi_master_check_workers_deadline(void);
@@ -4073,6 +4426,7 @@ void uwsgi_crc32(uint32_t *, char *, size_t);
 struct uwsgi_buffer *uwsgi_gzip(char *, size_t);
 struct uwsgi_buffer *uwsgi_zlib_decompress(char *, size_t);
 int uwsgi_gzip_fix(z_stream *, uint32_t, struct uwsgi_buffer *, size_t);
+int uwsgi_gzip_finish(z_stream *, uint32_t, struct uwsgi_buffer *, size_t);
 char *uwsgi_gzip_chunk(z_stream *, uint32_t *, char *, size_t, size_t *);
 int uwsgi_gzip_prepare(z_stream *, char *, size_t, uint32_t *);
 #endif